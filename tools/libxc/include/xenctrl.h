@@ -946,6 +946,17 @@ int xc_sched_credit2_params_set(xc_interface *xch,
 int xc_sched_credit2_params_get(xc_interface *xch,
                                 uint32_t cpupool_id,
                                 struct xen_sysctl_credit2_schedule *schedule);
+/*
+ * Like xc_sched_credit2_params_get(), but also retrieves the current
+ * timeslice and ratelimit of (up to *nr_runqs) runqueues. On return,
+ * *nr_runqs is the number of active runqueues in the cpupool, which may be
+ * more than the number of elements filled.
+ */
+int xc_sched_credit2_runqs_get(xc_interface *xch,
+                               uint32_t cpupool_id,
+                               struct xen_sysctl_credit2_schedule *schedule,
+                               xen_sysctl_credit2_runq_t *runqs,
+                               uint32_t *nr_runqs);
 int xc_sched_credit2_domain_set(xc_interface *xch,
                                 uint32_t domid,
                                 struct xen_domctl_sched_credit2 *sdom);
@@ -967,6 +978,12 @@ int xc_sched_rtds_vcpu_get(xc_interface *xch,
                            uint32_t domid,
                            struct xen_domctl_schedparam_vcpu *vcpus,
                            uint32_t num_vcpus);
+int xc_sched_rtds_params_set(xc_interface *xch,
+                             uint32_t cpupool_id,
+                             struct xen_sysctl_rtds_schedule *schedule);
+int xc_sched_rtds_params_get(xc_interface *xch,
+                             uint32_t cpupool_id,
+                             struct xen_sysctl_rtds_schedule *schedule);
 
 int
 xc_sched_arinc653_schedule_set(
@@ -1386,6 +1403,23 @@ int xc_domain_populate_physmap_exact(xc_interface *xch,
                                      unsigned int mem_flags,
                                      xen_pfn_t *extent_start);
 
+/**
+ * Populate [gpfn, gpfn + nr_pages) of a translated guest using the largest
+ * extents (up to 2^max_order pages) Xen can allocate, falling back to
+ * smaller ones as needed.  The nr_* counters are incremented by the number
+ * of extents of each size used, also when the call fails part way.
+ * Fails with ENOSYS when the hypervisor lacks support.
+ */
+int xc_domain_populate_physmap_range(xc_interface *xch,
+                                     uint32_t domid,
+                                     xen_pfn_t gpfn,
+                                     unsigned long nr_pages,
+                                     unsigned int max_order,
+                                     unsigned int mem_flags,
+                                     unsigned long *nr_4k,
+                                     unsigned long *nr_2m,
+                                     unsigned long *nr_1g);
+
 int xc_domain_claim_pages(xc_interface *xch,
                                uint32_t domid,
                                unsigned long nr_pages);
@@ -1457,6 +1491,14 @@ int xc_lockprof_query(xc_interface *xch,
                       uint64_t *time,
                       xc_hypercall_buffer_t *data);
 
+/*
+ * Scheduling latency histograms. 'hist' must have room for
+ * XEN_SYSCTL_SCHED_STATS_NR * XEN_SYSCTL_SCHED_STATS_BUCKETS entries.
+ */
+int xc_sched_stats_pcpu(xc_interface *xch, uint32_t cpu, uint64_t *hist);
+int xc_sched_stats_domain(xc_interface *xch, uint32_t domid, uint64_t *hist);
+int xc_sched_stats_reset(xc_interface *xch);
+
 void *xc_memalign(xc_interface *xch, size_t alignment, size_t size);
 
 /**
@@ -2200,6 +2242,25 @@ int xc_memshr_range_share(xc_interface *xch,
                           uint64_t first_gfn,
                           uint64_t last_gfn);
 
+/* Forks a domain: domid, created with the same configuration as the parent
+ * but with no memory populated and left paused, becomes a copy-on-write
+ * clone of parent_domain, which is paused until the fork is destroyed.
+ * Memory is shared or copied from the parent on first access.
+ *
+ * May fail with EBUSY if the fork isn't paused or already has memory, with
+ * EEXIST if it already is a fork, and with EINVAL if the two domains don't
+ * have the same vCPUs.
+ */
+int xc_memshr_fork(xc_interface *xch,
+                   domid_t parent_domain,
+                   domid_t domid);
+
+/* Resets a paused fork to its state at the time of forking, freeing the
+ * pages it has written to since.
+ */
+int xc_memshr_fork_reset(xc_interface *xch,
+                         domid_t domid);
+
 /* Debug calls: return the number of pages referencing the shared frame backing
  * the input argument. Should be one or greater. 
  *
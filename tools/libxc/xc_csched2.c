@@ -78,6 +78,9 @@ xc_sched_credit2_params_set(
     sysctl.u.scheduler_op.cmd = XEN_SYSCTL_SCHEDOP_putinfo;
 
     sysctl.u.scheduler_op.u.sched_credit2 = *schedule;
+    sysctl.u.scheduler_op.u.sched_credit2.nr_runqs = 0;
+    set_xen_guest_handle(sysctl.u.scheduler_op.u.sched_credit2.runqs,
+                         HYPERCALL_BUFFER_NULL);
 
     if ( do_sysctl(xch, &sysctl) )
         return -1;
@@ -99,6 +102,9 @@ xc_sched_credit2_params_get(
     sysctl.u.scheduler_op.cpupool_id = cpupool_id;
     sysctl.u.scheduler_op.sched_id = XEN_SCHEDULER_CREDIT2;
     sysctl.u.scheduler_op.cmd = XEN_SYSCTL_SCHEDOP_getinfo;
+    sysctl.u.scheduler_op.u.sched_credit2.nr_runqs = 0;
+    set_xen_guest_handle(sysctl.u.scheduler_op.u.sched_credit2.runqs,
+                         HYPERCALL_BUFFER_NULL);
 
     if ( do_sysctl(xch, &sysctl) )
         return -1;
@@ -107,3 +113,39 @@ xc_sched_credit2_params_get(
 
     return 0;
 }
+
+int
+xc_sched_credit2_runqs_get(
+    xc_interface *xch,
+    uint32_t cpupool_id,
+    struct xen_sysctl_credit2_schedule *schedule,
+    xen_sysctl_credit2_runq_t *runqs,
+    uint32_t *nr_runqs)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(runqs, *nr_runqs * sizeof(*runqs),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, runqs) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_scheduler_op;
+    sysctl.u.scheduler_op.cpupool_id = cpupool_id;
+    sysctl.u.scheduler_op.sched_id = XEN_SCHEDULER_CREDIT2;
+    sysctl.u.scheduler_op.cmd = XEN_SYSCTL_SCHEDOP_getinfo;
+    sysctl.u.scheduler_op.u.sched_credit2.nr_runqs = *nr_runqs;
+    set_xen_guest_handle(sysctl.u.scheduler_op.u.sched_credit2.runqs, runqs);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, runqs);
+
+    if ( rc )
+        return rc;
+
+    *schedule = sysctl.u.scheduler_op.u.sched_credit2;
+    *nr_runqs = schedule->nr_runqs;
+
+    return 0;
+}
@@ -1237,6 +1237,7 @@ static int meminit_hvm(struct xc_dom_image *dom)
         stat_1gb_pages = 0;
     unsigned int memflags = 0;
     int claim_enabled = dom->claim_enabled;
+    bool populate_range;
     uint64_t total_pages;
     xen_vmemrange_t dummy_vmemrange[2];
     unsigned int dummy_vnode_to_pnode[1];
@@ -1249,6 +1250,12 @@ static int meminit_hvm(struct xc_dom_image *dom)
     if ( nr_pages > target_pages )
         memflags |= XENMEMF_populate_on_demand;
 
+    /*
+     * Let Xen pick the largest extents it can find for each range, rather
+     * than probing 1GB and 2MB extents from here.  Not usable for PoD.
+     */
+    populate_range = !(memflags & XENMEMF_populate_on_demand);
+
     if ( dom->nr_vmemranges == 0 )
     {
         /* Build dummy vnode information
@@ -1413,6 +1420,33 @@ static int meminit_hvm(struct xc_dom_image *dom)
         else
             cur_pages = vmemranges[vmemid].start >> PAGE_SHIFT;
 
+        if ( populate_range && end_pages > cur_pages )
+        {
+            unsigned long nr_4k = 0, nr_2m = 0, nr_1g = 0;
+
+            rc = xc_domain_populate_physmap_range(
+                xch, domid, dom->p2m_host[cur_pages], end_pages - cur_pages,
+                SUPERPAGE_1GB_SHIFT, new_memflags, &nr_4k, &nr_2m, &nr_1g);
+
+            stat_normal_pages += nr_4k;
+            stat_2mb_pages += nr_2m;
+            stat_1gb_pages += nr_1g;
+            cur_pages += nr_4k + (nr_2m << SUPERPAGE_2MB_SHIFT) +
+                         (nr_1g << SUPERPAGE_1GB_SHIFT);
+
+            if ( rc == 0 )
+                continue;
+
+            if ( errno != ENOSYS )
+            {
+                DOMPRINTF("Could not allocate memory for HVM guest.");
+                goto error_out;
+            }
+
+            /* Older hypervisor: use the extent based interface below. */
+            populate_range = false;
+        }
+
         rc = 0;
         while ( (rc == 0) && (end_pages > cur_pages) )
         {
@@ -1107,6 +1107,41 @@ int xc_domain_populate_physmap_exact(xc_interface *xch,
     return err;
 }
 
+int xc_domain_populate_physmap_range(xc_interface *xch,
+                                     uint32_t domid,
+                                     xen_pfn_t gpfn,
+                                     unsigned long nr_pages,
+                                     unsigned int max_order,
+                                     unsigned int mem_flags,
+                                     unsigned long *nr_4k,
+                                     unsigned long *nr_2m,
+                                     unsigned long *nr_1g)
+{
+    int err;
+    struct xen_memory_populate_range range = {
+        .domid     = domid,
+        .mem_flags = mem_flags,
+        .max_order = max_order,
+        .gpfn      = gpfn,
+        .nr_pages  = nr_pages,
+    };
+
+    err = do_memory_op(xch, XENMEM_populate_physmap_range,
+                       &range, sizeof(range));
+
+    /* Report progress even on failure, so callers can account for it. */
+    *nr_4k += range.nr_4k;
+    *nr_2m += range.nr_2m;
+    *nr_1g += range.nr_1g;
+
+    if ( err < 0 && errno != ENOSYS )
+        DPRINTF("Failed to populate dom %d range %#"PRI_xen_pfn"+%#lx: "
+                "%#lx pages left\n", domid, gpfn, nr_pages,
+                (unsigned long)range.nr_pages);
+
+    return err;
+}
+
 int xc_domain_memory_exchange_pages(xc_interface *xch,
                                     int domid,
                                     unsigned long nr_in_extents,
@@ -443,6 +443,53 @@ int xc_lockprof_query(xc_interface *xch,
     return rc;
 }
 
+static int xc_sched_stats_get(xc_interface *xch, uint32_t cmd, uint32_t id,
+                              uint64_t *hist)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BOUNCE(hist, XEN_SYSCTL_SCHED_STATS_NR *
+                                   XEN_SYSCTL_SCHED_STATS_BUCKETS *
+                                   sizeof(*hist),
+                             XC_HYPERCALL_BUFFER_BOUNCE_OUT);
+
+    if ( xc_hypercall_bounce_pre(xch, hist) )
+        return -1;
+
+    sysctl.cmd = XEN_SYSCTL_sched_stats;
+    sysctl.u.sched_stats.cmd = cmd;
+    sysctl.u.sched_stats.id = id;
+    set_xen_guest_handle(sysctl.u.sched_stats.hist, hist);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    xc_hypercall_bounce_post(xch, hist);
+
+    return rc;
+}
+
+int xc_sched_stats_pcpu(xc_interface *xch, uint32_t cpu, uint64_t *hist)
+{
+    return xc_sched_stats_get(xch, XEN_SYSCTL_SCHED_STATS_get_pcpu, cpu, hist);
+}
+
+int xc_sched_stats_domain(xc_interface *xch, uint32_t domid, uint64_t *hist)
+{
+    return xc_sched_stats_get(xch, XEN_SYSCTL_SCHED_STATS_get_domain, domid,
+                              hist);
+}
+
+int xc_sched_stats_reset(xc_interface *xch)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_sched_stats;
+    sysctl.u.sched_stats.cmd = XEN_SYSCTL_SCHED_STATS_reset;
+    set_xen_guest_handle(sysctl.u.sched_stats.hist, HYPERCALL_BUFFER_NULL);
+
+    return do_sysctl(xch, &sysctl);
+}
+
 int xc_getcpuinfo(xc_interface *xch, int max_cpus,
                   xc_cpuinfo_t *info, int *nr_cpus)
 {
@@ -293,6 +293,29 @@
  */
 #define LIBXL_HAVE_SCHED_CREDIT2_PARAMS 1
 
+/*
+ * LIBXL_HAVE_SCHED_CREDIT2_ADAPTIVE indicates that libxl_sched_credit2_params
+ * has the 'adaptive' field, for per-runqueue adaptive timeslicing, and the
+ * existance of the libxl_sched_credit2_runqs_get() function, returning the
+ * current timeslice and ratelimit of each Credit2 runqueue.
+ */
+#define LIBXL_HAVE_SCHED_CREDIT2_ADAPTIVE 1
+
+/*
+ * LIBXL_HAVE_SCHED_RTDS_PARAMS indicates the existance of a
+ * libxl_sched_rtds_params structure, containing RTDS scheduler wide
+ * parameters (i.e., how the pCPUs of a cpupool are arranged in clusters).
+ */
+#define LIBXL_HAVE_SCHED_RTDS_PARAMS 1
+
+/*
+ * LIBXL_HAVE_SCHED_STATS indicates the existance of the
+ * libxl_sched_stats_{pcpu,domain,reset} functions, and of the
+ * libxl_sched_stats structure, containing the scheduling latency
+ * histograms kept by the hypervisor.
+ */
+#define LIBXL_HAVE_SCHED_STATS 1
+
 /*
  * LIBXL_HAVE_VIRIDIAN_CRASH_CTL indicates that the 'crash_ctl' value
  * is present in the viridian enlightenment enumeration.
@@ -2041,6 +2064,22 @@ int libxl_sched_credit2_params_get(libxl_ctx *ctx, uint32_t poolid,
                                    libxl_sched_credit2_params *scinfo);
 int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
                                    libxl_sched_credit2_params *scinfo);
+libxl_sched_credit2_runq *libxl_sched_credit2_runqs_get(libxl_ctx *ctx,
+                                                        uint32_t poolid,
+                                                        int *nr_runqs_out);
+void libxl_sched_credit2_runq_list_free(libxl_sched_credit2_runq *list,
+                                        int nr_runqs);
+int libxl_sched_rtds_params_get(libxl_ctx *ctx, uint32_t poolid,
+                                libxl_sched_rtds_params *scinfo);
+int libxl_sched_rtds_params_set(libxl_ctx *ctx, uint32_t poolid,
+                                libxl_sched_rtds_params *scinfo);
+
+/* Scheduling latency histograms, of a pCPU or of a domain */
+int libxl_sched_stats_pcpu(libxl_ctx *ctx, uint32_t cpu,
+                           libxl_sched_stats *stats);
+int libxl_sched_stats_domain(libxl_ctx *ctx, uint32_t domid,
+                             libxl_sched_stats *stats);
+int libxl_sched_stats_reset(libxl_ctx *ctx);
 
 /* Scheduler Per-domain parameters */
 
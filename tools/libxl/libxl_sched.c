@@ -356,6 +356,7 @@ int libxl_sched_credit2_params_get(libxl_ctx *ctx, uint32_t poolid,
     }
 
     scinfo->ratelimit_us = sparam.ratelimit_us;
+    libxl_defbool_set(&scinfo->adaptive, sparam.adaptive);
 
     rc = 0;
  out:
@@ -373,7 +374,17 @@ int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
     rc = sched_ratelimit_check(gc, scinfo->ratelimit_us);
     if (rc) goto out;
 
+    /* Leave adaptive timeslicing as it is, unless asked otherwise. */
+    r = xc_sched_credit2_params_get(ctx->xch, poolid, &sparam);
+    if (r < 0) {
+        LOGE(ERROR, "getting Credit2 scheduler parameters");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
     sparam.ratelimit_us = scinfo->ratelimit_us;
+    if (!libxl_defbool_is_default(scinfo->adaptive))
+        sparam.adaptive = libxl_defbool_val(scinfo->adaptive);
 
     r = xc_sched_credit2_params_set(ctx->xch, poolid, &sparam);
     if (r < 0) {
@@ -383,6 +394,109 @@ int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
     }
 
     scinfo->ratelimit_us = sparam.ratelimit_us;
+    libxl_defbool_set(&scinfo->adaptive, sparam.adaptive);
+
+    rc = 0;
+ out:
+    GC_FREE;
+    return rc;
+}
+
+libxl_sched_credit2_runq *libxl_sched_credit2_runqs_get(libxl_ctx *ctx,
+                                                        uint32_t poolid,
+                                                        int *nr_runqs_out)
+{
+    GC_INIT(ctx);
+    struct xen_sysctl_credit2_schedule sparam;
+    xen_sysctl_credit2_runq_t *runqs;
+    libxl_sched_credit2_runq *ret = NULL;
+    uint32_t size, nr_runqs;
+    int i;
+
+    /* Find out how many runqueues there are first. */
+    if (xc_sched_credit2_params_get(ctx->xch, poolid, &sparam)) {
+        LOGE(ERROR, "getting Credit2 scheduler parameters");
+        goto out;
+    }
+
+    size = nr_runqs = sparam.nr_runqs;
+    runqs = libxl__zalloc(gc, sizeof(*runqs) * size);
+
+    if (xc_sched_credit2_runqs_get(ctx->xch, poolid, &sparam,
+                                   runqs, &nr_runqs)) {
+        LOGE(ERROR, "getting Credit2 runqueues information");
+        goto out;
+    }
+
+    /* Runqueues may have come or gone in the meantime. */
+    nr_runqs = min(nr_runqs, size);
+    ret = libxl__zalloc(NOGC, sizeof(*ret) * nr_runqs);
+
+    for (i = 0; i < nr_runqs; i++) {
+        libxl_sched_credit2_runq_init(&ret[i]);
+        ret[i].id = runqs[i].id;
+        ret[i].nr_cpus = runqs[i].nr_cpus;
+        ret[i].tslice_us = runqs[i].tslice_us;
+        ret[i].ratelimit_us = runqs[i].ratelimit_us;
+    }
+
+    *nr_runqs_out = nr_runqs;
+
+ out:
+    GC_FREE;
+    return ret;
+}
+
+int libxl_sched_rtds_params_get(libxl_ctx *ctx, uint32_t poolid,
+                                libxl_sched_rtds_params *scinfo)
+{
+    struct xen_sysctl_rtds_schedule sparam;
+    int r, rc;
+    GC_INIT(ctx);
+
+    r = xc_sched_rtds_params_get(ctx->xch, poolid, &sparam);
+    if (r < 0) {
+        LOGE(ERROR, "getting RTDS scheduler parameters");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    scinfo->cluster = sparam.cluster;
+
+    rc = 0;
+ out:
+    GC_FREE;
+    return rc;
+}
+
+int libxl_sched_rtds_params_set(libxl_ctx *ctx, uint32_t poolid,
+                                libxl_sched_rtds_params *scinfo)
+{
+    struct xen_sysctl_rtds_schedule sparam = { 0 };
+    int r, rc;
+    GC_INIT(ctx);
+
+    if (scinfo->cluster < LIBXL_RTDS_CLUSTER_CPU ||
+        scinfo->cluster > LIBXL_RTDS_CLUSTER_ALL) {
+        LOG(ERROR, "invalid RTDS clusters arrangement %d", scinfo->cluster);
+        rc = ERROR_INVAL;
+        goto out;
+    }
+
+    sparam.cluster = scinfo->cluster;
+
+    r = xc_sched_rtds_params_set(ctx->xch, poolid, &sparam);
+    if (r < 0) {
+        if (errno == EBUSY)
+            LOG(ERROR, "the clusters arrangement of a cpupool can only be "
+                "changed while the cpupool has no cpus");
+        else
+            LOGE(ERROR, "setting RTDS scheduler parameters");
+        rc = ERROR_FAIL;
+        goto out;
+    }
+
+    scinfo->cluster = sparam.cluster;
 
     rc = 0;
  out:
@@ -390,6 +504,80 @@ int libxl_sched_credit2_params_set(libxl_ctx *ctx, uint32_t poolid,
     return rc;
 }
 
+static int sched_stats_get(libxl__gc *gc, bool domain, uint32_t id,
+                           libxl_sched_stats *stats)
+{
+    uint64_t *hist;
+    int i, r;
+
+    GCNEW_ARRAY(hist, XEN_SYSCTL_SCHED_STATS_NR *
+                      XEN_SYSCTL_SCHED_STATS_BUCKETS);
+
+    if (domain)
+        r = xc_sched_stats_domain(CTX->xch, id, hist);
+    else
+        r = xc_sched_stats_pcpu(CTX->xch, id, hist);
+    if (r < 0) {
+        LOGE(ERROR, "getting scheduling stats of %s %u",
+             domain ? "domain" : "cpu", id);
+        return ERROR_FAIL;
+    }
+
+#define HIST(which, i) \
+    hist[XEN_SYSCTL_SCHED_STATS_##which * XEN_SYSCTL_SCHED_STATS_BUCKETS + (i)]
+
+    stats->num_buckets = XEN_SYSCTL_SCHED_STATS_BUCKETS;
+    stats->buckets = libxl__calloc(NOGC, stats->num_buckets,
+                                   sizeof(*stats->buckets));
+    for (i = 0; i < stats->num_buckets; i++) {
+        stats->buckets[i].wake = HIST(wake, i);
+        stats->buckets[i].wait = HIST(wait, i);
+        stats->buckets[i].slice = HIST(slice, i);
+    }
+
+#undef HIST
+
+    return 0;
+}
+
+int libxl_sched_stats_pcpu(libxl_ctx *ctx, uint32_t cpu,
+                           libxl_sched_stats *stats)
+{
+    int rc;
+    GC_INIT(ctx);
+
+    rc = sched_stats_get(gc, false, cpu, stats);
+
+    GC_FREE;
+    return rc;
+}
+
+int libxl_sched_stats_domain(libxl_ctx *ctx, uint32_t domid,
+                             libxl_sched_stats *stats)
+{
+    int rc;
+    GC_INIT(ctx);
+
+    rc = sched_stats_get(gc, true, domid, stats);
+
+    GC_FREE;
+    return rc;
+}
+
+int libxl_sched_stats_reset(libxl_ctx *ctx)
+{
+    int rc = 0;
+    GC_INIT(ctx);
+
+    if (xc_sched_stats_reset(ctx->xch) < 0) {
+        LOGE(ERROR, "resetting scheduling stats");
+        rc = ERROR_FAIL;
+    }
+
+    GC_FREE;
+    return rc;
+}
+
 static int sched_credit2_domain_get(libxl__gc *gc, uint32_t domid,
                                     libxl_domain_sched_params *scinfo)
 {
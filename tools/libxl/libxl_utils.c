@@ -1036,6 +1036,15 @@ void libxl_cputopology_list_free(libxl_cputopology *list, int nr)
     free(list);
 }
 
+void libxl_sched_credit2_runq_list_free(libxl_sched_credit2_runq *list,
+                                        int nr)
+{
+    int i;
+    for (i = 0; i < nr; i++)
+        libxl_sched_credit2_runq_dispose(&list[i]);
+    free(list);
+}
+
 void libxl_pcitopology_list_free(libxl_pcitopology *list, int nr)
 {
     int i;
@@ -185,6 +185,8 @@ void parse_time_stats(char *s)
     PRINTF_CYC_COUNTER(pg_copy,"page copy cycles:");
     PRINTF_CYC_COUNTER(compress,"compression cycles:");
     PRINTF_CYC_COUNTER(decompress,"decompression cycles:");
+
+    printf("ephemeral LRU busy on eviction: %llu\n", parse(s,"Lb"));
 }
 
 void parse_client(char *s)
@@ -0,0 +1,167 @@
+/*
+ * Xen emulation for running rangeset.c in userspace
+ *
+ * Just enough of the hypervisor environment (lists, locks, object caches
+ * and domains) for xen/common/rangeset.c and xen/common/rbtree.c to be
+ * built unmodified and driven by main.c.  Everything is single threaded:
+ * locks only keep track of whether they are held.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RANGESET_TEST_EMUL_H__
+#define __RANGESET_TEST_EMUL_H__
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool bool_t;
+
+#define __must_check __attribute__((__warn_unused_result__))
+#define EXPORT_SYMBOL(sym)
+
+#define BUG()       abort()
+#define BUG_ON(p)   do { if ( p ) BUG(); } while ( 0 )
+#define ASSERT(p)   assert(p)
+
+#define container_of(ptr, type, member) ({             \
+    typeof(((type *)0)->member) *mptr__ = (ptr);       \
+    (type *)((char *)mptr__ - offsetof(type, member)); \
+})
+
+#define min(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); \
+                     (void)(&x_ == &y_); x_ < y_ ? x_ : y_; })
+#define max(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); \
+                     (void)(&x_ == &y_); x_ > y_ ? x_ : y_; })
+
+#define printk printf
+#define safe_strcpy(d, s) snprintf(d, sizeof(d), "%s", s)
+
+#define xmalloc(_type) ((_type *)malloc(sizeof(_type)))
+#define xfree(_p)      free(_p)
+
+/* Object caches: straight onto malloc(). */
+
+struct xmem_cache {
+    size_t size;
+};
+
+#define DEFINE_XMEM_CACHE(_name, _type) \
+    struct xmem_cache _name = { .size = sizeof(_type) }
+#define xmem_cache_alloc(c)   malloc((c)->size)
+#define xmem_cache_free(c, p) free(p)
+
+/* Locks: they only record being held. */
+
+typedef struct { int held; } spinlock_t;
+typedef struct { int readers, writer; } rwlock_t;
+
+#define spin_lock_init(l)    ((l)->held = 0)
+#define spin_lock(l)         (ASSERT(!(l)->held), (l)->held = 1, (void)0)
+#define spin_unlock(l)       (ASSERT((l)->held), (l)->held = 0, (void)0)
+
+#define rwlock_init(l)       ((l)->readers = (l)->writer = 0)
+#define read_lock(l)         (ASSERT(!(l)->writer), (l)->readers++, (void)0)
+#define read_unlock(l)       (ASSERT((l)->readers), (l)->readers--, (void)0)
+#define write_lock(l)        (ASSERT(!(l)->writer && !(l)->readers), \
+                              (l)->writer = 1, (void)0)
+#define write_unlock(l)      (ASSERT((l)->writer), (l)->writer = 0, (void)0)
+
+/* Lists (same semantics as xen/list.h). */
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new, struct list_head *prev,
+                              struct list_head *next)
+{
+    next->prev = new;
+    new->next = next;
+    new->prev = prev;
+    prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+    __list_add(new, head, head->next);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    entry->next = entry->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+static inline void __list_splice(struct list_head *list,
+                                 struct list_head *head)
+{
+    struct list_head *first = list->next, *last = list->prev;
+    struct list_head *at = head->next;
+
+    first->prev = head;
+    head->next = first;
+    last->next = at;
+    at->prev = last;
+}
+
+static inline void list_splice(struct list_head *list, struct list_head *head)
+{
+    if ( !list_empty(list) )
+        __list_splice(list, head);
+}
+
+static inline void list_splice_init(struct list_head *list,
+                                    struct list_head *head)
+{
+    if ( !list_empty(list) )
+    {
+        __list_splice(list, head);
+        INIT_LIST_HEAD(list);
+    }
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_for_each_entry(pos, head, member)                  \
+    for ( pos = list_entry((head)->next, typeof(*pos), member); \
+          &pos->member != (head);                               \
+          pos = list_entry(pos->member.next, typeof(*pos), member) )
+
+/* Domains: only what owning rangesets needs. */
+
+struct domain {
+    unsigned int domain_id;
+    struct list_head rangesets;
+    spinlock_t rangesets_lock;
+};
+
+#include "rbtree.h"
+#include "rangeset.h"
+
+#endif /* __RANGESET_TEST_EMUL_H__ */
@@ -0,0 +1,238 @@
+/*
+ * Userspace test and micro-benchmark for Xen rangesets
+ *
+ * rangeset.c and rbtree.c are built unmodified against emul.h.  First a
+ * random sequence of adds and removes is checked against a bitmap model
+ * of the same set, comparing the results of every query.  Then sets of
+ * increasing numbers of disjoint ranges (as ioreq servers and I/O
+ * permissions accumulate them) are built, and the cost of the lookups
+ * done on each trapped access is timed, next to that of the ordered walk
+ * rangesets used to do.
+ *
+ * Usage:
+ *
+ *  ./test_rangeset [-s <seed>] [-n <lookups>]
+ *
+ * The exit status is non-zero if the rangeset disagreed with the model.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include "emul.h"
+
+#define MODEL_SIZE  4096
+#define MODEL_OPS   20000
+
+static bool model[MODEL_SIZE];
+
+static unsigned long rnd(unsigned long n)
+{
+    return ((unsigned long)random() << 16 ^ random()) % n;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct report {
+    unsigned long next;
+    bool ok;
+};
+
+/* Ranges must be reported in order, merged, and match the model. */
+static int check_report(unsigned long s, unsigned long e, void *arg)
+{
+    struct report *rep = arg;
+    unsigned long i;
+
+    if ( s < rep->next || s > e )
+        rep->ok = false;
+    for ( ; rep->next < s; rep->next++ )
+        if ( model[rep->next] )
+            rep->ok = false;
+    for ( i = s; i <= e; i++ )
+        if ( !model[i] )
+            rep->ok = false;
+    rep->next = e + 1;
+
+    return 0;
+}
+
+static bool test_model(void)
+{
+    struct rangeset *r = rangeset_new(NULL, "model", 0);
+    unsigned int op;
+    bool ok = true;
+
+    for ( op = 0; op < MODEL_OPS && ok; op++ )
+    {
+        unsigned long s = rnd(MODEL_SIZE), e = s + rnd(64), i;
+        bool contains = true, overlaps = false;
+        struct report rep = { .ok = true };
+
+        if ( e >= MODEL_SIZE )
+            e = MODEL_SIZE - 1;
+
+        if ( rnd(3) )
+        {
+            if ( rangeset_add_range(r, s, e) )
+                return false;
+            for ( i = s; i <= e; i++ )
+                model[i] = true;
+        }
+        else
+        {
+            if ( rangeset_remove_range(r, s, e) )
+                return false;
+            for ( i = s; i <= e; i++ )
+                model[i] = false;
+        }
+
+        s = rnd(MODEL_SIZE);
+        e = min(s + rnd(64), (unsigned long)MODEL_SIZE - 1);
+        for ( i = s; i <= e; i++ )
+        {
+            contains &= model[i];
+            overlaps |= model[i];
+        }
+        ok &= rangeset_contains_range(r, s, e) == contains;
+        ok &= rangeset_overlaps_range(r, s, e) == overlaps;
+        ok &= rangeset_contains_singleton(r, s) == model[s];
+
+        rep.next = s;
+        rangeset_report_ranges(r, s, e, check_report, &rep);
+        for ( ; rep.next <= e; rep.next++ )
+            if ( model[rep.next] )
+                rep.ok = false;
+        ok &= rep.ok;
+    }
+
+    if ( !ok )
+        fprintf(stderr, "rangeset and model disagree after %u operations\n",
+                op);
+
+    rangeset_destroy(r);
+
+    return ok;
+}
+
+/* The ordered walk find_range() used to do, over the same ranges. */
+struct linear_range {
+    struct linear_range *next;
+    unsigned long s, e;
+};
+
+static bool linear_contains(struct linear_range *l, unsigned long s)
+{
+    struct linear_range *x = NULL;
+
+    for ( ; l; l = l->next )
+    {
+        if ( l->s > s )
+            break;
+        x = l;
+    }
+
+    return x && x->e >= s;
+}
+
+static void bench(unsigned int nr, unsigned long lookups)
+{
+    struct rangeset *r = rangeset_new(NULL, "bench", 0);
+    struct linear_range *head = NULL, **tail = &head, *l;
+    unsigned long *addrs = malloc(sizeof(*addrs) * lookups);
+    unsigned long i, hits = 0, lhits = 0;
+    double t0, t1, t2;
+
+    /* nr disjoint 16-unit "BARs" with 16-unit holes between them. */
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( rangeset_add_range(r, i * 32, i * 32 + 15) )
+            abort();
+        l = malloc(sizeof(*l));
+        l->s = i * 32;
+        l->e = i * 32 + 15;
+        l->next = NULL;
+        *tail = l;
+        tail = &l->next;
+    }
+
+    for ( i = 0; i < lookups; i++ )
+        addrs[i] = rnd(nr * 32UL);
+
+    t0 = now_ns();
+    for ( i = 0; i < lookups; i++ )
+        hits += rangeset_contains_singleton(r, addrs[i]);
+    t1 = now_ns();
+    for ( i = 0; i < lookups; i++ )
+        lhits += linear_contains(head, addrs[i]);
+    t2 = now_ns();
+
+    if ( hits != lhits )
+    {
+        fprintf(stderr, "%u ranges: %lu hits, linear walk %lu\n",
+                nr, hits, lhits);
+        exit(1);
+    }
+
+    printf("%6u ranges: %8.1f ns/lookup (tree)  %8.1f ns/lookup (linear)\n",
+           nr, (t1 - t0) / lookups, (t2 - t1) / lookups);
+
+    while ( head )
+    {
+        l = head->next;
+        free(head);
+        head = l;
+    }
+    free(addrs);
+    rangeset_destroy(r);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long lookups = 1000000;
+    unsigned int seed = 1, nr;
+    int c;
+
+    while ( (c = getopt(argc, argv, "s:n:")) != -1 )
+    {
+        switch ( c )
+        {
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            lookups = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s <seed>] [-n <lookups>]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    srandom(seed);
+
+    if ( !test_model() )
+        return 1;
+    printf("model check: %u operations OK\n", MODEL_OPS);
+
+    for ( nr = 4; nr <= 4096; nr *= 4 )
+        bench(nr, lookups);
+
+    return 0;
+}
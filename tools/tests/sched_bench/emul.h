@@ -0,0 +1,694 @@
+/*
+ * Xen emulation for running the schedulers in userspace
+ *
+ * Just enough of the hypervisor environment (cpumasks, per-cpu data,
+ * locks, timers, softirqs, domains and vcpus) for sched_credit.c,
+ * sched_credit2.c and sched_rt.c to be built unmodified and driven by
+ * the simulation in main.c.  Everything is single threaded: "locks" only
+ * keep track of whether they are held, so that the schedulers' own
+ * ASSERT()s keep working.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCHED_BENCH_EMUL_H__
+#define __SCHED_BENCH_EMUL_H__
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xen/xen.h>
+#include <xen/domctl.h>
+#include <xen/sysctl.h>
+#include <xen/trace.h>
+#include <xen/vcpu.h>
+
+#define NR_CPUS 256
+
+typedef int64_t s_time_t;
+typedef bool bool_t;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+
+/* Compiler and debugging helpers. */
+
+#define __init
+#define __initdata
+#define __read_mostly
+#define __cacheline_aligned
+#define __used_section(s) __attribute__((__unused__))
+#define __maybe_unused __attribute__((__unused__))
+#define __must_check __attribute__((__warn_unused_result__))
+
+#define likely(x)   __builtin_expect(!!(x), true)
+#define unlikely(x) __builtin_expect(!!(x), false)
+
+#define barrier()   asm volatile ( "" : : : "memory" )
+#define smp_mb()    __sync_synchronize()
+#define smp_rmb()   barrier()
+#define smp_wmb()   barrier()
+#define cpu_relax() barrier()
+
+#define ACCESS_ONCE(x)     (*(volatile typeof(x) *)&(x))
+#define read_atomic(p)     ACCESS_ONCE(*(p))
+#define write_atomic(p, x) (ACCESS_ONCE(*(p)) = (x))
+
+#define BUG()                abort()
+#define BUG_ON(p)            do { if ( unlikely(p) ) BUG(); } while ( 0 )
+#define ASSERT(p)            assert(p)
+#define ASSERT_UNREACHABLE() assert(!__LINE__)
+#define WARN_ON(p)           ((void)(p))
+#define BUILD_BUG_ON(cond)   ((void)sizeof(char[1 - 2 * !!(cond)]))
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
+
+#define container_of(ptr, type, member) ({             \
+    typeof(((type *)0)->member) *mptr__ = (ptr);       \
+    (type *)((char *)mptr__ - offsetof(type, member)); \
+})
+
+#define min(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); \
+                     (void)(&x_ == &y_); x_ < y_ ? x_ : y_; })
+#define max(x, y) ({ typeof(x) x_ = (x); typeof(y) y_ = (y); \
+                     (void)(&x_ == &y_); x_ > y_ ? x_ : y_; })
+#define min_t(type, x, y) ({ type x_ = (x); type y_ = (y); x_ < y_ ? x_ : y_; })
+#define max_t(type, x, y) ({ type x_ = (x); type y_ = (y); x_ > y_ ? x_ : y_; })
+
+#define ROUNDUP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+#define IS_ERR_VALUE(x) unlikely((unsigned long)(x) >= (unsigned long)-4095)
+#define ERR_PTR(e)      ((void *)(long)(e))
+#define PTR_ERR(p)      ((long)(p))
+#define IS_ERR(p)       IS_ERR_VALUE(p)
+
+/* Consoles, command line, tracing and statistics: mostly compiled out. */
+
+extern bool sim_verbose;
+
+#define XENLOG_ERR     "<err>"
+#define XENLOG_WARNING "<warn>"
+#define XENLOG_INFO    "<info>"
+#define XENLOG_G_INFO  "<info>"
+#define XENLOG_G_WARNING "<warn>"
+#define XENLOG_G_ERR   "<err>"
+#define XENLOG_G_DEBUG "<debug>"
+#define KERN_ERR       XENLOG_ERR
+#define KERN_INFO      XENLOG_INFO
+#define KERN_WARNING   XENLOG_WARNING
+
+#define printk(fmt, args...) \
+    do { if ( sim_verbose ) printf(fmt, ## args); } while ( 0 )
+#define dprintk(lvl, fmt, args...) printk(fmt, ## args)
+#define gdprintk(lvl, fmt, args...) printk(fmt, ## args)
+#define panic(fmt, args...) \
+    do { fprintf(stderr, fmt "\n", ## args); abort(); } while ( 0 )
+#define scnprintf snprintf
+
+#define boolean_param(name, var)
+#define integer_param(name, var)
+#define custom_param(name, fn)
+#define string_param(name, var)
+
+#define register_keyhandler(key, fn, desc, diag)
+extern char keyhandler_scratch[1024];
+
+#define PRI_stime PRId64
+
+#define tb_init_done false
+#define __trace_var(evt, cyc, size, data) ((void)(data))
+#define trace_var(evt, cyc, size, data)   ((void)(data))
+#define TRACE_0D(e)                      ((void)0)
+#define TRACE_1D(e, d1)                  ((void)(d1))
+#define TRACE_2D(e, d1, d2)              ((void)(d1), (void)(d2))
+#define TRACE_3D(e, d1, d2, d3)          ((void)(d1), (void)(d2), (void)(d3))
+#define TRACE_4D(e, d1, d2, d3, d4)      ((void)(d1), (void)(d2), (void)(d3), \
+                                          (void)(d4))
+
+#define perfc_incr(x)       ((void)0)
+#define SCHED_STAT_CRANK(x) perfc_incr(x)
+
+/* Time. */
+
+#define SECONDS(_s)     ((s_time_t)((_s)  * 1000000000ULL))
+#define MILLISECS(_ms)  ((s_time_t)((_ms) * 1000000ULL))
+#define MICROSECS(_us)  ((s_time_t)((_us) * 1000ULL))
+#define STIME_MAX       ((s_time_t)((uint64_t)~0ull >> 1))
+#define STIME_DELTA_MAX ((s_time_t)((uint64_t)~0ull >> 2))
+
+extern s_time_t sim_now;
+#define NOW() (sim_now)
+
+/* Bit operations. */
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define BITS_TO_LONGS(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define BIT_WORD(nr) ((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr) (1UL << ((nr) % BITS_PER_LONG))
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+#define set_bit(nr, addr)   \
+    ((void)(((unsigned long *)(addr))[BIT_WORD(nr)] |= BIT_MASK(nr)))
+#define clear_bit(nr, addr) \
+    ((void)(((unsigned long *)(addr))[BIT_WORD(nr)] &= ~BIT_MASK(nr)))
+#define test_bit(nr, addr)  \
+    (!!(((const unsigned long *)(addr))[BIT_WORD(nr)] & BIT_MASK(nr)))
+#define __set_bit   set_bit
+#define __clear_bit clear_bit
+
+static inline bool test_and_set_bit(unsigned int nr, volatile void *addr)
+{
+    bool old = test_bit(nr, addr);
+
+    set_bit(nr, addr);
+    return old;
+}
+
+static inline bool test_and_clear_bit(unsigned int nr, volatile void *addr)
+{
+    bool old = test_bit(nr, addr);
+
+    clear_bit(nr, addr);
+    return old;
+}
+
+#define __test_and_set_bit   test_and_set_bit
+#define __test_and_clear_bit test_and_clear_bit
+
+static inline int fls(unsigned int x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+/* Atomics: there is only one thread. */
+
+typedef struct { int counter; } atomic_t;
+#define ATOMIC_INIT(i)      { (i) }
+#define atomic_read(v)      ((v)->counter)
+#define atomic_set(v, i)    ((v)->counter = (i))
+#define atomic_inc(v)       ((void)((v)->counter++))
+#define atomic_dec(v)       ((void)((v)->counter--))
+#define atomic_add(i, v)    ((void)((v)->counter += (i)))
+#define atomic_sub(i, v)    ((void)((v)->counter -= (i)))
+#define atomic_dec_and_test(v) (--(v)->counter == 0)
+
+/* Division helpers. */
+
+#define do_div(n, base) ({                   \
+    uint32_t rem_ = (uint64_t)(n) % (base);  \
+    (n) = (uint64_t)(n) / (base);            \
+    rem_;                                    \
+})
+
+/* Memory allocation. */
+
+#define xmalloc(_type)             ((_type *)malloc(sizeof(_type)))
+#define xzalloc(_type)             ((_type *)calloc(1, sizeof(_type)))
+#define xmalloc_array(_type, _num) ((_type *)malloc(sizeof(_type) * (_num)))
+#define xzalloc_array(_type, _num) ((_type *)calloc(_num, sizeof(_type)))
+#define xmalloc_bytes(_size)       malloc(_size)
+#define xzalloc_bytes(_size)       calloc(1, _size)
+#define xfree(_p)                  free(_p)
+
+/* Locks: they only record being held. */
+
+typedef struct { int held; } spinlock_t;
+typedef struct { int readers, writer; } rwlock_t;
+
+#define SPIN_LOCK_UNLOCKED   { 0 }
+#define DEFINE_SPINLOCK(l)   spinlock_t l = SPIN_LOCK_UNLOCKED
+#define spin_lock_init(l)    ((l)->held = 0)
+#define spin_is_locked(l)    ((l)->held != 0)
+#define spin_lock(l)         (ASSERT(!(l)->held), (l)->held = 1, (void)0)
+#define spin_unlock(l)       (ASSERT((l)->held), (l)->held = 0, (void)0)
+#define spin_trylock(l)      ((l)->held ? 0 : ((l)->held = 1))
+#define spin_lock_irq        spin_lock
+#define spin_unlock_irq      spin_unlock
+#define spin_lock_irqsave(l, f)      ((f) = 0, spin_lock(l))
+#define spin_unlock_irqrestore(l, f) ((void)(f), spin_unlock(l))
+#define spin_barrier(l)      ASSERT(!(l)->held)
+
+#define rwlock_init(l)       ((l)->readers = (l)->writer = 0)
+#define read_lock(l)         (ASSERT(!(l)->writer), (l)->readers++, (void)0)
+#define read_trylock(l)      ((l)->writer ? 0 : ((l)->readers++, 1))
+#define read_unlock(l)       (ASSERT((l)->readers), (l)->readers--, (void)0)
+#define write_lock(l)        (ASSERT(!(l)->writer && !(l)->readers), \
+                              (l)->writer = 1, (void)0)
+#define write_unlock(l)      (ASSERT((l)->writer), (l)->writer = 0, (void)0)
+#define write_lock_irqsave(l, f)      ((f) = 0, write_lock(l))
+#define write_unlock_irqrestore(l, f) ((void)(f), write_unlock(l))
+#define read_lock_irqsave(l, f)       ((f) = 0, read_lock(l))
+#define read_unlock_irqrestore(l, f)  ((void)(f), read_unlock(l))
+#define rw_is_locked(l)         ((l)->readers || (l)->writer)
+#define rw_is_write_locked(l)   ((l)->writer)
+
+#define local_irq_disable()     ((void)0)
+#define local_irq_enable()      ((void)0)
+#define local_irq_save(f)       ((f) = 0)
+#define local_irq_restore(f)    ((void)(f))
+#define local_irq_is_enabled()  true
+
+/* Lists (same semantics as xen/list.h). */
+
+struct list_head {
+    struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new, struct list_head *prev,
+                              struct list_head *next)
+{
+    next->prev = new;
+    new->next = next;
+    new->prev = prev;
+    prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+    __list_add(new, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+    __list_add(new, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    entry->next = entry->prev = NULL;
+}
+
+static inline void list_del_init(struct list_head *entry)
+{
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+    INIT_LIST_HEAD(entry);
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+static inline int list_is_last(const struct list_head *list,
+                               const struct list_head *head)
+{
+    return list->next == head;
+}
+
+static inline void list_move_tail(struct list_head *list,
+                                  struct list_head *head)
+{
+    list_del(list);
+    list_add_tail(list, head);
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) \
+    list_entry((ptr)->next, type, member)
+#define list_for_each(pos, head) \
+    for ( pos = (head)->next; pos != (head); pos = pos->next )
+#define list_for_each_safe(pos, n, head) \
+    for ( pos = (head)->next, n = pos->next; pos != (head); \
+          pos = n, n = pos->next )
+#define list_for_each_entry(pos, head, member)                  \
+    for ( pos = list_entry((head)->next, typeof(*pos), member); \
+          &pos->member != (head);                               \
+          pos = list_entry(pos->member.next, typeof(*pos), member) )
+#define list_for_each_entry_safe(pos, n, head, member)          \
+    for ( pos = list_entry((head)->next, typeof(*pos), member), \
+          n = list_entry(pos->member.next, typeof(*pos), member); \
+          &pos->member != (head);                               \
+          pos = n, n = list_entry(n->member.next, typeof(*n), member) )
+
+/* Cpumasks. */
+
+typedef struct cpumask {
+    DECLARE_BITMAP(bits, NR_CPUS);
+} cpumask_t;
+typedef cpumask_t *cpumask_var_t;
+
+extern unsigned int nr_cpu_ids;
+extern cpumask_t cpu_online_map;
+
+#define cpumask_bits(m) ((m)->bits)
+#define cpumask_set_cpu(c, m)   set_bit(c, (m)->bits)
+#define cpumask_clear_cpu(c, m) clear_bit(c, (m)->bits)
+#define cpumask_test_cpu(c, m)  test_bit(c, (m)->bits)
+#define cpumask_test_and_set_cpu(c, m)   test_and_set_bit(c, (m)->bits)
+#define cpumask_test_and_clear_cpu(c, m) test_and_clear_bit(c, (m)->bits)
+#define __cpumask_set_cpu            cpumask_set_cpu
+#define __cpumask_clear_cpu          cpumask_clear_cpu
+#define __cpumask_test_and_set_cpu   cpumask_test_and_set_cpu
+#define __cpumask_test_and_clear_cpu cpumask_test_and_clear_cpu
+
+#define cpumask_op(name, op)                                    \
+static inline void cpumask_##name(cpumask_t *dst,               \
+                                  const cpumask_t *s1,          \
+                                  const cpumask_t *s2)          \
+{                                                               \
+    unsigned int i;                                             \
+                                                                \
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )              \
+        dst->bits[i] = s1->bits[i] op s2->bits[i];              \
+}
+cpumask_op(and, &)
+cpumask_op(or, |)
+cpumask_op(xor, ^)
+cpumask_op(andnot, & ~)
+#undef cpumask_op
+
+static inline void cpumask_copy(cpumask_t *dst, const cpumask_t *src)
+{
+    *dst = *src;
+}
+
+static inline void cpumask_clear(cpumask_t *dst)
+{
+    memset(dst, 0, sizeof(*dst));
+}
+
+static inline void cpumask_setall(cpumask_t *dst)
+{
+    unsigned int i;
+
+    cpumask_clear(dst);
+    for ( i = 0; i < nr_cpu_ids; i++ )
+        cpumask_set_cpu(i, dst);
+}
+
+static inline int cpumask_next(int n, const cpumask_t *srcp)
+{
+    for ( n++; n < (int)nr_cpu_ids; n++ )
+        if ( cpumask_test_cpu(n, srcp) )
+            return n;
+    return nr_cpu_ids;
+}
+
+#define cpumask_first(m) cpumask_next(-1, m)
+
+static inline int cpumask_last(const cpumask_t *srcp)
+{
+    int n;
+
+    for ( n = nr_cpu_ids - 1; n >= 0; n-- )
+        if ( cpumask_test_cpu(n, srcp) )
+            return n;
+    return nr_cpu_ids;
+}
+
+static inline int cpumask_cycle(int n, const cpumask_t *srcp)
+{
+    int nxt = cpumask_next(n, srcp);
+
+    if ( nxt == nr_cpu_ids )
+        nxt = cpumask_first(srcp);
+    return nxt;
+}
+
+static inline int cpumask_test_or_cycle(int n, const cpumask_t *srcp)
+{
+    if ( cpumask_test_cpu(n, srcp) )
+        return n;
+
+    return cpumask_cycle(n, srcp);
+}
+
+static inline unsigned int cpumask_weight(const cpumask_t *srcp)
+{
+    unsigned int i, w = 0;
+
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )
+        w += __builtin_popcountl(srcp->bits[i]);
+    return w;
+}
+
+static inline bool cpumask_empty(const cpumask_t *srcp)
+{
+    return cpumask_weight(srcp) == 0;
+}
+
+static inline bool cpumask_equal(const cpumask_t *s1, const cpumask_t *s2)
+{
+    return !memcmp(s1, s2, sizeof(*s1));
+}
+
+static inline bool cpumask_intersects(const cpumask_t *s1,
+                                      const cpumask_t *s2)
+{
+    unsigned int i;
+
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )
+        if ( s1->bits[i] & s2->bits[i] )
+            return true;
+    return false;
+}
+
+static inline bool cpumask_subset(const cpumask_t *s1, const cpumask_t *s2)
+{
+    unsigned int i;
+
+    for ( i = 0; i < BITS_TO_LONGS(NR_CPUS); i++ )
+        if ( s1->bits[i] & ~s2->bits[i] )
+            return false;
+    return true;
+}
+
+#define cpumask_any(m) cpumask_first(m)
+
+const cpumask_t *cpumask_of(unsigned int cpu);
+int cpumask_scnprintf(char *buf, int len, const cpumask_t *srcp);
+#define cpulist_scnprintf cpumask_scnprintf
+
+static inline bool alloc_cpumask_var(cpumask_var_t *mask)
+{
+    *mask = xmalloc(cpumask_t);
+    return *mask != NULL;
+}
+
+static inline bool zalloc_cpumask_var(cpumask_var_t *mask)
+{
+    *mask = xzalloc(cpumask_t);
+    return *mask != NULL;
+}
+
+#define free_cpumask_var(m) xfree(m)
+
+#define for_each_cpu(cpu, mask)               \
+    for ( (cpu) = cpumask_first(mask);        \
+          (cpu) < nr_cpu_ids;                 \
+          (cpu) = cpumask_next(cpu, mask) )
+
+#define cpu_online(cpu)        cpumask_test_cpu(cpu, &cpu_online_map)
+#define num_online_cpus()      cpumask_weight(&cpu_online_map)
+#define for_each_online_cpu(cpu) for_each_cpu(cpu, &cpu_online_map)
+
+/* Per-cpu data, and the (simulated) current pCPU. */
+
+#define DECLARE_PER_CPU(type, name) extern typeof(type) per_cpu__##name[NR_CPUS]
+#define DEFINE_PER_CPU(type, name)  typeof(type) per_cpu__##name[NR_CPUS]
+#define per_cpu(name, cpu)          (per_cpu__##name[cpu])
+#define this_cpu(name)              per_cpu(name, smp_processor_id())
+
+extern unsigned int sim_cpu;
+#define smp_processor_id() (sim_cpu)
+
+/* Topology, set up by the harness. */
+
+extern unsigned int sim_threads, sim_cores, sim_llc_cores;
+
+#define cpu_to_core(cpu)   ((cpu) / sim_threads)
+#define cpu_to_llc(cpu)    ((cpu) / (sim_threads * sim_llc_cores))
+#define cpu_to_socket(cpu) ((cpu) / (sim_threads * sim_cores))
+#define cpu_to_node(cpu)   cpu_to_socket(cpu)
+
+DECLARE_PER_CPU(cpumask_var_t, cpu_sibling_mask);
+DECLARE_PER_CPU(cpumask_var_t, cpu_core_mask);
+
+#define MAX_NUMNODES 64
+
+typedef struct { DECLARE_BITMAP(bits, MAX_NUMNODES); } nodemask_t;
+
+extern nodemask_t node_online_map;
+extern cpumask_t node_to_cpumask_map[MAX_NUMNODES];
+
+#define node_to_cpumask(node) (node_to_cpumask_map[node])
+
+static inline int cycle_node(int n, nodemask_t mask)
+{
+    int i;
+
+    for ( i = 1; i <= MAX_NUMNODES; i++ )
+        if ( test_bit((n + i) % MAX_NUMNODES, mask.bits) )
+            return (n + i) % MAX_NUMNODES;
+    return MAX_NUMNODES;
+}
+
+extern bool sched_smt_power_savings;
+
+enum sys_state {
+    SYS_STATE_early_boot,
+    SYS_STATE_boot,
+    SYS_STATE_active,
+    SYS_STATE_suspend,
+    SYS_STATE_resume
+};
+extern enum sys_state system_state;
+
+/* Timers, fired by the harness when simulated time reaches them. */
+
+#define TIMER_STATUS_invalid  0
+#define TIMER_STATUS_inactive 1
+#define TIMER_STATUS_killed   2
+#define TIMER_STATUS_in_heap  3
+
+struct timer {
+    s_time_t expires;
+    uint8_t status;
+    void (*function)(void *);
+    void *data;
+    unsigned int cpu;
+    struct timer *next;     /* All initialised timers. */
+};
+
+void init_timer(struct timer *timer, void (*function)(void *), void *data,
+                unsigned int cpu);
+void set_timer(struct timer *timer, s_time_t expires);
+void stop_timer(struct timer *timer);
+void migrate_timer(struct timer *timer, unsigned int new_cpu);
+void kill_timer(struct timer *timer);
+
+static inline bool active_timer(const struct timer *timer)
+{
+    return timer->status == TIMER_STATUS_in_heap;
+}
+
+/* Softirqs: only SCHEDULE_SOFTIRQ matters. */
+
+enum {
+    TIMER_SOFTIRQ = 0,
+    SCHEDULE_SOFTIRQ,
+    NR_SOFTIRQS
+};
+
+void cpu_raise_softirq(unsigned int cpu, unsigned int nr);
+void cpumask_raise_softirq(const cpumask_t *mask, unsigned int nr);
+
+/* Guest memory access, only used by sched_rt's per-vcpu adjust. */
+
+#define guest_handle_is_null(hnd)  ((hnd).p == NULL)
+#define copy_from_guest_offset(ptr, hnd, off, nr) \
+    (memcpy(ptr, (hnd).p + (off), (nr) * sizeof(*(ptr))), 0)
+#define __copy_from_guest_offset copy_from_guest_offset
+#define copy_to_guest_offset(hnd, off, ptr, nr) \
+    (memcpy((hnd).p + (off), ptr, (nr) * sizeof(*(ptr))), 0)
+#define __copy_to_guest_offset copy_to_guest_offset
+#define hypercall_preempt_check() false
+#define hypercall_create_continuation(op, fmt, args...) (-ERESTART)
+#define process_pending_softirqs() ((void)0)
+#define ERESTART 85
+
+/* Domains and vcpus. */
+
+#define _VPF_blocked    0
+#define VPF_blocked     (1UL << _VPF_blocked)
+#define _VPF_down       1
+#define VPF_down        (1UL << _VPF_down)
+#define _VPF_migrating  3
+#define VPF_migrating   (1UL << _VPF_migrating)
+
+struct vcpu {
+    int              vcpu_id;
+    int              processor;
+    void            *sched_priv;
+    struct vcpu     *next_in_list;
+    struct domain   *domain;
+    struct vcpu_runstate_info runstate;
+    s_time_t         last_run_time;
+    bool             is_running;
+    bool             is_urgent;
+    unsigned long    pause_flags;
+    atomic_t         pause_count;
+    cpumask_var_t    cpu_hard_affinity;
+    cpumask_var_t    cpu_soft_affinity;
+};
+
+struct domain {
+    domid_t          domain_id;
+    unsigned int     max_vcpus;
+    struct vcpu    **vcpu;
+    void            *sched_priv;
+    struct cpupool  *cpupool;
+    struct domain   *next_in_list;
+    atomic_t         pause_count;
+    bool             is_dying;
+};
+
+extern struct vcpu *idle_vcpu[NR_CPUS];
+
+#define current (per_cpu(schedule_data, smp_processor_id()).curr)
+
+#define is_idle_domain(d) ((d)->domain_id == DOMID_IDLE)
+#define is_idle_vcpu(v)   (is_idle_domain((v)->domain))
+
+static inline int vcpu_runnable(struct vcpu *v)
+{
+    return !(v->pause_flags |
+             atomic_read(&v->pause_count) |
+             atomic_read(&v->domain->pause_count));
+}
+
+#define for_each_vcpu(_d, _v)                      \
+ for ( (_v) = (_d)->vcpu ? (_d)->vcpu[0] : NULL;   \
+       (_v) != NULL;                               \
+       (_v) = (_v)->next_in_list )
+
+void vcpu_pause_nosync(struct vcpu *v);
+void vcpu_unpause(struct vcpu *v);
+
+struct domain *first_domain_in_cpupool(struct cpupool *c);
+struct domain *next_domain_in_cpupool(struct domain *d, struct cpupool *c);
+
+#define for_each_domain_in_cpupool(_d, _c)      \
+ for ( (_d) = first_domain_in_cpupool(_c);      \
+       (_d) != NULL;                            \
+       (_d) = next_domain_in_cpupool((_d), (_c)))
+
+#define rcu_read_lock(l)   ((void)0)
+#define rcu_read_unlock(l) ((void)0)
+
+#include "sched-if.h"
+
+/* Export the schedulers to main.c, rather than via a linker section. */
+#undef REGISTER_SCHEDULER
+#define REGISTER_SCHEDULER(x) const struct scheduler *x##_entry = &x
+
+#endif /* __SCHED_BENCH_EMUL_H__ */
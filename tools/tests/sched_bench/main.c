@@ -0,0 +1,1004 @@
+/*
+ * Userspace micro-benchmark for the Xen schedulers
+ *
+ * sched_credit.c, sched_credit2.c and sched_rt.c are built unmodified
+ * against emul.h, and driven by a discrete event simulation of a host
+ * with a configurable number of pCPUs (and topology), running a number
+ * of domains whose vCPUs either always want to run ("cpu"), or run for
+ * short bursts and then block ("io").  Simulated time only advances
+ * between scheduler invocations, so the results (which vCPU ran where,
+ * and for how long) are exactly reproducible for a given seed, while the
+ * host time spent inside the scheduler hooks gives their cost.
+ *
+ * Usage:
+ *
+ *  make -C tools/tests/sched_bench run
+ *
+ * or, for a single configuration:
+ *
+ *  ./test_sched_bench -s credit2 -c 16 -t 2 -d 8 -v 4 -w mixed -T 20
+ *
+ * With -f <min>, the exit status is non-zero if the Jain fairness index
+ * of the CPU hungry vCPUs falls below <min>, so that the harness can be
+ * used as a (reproducible) gate for scheduler changes.
+ *
+ * This file is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License Version 2 (GPLv2)
+ * as published by the Free Software Foundation.
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details. <http://www.gnu.org/licenses/>.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+#include "emul.h"
+
+extern const struct scheduler *sched_credit_def_entry;
+extern const struct scheduler *sched_credit2_def_entry;
+extern const struct scheduler *sched_rtds_def_entry;
+
+static const struct scheduler **schedulers[] = {
+    &sched_credit_def_entry,
+    &sched_credit2_def_entry,
+    &sched_rtds_def_entry,
+};
+
+/* The environment the schedulers expect (see emul.h). */
+
+bool sim_verbose;
+s_time_t sim_now;
+unsigned int sim_cpu;
+unsigned int sim_threads = 1, sim_cores, sim_llc_cores;
+
+unsigned int nr_cpu_ids;
+cpumask_t cpu_online_map;
+nodemask_t node_online_map;
+cpumask_t node_to_cpumask_map[MAX_NUMNODES];
+DEFINE_PER_CPU(cpumask_var_t, cpu_sibling_mask);
+DEFINE_PER_CPU(cpumask_var_t, cpu_core_mask);
+bool sched_smt_power_savings;
+enum sys_state system_state = SYS_STATE_active;
+char keyhandler_scratch[1024];
+
+struct vcpu *idle_vcpu[NR_CPUS];
+DEFINE_PER_CPU(struct schedule_data, schedule_data);
+DEFINE_PER_CPU(struct scheduler *, scheduler);
+DEFINE_PER_CPU(struct cpupool *, cpupool);
+DEFINE_PER_CPU(struct sched_core *, sched_core);
+DEFINE_PER_CPU(bool, sched_core_busy);
+DEFINE_PER_CPU(bool, sched_core_waiting);
+DEFINE_PER_CPU(cpumask_t, cpumask_scratch);
+
+static struct cpupool pool0;
+struct cpupool *cpupool0 = &pool0;
+cpumask_t cpupool_free_cpus;
+int sched_ratelimit_us = SCHED_DEFAULT_RATELIMIT_US;
+
+static struct scheduler ops;
+static struct domain idle_domain;
+static struct domain *domain_list;
+
+/* Benchmark configuration. */
+
+enum workload { WL_CPU, WL_IO, WL_MIXED };
+
+static unsigned int opt_cpus = 8;
+static unsigned int opt_doms = 4;
+static unsigned int opt_vcpus;
+static enum workload opt_workload = WL_CPU;
+static unsigned int opt_seconds = 10;
+static unsigned long opt_seed = 1;
+static bool opt_weights;
+static bool opt_adaptive;
+static double opt_min_fairness;
+
+/* "io" vCPUs run for run_mean on average, and then block for sleep_mean. */
+static const s_time_t run_mean = MICROSECS(200);
+static const s_time_t sleep_mean = MILLISECS(1);
+
+#define LAT_BUCKETS 32
+
+struct bench_vcpu {
+    struct vcpu vcpu;
+    bool io;
+    s_time_t burst;       /* Time left to run before blocking. */
+    s_time_t wake_at;     /* When to unblock, if blocked. */
+    s_time_t woken_at;    /* When last woken, or -1 if not waiting. */
+    s_time_t run_since;   /* When last put on a pCPU. */
+    s_time_t runtime;
+    int last_cpu;
+    unsigned long migrations;
+};
+
+struct bench_domain {
+    struct domain dom;
+    unsigned int weight;
+    struct bench_vcpu *bvcpus;
+};
+
+static struct bench_domain *bdoms;
+
+/* What the harness tracks per pCPU. */
+static s_time_t slice_end[NR_CPUS];
+static s_time_t idle_since[NR_CPUS];
+static bool resched[NR_CPUS];
+static struct timer *timers;
+
+static struct {
+    unsigned long calls;
+    uint64_t ns;
+} st_schedule, st_wake, st_saved;
+
+static unsigned long nr_switches, nr_tickles, nr_migrations, nr_wakeups;
+static unsigned long wake_lat[LAT_BUCKETS];
+static s_time_t wake_lat_max, wake_lat_sum;
+static s_time_t idle_time;
+
+static inline struct bench_vcpu *bench_vcpu(struct vcpu *v)
+{
+    return container_of(v, struct bench_vcpu, vcpu);
+}
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift64*, so that results do not depend on the libc. */
+static uint64_t rnd(void)
+{
+    static uint64_t x;
+
+    if ( !x )
+        x = opt_seed * 0x9e3779b97f4a7c15ULL ?: 1;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static s_time_t rnd_exp(s_time_t mean)
+{
+    double u = (rnd() >> 11) * (1.0 / 9007199254740992.0);
+
+    return (s_time_t)(-log(1.0 - u) * mean) + 1;
+}
+
+/* Helpers provided by common code in the hypervisor. */
+
+const cpumask_t *cpumask_of(unsigned int cpu)
+{
+    static cpumask_t masks[NR_CPUS];
+
+    cpumask_clear(&masks[cpu]);
+    cpumask_set_cpu(cpu, &masks[cpu]);
+    return &masks[cpu];
+}
+
+int cpumask_scnprintf(char *buf, int len, const cpumask_t *srcp)
+{
+    unsigned int cpu;
+    int n = 0;
+
+    buf[0] = '\0';
+    for_each_cpu ( cpu, srcp )
+        if ( n < len )
+            n += snprintf(buf + n, len - n, "%s%u", n ? "," : "", cpu);
+    return n;
+}
+
+void init_timer(struct timer *timer, void (*function)(void *), void *data,
+                unsigned int cpu)
+{
+    struct timer **pt;
+
+    for ( pt = &timers; *pt; pt = &(*pt)->next )
+        if ( *pt == timer )
+        {
+            *pt = timer->next;
+            break;
+        }
+
+    memset(timer, 0, sizeof(*timer));
+    timer->function = function;
+    timer->data = data;
+    timer->cpu = cpu;
+    timer->status = TIMER_STATUS_inactive;
+    timer->next = timers;
+    timers = timer;
+}
+
+void set_timer(struct timer *timer, s_time_t expires)
+{
+    ASSERT(timer->status != TIMER_STATUS_killed);
+    timer->expires = expires;
+    timer->status = TIMER_STATUS_in_heap;
+}
+
+void stop_timer(struct timer *timer)
+{
+    if ( timer->status == TIMER_STATUS_in_heap )
+        timer->status = TIMER_STATUS_inactive;
+}
+
+void migrate_timer(struct timer *timer, unsigned int new_cpu)
+{
+    timer->cpu = new_cpu;
+}
+
+void kill_timer(struct timer *timer)
+{
+    struct timer **pt;
+
+    for ( pt = &timers; *pt; pt = &(*pt)->next )
+        if ( *pt == timer )
+        {
+            *pt = timer->next;
+            break;
+        }
+    timer->status = TIMER_STATUS_killed;
+}
+
+void cpu_raise_softirq(unsigned int cpu, unsigned int nr)
+{
+    if ( nr != SCHEDULE_SOFTIRQ )
+        return;
+    resched[cpu] = true;
+    nr_tickles++;
+}
+
+void cpumask_raise_softirq(const cpumask_t *mask, unsigned int nr)
+{
+    unsigned int cpu;
+
+    for_each_cpu ( cpu, mask )
+        cpu_raise_softirq(cpu, nr);
+}
+
+struct domain *first_domain_in_cpupool(struct cpupool *c)
+{
+    struct domain *d;
+
+    for ( d = domain_list; d && d->cpupool != c; d = d->next_in_list )
+        ;
+    return d;
+}
+
+struct domain *next_domain_in_cpupool(struct domain *d, struct cpupool *c)
+{
+    for ( d = d->next_in_list; d && d->cpupool != c; d = d->next_in_list )
+        ;
+    return d;
+}
+
+void sched_core_defer(unsigned int cpu, const struct vcpu *v)
+{
+    /* Core scheduling is never enabled here. */
+    BUG();
+}
+
+/* A (simplified) copy of what common/schedule.c does around the hooks. */
+
+static void vcpu_runstate_change(struct vcpu *v, int new_state,
+                                 s_time_t new_entry_time)
+{
+    s_time_t delta = new_entry_time - v->runstate.state_entry_time;
+
+    ASSERT(v->runstate.state != new_state);
+    if ( delta > 0 )
+    {
+        v->runstate.time[v->runstate.state] += delta;
+        v->runstate.state_entry_time = new_entry_time;
+    }
+    v->runstate.state = new_state;
+}
+
+static void vcpu_wake(struct vcpu *v)
+{
+    unsigned long flags;
+    spinlock_t *lock;
+    uint64_t t;
+
+    sim_cpu = v->processor;
+    lock = vcpu_schedule_lock_irqsave(v, &flags);
+
+    if ( likely(vcpu_runnable(v)) )
+    {
+        if ( v->runstate.state >= RUNSTATE_blocked )
+            vcpu_runstate_change(v, RUNSTATE_runnable, NOW());
+        t = host_ns();
+        ops.wake(&ops, v);
+        st_wake.ns += host_ns() - t;
+        st_wake.calls++;
+    }
+    else if ( !(v->pause_flags & VPF_blocked) )
+    {
+        if ( v->runstate.state == RUNSTATE_blocked )
+            vcpu_runstate_change(v, RUNSTATE_offline, NOW());
+    }
+
+    vcpu_schedule_unlock_irqrestore(lock, flags, v);
+}
+
+static void vcpu_sleep_nosync(struct vcpu *v)
+{
+    unsigned long flags;
+    spinlock_t *lock = vcpu_schedule_lock_irqsave(v, &flags);
+
+    if ( likely(!vcpu_runnable(v)) )
+    {
+        if ( v->runstate.state == RUNSTATE_runnable )
+            vcpu_runstate_change(v, RUNSTATE_offline, NOW());
+        ops.sleep(&ops, v);
+    }
+
+    vcpu_schedule_unlock_irqrestore(lock, flags, v);
+}
+
+void vcpu_pause_nosync(struct vcpu *v)
+{
+    atomic_inc(&v->pause_count);
+    vcpu_sleep_nosync(v);
+}
+
+void vcpu_unpause(struct vcpu *v)
+{
+    if ( atomic_dec_and_test(&v->pause_count) )
+        vcpu_wake(v);
+}
+
+static void vcpu_migrate(struct vcpu *v)
+{
+    unsigned long flags;
+    unsigned int new_cpu;
+    spinlock_t *old_lock, *new_lock;
+
+    old_lock = vcpu_schedule_lock_irqsave(v, &flags);
+    new_cpu = ops.pick_cpu(&ops, v);
+    new_lock = per_cpu(schedule_data, new_cpu).schedule_lock;
+    if ( new_lock != old_lock )
+        spin_lock(new_lock);
+
+    if ( v->is_running ||
+         !test_and_clear_bit(_VPF_migrating, &v->pause_flags) )
+        goto out;
+
+    if ( ops.migrate )
+        ops.migrate(&ops, v, new_cpu);
+    else
+        v->processor = new_cpu;
+
+ out:
+    if ( new_lock != old_lock )
+        spin_unlock(new_lock);
+    spin_unlock_irqrestore(old_lock, flags);
+
+    vcpu_wake(v);
+}
+
+static void context_saved(struct vcpu *prev)
+{
+    uint64_t t;
+
+    prev->is_running = 0;
+
+    t = host_ns();
+    if ( ops.context_saved )
+        ops.context_saved(&ops, prev);
+    st_saved.ns += host_ns() - t;
+    st_saved.calls++;
+
+    if ( unlikely(prev->pause_flags & VPF_migrating) )
+        vcpu_migrate(prev);
+}
+
+static void schedule(unsigned int cpu)
+{
+    struct schedule_data *sd = &per_cpu(schedule_data, cpu);
+    struct vcpu *prev = sd->curr, *next;
+    struct task_slice next_slice;
+    s_time_t now = NOW();
+    spinlock_t *lock;
+    uint64_t t;
+
+    sim_cpu = cpu;
+    lock = pcpu_schedule_lock_irq(cpu);
+
+    t = host_ns();
+    next_slice = ops.do_schedule(&ops, now, 0);
+    st_schedule.ns += host_ns() - t;
+    st_schedule.calls++;
+
+    next = next_slice.task;
+    sd->curr = next;
+    slice_end[cpu] = next_slice.time >= 0 ? now + next_slice.time : STIME_MAX;
+
+    if ( prev == next )
+    {
+        pcpu_schedule_unlock_irq(lock, cpu);
+        return;
+    }
+
+    ASSERT(prev->runstate.state == RUNSTATE_running);
+    vcpu_runstate_change(
+        prev,
+        ((prev->pause_flags & VPF_blocked) ? RUNSTATE_blocked :
+         (vcpu_runnable(prev) ? RUNSTATE_runnable : RUNSTATE_offline)),
+        now);
+    prev->last_run_time = now;
+
+    ASSERT(next->runstate.state != RUNSTATE_running);
+    vcpu_runstate_change(next, RUNSTATE_running, now);
+
+    ASSERT(!next->is_running);
+    next->is_running = 1;
+
+    pcpu_schedule_unlock_irq(lock, cpu);
+
+    nr_switches++;
+
+    if ( is_idle_vcpu(prev) )
+        idle_time += now - idle_since[cpu];
+    else
+    {
+        struct bench_vcpu *bv = bench_vcpu(prev);
+
+        bv->runtime += now - bv->run_since;
+        if ( bv->burst != STIME_MAX )
+            bv->burst -= now - bv->run_since;
+    }
+
+    if ( !is_idle_vcpu(next) )
+    {
+        struct bench_vcpu *bv = bench_vcpu(next);
+
+        bv->run_since = now;
+        if ( bv->last_cpu >= 0 && bv->last_cpu != cpu )
+        {
+            bv->migrations++;
+            nr_migrations++;
+        }
+        bv->last_cpu = cpu;
+        if ( bv->woken_at >= 0 )
+        {
+            s_time_t lat = now - bv->woken_at;
+
+            wake_lat[min(fls((uint32_t)(lat >> 10)), LAT_BUCKETS - 1)]++;
+            wake_lat_sum += lat;
+            wake_lat_max = max(wake_lat_max, lat);
+            bv->woken_at = -1;
+        }
+    }
+    else
+        idle_since[cpu] = now;
+
+    context_saved(prev);
+}
+
+/* Setting up the host, the scheduler and the domains. */
+
+static void setup_topology(void)
+{
+    unsigned int cpu, other;
+
+    if ( !sim_cores )
+        sim_cores = opt_cpus / sim_threads;
+    if ( !sim_llc_cores )
+        sim_llc_cores = sim_cores;
+
+    nr_cpu_ids = opt_cpus;
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        cpumask_set_cpu(cpu, &cpu_online_map);
+        set_bit(cpu_to_node(cpu), node_online_map.bits);
+        cpumask_set_cpu(cpu, &node_to_cpumask(cpu_to_node(cpu)));
+
+        if ( !zalloc_cpumask_var(&per_cpu(cpu_sibling_mask, cpu)) ||
+             !zalloc_cpumask_var(&per_cpu(cpu_core_mask, cpu)) )
+            BUG();
+        for ( other = 0; other < nr_cpu_ids; other++ )
+        {
+            if ( cpu_to_core(other) == cpu_to_core(cpu) )
+                cpumask_set_cpu(other, per_cpu(cpu_sibling_mask, cpu));
+            if ( cpu_to_socket(other) == cpu_to_socket(cpu) )
+                cpumask_set_cpu(other, per_cpu(cpu_core_mask, cpu));
+        }
+    }
+}
+
+static void setup_scheduler(void)
+{
+    unsigned int cpu;
+
+    if ( ops.global_init && ops.global_init() )
+        panic("%s: global_init failed", ops.opt_name);
+    if ( ops.init(&ops) )
+        panic("%s: init failed", ops.opt_name);
+
+    if ( !zalloc_cpumask_var(&pool0.cpu_valid) ||
+         !zalloc_cpumask_var(&pool0.cpu_suspended) )
+        BUG();
+    pool0.sched = &ops;
+
+    idle_domain.domain_id = DOMID_IDLE;
+    idle_domain.vcpu = idle_vcpu;
+    idle_domain.max_vcpus = nr_cpu_ids;
+    if ( ops.init_domain && ops.init_domain(&ops, &idle_domain) )
+        panic("%s: init_domain failed for the idle domain", ops.opt_name);
+
+    /* What cpu_schedule_up() and the CPU_STARTING notifier do. */
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        struct schedule_data *sd = &per_cpu(schedule_data, cpu);
+        struct vcpu *idle = xzalloc(struct vcpu);
+        void *ppriv = NULL;
+
+        sim_cpu = cpu;
+        per_cpu(scheduler, cpu) = &ops;
+        per_cpu(cpupool, cpu) = cpupool0;
+        spin_lock_init(&sd->_lock);
+        sd->schedule_lock = &sd->_lock;
+
+        if ( !idle ||
+             !zalloc_cpumask_var(&idle->cpu_hard_affinity) ||
+             !zalloc_cpumask_var(&idle->cpu_soft_affinity) )
+            BUG();
+        idle->vcpu_id = cpu;
+        idle->domain = &idle_domain;
+        idle->processor = cpu;
+        cpumask_copy(idle->cpu_hard_affinity, cpumask_of(cpu));
+        cpumask_setall(idle->cpu_soft_affinity);
+        idle->sched_priv = ops.alloc_vdata(&ops, idle, idle_domain.sched_priv);
+        if ( !idle->sched_priv )
+            panic("%s: alloc_vdata failed for d%dv%u", ops.opt_name,
+                  DOMID_IDLE, cpu);
+        idle->is_running = 1;
+        idle->runstate.state = RUNSTATE_running;
+        if ( cpu )
+            idle_vcpu[cpu - 1]->next_in_list = idle;
+        idle_vcpu[cpu] = idle;
+        sd->curr = idle;
+
+        if ( ops.alloc_pdata )
+        {
+            ppriv = ops.alloc_pdata(&ops, cpu);
+            if ( IS_ERR(ppriv) )
+                panic("%s: alloc_pdata failed for CPU%u", ops.opt_name, cpu);
+        }
+        sd->sched_priv = ppriv;
+        if ( ops.init_pdata )
+            ops.init_pdata(&ops, ppriv, cpu);
+
+        cpumask_set_cpu(cpu, pool0.cpu_valid);
+    }
+}
+
+static void set_weight(struct domain *d, unsigned int weight)
+{
+    struct xen_domctl_scheduler_op op = {
+        .sched_id = ops.sched_id,
+        .cmd = XEN_DOMCTL_SCHEDOP_putinfo,
+    };
+
+    switch ( ops.sched_id )
+    {
+    case XEN_SCHEDULER_CREDIT:
+        op.u.credit.weight = weight;
+        op.u.credit.cap = 0;
+        break;
+    case XEN_SCHEDULER_CREDIT2:
+        op.u.credit2.weight = weight;
+        break;
+    default:
+        return;
+    }
+    if ( ops.adjust(&ops, d, &op) )
+        panic("%s: cannot set the weight of d%d", ops.opt_name, d->domain_id);
+}
+
+/* What "xl sched-credit2 -s -a 1" does. */
+static void set_adaptive(void)
+{
+    struct xen_sysctl_scheduler_op sc = {
+        .sched_id = ops.sched_id,
+        .cmd = XEN_SYSCTL_SCHEDOP_putinfo,
+    };
+
+    if ( ops.sched_id != XEN_SCHEDULER_CREDIT2 )
+        return;
+    sc.u.sched_credit2.ratelimit_us = sched_ratelimit_us;
+    sc.u.sched_credit2.adaptive = 1;
+    if ( ops.adjust_global(&ops, &sc) )
+        panic("%s: cannot enable adaptive timeslicing", ops.opt_name);
+}
+
+static void setup_domains(void)
+{
+    struct domain **pd = &domain_list;
+    unsigned int i, j, n = 0;
+
+    bdoms = calloc(opt_doms, sizeof(*bdoms));
+    if ( !bdoms )
+        BUG();
+
+    for ( i = 0; i < opt_doms; i++ )
+    {
+        struct bench_domain *bd = &bdoms[i];
+        struct domain *d = &bd->dom;
+
+        d->domain_id = i + 1;
+        d->max_vcpus = opt_vcpus;
+        d->cpupool = cpupool0;
+        d->vcpu = calloc(opt_vcpus, sizeof(*d->vcpu));
+        bd->bvcpus = calloc(opt_vcpus, sizeof(*bd->bvcpus));
+        if ( !d->vcpu || !bd->bvcpus )
+            BUG();
+        if ( ops.init_domain && ops.init_domain(&ops, d) )
+            panic("%s: init_domain failed for d%u", ops.opt_name, i + 1);
+        pool0.n_dom++;
+        *pd = d;
+        pd = &d->next_in_list;
+
+        bd->weight = opt_weights ? 128 << (i % 3) : 256;
+        set_weight(d, bd->weight);
+
+        /* What sched_init_vcpu() does. */
+        for ( j = 0; j < opt_vcpus; j++ )
+        {
+            struct bench_vcpu *bv = &bd->bvcpus[j];
+            struct vcpu *v = &bv->vcpu;
+
+            v->vcpu_id = j;
+            v->domain = d;
+            v->processor = n++ % nr_cpu_ids;
+            v->pause_flags = VPF_down;
+            v->runstate.state = RUNSTATE_offline;
+            if ( !zalloc_cpumask_var(&v->cpu_hard_affinity) ||
+                 !zalloc_cpumask_var(&v->cpu_soft_affinity) )
+                BUG();
+            cpumask_setall(v->cpu_hard_affinity);
+            cpumask_setall(v->cpu_soft_affinity);
+            if ( j )
+                d->vcpu[j - 1]->next_in_list = v;
+            d->vcpu[j] = v;
+
+            sim_cpu = v->processor;
+            v->sched_priv = ops.alloc_vdata(&ops, v, d->sched_priv);
+            if ( !v->sched_priv )
+                panic("%s: alloc_vdata failed for d%uv%u", ops.opt_name,
+                      i + 1, j);
+            ops.insert_vcpu(&ops, v);
+
+            bv->io = opt_workload == WL_IO ||
+                     (opt_workload == WL_MIXED && (i & 1));
+            bv->burst = bv->io ? rnd_exp(run_mean) : STIME_MAX;
+            bv->woken_at = -1;
+            bv->last_cpu = -1;
+        }
+    }
+}
+
+/* The simulation. */
+
+static void fire_timers(void)
+{
+    struct timer *t;
+    bool again;
+
+    do {
+        again = false;
+        for ( t = timers; t; t = t->next )
+            if ( t->status == TIMER_STATUS_in_heap && t->expires <= sim_now )
+            {
+                /* The handler may re-arm, or even kill, any timer. */
+                t->status = TIMER_STATUS_inactive;
+                sim_cpu = t->cpu;
+                t->function(t->data);
+                again = true;
+                break;
+            }
+    } while ( again );
+}
+
+static s_time_t next_event(s_time_t end)
+{
+    s_time_t next = end;
+    struct timer *t;
+    unsigned int i, j, cpu;
+
+    for ( t = timers; t; t = t->next )
+        if ( t->status == TIMER_STATUS_in_heap )
+            next = min(next, t->expires);
+
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+        next = min(next, slice_end[cpu]);
+
+    for ( i = 0; i < opt_doms; i++ )
+        for ( j = 0; j < opt_vcpus; j++ )
+        {
+            struct bench_vcpu *bv = &bdoms[i].bvcpus[j];
+            struct vcpu *v = &bv->vcpu;
+
+            if ( v->pause_flags & VPF_blocked )
+                next = min(next, bv->wake_at);
+            else if ( bv->burst != STIME_MAX && v->is_running &&
+                      curr_on_cpu(v->processor) == v )
+                next = min(next, bv->run_since + bv->burst);
+        }
+
+    return max(next, sim_now);
+}
+
+static void run(s_time_t end)
+{
+    unsigned int i, j, cpu;
+    bool pending;
+
+    /* Bring all the vCPUs up, as VCPUOP_up would. */
+    for ( i = 0; i < opt_doms; i++ )
+        for ( j = 0; j < opt_vcpus; j++ )
+        {
+            struct vcpu *v = &bdoms[i].bvcpus[j].vcpu;
+
+            clear_bit(_VPF_down, &v->pause_flags);
+            vcpu_wake(v);
+        }
+
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        slice_end[cpu] = STIME_MAX;
+        resched[cpu] = true;
+    }
+
+    for ( ; ; )
+    {
+        /* Run the scheduler on all the pCPUs that were asked to. */
+        do {
+            pending = false;
+            for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+                if ( resched[cpu] )
+                {
+                    resched[cpu] = false;
+                    schedule(cpu);
+                    pending = true;
+                }
+        } while ( pending );
+
+        if ( sim_now >= end )
+            break;
+        sim_now = next_event(end);
+
+        fire_timers();
+
+        for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+            if ( slice_end[cpu] <= sim_now )
+            {
+                slice_end[cpu] = STIME_MAX;
+                resched[cpu] = true;
+            }
+
+        for ( i = 0; i < opt_doms; i++ )
+            for ( j = 0; j < opt_vcpus; j++ )
+            {
+                struct bench_vcpu *bv = &bdoms[i].bvcpus[j];
+                struct vcpu *v = &bv->vcpu;
+
+                if ( (v->pause_flags & VPF_blocked) )
+                {
+                    /* vcpu_unblock() */
+                    if ( bv->wake_at > sim_now )
+                        continue;
+                    clear_bit(_VPF_blocked, &v->pause_flags);
+                    bv->burst = rnd_exp(run_mean);
+                    bv->woken_at = sim_now;
+                    nr_wakeups++;
+                    vcpu_wake(v);
+                }
+                else if ( bv->burst != STIME_MAX && v->is_running &&
+                          curr_on_cpu(v->processor) == v &&
+                          bv->run_since + bv->burst <= sim_now )
+                {
+                    /* vcpu_block() */
+                    set_bit(_VPF_blocked, &v->pause_flags);
+                    bv->wake_at = sim_now + rnd_exp(sleep_mean);
+                    resched[v->processor] = true;
+                }
+            }
+    }
+
+    /* Account for what is still running. */
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        struct vcpu *v = curr_on_cpu(cpu);
+
+        if ( is_idle_vcpu(v) )
+            idle_time += sim_now - idle_since[cpu];
+        else
+            bench_vcpu(v)->runtime += sim_now - bench_vcpu(v)->run_since;
+    }
+}
+
+/* Reporting. */
+
+static double report(void)
+{
+    double sum = 0, sum2 = 0, fairness = 1;
+    unsigned long seen = 0;
+    unsigned int i, j, n = 0, p99 = 0;
+
+    printf("%s: %u pCPUs (%u threads/core, %u cores/LLC, %u cores/socket), "
+           "%u domains x %u vCPUs, %s workload, %us\n",
+           ops.opt_name, nr_cpu_ids, sim_threads, sim_llc_cores, sim_cores,
+           opt_doms, opt_vcpus,
+           opt_workload == WL_CPU ? "cpu" :
+           opt_workload == WL_IO ? "io" : "mixed", opt_seconds);
+
+#define PRINT_OP(name, st)                                                  \
+    printf("  %-14s %10lu calls %8.1f ns/call %10.0f calls/s\n", name,      \
+           (st).calls, (st).calls ? (double)(st).ns / (st).calls : 0,       \
+           (st).ns ? (st).calls * 1e9 / (st).ns : 0)
+    PRINT_OP("do_schedule", st_schedule);
+    PRINT_OP("wake", st_wake);
+    PRINT_OP("context_saved", st_saved);
+#undef PRINT_OP
+
+    printf("  context switches %lu, migrations %lu, tickles %lu, "
+           "wakeups %lu\n", nr_switches, nr_migrations, nr_tickles,
+           nr_wakeups);
+    printf("  pCPU utilisation %.2f%%\n",
+           100.0 - 100.0 * idle_time / ((double)sim_now * nr_cpu_ids));
+
+    for ( i = 0; i < LAT_BUCKETS; i++ )
+    {
+        seen += wake_lat[i];
+        if ( seen * 100 >= nr_wakeups * 99 )
+        {
+            p99 = i;
+            break;
+        }
+    }
+    if ( nr_wakeups )
+        printf("  wakeup latency avg %.1fus, p99 < %lluus, max %.1fus\n",
+               wake_lat_sum / 1000.0 / nr_wakeups,
+               (1024ULL << p99) / 1000, wake_lat_max / 1000.0);
+
+    printf("  %-6s %6s %6s %12s %12s %6s\n",
+           "domain", "weight", "vcpus", "runtime(ms)", "runnable(ms)", "migr");
+    for ( i = 0; i < opt_doms; i++ )
+    {
+        s_time_t runtime = 0, waited = 0;
+        unsigned long migr = 0;
+
+        for ( j = 0; j < opt_vcpus; j++ )
+        {
+            struct bench_vcpu *bv = &bdoms[i].bvcpus[j];
+            double x = (double)bv->runtime / bdoms[i].weight;
+
+            runtime += bv->runtime;
+            waited += bv->vcpu.runstate.time[RUNSTATE_runnable];
+            migr += bv->migrations;
+            if ( bv->io )
+                continue;
+            sum += x;
+            sum2 += x * x;
+            n++;
+        }
+        printf("  d%-5u %6u %6u %12.1f %12.1f %6lu\n", i + 1,
+               bdoms[i].weight, opt_vcpus, runtime / 1e6, waited / 1e6, migr);
+    }
+
+    /* Jain's index, over the weighted runtime of the CPU hungry vCPUs. */
+    if ( n && sum2 > 0 )
+    {
+        fairness = sum * sum / (n * sum2);
+        printf("  fairness (Jain) %.4f\n", fairness);
+    }
+
+    if ( sim_verbose )
+    {
+        unsigned int cpu;
+
+        if ( ops.dump_settings )
+            ops.dump_settings(&ops);
+        for ( cpu = 0; ops.dump_cpu_state && cpu < nr_cpu_ids; cpu++ )
+            ops.dump_cpu_state(&ops, cpu);
+    }
+
+    return fairness;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            " -s <sched>     scheduler: credit, credit2 or rtds (credit2)\n"
+            " -c <n>         number of pCPUs (8)\n"
+            " -t <n>         threads per core (1)\n"
+            " -C <n>         cores per socket (all)\n"
+            " -l <n>         cores per LLC (cores per socket)\n"
+            " -d <n>         number of domains (4)\n"
+            " -v <n>         vCPUs per domain (pCPUs / 2)\n"
+            " -w <workload>  cpu, io or mixed (cpu)\n"
+            " -W             give the domains different weights\n"
+            " -A             credit2: enable adaptive timeslicing\n"
+            " -T <s>         simulated seconds (10)\n"
+            " -S <seed>      random seed (1)\n"
+            " -f <min>       fail if fairness is below <min>\n"
+            " -V             verbose, dump the scheduler state at the end\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *opt_sched = "credit2";
+    unsigned int i;
+    double fairness;
+    int c;
+
+    while ( (c = getopt(argc, argv, "s:c:t:C:l:d:v:w:WAT:S:f:Vh")) != -1 )
+    {
+        switch ( c )
+        {
+        case 's': opt_sched = optarg; break;
+        case 'c': opt_cpus = strtoul(optarg, NULL, 0); break;
+        case 't': sim_threads = strtoul(optarg, NULL, 0); break;
+        case 'C': sim_cores = strtoul(optarg, NULL, 0); break;
+        case 'l': sim_llc_cores = strtoul(optarg, NULL, 0); break;
+        case 'd': opt_doms = strtoul(optarg, NULL, 0); break;
+        case 'v': opt_vcpus = strtoul(optarg, NULL, 0); break;
+        case 'w':
+            if ( !strcmp(optarg, "cpu") )
+                opt_workload = WL_CPU;
+            else if ( !strcmp(optarg, "io") )
+                opt_workload = WL_IO;
+            else if ( !strcmp(optarg, "mixed") )
+                opt_workload = WL_MIXED;
+            else
+                usage(argv[0]);
+            break;
+        case 'W': opt_weights = true; break;
+        case 'A': opt_adaptive = true; break;
+        case 'T': opt_seconds = strtoul(optarg, NULL, 0); break;
+        case 'S': opt_seed = strtoul(optarg, NULL, 0); break;
+        case 'f': opt_min_fairness = strtod(optarg, NULL); break;
+        case 'V': sim_verbose = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if ( !opt_cpus || opt_cpus > NR_CPUS || !sim_threads ||
+         opt_cpus % sim_threads || !opt_doms )
+        usage(argv[0]);
+    if ( sim_cores && (opt_cpus / sim_threads) % sim_cores )
+        usage(argv[0]);
+    if ( sim_llc_cores && sim_cores && sim_cores % sim_llc_cores )
+        usage(argv[0]);
+    if ( !opt_vcpus )
+        opt_vcpus = max(opt_cpus / 2, 1U);
+
+    for ( i = 0; i < ARRAY_SIZE(schedulers); i++ )
+        if ( !strcmp((*schedulers[i])->opt_name, opt_sched) )
+            break;
+    if ( i == ARRAY_SIZE(schedulers) )
+        usage(argv[0]);
+    ops = *(*schedulers[i]);
+
+    setup_topology();
+    setup_scheduler();
+    if ( opt_adaptive )
+        set_adaptive();
+    setup_domains();
+    run(SECONDS(opt_seconds));
+    fairness = report();
+
+    return fairness < opt_min_fairness;
+}
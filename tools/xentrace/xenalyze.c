@@ -7469,6 +7469,17 @@ void sched_process(struct pcpu_info *p)
             if(opt.dump_all)
                 dump_sched_vcpu_action(ri, "vcpu_yield");
             break;
+        case TRC_SCHED_YIELD_TO:
+            if(opt.dump_all) {
+                struct {
+                    unsigned int domid, vcpuid, target;
+                } *r = (typeof(r))ri->d;
+
+                printf(" %s vcpu_yield_to d%uv%u -> d%uv%u\n",
+                       ri->dump_header, r->domid, r->vcpuid,
+                       r->domid, r->target);
+            }
+            break;
         case TRC_SCHED_BLOCK:
             if(opt.dump_all)
                 dump_sched_vcpu_action(ri, "vcpu_block");
@@ -7903,6 +7914,22 @@ void sched_process(struct pcpu_info *p)
                        ri->dump_header, r->domid, r->vcpuid);
             }
             break;
+        case TRC_SCHED_CLASS_EVT(CSCHED2, 24): /* ADAPT_TSLICE     */
+            if(opt.dump_all) {
+                struct {
+                    unsigned int rqi:16, overloaded:16;
+                    unsigned int tslice_us, ratelimit_us;
+                    unsigned int wakeups, expired;
+                } *r = (typeof(r))ri->d;
+
+                printf(" %s csched2:adapt_tslice rq# %u%s, tslice = %uus, "
+                       "ratelimit = %uus, wakeups = %u, expired = %u\n",
+                       ri->dump_header, r->rqi,
+                       r->overloaded ? " (overloaded)" : "",
+                       r->tslice_us, r->ratelimit_us,
+                       r->wakeups, r->expired);
+            }
+            break;
         /* RTDS (TRC_RTDS_xxx) */
         case TRC_SCHED_CLASS_EVT(RTDS, 1): /* TICKLE           */
             if(opt.dump_all) {
@@ -267,17 +267,30 @@ struct cmd_spec cmd_table[] = {
       "-w WEIGHT, --weight=WEIGHT     Weight (int)\n"
       "-s         --schedparam        Query / modify scheduler parameters\n"
       "-r RLIMIT, --ratelimit_us=RLIMIT Set the scheduling rate limit, in microseconds\n"
+      "-a 0|1,    --adaptive=0|1      Disable/enable per-runqueue adaptive timeslicing\n"
       "-p CPUPOOL, --cpupool=CPUPOOL  Restrict output to CPUPOOL"
     },
     { "sched-rtds",
       &main_sched_rtds, 0, 1,
       "Get/set rtds scheduler parameters",
-      "[-d <Domain> [-v[=VCPUID/all]] [-p[=PERIOD]] [-b[=BUDGET]]]",
+      "[-d <Domain> [-v[=VCPUID/all]] [-p[=PERIOD]] [-b[=BUDGET]]]"
+      " [-c CPUPOOL] [-C CLUSTER]",
       "-d DOMAIN, --domain=DOMAIN     Domain to modify\n"
       "-v VCPUID/all, --vcpuid=VCPUID/all    VCPU to modify or output;\n"
       "               Using '-v all' to modify/output all vcpus\n"
       "-p PERIOD, --period=PERIOD     Period (us)\n"
       "-b BUDGET, --budget=BUDGET     Budget (us)\n"
+      "-c CPUPOOL, --cpupool=CPUPOOL  Restrict output to CPUPOOL\n"
+      "-C CLUSTER, --cluster=CLUSTER  Arrange the pCPUs of the cpupool in\n"
+      "                               clusters (cpu, core, socket, node, all)\n"
+    },
+    { "sched-stats",
+      &main_sched_stats, 0, 0,
+      "Show or reset scheduling latency histograms",
+      "[-d <Domain> | -c <CPU> | -r]",
+      "-d DOMAIN, --domain=DOMAIN     Only show DOMAIN\n"
+      "-c CPU, --cpu=CPU              Only show pCPU CPU\n"
+      "-r, --reset                    Reset all the histograms"
     },
     { "domid",
       &main_domid, 0, 0,
@@ -13,6 +13,7 @@
  */
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 #include <libxl.h>
@@ -231,14 +232,30 @@ static int sched_credit2_domain_output(int domid)
 static int sched_credit2_pool_output(uint32_t poolid)
 {
     libxl_sched_credit2_params scparam;
+    libxl_sched_credit2_runq *runqs;
     char *poolname = libxl_cpupoolid_to_name(ctx, poolid);
+    int i, nr_runqs;
 
-    if (sched_credit2_params_get(poolid, &scparam))
+    libxl_sched_credit2_params_init(&scparam);
+    if (sched_credit2_params_get(poolid, &scparam)) {
         printf("Cpupool %s: [sched params unavailable]\n", poolname);
-    else
-        printf("Cpupool %s: ratelimit=%dus\n",
-               poolname, scparam.ratelimit_us);
+        goto out;
+    }
+
+    printf("Cpupool %s: ratelimit=%dus adaptive=%s\n",
+           poolname, scparam.ratelimit_us,
+           libxl_defbool_val(scparam.adaptive) ? "on" : "off");
+
+    runqs = libxl_sched_credit2_runqs_get(ctx, poolid, &nr_runqs);
+    if (!runqs)
+        goto out;
+    for (i = 0; i < nr_runqs; i++)
+        printf("  Runqueue %u: cpus=%u tslice=%uus ratelimit=%uus\n",
+               runqs[i].id, runqs[i].nr_cpus,
+               runqs[i].tslice_us, runqs[i].ratelimit_us);
+    libxl_sched_credit2_runq_list_free(runqs, nr_runqs);
 
+ out:
     free(poolname);
 
     return 0;
@@ -334,10 +351,16 @@ static int sched_rtds_vcpu_output_all(int domid,
 
 static int sched_rtds_pool_output(uint32_t poolid)
 {
+    libxl_sched_rtds_params scparam;
     char *poolname;
 
     poolname = libxl_cpupoolid_to_name(ctx, poolid);
-    printf("Cpupool %s: sched=RTDS\n", poolname);
+    libxl_sched_rtds_params_init(&scparam);
+    if (libxl_sched_rtds_params_get(ctx, poolid, &scparam))
+        printf("Cpupool %s: sched=RTDS\n", poolname);
+    else
+        printf("Cpupool %s: sched=RTDS cluster=%s\n", poolname,
+               libxl_rtds_cluster_to_string(scparam.cluster));
 
     free(poolname);
     return 0;
@@ -590,20 +613,23 @@ int main_sched_credit2(int argc, char **argv)
     const char *cpupool = NULL;
     int ratelimit = 0;
     int weight = 256;
+    int adaptive = 0;
     bool opt_s = false;
     bool opt_r = false;
     bool opt_w = false;
+    bool opt_a = false;
     int opt, rc;
     static struct option opts[] = {
         {"domain", 1, 0, 'd'},
         {"weight", 1, 0, 'w'},
         {"schedparam", 0, 0, 's'},
         {"ratelimit_us", 1, 0, 'r'},
+        {"adaptive", 1, 0, 'a'},
         {"cpupool", 1, 0, 'p'},
         COMMON_LONG_OPTS
     };
 
-    SWITCH_FOREACH_OPT(opt, "d:w:p:r:s", opts, "sched-credit2", 0) {
+    SWITCH_FOREACH_OPT(opt, "d:w:p:r:a:s", opts, "sched-credit2", 0) {
     case 'd':
         dom = optarg;
         break;
@@ -618,6 +644,10 @@ int main_sched_credit2(int argc, char **argv)
         ratelimit = strtol(optarg, NULL, 10);
         opt_r = true;
         break;
+    case 'a':
+        adaptive = strtol(optarg, NULL, 10);
+        opt_a = true;
+        break;
     case 'p':
         cpupool = optarg;
         break;
@@ -646,12 +676,20 @@ int main_sched_credit2(int argc, char **argv)
             }
         }
 
-        if (!opt_r) { /* Output scheduling parameters */
+        if (!opt_r && !opt_a) { /* Output scheduling parameters */
             if (sched_credit2_pool_output(poolid))
                 return EXIT_FAILURE;
-        } else {      /* Set scheduling parameters (so far, just ratelimit) */
-            scparam.ratelimit_us = ratelimit;
-            if (sched_credit2_params_set(poolid, &scparam))
+        } else {      /* Set scheduling parameters (ratelimit, adaptive) */
+            libxl_sched_credit2_params_init(&scparam);
+            rc = sched_credit2_params_get(poolid, &scparam);
+            if (!rc) {
+                if (opt_r)
+                    scparam.ratelimit_us = ratelimit;
+                if (opt_a)
+                    libxl_defbool_set(&scparam.adaptive, !!adaptive);
+                rc = sched_credit2_params_set(poolid, &scparam);
+            }
+            if (rc)
                 return EXIT_FAILURE;
         }
     } else if (!dom) { /* list all domain's credit scheduler info */
@@ -699,6 +737,7 @@ int main_sched_rtds(int argc, char **argv)
 {
     const char *dom = NULL;
     const char *cpupool = NULL;
+    const char *cluster = NULL;
     int *vcpus = (int *)xmalloc(sizeof(int)); /* IDs of VCPUs that change */
     int *periods = (int *)xmalloc(sizeof(int)); /* period is in microsecond */
     int *budgets = (int *)xmalloc(sizeof(int)); /* budget is in microsecond */
@@ -719,10 +758,11 @@ int main_sched_rtds(int argc, char **argv)
         {"budget", 1, 0, 'b'},
         {"vcpuid",1, 0, 'v'},
         {"cpupool", 1, 0, 'c'},
+        {"cluster", 1, 0, 'C'},
         COMMON_LONG_OPTS
     };
 
-    SWITCH_FOREACH_OPT(opt, "d:p:b:v:c", opts, "sched-rtds", 0) {
+    SWITCH_FOREACH_OPT(opt, "d:p:b:v:c:C:", opts, "sched-rtds", 0) {
     case 'd':
         dom = optarg;
         break;
@@ -761,11 +801,14 @@ int main_sched_rtds(int argc, char **argv)
     case 'c':
         cpupool = optarg;
         break;
+    case 'C':
+        cluster = optarg;
+        break;
     }
 
-    if (cpupool && (dom || opt_p || opt_b || opt_v || opt_all)) {
-        fprintf(stderr, "Specifying a cpupool is not allowed with "
-                "other options.\n");
+    if ((cpupool || cluster) && (dom || opt_p || opt_b || opt_v || opt_all)) {
+        fprintf(stderr, "Specifying a cpupool or a cluster arrangement is "
+                "not allowed with other options.\n");
         r = EXIT_FAILURE;
         goto out;
     }
@@ -791,7 +834,33 @@ int main_sched_rtds(int argc, char **argv)
         goto out;
     }
 
-    if ((!dom) && opt_all) {
+    if (cluster) {
+        /* set the clusters arrangement of the cpupool */
+        libxl_sched_rtds_params scparam;
+        uint32_t poolid = 0;
+
+        if (cpupool) {
+            if (libxl_cpupool_qualifier_to_cpupoolid(ctx, cpupool,
+                                                     &poolid, NULL) ||
+                !libxl_cpupoolid_is_valid(ctx, poolid)) {
+                fprintf(stderr, "unknown cpupool \'%s\'\n", cpupool);
+                r = EXIT_FAILURE;
+                goto out;
+            }
+        }
+
+        libxl_sched_rtds_params_init(&scparam);
+        if (libxl_rtds_cluster_from_string(cluster, &scparam.cluster)) {
+            fprintf(stderr, "Invalid cluster arrangement \'%s\'\n", cluster);
+            r = EXIT_FAILURE;
+            goto out;
+        }
+        if (libxl_sched_rtds_params_set(ctx, poolid, &scparam)) {
+            fprintf(stderr, "libxl_sched_rtds_params_set failed.\n");
+            r = EXIT_FAILURE;
+            goto out;
+        }
+    } else if ((!dom) && opt_all) {
         /* get all domain's per-vcpu rtds scheduler parameters */
         rc = -sched_vcpu_output(LIBXL_SCHEDULER_RTDS,
                                 sched_rtds_vcpu_output_all,
@@ -879,6 +948,174 @@ out:
     return r;
 }
 
+/* Lower bound of a latency histogram bucket, in a human readable form. */
+static void sched_stats_bucket_str(char *buf, size_t len, int i)
+{
+    uint64_t ns = 1ULL << i;
+
+    if (ns < 1000)
+        snprintf(buf, len, "%"PRIu64"ns", ns);
+    else if (ns < 1000000)
+        snprintf(buf, len, "%"PRIu64"us", ns / 1000);
+    else
+        snprintf(buf, len, "%"PRIu64"ms", ns / 1000000);
+}
+
+/* Bucket in which the given percentile of the samples falls. */
+static int sched_stats_percentile(const libxl_sched_stats *stats,
+                                  size_t offset, uint64_t total, int pct)
+{
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < stats->num_buckets; i++) {
+        seen += *(uint64_t *)((char *)&stats->buckets[i] + offset);
+        if (seen * 100 >= total * pct)
+            break;
+    }
+    return i < stats->num_buckets ? i : stats->num_buckets - 1;
+}
+
+static void print_sched_stats(const char *what, uint32_t id,
+                              const libxl_sched_stats *stats)
+{
+    static const struct {
+        const char *name;
+        size_t offset;
+    } metrics[] = {
+        { "wake", offsetof(libxl_sched_stats_bucket, wake) },
+        { "wait", offsetof(libxl_sched_stats_bucket, wait) },
+        { "slice", offsetof(libxl_sched_stats_bucket, slice) },
+    };
+    char buf[16];
+    int i, m;
+
+    printf("%s %u:\n", what, id);
+    printf("%-10s %14s %14s %14s\n", ">=", "wake", "wait", "slice");
+    for (i = 0; i < stats->num_buckets; i++) {
+        const libxl_sched_stats_bucket *b = &stats->buckets[i];
+
+        if (!b->wake && !b->wait && !b->slice)
+            continue;
+        sched_stats_bucket_str(buf, sizeof(buf), i);
+        printf("%-10s %14"PRIu64" %14"PRIu64" %14"PRIu64"\n",
+               buf, b->wake, b->wait, b->slice);
+    }
+
+    for (m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+        uint64_t total = 0;
+
+        for (i = 0; i < stats->num_buckets; i++)
+            total += *(uint64_t *)((char *)&stats->buckets[i] +
+                                   metrics[m].offset);
+        if (!total)
+            continue;
+
+        printf("%-5s samples: %"PRIu64, metrics[m].name, total);
+        sched_stats_bucket_str(buf, sizeof(buf), 1 +
+            sched_stats_percentile(stats, metrics[m].offset, total, 50));
+        printf(", p50 < %s", buf);
+        sched_stats_bucket_str(buf, sizeof(buf), 1 +
+            sched_stats_percentile(stats, metrics[m].offset, total, 99));
+        printf(", p99 < %s\n", buf);
+    }
+}
+
+static int sched_stats_pcpu(uint32_t cpu)
+{
+    libxl_sched_stats stats;
+    int rc;
+
+    libxl_sched_stats_init(&stats);
+    rc = libxl_sched_stats_pcpu(ctx, cpu, &stats);
+    if (!rc)
+        print_sched_stats("CPU", cpu, &stats);
+    libxl_sched_stats_dispose(&stats);
+
+    return rc;
+}
+
+static int sched_stats_domain(uint32_t domid)
+{
+    libxl_sched_stats stats;
+    int rc;
+
+    libxl_sched_stats_init(&stats);
+    rc = libxl_sched_stats_domain(ctx, domid, &stats);
+    if (!rc)
+        print_sched_stats("Domain", domid, &stats);
+    libxl_sched_stats_dispose(&stats);
+
+    return rc;
+}
+
+int main_sched_stats(int argc, char **argv)
+{
+    const char *dom = NULL;
+    int cpu = -1, opt, rc = 0;
+    bool reset = false;
+    static struct option opts[] = {
+        {"domain", 1, 0, 'd'},
+        {"cpu", 1, 0, 'c'},
+        {"reset", 0, 0, 'r'},
+        COMMON_LONG_OPTS
+    };
+
+    SWITCH_FOREACH_OPT(opt, "d:c:r", opts, "sched-stats", 0) {
+    case 'd':
+        dom = optarg;
+        break;
+    case 'c':
+        cpu = strtol(optarg, NULL, 10);
+        break;
+    case 'r':
+        reset = true;
+        break;
+    }
+
+    if ((dom != NULL) + (cpu >= 0) + reset > 1) {
+        fprintf(stderr, "Specify only one of -d, -c or -r.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (reset)
+        return libxl_sched_stats_reset(ctx) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    if (dom)
+        return sched_stats_domain(find_domain(dom)) ? EXIT_FAILURE
+                                                    : EXIT_SUCCESS;
+    if (cpu >= 0)
+        return sched_stats_pcpu(cpu) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    /* No arguments: all the online pCPUs, and then all the domains. */
+    {
+        libxl_cputopology *topology;
+        libxl_dominfo *info;
+        int i, nr;
+
+        topology = libxl_get_cpu_topology(ctx, &nr);
+        if (topology == NULL) {
+            fprintf(stderr, "libxl_get_cpu_topology failed.\n");
+            return EXIT_FAILURE;
+        }
+        for (i = 0; i < nr; i++)
+            if (topology[i].core != LIBXL_CPUTOPOLOGY_INVALID_ENTRY)
+                rc |= sched_stats_pcpu(i);
+        libxl_cputopology_list_free(topology, nr);
+
+        info = libxl_list_domain(ctx, &nr);
+        if (info == NULL) {
+            fprintf(stderr, "libxl_list_domain failed.\n");
+            return EXIT_FAILURE;
+        }
+        for (i = 0; i < nr; i++)
+            rc |= sched_stats_domain(info[i].domid);
+        libxl_dominfo_list_free(info, nr);
+    }
+
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 /*
  * Local variables:
  * mode: C
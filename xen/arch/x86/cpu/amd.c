@@ -498,10 +498,30 @@ static void amd_get_topology(struct cpuinfo_x86 *c)
         /* Collect compute unit ID if available */
         if (cpu_has(c, X86_FEATURE_TOPOEXT)) {
                 u32 eax, ebx, ecx, edx;
+                unsigned int i, llc_level = 1;
 
                 cpuid(0x8000001e, &eax, &ebx, &ecx, &edx);
                 c->compute_unit_id = ebx & 0xFF;
                 c->x86_num_siblings = ((ebx >> 8) & 0x3) + 1;
+
+                /*
+                 * Leaf 0x8000001d enumerates the cache hierarchy: find the
+                 * outermost cache and derive its ID from the APIC ID, as
+                 * done for Intel via cpuid(4).
+                 */
+                for (i = 0; ; i++) {
+                        unsigned int level, sharing;
+
+                        cpuid_count(0x8000001d, i, &eax, &ebx, &ecx, &edx);
+                        if (!(eax & 0x1f))
+                                break;
+                        level = (eax >> 5) & 0x7;
+                        if (level <= llc_level)
+                                continue;
+                        llc_level = level;
+                        sharing = ((eax >> 14) & 0xfff) + 1;
+                        c->cpu_llc_id = c->apicid >> get_count_order(sharing);
+                }
         }
         
         if (opt_cpu_info)
@@ -171,6 +171,12 @@ unsigned int init_intel_cacheinfo(struct cpuinfo_x86 *c)
 				}
 			}
 		}
+
+		/* The last level cache is the outermost one cpuid(4) reports. */
+		if (new_l3)
+			c->cpu_llc_id = l3_id;
+		else if (new_l2)
+			c->cpu_llc_id = l2_id;
 	}
 	/*
 	 * Don't use cpuid2 if cpuid4 is supported. For P4, we use cpuid2 for
@@ -58,6 +58,7 @@
 #include <asm/traps.h>
 #include <asm/nmi.h>
 #include <asm/mce.h>
+#include <asm/mem_sharing.h>
 #include <asm/amd.h>
 #include <xen/numa.h>
 #include <xen/iommu.h>
@@ -116,7 +117,9 @@ static void idle_loop(void)
     {
         if ( cpu_is_offline(smp_processor_id()) )
             play_dead();
-        (*pm_idle)();
+        /* Only go to sleep once there is no free memory left to scrub. */
+        if ( !scrub_free_pages() )
+            (*pm_idle)();
         do_tasklet();
         do_softirq();
         /*
@@ -564,6 +567,7 @@ void arch_domain_destroy(struct domain *d)
     cleanup_domain_irq_mapping(d);
 
     psr_domain_free(d);
+    numa_balance_domain_destroy(d);
 }
 
 void arch_domain_shutdown(struct domain *d)
@@ -1959,6 +1963,7 @@ int domain_relinquish_resources(struct domain *d)
 void arch_dump_domain_info(struct domain *d)
 {
     paging_dump_domain_info(d);
+    mem_sharing_dump_domain(d);
 }
 
 void arch_dump_vcpu_info(struct vcpu *v)
@@ -276,11 +276,28 @@ static int hvmemul_do_io(
         }
         else
         {
-            rc = hvm_send_ioreq(s, &p, 0);
-            if ( rc != X86EMUL_RETRY || currd->is_shutting_down )
+            rc = X86EMUL_UNHANDLEABLE;
+
+            /* Writes to posted ranges needn't wait for the device model. */
+            if ( hvm_ioreq_server_posted(s, &p) )
+            {
+                rc = hvm_send_ioreq(s, &p, 1);
+                if ( rc == X86EMUL_OKAY )
+                    perfc_incr(ioreq_posted);
+                else
+                    perfc_incr(ioreq_posted_full);
+            }
+
+            if ( rc == X86EMUL_OKAY )
                 vio->io_req.state = STATE_IOREQ_NONE;
-            else if ( data_is_addr )
-                rc = X86EMUL_OKAY;
+            else
+            {
+                rc = hvm_send_ioreq(s, &p, 0);
+                if ( rc != X86EMUL_RETRY || currd->is_shutting_down )
+                    vio->io_req.state = STATE_IOREQ_NONE;
+                else if ( data_is_addr )
+                    rc = X86EMUL_OKAY;
+            }
         }
         break;
     }
@@ -773,22 +790,71 @@ static struct hvm_mmio_cache *hvmemul_find_mmio_cache(
     return cache;
 }
 
+/*
+ * Look up a known MMIO translation of @gla good for @access_type, saving a
+ * guest page table walk.
+ */
+static const struct hvm_mmio_xlat *hvmemul_find_xlat(
+    const struct hvm_vcpu_io *vio, unsigned long gla,
+    enum hvm_access_type access_type)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(vio->mmio_xlat); i++ )
+    {
+        const struct hvm_mmio_xlat *xlat = &vio->mmio_xlat[i];
+
+        if ( !xlat->access.gla_valid || xlat->gla != (gla & PAGE_MASK) )
+            continue;
+
+        if ( access_type == hvm_access_insn_fetch ? xlat->access.insn_fetch :
+             access_type == hvm_access_write ? xlat->access.write_access :
+             xlat->access.read_access )
+        {
+            perfc_incr(hvm_mmio_xlat_hit);
+            return xlat;
+        }
+    }
+
+    return NULL;
+}
+
 static void latch_linear_to_phys(struct hvm_vcpu_io *vio, unsigned long gla,
                                  unsigned long gpa, bool_t write)
 {
-    if ( vio->mmio_access.gla_valid )
-        return;
+    struct hvm_mmio_xlat *xlat = NULL;
+    unsigned int i;
 
-    vio->mmio_gla = gla & PAGE_MASK;
-    vio->mmio_gpfn = PFN_DOWN(gpa);
-    vio->mmio_access = (struct npfec){ .gla_valid = 1,
-                                       .read_access = 1,
-                                       .write_access = write };
+    for ( i = 0; i < ARRAY_SIZE(vio->mmio_xlat); i++ )
+        if ( vio->mmio_xlat[i].access.gla_valid &&
+             vio->mmio_xlat[i].gla == (gla & PAGE_MASK) )
+        {
+            xlat = &vio->mmio_xlat[i];
+            break;
+        }
+
+    if ( !xlat || xlat->gpfn != PFN_DOWN(gpa) )
+    {
+        if ( !xlat )
+            xlat = &vio->mmio_xlat[vio->mmio_xlat_next++ %
+                                   ARRAY_SIZE(vio->mmio_xlat)];
+        xlat->gla = gla & PAGE_MASK;
+        xlat->gpfn = PFN_DOWN(gpa);
+        xlat->access = (struct npfec){ .gla_valid = 1 };
+    }
+
+    /* A walk for a write also establishes the right to read. */
+    xlat->access.read_access = 1;
+    xlat->access.write_access |= write;
 }
 
+/*
+ * @gpfn, if not INVALID_GFN, is the already known translation of the page
+ * containing @gla.
+ */
 static int hvmemul_linear_mmio_access(
     unsigned long gla, unsigned int size, uint8_t dir, void *buffer,
-    uint32_t pfec, struct hvm_emulate_ctxt *hvmemul_ctxt, bool_t known_gpfn)
+    uint32_t pfec, struct hvm_emulate_ctxt *hvmemul_ctxt, unsigned long gpfn)
 {
     struct hvm_vcpu_io *vio = &current->arch.hvm_vcpu.hvm_io;
     unsigned long offset = gla & ~PAGE_MASK;
@@ -803,18 +869,19 @@ static int hvmemul_linear_mmio_access(
 
     chunk = min_t(unsigned int, size, PAGE_SIZE - offset);
 
-    if ( known_gpfn )
-        gpa = pfn_to_paddr(vio->mmio_gpfn) | offset;
+    if ( gpfn != gfn_x(INVALID_GFN) )
+        gpa = pfn_to_paddr(gpfn) | offset;
     else
     {
+        perfc_incr(hvm_mmio_xlat_walk);
         rc = hvmemul_linear_to_phys(gla, &gpa, chunk, &one_rep, pfec,
                                     hvmemul_ctxt);
         if ( rc != X86EMUL_OKAY )
             return rc;
-
-        latch_linear_to_phys(vio, gla, gpa, dir == IOREQ_WRITE);
     }
 
+    latch_linear_to_phys(vio, gla, gpa, dir == IOREQ_WRITE);
+
     for ( ;; )
     {
         rc = hvmemul_phys_mmio_access(cache, gpa, chunk, dir, buffer, buffer_offset);
@@ -841,19 +908,34 @@ static int hvmemul_linear_mmio_access(
 static inline int hvmemul_linear_mmio_read(
     unsigned long gla, unsigned int size, void *buffer,
     uint32_t pfec, struct hvm_emulate_ctxt *hvmemul_ctxt,
-    bool_t translate)
+    unsigned long gpfn)
 {
     return hvmemul_linear_mmio_access(gla, size, IOREQ_READ, buffer,
-                                      pfec, hvmemul_ctxt, translate);
+                                      pfec, hvmemul_ctxt, gpfn);
 }
 
 static inline int hvmemul_linear_mmio_write(
     unsigned long gla, unsigned int size, void *buffer,
     uint32_t pfec, struct hvm_emulate_ctxt *hvmemul_ctxt,
-    bool_t translate)
+    unsigned long gpfn)
 {
     return hvmemul_linear_mmio_access(gla, size, IOREQ_WRITE, buffer,
-                                      pfec, hvmemul_ctxt, translate);
+                                      pfec, hvmemul_ctxt, gpfn);
+}
+
+/*
+ * The translation a guest linear copy found for @gla before failing with
+ * HVMCOPY_bad_gfn_to_mfn, if that was on the first page.
+ */
+static unsigned long copy_fault_gpfn(const pagefault_info_t *pfinfo,
+                                     unsigned long gla)
+{
+    if ( (pfinfo->linear ^ gla) & PAGE_MASK )
+        return gfn_x(INVALID_GFN);
+
+    perfc_incr(hvm_mmio_xlat_copy);
+
+    return pfinfo->gfn;
 }
 
 static int __hvmemul_read(
@@ -869,6 +951,7 @@ static int __hvmemul_read(
     unsigned long addr, reps = 1;
     uint32_t pfec = PFEC_page_present;
     struct hvm_vcpu_io *vio = &curr->arch.hvm_vcpu.hvm_io;
+    const struct hvm_mmio_xlat *xlat;
     int rc;
 
     if ( is_x86_system_segment(seg) )
@@ -880,11 +963,10 @@ static int __hvmemul_read(
         seg, offset, bytes, &reps, access_type, hvmemul_ctxt, &addr);
     if ( rc != X86EMUL_OKAY || !bytes )
         return rc;
-    if ( ((access_type != hvm_access_insn_fetch
-           ? vio->mmio_access.read_access
-           : vio->mmio_access.insn_fetch)) &&
-         (vio->mmio_gla == (addr & PAGE_MASK)) )
-        return hvmemul_linear_mmio_read(addr, bytes, p_data, pfec, hvmemul_ctxt, 1);
+    xlat = hvmemul_find_xlat(vio, addr, access_type);
+    if ( xlat )
+        return hvmemul_linear_mmio_read(addr, bytes, p_data, pfec,
+                                        hvmemul_ctxt, xlat->gpfn);
 
     rc = ((access_type == hvm_access_insn_fetch) ?
           hvm_fetch_from_guest_linear(p_data, addr, bytes, pfec, &pfinfo) :
@@ -901,7 +983,8 @@ static int __hvmemul_read(
         if ( access_type == hvm_access_insn_fetch )
             return X86EMUL_UNHANDLEABLE;
 
-        return hvmemul_linear_mmio_read(addr, bytes, p_data, pfec, hvmemul_ctxt, 0);
+        return hvmemul_linear_mmio_read(addr, bytes, p_data, pfec, hvmemul_ctxt,
+                                        copy_fault_gpfn(&pfinfo, addr));
     case HVMCOPY_gfn_paged_out:
     case HVMCOPY_gfn_shared:
         return X86EMUL_RETRY;
@@ -980,6 +1063,7 @@ static int hvmemul_write(
     unsigned long addr, reps = 1;
     uint32_t pfec = PFEC_page_present | PFEC_write_access;
     struct hvm_vcpu_io *vio = &curr->arch.hvm_vcpu.hvm_io;
+    const struct hvm_mmio_xlat *xlat;
     int rc;
 
     if ( is_x86_system_segment(seg) )
@@ -992,9 +1076,10 @@ static int hvmemul_write(
     if ( rc != X86EMUL_OKAY || !bytes )
         return rc;
 
-    if ( vio->mmio_access.write_access &&
-         (vio->mmio_gla == (addr & PAGE_MASK)) )
-        return hvmemul_linear_mmio_write(addr, bytes, p_data, pfec, hvmemul_ctxt, 1);
+    xlat = hvmemul_find_xlat(vio, addr, hvm_access_write);
+    if ( xlat )
+        return hvmemul_linear_mmio_write(addr, bytes, p_data, pfec,
+                                         hvmemul_ctxt, xlat->gpfn);
 
     rc = hvm_copy_to_guest_linear(addr, p_data, bytes, pfec, &pfinfo);
 
@@ -1006,7 +1091,9 @@ static int hvmemul_write(
         x86_emul_pagefault(pfinfo.ec, pfinfo.linear, &hvmemul_ctxt->ctxt);
         return X86EMUL_EXCEPTION;
     case HVMCOPY_bad_gfn_to_mfn:
-        return hvmemul_linear_mmio_write(addr, bytes, p_data, pfec, hvmemul_ctxt, 0);
+        return hvmemul_linear_mmio_write(addr, bytes, p_data, pfec,
+                                         hvmemul_ctxt,
+                                         copy_fault_gpfn(&pfinfo, addr));
     case HVMCOPY_gfn_paged_out:
     case HVMCOPY_gfn_shared:
         return X86EMUL_RETRY;
@@ -1258,6 +1345,7 @@ static int hvmemul_rep_movs(
     struct hvm_emulate_ctxt *hvmemul_ctxt =
         container_of(ctxt, struct hvm_emulate_ctxt, ctxt);
     struct hvm_vcpu_io *vio = &current->arch.hvm_vcpu.hvm_io;
+    const struct hvm_mmio_xlat *xlat;
     unsigned long saddr, daddr, bytes;
     paddr_t sgpa, dgpa;
     uint32_t pfec = PFEC_page_present;
@@ -1280,9 +1368,7 @@ static int hvmemul_rep_movs(
     if ( hvmemul_ctxt->seg_reg[x86_seg_ss].attr.fields.dpl == 3 )
         pfec |= PFEC_user_mode;
 
-    if ( vio->mmio_access.read_access &&
-         (vio->mmio_gla == (saddr & PAGE_MASK)) &&
-         /*
+    if ( /*
           * Upon initial invocation don't truncate large batches just because
           * of a hit for the translation: Doing the guest page table walk is
           * cheaper than multiple round trips through the device model. Yet
@@ -1290,8 +1376,9 @@ static int hvmemul_rep_movs(
           */
          (vio->io_req.state == STATE_IORESP_READY ||
           ((!df || *reps == 1) &&
-           PAGE_SIZE - (saddr & ~PAGE_MASK) >= *reps * bytes_per_rep)) )
-        sgpa = pfn_to_paddr(vio->mmio_gpfn) | (saddr & ~PAGE_MASK);
+           PAGE_SIZE - (saddr & ~PAGE_MASK) >= *reps * bytes_per_rep)) &&
+         (xlat = hvmemul_find_xlat(vio, saddr, hvm_access_read)) != NULL )
+        sgpa = pfn_to_paddr(xlat->gpfn) | (saddr & ~PAGE_MASK);
     else
     {
         rc = hvmemul_linear_to_phys(saddr, &sgpa, bytes_per_rep, reps, pfec,
@@ -1301,13 +1388,12 @@ static int hvmemul_rep_movs(
     }
 
     bytes = PAGE_SIZE - (daddr & ~PAGE_MASK);
-    if ( vio->mmio_access.write_access &&
-         (vio->mmio_gla == (daddr & PAGE_MASK)) &&
-         /* See comment above. */
+    if ( /* See comment above. */
          (vio->io_req.state == STATE_IORESP_READY ||
           ((!df || *reps == 1) &&
-           PAGE_SIZE - (daddr & ~PAGE_MASK) >= *reps * bytes_per_rep)) )
-        dgpa = pfn_to_paddr(vio->mmio_gpfn) | (daddr & ~PAGE_MASK);
+           PAGE_SIZE - (daddr & ~PAGE_MASK) >= *reps * bytes_per_rep)) &&
+         (xlat = hvmemul_find_xlat(vio, daddr, hvm_access_write)) != NULL )
+        dgpa = pfn_to_paddr(xlat->gpfn) | (daddr & ~PAGE_MASK);
     else
     {
         rc = hvmemul_linear_to_phys(daddr, &dgpa, bytes_per_rep, reps,
@@ -1413,6 +1499,7 @@ static int hvmemul_rep_stos(
     struct hvm_emulate_ctxt *hvmemul_ctxt =
         container_of(ctxt, struct hvm_emulate_ctxt, ctxt);
     struct hvm_vcpu_io *vio = &current->arch.hvm_vcpu.hvm_io;
+    const struct hvm_mmio_xlat *xlat;
     unsigned long addr, bytes;
     paddr_t gpa;
     p2m_type_t p2mt;
@@ -1424,13 +1511,12 @@ static int hvmemul_rep_stos(
         return rc;
 
     bytes = PAGE_SIZE - (addr & ~PAGE_MASK);
-    if ( vio->mmio_access.write_access &&
-         (vio->mmio_gla == (addr & PAGE_MASK)) &&
-         /* See respective comment in MOVS processing. */
+    if ( /* See respective comment in MOVS processing. */
          (vio->io_req.state == STATE_IORESP_READY ||
           ((!df || *reps == 1) &&
-           PAGE_SIZE - (addr & ~PAGE_MASK) >= *reps * bytes_per_rep)) )
-        gpa = pfn_to_paddr(vio->mmio_gpfn) | (addr & ~PAGE_MASK);
+           PAGE_SIZE - (addr & ~PAGE_MASK) >= *reps * bytes_per_rep)) &&
+         (xlat = hvmemul_find_xlat(vio, addr, hvm_access_write)) != NULL )
+        gpa = pfn_to_paddr(xlat->gpfn) | (addr & ~PAGE_MASK);
     else
     {
         uint32_t pfec = PFEC_page_present | PFEC_write_access;
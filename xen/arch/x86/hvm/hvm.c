@@ -1860,6 +1860,8 @@ int hvm_hap_nested_page_fault(paddr_t gpa, unsigned long gla,
      * locks in such circumstance */
     if ( paged )
         p2m_mem_paging_populate(currd, gfn);
+    if ( npfec.write_access )
+        mem_sharing_unshare_batch(currd);
     if ( sharing_enomem )
     {
         int rv;
@@ -3092,12 +3094,20 @@ static enum hvm_copy_result __hvm_copy(
         if ( v == current && is_hvm_vcpu(v)
              && !nestedhvm_vcpu_in_guestmode(v)
              && hvm_mmio_internal(gpa) )
-            return HVMCOPY_bad_gfn_to_mfn;
-
-        page = get_page_from_gfn(v->domain, gfn, &p2mt, P2M_UNSHARE);
+            page = NULL;
+        else
+            page = get_page_from_gfn(v->domain, gfn, &p2mt, P2M_UNSHARE);
 
         if ( !page )
+        {
+            /* Let MMIO emulation re-use the translation. */
+            if ( (flags & HVMCOPY_linear) && pfinfo )
+            {
+                pfinfo->linear = addr;
+                pfinfo->gfn = gfn;
+            }
             return HVMCOPY_bad_gfn_to_mfn;
+        }
 
         if ( p2m_is_paging(p2mt) )
         {
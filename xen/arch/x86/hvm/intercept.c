@@ -29,6 +29,8 @@
 #include <io_ports.h>
 #include <xen/event.h>
 #include <xen/iommu.h>
+#include <xen/keyhandler.h>
+#include <xen/perfc.h>
 
 static bool_t hvm_mmio_accept(const struct hvm_io_handler *handler,
                               const ioreq_t *p)
@@ -209,33 +211,124 @@ int hvm_process_io_intercept(const struct hvm_io_handler *handler,
     return rc;
 }
 
-static const struct hvm_io_handler *hvm_find_io_handler(const ioreq_t *p)
+/* Binary search the plain port I/O handlers for one accepting p. */
+static struct hvm_io_handler *hvm_find_portio_handler(struct hvm_domain *hd,
+                                                      const ioreq_t *p)
 {
-    struct domain *curr_d = current->domain;
-    unsigned int i;
+    unsigned int lo = 0, hi = ACCESS_ONCE(hd->portio_sorted_count), mid;
+    struct hvm_io_handler *handler;
+
+    while ( lo < hi )
+    {
+        mid = (lo + hi) / 2;
+        if ( hd->io_handler[hd->portio_sorted[mid]].portio.port <= p->addr )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ( lo == 0 )
+        return NULL;
+
+    handler = &hd->io_handler[hd->portio_sorted[lo - 1]];
+
+    return (handler->ops == &portio_ops &&
+            hvm_portio_accept(handler, p)) ? handler : NULL;
+}
+
+/*
+ * Rebuild the port-sorted index after a plain port I/O handler has been
+ * added or moved.  Lookups racing with this may miss in the index, and then
+ * fall back to polling.
+ */
+static void hvm_sort_portio_handlers(struct domain *d)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    uint8_t sorted[NR_IO_HANDLERS];
+    unsigned int i, j, n = 0;
+    unsigned int count = min_t(unsigned int, hd->io_handler_count,
+                               NR_IO_HANDLERS);
+
+    for ( i = 0; i < count; i++ )
+    {
+        unsigned int port = hd->io_handler[i].portio.port;
+
+        if ( hd->io_handler[i].ops != &portio_ops )
+            continue;
+
+        for ( j = n; j && hd->io_handler[sorted[j - 1]].portio.port > port;
+              j-- )
+            sorted[j] = sorted[j - 1];
+        sorted[j] = i;
+        n++;
+    }
+
+    memcpy(hd->portio_sorted, sorted, n);
+    smp_wmb();
+    hd->portio_sorted_count = n;
+}
+
+/*
+ * Find the handler for an access: first try the handler this vCPU last hit
+ * with the same type of access, then (for port I/O) search the plain port
+ * ranges, and only then poll every handler's accept() in turn.  The first
+ * two only suggest a handler, which must still accept the access, so they
+ * can't misroute it; they do rely on handlers not overlapping, which
+ * internal ones don't.
+ */
+static struct hvm_io_handler *hvm_find_io_handler(const ioreq_t *p)
+{
+    struct vcpu *curr = current;
+    struct hvm_domain *hd = &curr->domain->arch.hvm_domain;
+    unsigned int *hint = &curr->arch.hvm_vcpu.hvm_io.io_handler_hint[p->type];
+    unsigned int i, count = min_t(unsigned int, hd->io_handler_count,
+                                  NR_IO_HANDLERS);
+    struct hvm_io_handler *handler;
 
     BUG_ON((p->type != IOREQ_TYPE_PIO) &&
            (p->type != IOREQ_TYPE_COPY));
 
-    for ( i = 0; i < curr_d->arch.hvm_domain.io_handler_count; i++ )
+    if ( *hint < count )
+    {
+        handler = &hd->io_handler[*hint];
+        if ( handler->type == p->type && handler->ops->accept(handler, p) )
+        {
+            perfc_incr(hvm_io_hint);
+            return handler;
+        }
+    }
+
+    if ( p->type == IOREQ_TYPE_PIO &&
+         (handler = hvm_find_portio_handler(hd, p)) != NULL )
+    {
+        perfc_incr(hvm_io_sorted);
+        goto found;
+    }
+
+    for ( i = 0; i < count; i++ )
     {
-        const struct hvm_io_handler *handler =
-            &curr_d->arch.hvm_domain.io_handler[i];
-        const struct hvm_io_ops *ops = handler->ops;
+        handler = &hd->io_handler[i];
 
         if ( handler->type != p->type )
             continue;
 
-        if ( ops->accept(handler, p) )
-            return handler;
+        if ( handler->ops->accept(handler, p) )
+        {
+            perfc_incr(hvm_io_poll);
+            goto found;
+        }
     }
 
     return NULL;
+
+ found:
+    *hint = handler - hd->io_handler;
+    return handler;
 }
 
 int hvm_io_intercept(ioreq_t *p)
 {
-    const struct hvm_io_handler *handler;
+    struct hvm_io_handler *handler;
     const struct hvm_io_ops *ops;
     int rc;
 
@@ -244,6 +337,8 @@ int hvm_io_intercept(ioreq_t *p)
     if ( handler == NULL )
         return X86EMUL_UNHANDLEABLE;
 
+    handler->hits++;
+
     rc = hvm_process_io_intercept(handler, p);
 
     ops = handler->ops;
@@ -294,6 +389,8 @@ void register_portio_handler(struct domain *d, unsigned int port,
     handler->portio.port = port;
     handler->portio.size = size;
     handler->portio.action = action;
+
+    hvm_sort_portio_handlers(d);
 }
 
 void relocate_portio_handler(struct domain *d, unsigned int old_port,
@@ -306,13 +403,14 @@ void relocate_portio_handler(struct domain *d, unsigned int old_port,
         struct hvm_io_handler *handler =
             &d->arch.hvm_domain.io_handler[i];
 
-        if ( handler->type != IOREQ_TYPE_PIO )
+        if ( handler->ops != &portio_ops )
             continue;
 
         if ( (handler->portio.port == old_port) &&
-             (handler->portio.size = size) )
+             (handler->portio.size == size) )
         {
             handler->portio.port = new_port;
+            hvm_sort_portio_handlers(d);
             break;
         }
     }
@@ -341,6 +439,54 @@ bool_t hvm_mmio_internal(paddr_t gpa)
     return 1;
 }
 
+static void dump_io_handlers(unsigned char key)
+{
+    struct domain *d;
+    unsigned int i, count;
+
+    printk("'%c' pressed -> dumping HVM I/O handlers\n", key);
+
+    rcu_read_lock(&domlist_read_lock);
+
+    for_each_domain ( d )
+    {
+        struct hvm_domain *hd = &d->arch.hvm_domain;
+
+        if ( !is_hvm_domain(d) || !hd->io_handler )
+            continue;
+
+        count = min_t(unsigned int, hd->io_handler_count, NR_IO_HANDLERS);
+        printk("d%d: %u handlers\n", d->domain_id, count);
+
+        for ( i = 0; i < count; i++ )
+        {
+            const struct hvm_io_handler *handler = &hd->io_handler[i];
+
+            if ( handler->ops == &portio_ops )
+                printk("  %2u: port %#x-%#x %ps: %lu hits\n", i,
+                       handler->portio.port,
+                       handler->portio.port + handler->portio.size - 1,
+                       handler->portio.action, handler->hits);
+            else if ( handler->ops == &mmio_ops )
+                printk("  %2u: mmio %ps: %lu hits\n", i,
+                       handler->mmio.ops->check, handler->hits);
+            else
+                printk("  %2u: %s %ps: %lu hits\n", i,
+                       handler->type == IOREQ_TYPE_PIO ? "port" : "mmio",
+                       handler->ops->accept, handler->hits);
+        }
+    }
+
+    rcu_read_unlock(&domlist_read_lock);
+}
+
+static int __init dump_io_handlers_key_init(void)
+{
+    register_keyhandler('j', dump_io_handlers, "dump HVM I/O handler hits", 1);
+    return 0;
+}
+__initcall(dump_io_handlers_key_init);
+
 /*
  * Local variables:
  * mode: C
@@ -91,7 +91,7 @@ bool hvm_emulate_one_insn(hvm_emulate_validate_t *validate, const char *descr)
     if ( hvm_vcpu_io_need_completion(vio) || vio->mmio_retry )
         vio->io_completion = HVMIO_mmio_completion;
     else
-        vio->mmio_access = (struct npfec){};
+        hvm_vcpu_io_flush_xlat(vio);
 
     switch ( rc )
     {
@@ -114,11 +114,14 @@ bool handle_mmio_with_translation(unsigned long gla, unsigned long gpfn,
 {
     struct hvm_vcpu_io *vio = &current->arch.hvm_vcpu.hvm_io;
 
-    vio->mmio_access = access.gla_valid &&
-                       access.kind == npfec_kind_with_gla
-                       ? access : (struct npfec){};
-    vio->mmio_gla = gla & PAGE_MASK;
-    vio->mmio_gpfn = gpfn;
+    hvm_vcpu_io_flush_xlat(vio);
+    if ( access.gla_valid && access.kind == npfec_kind_with_gla )
+    {
+        vio->mmio_xlat[0].access = access;
+        vio->mmio_xlat[0].gla = gla & PAGE_MASK;
+        vio->mmio_xlat[0].gpfn = gpfn;
+        vio->mmio_xlat_next = 1;
+    }
     return handle_mmio();
 }
 
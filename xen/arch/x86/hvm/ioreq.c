@@ -516,6 +516,8 @@ static int hvm_ioreq_server_alloc_rangesets(struct hvm_ioreq_server *s,
                       (i == XEN_DMOP_IO_RANGE_PORT) ? "port" :
                       (i == XEN_DMOP_IO_RANGE_MEMORY) ? "memory" :
                       (i == XEN_DMOP_IO_RANGE_PCI) ? "pci" :
+                      (i == XEN_DMOP_IO_RANGE_POSTED_PORT) ? "posted port" :
+                      (i == XEN_DMOP_IO_RANGE_POSTED_MEMORY) ? "posted memory" :
                       "");
         if ( rc )
             goto fail;
@@ -617,7 +619,9 @@ static int hvm_ioreq_server_init(struct hvm_ioreq_server *s,
     if ( rc )
         return rc;
 
-    if ( bufioreq_handling == HVM_IOREQSRV_BUFIOREQ_ATOMIC )
+    if ( bufioreq_handling == HVM_IOREQSRV_BUFIOREQ_EXTENDED )
+        s->bufioreq_extended = 1;
+    if ( bufioreq_handling >= HVM_IOREQSRV_BUFIOREQ_ATOMIC )
         s->bufioreq_atomic = 1;
 
     rc = hvm_ioreq_server_setup_pages(
@@ -686,7 +690,7 @@ int hvm_create_ioreq_server(struct domain *d, domid_t domid,
     struct hvm_ioreq_server *s;
     int rc;
 
-    if ( bufioreq_handling > HVM_IOREQSRV_BUFIOREQ_ATOMIC )
+    if ( bufioreq_handling > HVM_IOREQSRV_BUFIOREQ_EXTENDED )
         return -EINVAL;
 
     rc = -ENOMEM;
@@ -838,6 +842,8 @@ int hvm_map_io_range_to_ioreq_server(struct domain *d, ioservid_t id,
             case XEN_DMOP_IO_RANGE_PORT:
             case XEN_DMOP_IO_RANGE_MEMORY:
             case XEN_DMOP_IO_RANGE_PCI:
+            case XEN_DMOP_IO_RANGE_POSTED_PORT:
+            case XEN_DMOP_IO_RANGE_POSTED_MEMORY:
                 r = s->range[type];
                 break;
 
@@ -890,6 +896,8 @@ int hvm_unmap_io_range_from_ioreq_server(struct domain *d, ioservid_t id,
             case XEN_DMOP_IO_RANGE_PORT:
             case XEN_DMOP_IO_RANGE_MEMORY:
             case XEN_DMOP_IO_RANGE_PCI:
+            case XEN_DMOP_IO_RANGE_POSTED_PORT:
+            case XEN_DMOP_IO_RANGE_POSTED_MEMORY:
                 r = s->range[type];
                 break;
 
@@ -1255,6 +1263,87 @@ struct hvm_ioreq_server *hvm_select_ioreq_server(struct domain *d,
     return d->arch.hvm_domain.default_ioreq_server;
 }
 
+/* Canonicalize read/write pointers to prevent their overflow. */
+static void hvm_bufioreq_canonicalize(union bufioreq_pointers *ptrs,
+                                      unsigned int slots)
+{
+    unsigned int tries = 0;
+
+    while ( tries++ < slots && ptrs->read_pointer >= slots )
+    {
+        union bufioreq_pointers old = *ptrs, new;
+        unsigned int n = old.read_pointer / slots;
+
+        new.read_pointer = old.read_pointer - n * slots;
+        new.write_pointer = old.write_pointer - n * slots;
+        cmpxchg(&ptrs->full, old.full, new.full);
+    }
+}
+
+/*
+ * Queue a write on a HVM_IOREQSRV_BUFIOREQ_EXTENDED ring.  Any single access
+ * fits in an entry, so failure means the ring is full (or the request is a
+ * string access) and the caller must send it synchronously instead.
+ */
+static int hvm_send_buffered_ioreq_ext(struct hvm_ioreq_server *s, ioreq_t *p)
+{
+    buffered_iopage_ext_t *pg = s->bufioreq.va;
+    buf_ioreq_ext_t bp = { .addr = p->addr,
+                           .data = p->data,
+                           .type = p->type,
+                           .size = p->size,
+                           .dir = p->dir };
+    union bufioreq_pointers ptrs;
+
+    BUILD_BUG_ON(sizeof(buffered_iopage_ext_t) > PAGE_SIZE);
+
+    if ( p->data_is_ptr || (p->count != 1) )
+        return X86EMUL_UNHANDLEABLE;
+
+    switch ( p->size )
+    {
+    case 1: case 2: case 4: case 8:
+        break;
+    default:
+        gdprintk(XENLOG_WARNING, "unexpected ioreq size: %u\n", p->size);
+        return X86EMUL_UNHANDLEABLE;
+    }
+
+    spin_lock(&s->bufioreq_lock);
+
+    if ( (pg->ptrs.write_pointer - pg->ptrs.read_pointer) >=
+         IOREQ_BUFFER_EXT_SLOT_NUM )
+    {
+        spin_unlock(&s->bufioreq_lock);
+        return X86EMUL_UNHANDLEABLE;
+    }
+
+    pg->buf_ioreq[pg->ptrs.write_pointer % IOREQ_BUFFER_EXT_SLOT_NUM] = bp;
+
+    /* Make the entry visible /before/ write_pointer. */
+    wmb();
+    pg->ptrs.write_pointer++;
+
+    hvm_bufioreq_canonicalize(&pg->ptrs, IOREQ_BUFFER_EXT_SLOT_NUM);
+
+    /*
+     * Only notify if the ring was empty: otherwise the device model has yet
+     * to see the previous notification, or is still draining and will find
+     * this entry when it re-reads write_pointer (see ioreq.h).  The barrier
+     * pairs with the one it has between updating read_pointer and that read.
+     */
+    smp_mb();
+    ptrs.full = read_u64_atomic(&pg->ptrs.full);
+    if ( ptrs.write_pointer - ptrs.read_pointer == 1 )
+        notify_via_xen_event_channel(s->domain, s->bufioreq_evtchn);
+    else
+        perfc_incr(bufioreq_notify_coalesced);
+
+    spin_unlock(&s->bufioreq_lock);
+
+    return X86EMUL_OKAY;
+}
+
 static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
 {
     struct domain *d = current->domain;
@@ -1276,6 +1365,9 @@ static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
     if ( !pg )
         return X86EMUL_UNHANDLEABLE;
 
+    if ( s->bufioreq_extended )
+        return hvm_send_buffered_ioreq_ext(s, p);
+
     /*
      * Return 0 for the cases we can't deal with:
      *  - 'addr' is only a 20-bit field, so we cannot address beyond 1MB
@@ -1329,17 +1421,8 @@ static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
     wmb();
     pg->ptrs.write_pointer += qw ? 2 : 1;
 
-    /* Canonicalize read/write pointers to prevent their overflow. */
-    while ( s->bufioreq_atomic && qw++ < IOREQ_BUFFER_SLOT_NUM &&
-            pg->ptrs.read_pointer >= IOREQ_BUFFER_SLOT_NUM )
-    {
-        union bufioreq_pointers old = pg->ptrs, new;
-        unsigned int n = old.read_pointer / IOREQ_BUFFER_SLOT_NUM;
-
-        new.read_pointer = old.read_pointer - n * IOREQ_BUFFER_SLOT_NUM;
-        new.write_pointer = old.write_pointer - n * IOREQ_BUFFER_SLOT_NUM;
-        cmpxchg(&pg->ptrs.full, old.full, new.full);
-    }
+    if ( s->bufioreq_atomic )
+        hvm_bufioreq_canonicalize(&pg->ptrs, IOREQ_BUFFER_SLOT_NUM);
 
     notify_via_xen_event_channel(d, s->bufioreq_evtchn);
     spin_unlock(&s->bufioreq_lock);
@@ -1347,6 +1430,46 @@ static int hvm_send_buffered_ioreq(struct hvm_ioreq_server *s, ioreq_t *p)
     return X86EMUL_OKAY;
 }
 
+/*
+ * Can @p, which hvm_select_ioreq_server() picked @s for, be posted to its
+ * buffered ring rather than sent synchronously?  The legacy ring format can
+ * only carry port writes, as it has 20 address bits.
+ */
+bool hvm_ioreq_server_posted(const struct hvm_ioreq_server *s,
+                             const ioreq_t *p)
+{
+    struct rangeset *r;
+    uint64_t end;
+
+    /* The default server has no ranges of its own. */
+    if ( s == s->domain->arch.hvm_domain.default_ioreq_server )
+        return false;
+
+    if ( p->dir != IOREQ_WRITE || p->data_is_ptr || (p->count != 1) ||
+         !s->bufioreq.va )
+        return false;
+
+    switch ( p->type )
+    {
+    case IOREQ_TYPE_PIO:
+        r = s->range[XEN_DMOP_IO_RANGE_POSTED_PORT];
+        break;
+
+    case IOREQ_TYPE_COPY:
+        if ( !s->bufioreq_extended )
+            return false;
+        r = s->range[XEN_DMOP_IO_RANGE_POSTED_MEMORY];
+        break;
+
+    default:
+        return false;
+    }
+
+    end = p->addr + p->size - 1;
+
+    return rangeset_contains_range(r, p->addr, end);
+}
+
 int hvm_send_ioreq(struct hvm_ioreq_server *s, ioreq_t *proto_p,
                    bool_t buffered)
 {
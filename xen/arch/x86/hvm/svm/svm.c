@@ -2122,10 +2122,11 @@ static void svm_vmexit_do_pause(struct cpu_user_regs *regs)
 
     /*
      * The guest is running a contended spinlock and we've detected it.
-     * Do something useful, like reschedule the guest
+     * Do something useful, like letting the lock holder run, if it has
+     * been preempted, and reschedule the guest.
      */
     perfc_incr(pauseloop_exits);
-    do_sched_op(SCHEDOP_yield, guest_handle_from_ptr(NULL, void));
+    vcpu_directed_yield();
 }
 
 static void
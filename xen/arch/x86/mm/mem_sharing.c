@@ -30,8 +30,18 @@
 #include <xen/rcupdate.h>
 #include <xen/guest_access.h>
 #include <xen/vm_event.h>
+#include <xen/init.h>
+#include <xen/perfc.h>
+#include <xen/softirq.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
+#include <xen/vmap.h>
+#include <xen/hvm/irq.h>
+#include <xen/hvm/save.h>
+#include <asm/hap.h>
 #include <asm/page.h>
 #include <asm/string.h>
+#include <asm/time.h>
 #include <asm/p2m.h>
 #include <asm/altp2m.h>
 #include <asm/atomic.h>
@@ -1098,9 +1108,92 @@ err_out:
  *     4.3. do not corrupt guest memory
  *     4.4. let the guest deal with it if the error propagation will reach it
  */
+
+/* Number of adjacent gfns unshared together on a guest write. */
+static unsigned int __read_mostly opt_unshare_batch = 1;
+integer_param("mem_sharing_unshare_batch", opt_unshare_batch);
+
+/*
+ * Gfn the guest running here last had unshared, for unshare batching. The
+ * domain is only compared against, never dereferenced.
+ */
+struct unshare_batch {
+    const struct domain *d;
+    unsigned long gfn;
+};
+static DEFINE_PER_CPU(struct unshare_batch, unshare_batch);
+
+/*
+ * Account an unshare in the per-domain statistics. Callers hold the p2m
+ * lock, which serializes the updates.
+ */
+static void unshare_account(struct domain *d, s_time_t start)
+{
+    struct hvm_domain *hd = &d->arch.hvm_domain;
+    uint64_t ns = NOW() - start;
+
+    hd->mem_sharing_unshares++;
+    hd->mem_sharing_unshare_ns += ns;
+    if ( ns > hd->mem_sharing_unshare_max_ns )
+        hd->mem_sharing_unshare_max_ns = ns;
+}
+
+/*
+ * If gfn is shared, copy the frame to a new private page for d, without
+ * holding the p2m lock: a shared frame can't be written by anyone, so a
+ * reference is all that's needed to keep its contents stable. The copy
+ * is used by __mem_sharing_unshare_page() if the gfn still maps the same
+ * frame by then; either way mem_sharing_unshare_release() must be called.
+ */
+void mem_sharing_unshare_prepare(struct domain *d, unsigned long gfn,
+                                 struct mem_sharing_precopy *pc)
+{
+    struct page_info *src, *page;
+    p2m_type_t p2mt;
+    mfn_t mfn;
+
+    pc->page = pc->src = NULL;
+    pc->start = NOW();
+
+    mfn = get_gfn_query_unlocked(d, gfn, &p2mt);
+    if ( !p2m_is_shared(p2mt) || !mfn_valid(mfn) )
+        return;
+
+    src = mfn_to_page(mfn);
+    if ( !get_page(src, dom_cow) )
+        return;
+
+    /* The copy below overwrites all of the page, so it needn't be scrubbed. */
+    page = alloc_domheap_page(d, MEMF_no_scrub);
+    if ( !page )
+    {
+        put_page(src);
+        return;
+    }
+
+    copy_domain_page(page_to_mfn(page), mfn);
+    pc->page = page;
+    pc->src = src;
+}
+
+void mem_sharing_unshare_release(struct mem_sharing_precopy *pc)
+{
+    if ( pc->page )
+    {
+        free_domheap_page(pc->page);
+        pc->page = NULL;
+    }
+    if ( pc->src )
+    {
+        put_page(pc->src);
+        pc->src = NULL;
+    }
+}
+
 int __mem_sharing_unshare_page(struct domain *d,
                              unsigned long gfn, 
-                             uint16_t flags)
+                             uint16_t flags,
+                             struct mem_sharing_precopy *pc)
 {
     p2m_type_t p2mt;
     mfn_t mfn;
@@ -1108,6 +1201,7 @@ int __mem_sharing_unshare_page(struct domain *d,
     void *s, *t;
     int last_gfn;
     gfn_info_t *gfn_info = NULL;
+    s_time_t start = pc ? pc->start : NOW();
    
     mfn = get_gfn(d, gfn, &p2mt);
     
@@ -1172,7 +1266,17 @@ int __mem_sharing_unshare_page(struct domain *d,
     }
 
     old_page = page;
-    page = alloc_domheap_page(d, 0);
+    if ( pc && pc->page && pc->src == old_page )
+    {
+        /* Already copied, before we took the p2m lock. */
+        page = pc->page;
+        pc->page = NULL;
+        perfc_incr(mem_sharing_unshare_precopied);
+        goto copied;
+    }
+
+    /* The copy below overwrites all of the page, so it needn't be scrubbed. */
+    page = alloc_domheap_page(d, MEMF_no_scrub);
     if ( !page ) 
     {
         /* Undo dec of nr_saved_mfns, as the retry will decrease again. */
@@ -1190,6 +1294,8 @@ int __mem_sharing_unshare_page(struct domain *d,
     unmap_domain_page(s);
     unmap_domain_page(t);
 
+ copied:
+
     BUG_ON(set_shared_p2m_entry(d, gfn, page_to_mfn(page)));
     mem_sharing_gfn_destroy(old_page, d, gfn_info);
     mem_sharing_page_unlock(old_page);
@@ -1209,11 +1315,72 @@ private_page_found:
     /* Now that the gfn<->mfn map is properly established,
      * marking dirty is feasible */
     paging_mark_dirty(d, page_to_mfn(page));
+    unshare_account(d, start);
     /* We do not need to unlock a private page */
     put_gfn(d, gfn);
     return 0;
 }
 
+void mem_sharing_unshare_batch_queue(struct domain *d, unsigned long gfn)
+{
+    struct unshare_batch *ub = &this_cpu(unshare_batch);
+
+    if ( opt_unshare_batch <= 1 || current->domain != d )
+        return;
+
+    ub->d = d;
+    ub->gfn = gfn;
+}
+
+void mem_sharing_unshare_batch(struct domain *d)
+{
+    struct unshare_batch *ub = &this_cpu(unshare_batch);
+    unsigned long start, i, gfn = ub->gfn;
+
+    if ( ub->d != d )
+        return;
+    ub->d = NULL;
+
+    /* The copies below are made without the p2m lock, like the first one. */
+    ASSERT(!p2m_locked_by_me(p2m_get_hostp2m(d)));
+
+    start = gfn & ~((unsigned long)opt_unshare_batch - 1);
+    for ( i = start; i < start + opt_unshare_batch; i++ )
+    {
+        struct mem_sharing_precopy pc;
+        int rc;
+
+        if ( i == gfn )
+            continue;
+
+        mem_sharing_unshare_prepare(d, i, &pc);
+        if ( !pc.page )
+            continue;
+        rc = __mem_sharing_unshare_page(d, i, 0, &pc);
+        mem_sharing_unshare_release(&pc);
+        if ( rc )
+            break;
+        perfc_incr(mem_sharing_unshare_batched);
+    }
+}
+
+void mem_sharing_dump_domain(const struct domain *d)
+{
+    const struct hvm_domain *hd = &d->arch.hvm_domain;
+
+    if ( !mem_sharing_enabled(d) )
+        return;
+
+    printk("    Sharing: %u shared pages, %lu unshares, "
+           "avg %"PRIu64"ns max %"PRIu64"ns\n",
+           atomic_read(&d->shr_pages), hd->mem_sharing_unshares,
+           hd->mem_sharing_unshares
+           ? hd->mem_sharing_unshare_ns / hd->mem_sharing_unshares : 0,
+           hd->mem_sharing_unshare_max_ns);
+    if ( hd->mem_sharing_parent )
+        printk("    Forked from d%d\n", hd->mem_sharing_parent->domain_id);
+}
+
 int relinquish_shared_pages(struct domain *d)
 {
     int rc = 0;
@@ -1239,7 +1406,7 @@ int relinquish_shared_pages(struct domain *d)
         {
             /* Does not fail with ENOMEM given the DESTROY flag */
             BUG_ON(__mem_sharing_unshare_page(d, gfn, 
-                    MEM_SHARING_DESTROY_GFN));
+                    MEM_SHARING_DESTROY_GFN, NULL));
             /* Clear out the p2m entry so no one else may try to
              * unshare.  Must succeed: we just read the old entry and
              * we hold the p2m lock. */
@@ -1265,6 +1432,17 @@ int relinquish_shared_pages(struct domain *d)
     }
 
     p2m_unlock(p2m);
+
+    /* A fork no longer needs its parent kept around, nor paused. */
+    if ( !rc && d->arch.hvm_domain.mem_sharing_parent )
+    {
+        struct domain *parent = d->arch.hvm_domain.mem_sharing_parent;
+
+        d->arch.hvm_domain.mem_sharing_parent = NULL;
+        domain_unpause(parent);
+        put_domain(parent);
+    }
+
     return rc;
 }
 
@@ -1319,6 +1497,381 @@ static int range_share(struct domain *d, struct domain *cd,
     return rc;
 }
 
+/** VM forking **/
+/*
+ * A fork is a domain, created by the toolstack with the same configuration
+ * as its parent, whose memory starts out as the parent's. Rather than being
+ * copied up front, the fork's physmap is filled in on first access: reads
+ * share the parent's page, writes (and pages which can't be shared) get a
+ * private copy. The parent is kept paused for as long as the fork exists,
+ * so that what the fork sees of it never changes.
+ */
+
+/*
+ * Fill the hole at @gfn in @d from @d's parent. Called from
+ * __get_gfn_type_access() with @d's p2m unlocked: both domains' gfns are
+ * only ever held together through get_two_gfns(), which orders them.
+ * Returns 0 if @gfn is no longer a hole, whoever filled it.
+ */
+int mem_sharing_fork_page(struct domain *d, gfn_t gfn, bool unsharing)
+{
+    struct domain *parent = d->arch.hvm_domain.mem_sharing_parent;
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    struct page_info *page;
+    shr_handle_t handle;
+    p2m_type_t p2mt, cp2mt;
+    mfn_t mfn, cmfn;
+    struct two_gfns tg;
+    int rc;
+
+    ASSERT(!p2m_locked_by_me(p2m));
+
+    if ( !parent )
+        return -ENOENT;
+
+    /*
+     * The parent may itself be a fork, in which case this fills it in too.
+     * Do so now, while no other p2m lock is held.
+     */
+    mfn = get_gfn(parent, gfn_x(gfn), &p2mt);
+    rc = (parent->is_dying || !mfn_valid(mfn) || !p2m_is_ram(p2mt))
+         ? -ENOENT : 0;
+    put_gfn(parent, gfn_x(gfn));
+    if ( rc )
+        return rc;
+
+    if ( !unsharing &&
+         !nominate_page(parent, gfn, 0, &handle) &&
+         !mem_sharing_add_to_physmap(parent, gfn_x(gfn), handle,
+                                     d, gfn_x(gfn)) )
+    {
+        perfc_incr(mem_sharing_fork_shared);
+        return 0;
+    }
+
+    /* The copy below overwrites all of the page, so it needn't be scrubbed. */
+    page = alloc_domheap_page(d, MEMF_no_scrub);
+    if ( !page )
+        return -ENOMEM;
+
+    get_two_gfns(parent, gfn_x(gfn), &p2mt, NULL, &mfn,
+                 d, gfn_x(gfn), &cp2mt, NULL, &cmfn, 0, &tg);
+
+    if ( cp2mt != p2m_invalid && cp2mt != p2m_mmio_dm )
+        rc = 0;
+    else if ( !mfn_valid(mfn) || !p2m_is_ram(p2mt) )
+        rc = -ENOENT;
+    else
+    {
+        copy_domain_page(page_to_mfn(page), mfn);
+        rc = p2m_set_entry(p2m, gfn_x(gfn), page_to_mfn(page), PAGE_ORDER_4K,
+                           p2m_ram_rw, p2m->default_access);
+        if ( !rc )
+        {
+            set_gpfn_from_mfn(mfn_x(page_to_mfn(page)), gfn_x(gfn));
+            perfc_incr(mem_sharing_fork_copied);
+            page = NULL;
+        }
+    }
+
+    put_two_gfns(&tg);
+
+    if ( page && test_and_clear_bit(_PGC_allocated, &page->count_info) )
+        put_page(page);
+
+    return rc;
+}
+
+/* Give @cd a private copy of @d's page at @gfn, if @d has one there. */
+static int fork_copy_gfn(struct domain *cd, struct domain *d,
+                         unsigned long gfn)
+{
+    struct page_info *page, *cpage;
+    p2m_type_t p2mt;
+
+    page = get_page_from_gfn(d, gfn, &p2mt, P2M_ALLOC);
+    if ( !page )
+        return 0;
+
+    cpage = get_page_from_gfn(cd, gfn, &p2mt, P2M_UNSHARE);
+    if ( !cpage || p2m_is_shared(p2mt) )
+    {
+        if ( cpage )
+            put_page(cpage);
+        put_page(page);
+        return -ENOMEM;
+    }
+
+    copy_domain_page(page_to_mfn(cpage), page_to_mfn(page));
+
+    put_page(cpage);
+    put_page(page);
+
+    return 0;
+}
+
+static int fork_vcpu_info(struct vcpu *cv, struct vcpu *v)
+{
+    unsigned long gfn;
+    int rc;
+
+    if ( mfn_eq(v->vcpu_info_mfn, INVALID_MFN) )
+        return 0;
+
+    gfn = get_gpfn_from_mfn(mfn_x(v->vcpu_info_mfn));
+    rc = fork_copy_gfn(cv->domain, v->domain, gfn);
+    if ( rc )
+        return rc;
+
+    if ( mfn_eq(cv->vcpu_info_mfn, INVALID_MFN) )
+    {
+        rc = map_vcpu_info(cv, gfn, (unsigned long)v->vcpu_info & ~PAGE_MASK);
+        if ( rc )
+            return rc;
+    }
+
+    /* Mapping it reinitialises it from the shared info page. */
+    memcpy(cv->vcpu_info, v->vcpu_info, sizeof(vcpu_info_t));
+
+    return 0;
+}
+
+static int fork_shared_info(struct domain *cd, struct domain *d)
+{
+    mfn_t mfn = _mfn(virt_to_mfn(d->shared_info));
+    mfn_t cmfn = _mfn(virt_to_mfn(cd->shared_info));
+    unsigned long gfn = get_gpfn_from_mfn(mfn_x(mfn));
+    unsigned long cgfn = get_gpfn_from_mfn(mfn_x(cmfn));
+    int rc;
+
+    cd->arch.has_32bit_shinfo = d->arch.has_32bit_shinfo;
+    copy_domain_page(cmfn, mfn);
+
+    if ( gfn == cgfn )
+        return 0;
+
+    if ( VALID_M2P(cgfn) )
+    {
+        rc = guest_physmap_remove_page(cd, _gfn(cgfn), cmfn, 0);
+        if ( rc )
+            return rc;
+    }
+
+    return VALID_M2P(gfn) ? guest_physmap_add_page(cd, _gfn(gfn), cmfn, 0)
+                          : 0;
+}
+
+/*
+ * Make @cd's vCPU and platform state that of @d. Its memory is filled in
+ * lazily, except for pages which Xen or the backends access on its behalf.
+ */
+static int fork_copy_state(struct domain *cd, struct domain *d)
+{
+    static const unsigned int special_params[] = {
+        HVM_PARAM_STORE_PFN,
+        HVM_PARAM_CONSOLE_PFN,
+        HVM_PARAM_IOREQ_PFN,
+        HVM_PARAM_BUFIOREQ_PFN,
+    };
+    struct hvm_domain_context c = { 0 };
+    uint32_t tsc_mode, gtsc_khz, incarnation;
+    uint64_t elapsed_nsec;
+    struct vcpu *v;
+    unsigned int i;
+    int rc;
+
+    for ( i = 0; i < ARRAY_SIZE(special_params); i++ )
+    {
+        uint64_t gfn = d->arch.hvm_domain.params[special_params[i]];
+
+        if ( gfn && (rc = fork_copy_gfn(cd, d, gfn)) )
+            return rc;
+    }
+
+    /* vcpu_info must be mapped while the fork's vCPUs are still down. */
+    for_each_vcpu ( d, v )
+        if ( (rc = fork_vcpu_info(cd->vcpu[v->vcpu_id], v)) )
+            return rc;
+
+    if ( (rc = fork_shared_info(cd, d)) )
+        return rc;
+
+    cd->arch.hvm_domain.params[HVM_PARAM_CALLBACK_IRQ] =
+        d->arch.hvm_domain.params[HVM_PARAM_CALLBACK_IRQ];
+    hvm_set_callback_via(cd, cd->arch.hvm_domain.params[HVM_PARAM_CALLBACK_IRQ]);
+
+    tsc_get_info(d, &tsc_mode, &elapsed_nsec, &gtsc_khz, &incarnation);
+    tsc_set_info(cd, tsc_mode, elapsed_nsec, gtsc_khz, incarnation);
+
+    c.size = hvm_save_size(d);
+    if ( (c.data = xmalloc_bytes(c.size)) == NULL )
+        return -ENOMEM;
+
+    rc = hvm_save(d, &c);
+    if ( !rc )
+    {
+        c.cur = 0;
+        rc = hvm_load(cd, &c);
+    }
+
+    xfree(c.data);
+
+    return rc;
+}
+
+/* Remove the private pages from a fork's physmap and free them. */
+static int fork_drop_pages(struct domain *cd, bool preemptible)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(cd);
+    struct page_info *pages[32], *page;
+    unsigned long gfns[ARRAY_SIZE(pages)];
+    unsigned int i, n;
+    int rc = 0;
+
+    p2m_lock(p2m);
+
+    do {
+        n = 0;
+
+        /*
+         * Only pages with no references other than the allocation one, which
+         * excludes those mapped by Xen (vcpu_info) or by backends.
+         */
+        spin_lock(&cd->page_alloc_lock);
+        page_list_for_each ( page, &cd->page_list )
+        {
+            unsigned long gfn = get_gpfn_from_mfn(mfn_x(page_to_mfn(page)));
+            p2m_access_t a;
+            p2m_type_t t;
+
+            if ( !VALID_M2P(gfn) ||
+                 (page->count_info & (PGC_count_mask | PGC_allocated)) !=
+                 (1 | PGC_allocated) ||
+                 (page->u.inuse.type_info & PGT_count_mask) )
+                continue;
+
+            if ( !mfn_eq(p2m->get_entry(p2m, gfn, &t, &a, 0, NULL, NULL),
+                         page_to_mfn(page)) ||
+                 t != p2m_ram_rw || !get_page(page, cd) )
+                continue;
+
+            pages[n] = page;
+            gfns[n] = gfn;
+            if ( ++n == ARRAY_SIZE(pages) )
+                break;
+        }
+        spin_unlock(&cd->page_alloc_lock);
+
+        for ( i = 0; i < n; i++ )
+        {
+            page = pages[i];
+
+            if ( !rc )
+                rc = p2m_set_entry(p2m, gfns[i], INVALID_MFN, PAGE_ORDER_4K,
+                                   p2m_invalid, p2m->default_access);
+            if ( !rc )
+            {
+                set_gpfn_from_mfn(mfn_x(page_to_mfn(page)),
+                                  INVALID_M2P_ENTRY);
+                if ( test_and_clear_bit(_PGC_allocated, &page->count_info) )
+                    put_page(page);
+                perfc_incr(mem_sharing_fork_reset_pages);
+            }
+            put_page(page);
+        }
+
+        if ( preemptible && n == ARRAY_SIZE(pages) && !rc &&
+             hypercall_preempt_check() )
+            rc = -ERESTART;
+    } while ( n == ARRAY_SIZE(pages) && !rc );
+
+    p2m_unlock(p2m);
+
+    return rc;
+}
+
+static int mem_sharing_fork(struct domain *cd, struct domain *d)
+{
+    unsigned int i, pages;
+    bool preempted = false, enabled, cenabled;
+    struct vcpu *v;
+    int rc;
+
+    if ( cd == d || cd->arch.hvm_domain.mem_sharing_parent )
+        return -EEXIST;
+
+    /* The toolstack keeps the fork paused until it is fully set up. */
+    if ( !cd->controller_pause_count || cd->tot_pages )
+        return -EBUSY;
+
+    if ( cd->max_vcpus != d->max_vcpus || need_iommu(cd) || need_iommu(d) )
+        return -EINVAL;
+
+    for ( i = 0; i < cd->max_vcpus; i++ )
+        if ( !cd->vcpu[i] != !d->vcpu[i] )
+            return -EINVAL;
+
+    /* The fork will need as much for its p2m as the parent has. */
+    pages = d->arch.paging.hap.total_pages + d->arch.paging.hap.p2m_pages;
+    paging_lock(cd);
+    if ( cd->arch.paging.hap.total_pages + cd->arch.paging.hap.p2m_pages <
+         pages )
+        rc = hap_set_allocation(cd, pages, &preempted);
+    else
+        rc = 0;
+    paging_unlock(cd);
+    if ( preempted )
+        return -ERESTART;
+    if ( rc )
+        return rc;
+
+    if ( !get_domain(d) )
+        return -EINVAL;
+    domain_pause(d);
+
+    enabled = d->arch.hvm_domain.mem_sharing_enabled;
+    cenabled = cd->arch.hvm_domain.mem_sharing_enabled;
+    d->arch.hvm_domain.mem_sharing_enabled = 1;
+    cd->arch.hvm_domain.mem_sharing_enabled = 1;
+    cd->arch.hvm_domain.mem_sharing_parent = d;
+    cd->max_pages = d->max_pages;
+
+    rc = fork_copy_state(cd, d);
+    if ( rc )
+    {
+        /* Leave both domains as they were, so that forking can be retried. */
+        cd->arch.hvm_domain.mem_sharing_parent = NULL;
+        for_each_vcpu ( cd, v )
+            unmap_vcpu_info(v);
+        fork_drop_pages(cd, false);
+        cd->arch.hvm_domain.mem_sharing_enabled = cenabled;
+        d->arch.hvm_domain.mem_sharing_enabled = enabled;
+        domain_unpause(d);
+        put_domain(d);
+        return rc;
+    }
+
+    perfc_incr(mem_sharing_fork);
+
+    return 0;
+}
+
+/*
+ * Throw away the pages a fork has written to, and reload its state from the
+ * parent, so that it starts over from where it was forked.
+ */
+static int mem_sharing_fork_reset(struct domain *cd)
+{
+    struct domain *d = cd->arch.hvm_domain.mem_sharing_parent;
+
+    if ( !d )
+        return -EINVAL;
+    if ( !cd->controller_pause_count )
+        return -EBUSY;
+
+    return fork_drop_pages(cd, true) ?: fork_copy_state(cd, d);
+}
+
 int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
 {
     int rc;
@@ -1342,7 +1895,12 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
 
     /* Only HAP is supported */
     rc = -ENODEV;
-    if ( !hap_enabled(d) || !d->arch.hvm_domain.mem_sharing_enabled )
+    if ( !hap_enabled(d) )
+        goto out;
+
+    /* Forking turns sharing on for both domains, everything else needs it. */
+    if ( mso.op != XENMEM_sharing_op_fork &&
+         !d->arch.hvm_domain.mem_sharing_enabled )
         goto out;
 
     switch ( mso.op )
@@ -1585,6 +2143,41 @@ int mem_sharing_memop(XEN_GUEST_HANDLE_PARAM(xen_mem_sharing_op_t) arg)
         }
         break;
 
+        case XENMEM_sharing_op_fork:
+        {
+            struct domain *pd;
+
+            rc = -EINVAL;
+            if ( mso.u.fork._pad[0] || mso.u.fork._pad[1] ||
+                 mso.u.fork._pad[2] )
+                goto out;
+
+            rc = rcu_lock_live_remote_domain_by_id(mso.u.fork.parent_domain,
+                                                   &pd);
+            if ( rc )
+                goto out;
+
+            rc = xsm_mem_sharing_op(XSM_DM_PRIV, pd, d, mso.op);
+            if ( !rc )
+                rc = hap_enabled(pd) ? mem_sharing_fork(d, pd) : -ENODEV;
+
+            rcu_unlock_domain(pd);
+
+            if ( rc == -ERESTART )
+                rc = hypercall_create_continuation(__HYPERVISOR_memory_op,
+                                                   "lh", XENMEM_sharing_op,
+                                                   arg);
+        }
+        break;
+
+        case XENMEM_sharing_op_fork_reset:
+            rc = mem_sharing_fork_reset(d);
+            if ( rc == -ERESTART )
+                rc = hypercall_create_continuation(__HYPERVISOR_memory_op,
+                                                   "lh", XENMEM_sharing_op,
+                                                   arg);
+            break;
+
         case XENMEM_sharing_op_debug_gfn:
             rc = debug_gfn(d, _gfn(mso.u.debug.u.gfn));
             break;
@@ -1633,9 +2226,286 @@ int mem_sharing_domctl(struct domain *d, xen_domctl_mem_sharing_op_t *mec)
     return rc;
 }
 
+/** Deduplication scanner **/
+/*
+ * When enabled, guests with sharing enabled are scanned in background for
+ * pages with identical contents, which are then shared, with no need for a
+ * toolstack agent to tell us what to nominate. Each page is hashed and looked
+ * up in a table of candidates, indexed by the hash, which remembers the last
+ * page seen with a given hash. On a hit, contents are compared once before
+ * nominating both pages (so that hash collisions and stale candidates don't
+ * make pages read-only for nothing) and once more after, when the guests
+ * can no longer write to them, before the two are actually shared.
+ *
+ * Passes over a domain which don't find anything make the scanner back off,
+ * up to SCAN_PERIOD_MAX between runs; finding something brings it back to
+ * running every SCAN_PERIOD_MIN.
+ */
+static bool __read_mostly opt_mem_sharing_scan;
+boolean_param("mem_sharing_scan", opt_mem_sharing_scan);
+
+/* Maximum number of pages scanned per second. */
+static unsigned int __read_mostly opt_mem_sharing_scan_rate = 8192;
+integer_param("mem_sharing_scan_rate", opt_mem_sharing_scan_rate);
+
+#define SCAN_PERIOD_MIN         MILLISECS(100)
+#define SCAN_PERIOD_MAX         SECONDS(10)
+#define SCAN_TABLE_ORDER        15
+
+struct scan_candidate {
+    uint64_t hash;
+    unsigned long gfn;
+    domid_t domid;
+};
+
+static struct scan_candidate *scan_table;
+static s_time_t scan_period = SCAN_PERIOD_MIN;
+static struct timer scan_timer;
+static void scan_work(unsigned long unused);
+static DECLARE_TASKLET(scan_tasklet, scan_work, 0);
+
+static inline uint64_t scan_rol64(uint64_t x, unsigned int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+/*
+ * Hash a page 32 bytes at a time, with four independent accumulators so
+ * that the multiplications can overlap (the same structure as xxHash64).
+ */
+static uint64_t hash_page(const void *p)
+{
+    static const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    static const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+    const uint64_t *w = p;
+    uint64_t h0 = prime1 + prime2, h1 = prime2, h2 = 0, h3 = -prime1;
+    unsigned int i;
+
+    for ( i = 0; i < PAGE_SIZE / sizeof(*w); i += 4 )
+    {
+        h0 = scan_rol64(h0 + w[i + 0] * prime2, 31) * prime1;
+        h1 = scan_rol64(h1 + w[i + 1] * prime2, 31) * prime1;
+        h2 = scan_rol64(h2 + w[i + 2] * prime2, 31) * prime1;
+        h3 = scan_rol64(h3 + w[i + 3] * prime2, 31) * prime1;
+    }
+
+    h0 = scan_rol64(h0, 1) + scan_rol64(h1, 7) + scan_rol64(h2, 12) +
+         scan_rol64(h3, 18);
+    h0 ^= h0 >> 33;
+    h0 *= prime2;
+    h0 ^= h0 >> 29;
+
+    return h0;
+}
+
+static struct page_info *scan_get_page(struct domain *d, unsigned long gfn)
+{
+    struct page_info *pg;
+    p2m_type_t t;
+
+    pg = get_page_from_gfn(d, gfn, &t, 0);
+    if ( pg && !p2m_is_sharable(t) && !p2m_is_shared(t) )
+    {
+        put_page(pg);
+        pg = NULL;
+    }
+
+    return pg;
+}
+
+/*
+ * Check whether two guest frames are distinct but have the same contents;
+ * false if either went away.
+ */
+static bool scan_same(struct domain *sd, unsigned long sgfn,
+                      struct domain *cd, unsigned long cgfn)
+{
+    struct page_info *spg, *cpg;
+    void *s, *c;
+    bool same;
+
+    if ( (spg = scan_get_page(sd, sgfn)) == NULL )
+        return false;
+    if ( (cpg = scan_get_page(cd, cgfn)) == NULL )
+    {
+        put_page(spg);
+        return false;
+    }
+
+    same = spg != cpg;
+    if ( same )
+    {
+        s = __map_domain_page(spg);
+        c = __map_domain_page(cpg);
+        same = !memcmp(s, c, PAGE_SIZE);
+        unmap_domain_page(c);
+        unmap_domain_page(s);
+    }
+
+    put_page(cpg);
+    put_page(spg);
+
+    return same;
+}
+
+/* Try and share (cd, cgfn) with the candidate; return whether it worked. */
+static bool scan_merge(struct scan_candidate *e, struct domain *cd,
+                       unsigned long cgfn)
+{
+    struct domain *sd;
+    shr_handle_t sh, ch;
+    bool merged = false;
+
+    sd = rcu_lock_domain_by_id(e->domid);
+    if ( !sd )
+        return false;
+
+    if ( mem_sharing_enabled(sd) && !sd->is_dying &&
+         scan_same(sd, e->gfn, cd, cgfn) &&
+         !nominate_page(sd, _gfn(e->gfn), 0, &sh) &&
+         !nominate_page(cd, _gfn(cgfn), 0, &ch) &&
+         /* Neither guest can write to the pages any longer. */
+         scan_same(sd, e->gfn, cd, cgfn) &&
+         !share_pages(sd, _gfn(e->gfn), sh, cd, _gfn(cgfn), ch) )
+        merged = true;
+    else
+        perfc_incr(mem_sharing_scan_mismatch);
+
+    rcu_unlock_domain(sd);
+
+    return merged;
+}
+
+/* Scan up to budget pages of d; return how many were shared. */
+static unsigned long scan_domain(struct domain *d, unsigned long budget)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long *next = &d->arch.hvm_domain.mem_sharing_scan_gfn;
+    unsigned long merged = 0;
+
+    while ( budget-- )
+    {
+        unsigned long gfn = (*next)++;
+        struct scan_candidate *e;
+        struct page_info *pg;
+        uint64_t hash;
+        void *p;
+
+        if ( gfn > p2m->max_mapped_pfn )
+        {
+            *next = 0;
+            break;
+        }
+
+        if ( (pg = scan_get_page(d, gfn)) == NULL )
+            continue;
+        p = __map_domain_page(pg);
+        hash = hash_page(p);
+        unmap_domain_page(p);
+        put_page(pg);
+        perfc_incr(mem_sharing_scan_pages);
+
+        e = &scan_table[hash & ((1UL << SCAN_TABLE_ORDER) - 1)];
+        if ( e->hash == hash && e->domid != DOMID_INVALID &&
+             (e->domid != d->domain_id || e->gfn != gfn) &&
+             scan_merge(e, d, gfn) )
+        {
+            perfc_incr(mem_sharing_scan_merged);
+            merged++;
+            continue;
+        }
+
+        e->hash = hash;
+        e->gfn = gfn;
+        e->domid = d->domain_id;
+
+        if ( !(budget & 0xff) )
+            process_pending_softirqs();
+    }
+
+    return merged;
+}
+
+static bool domain_scannable(const struct domain *d)
+{
+    return mem_sharing_enabled(d) && !d->is_dying &&
+           !d->controller_pause_count;
+}
+
+static void scan_work(unsigned long unused)
+{
+    unsigned long budget = (unsigned long)opt_mem_sharing_scan_rate *
+                           SCAN_PERIOD_MIN / SECONDS(1);
+    unsigned long merged = 0;
+    unsigned int nr = 0;
+    struct domain *d;
+
+    rcu_read_lock(&domlist_read_lock);
+
+    for_each_domain ( d )
+        if ( domain_scannable(d) )
+            nr++;
+
+    /* Share the budget evenly, so that each guest makes progress. */
+    for_each_domain ( d )
+    {
+        if ( !nr || !domain_scannable(d) || !get_domain(d) )
+            continue;
+
+        merged += scan_domain(d, budget / nr ?: 1);
+
+        put_domain(d);
+        process_pending_softirqs();
+    }
+
+    rcu_read_unlock(&domlist_read_lock);
+
+    if ( merged )
+        scan_period = SCAN_PERIOD_MIN;
+    else
+        scan_period = min(scan_period * 2, SCAN_PERIOD_MAX);
+
+    set_timer(&scan_timer, NOW() + scan_period);
+}
+
+static void scan_timer_fn(void *unused)
+{
+    tasklet_schedule(&scan_tasklet);
+}
+
+static int __init mem_sharing_scan_init(void)
+{
+    unsigned long i;
+
+    if ( !opt_mem_sharing_scan || !opt_mem_sharing_scan_rate )
+        return 0;
+
+    scan_table = vzalloc(sizeof(*scan_table) << SCAN_TABLE_ORDER);
+    if ( !scan_table )
+        return -ENOMEM;
+    for ( i = 0; i < (1UL << SCAN_TABLE_ORDER); i++ )
+        scan_table[i].domid = DOMID_INVALID;
+
+    init_timer(&scan_timer, scan_timer_fn, NULL, 0);
+    set_timer(&scan_timer, NOW() + scan_period);
+    printk(XENLOG_INFO "Memory sharing scanner enabled, up to %u pages/s\n",
+           opt_mem_sharing_scan_rate);
+
+    return 0;
+}
+__initcall(mem_sharing_scan_init);
+
 void __init mem_sharing_init(void)
 {
     printk("Initing memory sharing.\n");
+    if ( opt_unshare_batch > 64 ||
+         (opt_unshare_batch & (opt_unshare_batch - 1)) )
+    {
+        printk(XENLOG_WARNING
+               "Invalid mem_sharing_unshare_batch %u, ignoring\n",
+               opt_unshare_batch);
+        opt_unshare_batch = 1;
+    }
 #if MEM_SHARING_AUDIT
     spin_lock_init(&shr_audit_lock);
     INIT_LIST_HEAD(&shr_audit_list);
@@ -0,0 +1,397 @@
+/******************************************************************************
+ * arch/x86/mm/numa_balance.c
+ *
+ * Move the memory of HVM guests close to where their vcpus run.
+ *
+ * Memory is placed at domain creation time, according to the domain's node
+ * affinity, but the scheduler may (and, if affinity is not strict, will)
+ * run the vcpus elsewhere, and for long periods of time. When enabled, the
+ * balancer periodically samples, for each domain, how long its vcpus ran on
+ * each node. If a node clearly dominates, it then migrates, in background
+ * and at a limited rate, the guest pages that live on other nodes there, by
+ * allocating a copy on the preferred node and updating the p2m.
+ *
+ * Only guests whose frames can be replaced (see p2m_frames_replaceable())
+ * are dealt with, and neither vNUMA ones (the guest has been told where its
+ * memory is) nor PoD ones. Pages (including superpages, which are moved as
+ * a whole) are migrated only if the guest's own reference is the only one,
+ * i.e., they're not mapped by other domains or by Xen itself, and the
+ * domain is paused while a batch is being moved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/sched.h>
+#include <xen/numa.h>
+#include <xen/nodemask.h>
+#include <xen/perfc.h>
+#include <xen/softirq.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
+#include <asm/p2m.h>
+
+#include "mm-locks.h"
+
+static bool __read_mostly opt_numa_balance;
+boolean_param("numa_balance", opt_numa_balance);
+
+/* Maximum migration rate, in MB/s. */
+static unsigned int __read_mostly opt_numa_balance_rate = 32;
+integer_param("numa_balance_rate", opt_numa_balance_rate);
+
+#define NUMA_BALANCE_PERIOD     SECONDS(1)
+/* Share of the recent runtime a node needs for becoming the preferred one. */
+#define NUMA_BALANCE_THRESHOLD  75
+/* Max pages moved with the domain paused at once (4MB). */
+#define NUMA_BALANCE_BATCH      (1UL << (PAGE_ORDER_2M + 1))
+/* Max p2m entries looked at, per page we're allowed to move. */
+#define NUMA_BALANCE_SCAN_RATIO 16
+
+struct numa_balance {
+    /* Decaying runtime of the domain's vcpus on each node. */
+    uint64_t residency[MAX_NUMNODES];
+    /* Running time of each vcpu at the last sample. */
+    s_time_t *last_running;
+    unsigned int nr_vcpus;
+
+    nodeid_t node;              /* Preferred node, or NUMA_NO_NODE */
+    unsigned long next_gfn;     /* Where the scan resumes from */
+    bool settled;               /* Full scan found nothing to move */
+
+    /* Statistics */
+    unsigned long local, remote;    /* Pages found in the last full scan */
+    unsigned long scan_local, scan_remote;
+    unsigned long migrated;         /* Pages moved to the preferred node */
+    unsigned long busy;             /* Pages which could not be moved */
+};
+
+static struct timer numa_balance_timer;
+static void numa_balance_work(unsigned long unused);
+static DECLARE_TASKLET(numa_balance_tasklet, numa_balance_work, 0);
+
+/* Frames of the range being moved; only the tasklet uses it. */
+static mfn_t balance_mfns[1UL << PAGE_ORDER_2M];
+
+static struct numa_balance *numa_balance_get(struct domain *d)
+{
+    struct numa_balance *nb = d->arch.numa_balance;
+
+    if ( nb )
+        return nb;
+
+    nb = xzalloc(struct numa_balance);
+    if ( !nb )
+        return NULL;
+    nb->last_running = xzalloc_array(s_time_t, d->max_vcpus);
+    if ( !nb->last_running )
+    {
+        xfree(nb);
+        return NULL;
+    }
+    nb->nr_vcpus = d->max_vcpus;
+    nb->node = NUMA_NO_NODE;
+    d->arch.numa_balance = nb;
+
+    return nb;
+}
+
+void numa_balance_domain_destroy(struct domain *d)
+{
+    struct numa_balance *nb = d->arch.numa_balance;
+
+    if ( !nb )
+        return;
+
+    xfree(nb->last_running);
+    xfree(nb);
+    d->arch.numa_balance = NULL;
+}
+
+/*
+ * Sample how long each vcpu ran since last time, and account it to the
+ * node of the pcpu it is on now, with older history decaying by half each
+ * period. Return the node where most of the recent runtime was spent, if
+ * that is more than NUMA_BALANCE_THRESHOLD percent of it.
+ */
+static nodeid_t sample_residency(struct domain *d, struct numa_balance *nb)
+{
+    struct vcpu *v;
+    uint64_t total = 0, max = 0;
+    nodeid_t node, best = NUMA_NO_NODE;
+
+    for_each_online_node ( node )
+        nb->residency[node] /= 2;
+
+    for_each_vcpu ( d, v )
+    {
+        struct vcpu_runstate_info runstate;
+        s_time_t delta;
+
+        if ( v->vcpu_id >= nb->nr_vcpus )
+            continue;
+
+        vcpu_runstate_get(v, &runstate);
+        delta = runstate.time[RUNSTATE_running] - nb->last_running[v->vcpu_id];
+        nb->last_running[v->vcpu_id] = runstate.time[RUNSTATE_running];
+        if ( delta > 0 )
+            nb->residency[cpu_to_node(v->processor)] += delta;
+    }
+
+    for_each_online_node ( node )
+    {
+        total += nb->residency[node];
+        if ( nb->residency[node] > max )
+        {
+            max = nb->residency[node];
+            best = node;
+        }
+    }
+
+    if ( !total || max * 100 < total * NUMA_BALANCE_THRESHOLD )
+        return NUMA_NO_NODE;
+
+    return best;
+}
+
+/*
+ * Move the (1 << order) pages mapped at gfn, which must be aligned, to
+ * node. The domain must be paused.
+ */
+static int migrate_gfn(struct domain *d, unsigned long gfn,
+                       unsigned int order, mfn_t mfn, nodeid_t node)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    struct page_info *new_pg;
+    unsigned long i;
+    unsigned int cur_order;
+    p2m_type_t t;
+    p2m_access_t a;
+    int rc = -EBUSY;
+
+    ASSERT(order <= PAGE_ORDER_2M);
+
+    new_pg = p2m_alloc_replacement(d, order,
+                                   MEMF_node(node) | MEMF_exact_node);
+    if ( !new_pg )
+        return -ENOMEM;
+
+    gfn_lock(p2m, gfn, order);
+
+    /* Re-check the mapping, now that we hold the lock. */
+    if ( mfn_eq(p2m->get_entry(p2m, gfn, &t, &a, 0, &cur_order, NULL), mfn) &&
+         t == p2m_ram_rw && cur_order >= order )
+    {
+        for ( i = 0; i < (1UL << order); i++ )
+            balance_mfns[i] = mfn_add(mfn, i);
+        rc = p2m_replace_frames(d, gfn, order, balance_mfns, new_pg, a);
+    }
+
+    gfn_unlock(p2m, gfn, order);
+
+    if ( rc )
+        free_domheap_pages(new_pg, order);
+
+    return rc;
+}
+
+/*
+ * Scan (part of) the p2m of d, looking for memory not on nb->node, and move
+ * up to budget pages there. Return how many pages were moved.
+ */
+static unsigned long balance_domain(struct domain *d, struct numa_balance *nb,
+                                    unsigned long budget)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long scan = budget * NUMA_BALANCE_SCAN_RATIO;
+    unsigned long moved = 0, batch = 0;
+    bool paused = false;
+
+    while ( scan && moved < budget )
+    {
+        unsigned long gfn = nb->next_gfn, nr, offs;
+        unsigned int order;
+        p2m_type_t t;
+        p2m_access_t a;
+        mfn_t mfn;
+        int rc;
+
+        if ( gfn > p2m->max_mapped_pfn )
+        {
+            /* Completed a pass: nothing left to do, until node changes. */
+            nb->local = nb->scan_local;
+            nb->remote = nb->scan_remote;
+            nb->settled = !nb->scan_remote;
+            nb->scan_local = nb->scan_remote = 0;
+            nb->next_gfn = 0;
+            break;
+        }
+
+        gfn_lock(p2m, gfn, 0);
+        mfn = p2m->get_entry(p2m, gfn, &t, &a, 0, &order, NULL);
+        gfn_unlock(p2m, gfn, 0);
+        scan--;
+
+        /* Deal with 1G mappings 2M at a time (the p2m splits them). */
+        order = min(order, (unsigned int)PAGE_ORDER_2M);
+        nr = 1UL << order;
+        offs = gfn & (nr - 1);
+        gfn -= offs;
+        nb->next_gfn = gfn + nr;
+
+        if ( t != p2m_ram_rw || !mfn_valid(mfn) )
+            continue;
+        mfn = _mfn(mfn_x(mfn) - offs);
+
+        if ( phys_to_nid(pfn_to_paddr(mfn_x(mfn))) == nb->node )
+        {
+            nb->scan_local += nr;
+            continue;
+        }
+
+        if ( !paused )
+        {
+            domain_pause(d);
+            paused = true;
+        }
+
+        rc = migrate_gfn(d, gfn, order, mfn, nb->node);
+        if ( rc == -ENOMEM )
+        {
+            /* The preferred node is full: try again from here next time. */
+            nb->next_gfn = gfn;
+            break;
+        }
+        if ( rc )
+        {
+            nb->busy += nr;
+            nb->scan_remote += nr;
+            perfc_add(numa_balance_busy, nr);
+        }
+        else
+        {
+            nb->migrated += nr;
+            nb->scan_local += nr;
+            moved += nr;
+            perfc_add(numa_balance_migrated, nr);
+        }
+
+        /* Don't keep the guest paused for too long, whatever the outcome. */
+        batch += nr;
+        if ( batch >= NUMA_BALANCE_BATCH )
+        {
+            domain_unpause(d);
+            paused = false;
+            batch = 0;
+            process_pending_softirqs();
+        }
+    }
+
+    if ( paused )
+        domain_unpause(d);
+
+    return moved;
+}
+
+static unsigned long numa_balance_domain(struct domain *d,
+                                         unsigned long budget)
+{
+    struct numa_balance *nb;
+    nodeid_t node;
+
+    /* vNUMA guests know where their memory is, and PoD ones are left alone. */
+    if ( d->vnuma || p2m_get_hostp2m(d)->pod.entry_count )
+        return 0;
+
+    nb = numa_balance_get(d);
+    if ( !nb )
+        return 0;
+
+    node = sample_residency(d, nb);
+    if ( node != nb->node )
+    {
+        nb->node = node;
+        nb->next_gfn = 0;
+        nb->scan_local = nb->scan_remote = 0;
+        nb->settled = false;
+    }
+
+    /* Memory may be tight on the preferred node: leave it alone. */
+    if ( node == NUMA_NO_NODE || nb->settled ||
+         avail_node_heap_pages(node) <= 2 * NUMA_BALANCE_BATCH )
+        return 0;
+
+    return balance_domain(d, nb, budget);
+}
+
+static void numa_balance_work(unsigned long unused)
+{
+    p2m_for_each_replaceable_domain((unsigned long)opt_numa_balance_rate <<
+                                    (20 - PAGE_SHIFT), numa_balance_domain);
+
+    set_timer(&numa_balance_timer, NOW() + NUMA_BALANCE_PERIOD);
+}
+
+static void numa_balance_timer_fn(void *unused)
+{
+    tasklet_schedule(&numa_balance_tasklet);
+}
+
+void numa_balance_dump_domain(const struct domain *d)
+{
+    const struct numa_balance *nb = d->arch.numa_balance;
+    uint64_t total = 0;
+    nodeid_t node;
+
+    if ( !nb )
+        return;
+
+    for_each_online_node ( node )
+        total += nb->residency[node];
+
+    printk("    Balancer: preferred node %d, %lu pages moved, %lu busy, "
+           "last scan %lu local / %lu remote\n",
+           nb->node == NUMA_NO_NODE ? -1 : nb->node, nb->migrated, nb->busy,
+           nb->local, nb->remote);
+    if ( !total )
+        return;
+    for_each_online_node ( node )
+        printk("      Node %u: %"PRIu64"%% of runtime\n",
+               node, nb->residency[node] * 100 / total);
+}
+
+static int __init numa_balance_init(void)
+{
+    if ( !opt_numa_balance || !opt_numa_balance_rate ||
+         num_online_nodes() < 2 )
+        return 0;
+
+    init_timer(&numa_balance_timer, numa_balance_timer_fn, NULL, 0);
+    set_timer(&numa_balance_timer, NOW() + NUMA_BALANCE_PERIOD);
+    printk(XENLOG_INFO "NUMA balancing enabled, up to %uMB/s\n",
+           opt_numa_balance_rate);
+
+    return 0;
+}
+__initcall(numa_balance_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
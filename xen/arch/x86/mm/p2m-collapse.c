@@ -0,0 +1,316 @@
+/******************************************************************************
+ * arch/x86/mm/p2m-collapse.c
+ *
+ * Reassemble superpage mappings in the p2m of HVM guests.
+ *
+ * Once a 2M or 1G p2m entry has been split (by ballooning, PoD reclaim,
+ * sharing, log-dirty tracking for migration, ...) nothing puts it back
+ * together, even when the whole range is later populated again, and the
+ * guest pays for it with more TLB misses for as long as it runs. When
+ * enabled, a background scan walks the p2m of each eligible guest looking
+ * for 2M ranges mapped with 4k entries which are all plain RAM:
+ *
+ *  - if the backing frames happen to be contiguous and suitably aligned,
+ *    the range is simply mapped again with a single 2M entry;
+ *  - otherwise, at a limited rate and with the domain paused, the contents
+ *    are copied to a freshly allocated 2M page which then replaces them.
+ *
+ * 1G ranges made of contiguous and aligned 2M entries are promoted in the
+ * same way, if the hardware supports 1G entries, but never copied: that
+ * would mean keeping the guest paused for far too long.
+ *
+ * All the guests whose frames can be replaced (see p2m_frames_replaceable())
+ * are dealt with.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/sched.h>
+#include <xen/numa.h>
+#include <xen/perfc.h>
+#include <xen/softirq.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
+#include <asm/p2m.h>
+#include <asm/hvm/hvm.h>
+
+#include "mm-locks.h"
+
+static bool __read_mostly opt_p2m_collapse;
+boolean_param("p2m_collapse", opt_p2m_collapse);
+
+/* Maximum rate at which guest memory is copied, in MB/s. */
+static unsigned int __read_mostly opt_p2m_collapse_rate = 16;
+integer_param("p2m_collapse_rate", opt_p2m_collapse_rate);
+
+#define P2M_COLLAPSE_PERIOD     SECONDS(1)
+/* Max pages copied with the domain paused at once (4MB). */
+#define P2M_COLLAPSE_BATCH      (1UL << (PAGE_ORDER_2M + 1))
+/* Max p2m entries looked at, per page we're allowed to copy. */
+#define P2M_COLLAPSE_SCAN_RATIO 16
+
+#define NR_2M                   (1UL << PAGE_ORDER_2M)
+
+static struct timer p2m_collapse_timer;
+static void p2m_collapse_work(unsigned long unused);
+static DECLARE_TASKLET(p2m_collapse_tasklet, p2m_collapse_work, 0);
+
+/* Backing frames of the range being looked at; only the tasklet uses it. */
+static mfn_t collapse_mfns[NR_2M];
+
+/*
+ * Check that the 2M range at gfn (aligned) is mapped by 4k RAM entries,
+ * all with the same access type, and record their frames in collapse_mfns.
+ * Return whether they are contiguous, or a negative error if the range
+ * can't be collapsed. The p2m must be locked.
+ */
+static int check_2m(struct p2m_domain *p2m, unsigned long gfn,
+                    p2m_access_t *access)
+{
+    unsigned long i;
+    unsigned int order;
+    p2m_type_t t;
+    p2m_access_t a;
+    bool contig;
+
+    for ( i = 0; i < NR_2M; i++ )
+    {
+        collapse_mfns[i] = p2m->get_entry(p2m, gfn + i, &t, &a, 0, &order,
+                                          NULL);
+        if ( t != p2m_ram_rw || !mfn_valid(collapse_mfns[i]) ||
+             (i && a != *access) || order >= PAGE_ORDER_2M )
+            return -EBUSY;
+        *access = a;
+    }
+
+    contig = !(mfn_x(collapse_mfns[0]) & (NR_2M - 1));
+    for ( i = 1; contig && i < NR_2M; i++ )
+        contig = mfn_eq(collapse_mfns[i], mfn_add(collapse_mfns[0], i));
+
+    return contig;
+}
+
+/* Map the 1G range at gfn (aligned) with a single entry, if possible. */
+static int promote_1g(struct p2m_domain *p2m, unsigned long gfn)
+{
+    unsigned long i;
+    unsigned int order;
+    p2m_type_t t;
+    p2m_access_t a, a0 = p2m_access_n;
+    mfn_t mfn, mfn0 = INVALID_MFN;
+    int rc = 0;
+
+    gfn_lock(p2m, gfn, PAGE_ORDER_1G);
+
+    for ( i = 0; i < (1UL << PAGE_ORDER_1G); i += NR_2M )
+    {
+        mfn = p2m->get_entry(p2m, gfn + i, &t, &a, 0, &order, NULL);
+        if ( !i )
+        {
+            mfn0 = mfn;
+            a0 = a;
+        }
+        if ( t != p2m_ram_rw || order != PAGE_ORDER_2M || a != a0 ||
+             !mfn_eq(mfn, mfn_add(mfn0, i)) )
+        {
+            rc = -EBUSY;
+            break;
+        }
+    }
+
+    if ( !rc && (mfn_x(mfn0) & ((1UL << PAGE_ORDER_1G) - 1)) )
+        rc = -EBUSY;
+    if ( !rc )
+        rc = p2m_set_entry(p2m, gfn, mfn0, PAGE_ORDER_1G, p2m_ram_rw, a0);
+
+    gfn_unlock(p2m, gfn, PAGE_ORDER_1G);
+
+    if ( !rc )
+        perfc_incr(p2m_collapse_promoted_1g);
+
+    return rc;
+}
+
+/*
+ * Replace the 4k pages backing the 2M range at gfn (aligned) with a single
+ * 2M page. The domain must be paused.
+ */
+static int copy_2m(struct domain *d, unsigned long gfn)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    struct page_info *new_pg;
+    p2m_access_t a;
+    int rc;
+
+    new_pg = p2m_alloc_replacement(d, PAGE_ORDER_2M,
+                                   MEMF_node(phys_to_nid(pfn_to_paddr(
+                                       mfn_x(collapse_mfns[0])))) |
+                                   MEMF_no_scrub);
+    if ( !new_pg )
+        return -ENOMEM;
+
+    gfn_lock(p2m, gfn, PAGE_ORDER_2M);
+
+    /* The p2m may have changed while it was unlocked. */
+    rc = check_2m(p2m, gfn, &a);
+    if ( rc > 0 )
+        rc = -EAGAIN;
+    else if ( !rc )
+        rc = p2m_replace_frames(d, gfn, PAGE_ORDER_2M, collapse_mfns, new_pg,
+                                a);
+
+    gfn_unlock(p2m, gfn, PAGE_ORDER_2M);
+
+    if ( rc )
+        free_domheap_pages(new_pg, PAGE_ORDER_2M);
+
+    return rc;
+}
+
+/*
+ * Scan (part of) the p2m of d, collapsing what can be, and copying up to
+ * budget pages. Return how many pages were copied.
+ */
+static unsigned long collapse_domain(struct domain *d, unsigned long budget)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long scan = budget * P2M_COLLAPSE_SCAN_RATIO;
+    unsigned long copied = 0, batch = 0;
+    bool paused = false;
+
+    while ( scan )
+    {
+        unsigned long gfn = p2m->collapse_next_gfn;
+        unsigned int order;
+        p2m_type_t t;
+        p2m_access_t a;
+        int rc;
+
+        if ( gfn > p2m->max_mapped_pfn )
+        {
+            p2m->collapse_next_gfn = 0;
+            break;
+        }
+
+        /* Try 1G first, as that's where we'll next look at 2M ranges. */
+        if ( hap_has_1gb && !(gfn & ((1UL << PAGE_ORDER_1G) - 1)) &&
+             gfn + (1UL << PAGE_ORDER_1G) - 1 <= p2m->max_mapped_pfn )
+        {
+            scan -= min(scan, 1UL << (PAGE_ORDER_1G - PAGE_ORDER_2M));
+            if ( !promote_1g(p2m, gfn) )
+            {
+                p2m->collapse_next_gfn = gfn + (1UL << PAGE_ORDER_1G);
+                continue;
+            }
+        }
+
+        gfn_lock(p2m, gfn, 0);
+        p2m->get_entry(p2m, gfn, &t, &a, 0, &order, NULL);
+        gfn_unlock(p2m, gfn, 0);
+        scan--;
+
+        if ( order >= PAGE_ORDER_2M )
+        {
+            /* Already a superpage, or a hole. */
+            p2m->collapse_next_gfn = (gfn | ((1UL << order) - 1)) + 1;
+            continue;
+        }
+        p2m->collapse_next_gfn = gfn + NR_2M;
+        if ( t != p2m_ram_rw )
+            continue;
+
+        scan -= min(scan, NR_2M);
+        gfn_lock(p2m, gfn, PAGE_ORDER_2M);
+        rc = check_2m(p2m, gfn, &a);
+        if ( rc > 0 &&
+             !p2m_set_entry(p2m, gfn, collapse_mfns[0], PAGE_ORDER_2M,
+                            p2m_ram_rw, a) )
+            perfc_incr(p2m_collapse_promoted_2m);
+        gfn_unlock(p2m, gfn, PAGE_ORDER_2M);
+
+        /* Only scattered 4k RAM pages are worth copying. */
+        if ( rc || copied + NR_2M > budget )
+            continue;
+
+        if ( !paused )
+        {
+            domain_pause(d);
+            paused = true;
+        }
+
+        rc = copy_2m(d, gfn);
+        if ( !rc )
+        {
+            copied += NR_2M;
+            batch += NR_2M;
+            perfc_incr(p2m_collapse_copied_2m);
+        }
+        else if ( rc != -ENOMEM )
+            perfc_incr(p2m_collapse_busy);
+        else
+            break;
+
+        /* Don't keep the guest paused for too long. */
+        if ( batch >= P2M_COLLAPSE_BATCH )
+        {
+            domain_unpause(d);
+            paused = false;
+            batch = 0;
+            process_pending_softirqs();
+        }
+    }
+
+    if ( paused )
+        domain_unpause(d);
+
+    return copied;
+}
+
+static void p2m_collapse_work(unsigned long unused)
+{
+    p2m_for_each_replaceable_domain((unsigned long)opt_p2m_collapse_rate <<
+                                    (20 - PAGE_SHIFT), collapse_domain);
+
+    set_timer(&p2m_collapse_timer, NOW() + P2M_COLLAPSE_PERIOD);
+}
+
+static void p2m_collapse_timer_fn(void *unused)
+{
+    tasklet_schedule(&p2m_collapse_tasklet);
+}
+
+static int __init p2m_collapse_init(void)
+{
+    if ( !opt_p2m_collapse || !hvm_enabled || !opt_p2m_collapse_rate )
+        return 0;
+
+    init_timer(&p2m_collapse_timer, p2m_collapse_timer_fn, NULL, 0);
+    set_timer(&p2m_collapse_timer, NOW() + P2M_COLLAPSE_PERIOD);
+    printk(XENLOG_INFO "p2m superpage collapsing enabled, up to %uMB/s\n",
+           opt_p2m_collapse_rate);
+
+    return 0;
+}
+__initcall(p2m_collapse_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
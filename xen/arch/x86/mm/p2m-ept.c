@@ -869,6 +869,12 @@ out:
             rc = iommu_pte_flush(d, gfn, &ept_entry->epte, order, vtd_pte_present);
         else
         {
+            /* Invalidate the IOTLB once for the whole superpage. */
+            bool_t batch = order && !this_cpu(iommu_dont_flush_iotlb);
+
+            if ( batch )
+                this_cpu(iommu_dont_flush_iotlb) = 1;
+
             if ( iommu_flags )
                 for ( i = 0; i < (1 << order); i++ )
                 {
@@ -890,6 +896,14 @@ out:
                     if ( !rc )
                         rc = ret;
                 }
+
+            if ( batch )
+            {
+                this_cpu(iommu_dont_flush_iotlb) = 0;
+                ret = iommu_iotlb_flush(d, gfn, 1u << order);
+                if ( !rc )
+                    rc = ret;
+            }
         }
     }
 
@@ -22,6 +22,11 @@
 #include <xen/iommu.h>
 #include <xen/vm_event.h>
 #include <xen/event.h>
+#include <xen/init.h>
+#include <xen/perfc.h>
+#include <xen/softirq.h>
+#include <xen/tasklet.h>
+#include <xen/timer.h>
 #include <public/vm_event.h>
 #include <asm/domain.h>
 #include <asm/page.h>
@@ -42,6 +47,8 @@
 
 #define superpage_aligned(_x)  (((_x)&(SUPERPAGE_PAGES-1))==0)
 
+static void pod_reclaim_kick(struct p2m_domain *p2m);
+
 /* Enforce lock ordering when grabbing the "external" page_alloc lock */
 static inline void lock_page_alloc(struct p2m_domain *p2m)
 {
@@ -341,6 +348,9 @@ p2m_pod_set_mem_target(struct domain *d, unsigned long target)
 
     pod_lock(p2m);
 
+    /* The guest may have given memory back: have background reclaim look. */
+    p2m->pod.reclaim_backoff = p2m->pod.reclaim_skip = 0;
+
     /* P == B: Nothing to do (unless the guest is being created). */
     populated = d->tot_pages - p2m->pod.count;
     if ( populated > 0 && p2m->pod.entry_count == 0 )
@@ -663,6 +673,22 @@ void p2m_pod_dump_data(struct domain *d)
 }
 
 
+/*
+ * Check a whole page for zeroes. ORing together a cache line's worth of words
+ * before testing keeps the loop free of data-dependent branches, which lets
+ * the compiler and the CPU go through it much faster than word by word.
+ */
+static bool pod_page_is_zero(const unsigned long *p)
+{
+    const unsigned long *end = p + PAGE_SIZE / sizeof(*p);
+
+    for ( ; p < end; p += 8 )
+        if ( p[0] | p[1] | p[2] | p[3] | p[4] | p[5] | p[6] | p[7] )
+            return false;
+
+    return true;
+}
+
 /* Search for all-zero superpages to be reclaimed as superpages for the
  * PoD cache. Must be called w/ pod lock held, must lock the superpage
  * in the p2m */
@@ -774,12 +800,8 @@ p2m_pod_zero_check_superpage(struct p2m_domain *p2m, unsigned long gfn)
     {
         map = map_domain_page(_mfn(mfn_x(mfn0) + i));
 
-        for ( j=0; j<PAGE_SIZE/sizeof(*map); j++ )
-            if( *(map+j) != 0 )
-            {
-                reset = 1;
-                break;
-            }
+        if ( !pod_page_is_zero(map) )
+            reset = 1;
 
         unmap_domain_page(map);
 
@@ -818,13 +840,15 @@ out:
     return ret;
 }
 
-static void
+/* Returns the number of pages reclaimed. */
+static unsigned int
 p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
 {
     mfn_t mfns[count];
     p2m_type_t types[count];
     unsigned long * map[count];
     struct domain *d = p2m->domain;
+    unsigned int reclaimed = 0;
 
     int i, j;
     int max_ref = 1;
@@ -891,18 +915,18 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
     /* Now check each page for real */
     for ( i=0; i < count; i++ )
     {
+        bool zero;
+
         if(!map[i])
             continue;
 
-        for ( j=0; j<PAGE_SIZE/sizeof(*map[i]); j++ )
-            if( *(map[i]+j) != 0 )
-                break;
+        zero = pod_page_is_zero(map[i]);
 
         unmap_domain_page(map[i]);
 
         /* See comment in p2m_pod_zero_check_superpage() re gnttab
          * check timing.  */
-        if ( j < PAGE_SIZE/sizeof(*map[i]) )
+        if ( !zero )
         {
             p2m_set_entry(p2m, gfns[i], mfns[i], PAGE_ORDER_4K,
                 types[i], p2m->default_access);
@@ -927,9 +951,11 @@ p2m_pod_zero_check(struct p2m_domain *p2m, unsigned long *gfns, int count)
             /* Add to cache, and account for the new p2m PoD entry */
             p2m_pod_cache_add(p2m, mfn_to_page(mfns[i]), PAGE_ORDER_4K);
             p2m->pod.entry_count++;
+            reclaimed++;
         }
     }
-    
+
+    return reclaimed;
 }
 
 #define POD_SWEEP_LIMIT 1024
@@ -948,6 +974,8 @@ p2m_pod_emergency_sweep(struct p2m_domain *p2m)
     start = p2m->pod.reclaim_single;
     limit = (start > POD_SWEEP_LIMIT) ? (start - POD_SWEEP_LIMIT) : 0;
 
+    perfc_incr(pod_emergency_sweep);
+
     /* FIXME: Figure out how to avoid superpages */
     /* NOTE: Promote to globally locking the p2m. This will get complicated
      * in a fine-grained scenario. If we lock each gfn individually we must be
@@ -985,6 +1013,33 @@ p2m_pod_emergency_sweep(struct p2m_domain *p2m)
 
 }
 
+/* Try and reclaim the recently populated page(s) at slot idx of the mrp list. */
+static void pod_mrp_reclaim(struct p2m_domain *p2m, unsigned int idx)
+{
+    struct pod_mrp_list *mrp = &p2m->pod.mrp;
+    unsigned long gfn = mrp->list[idx];
+
+    if ( gfn == gfn_x(INVALID_GFN) )
+        return;
+
+    if ( gfn & POD_LAST_SUPERPAGE )
+    {
+        gfn &= ~POD_LAST_SUPERPAGE;
+
+        if ( p2m_pod_zero_check_superpage(p2m, gfn) == 0 )
+        {
+            unsigned int x;
+
+            for ( x = 0; x < SUPERPAGE_PAGES; ++x, ++gfn )
+                p2m_pod_zero_check(p2m, &gfn, 1);
+        }
+    }
+    else
+        p2m_pod_zero_check(p2m, &gfn, 1);
+
+    mrp->list[idx] = gfn_x(INVALID_GFN);
+}
+
 static void pod_eager_reclaim(struct p2m_domain *p2m)
 {
     struct pod_mrp_list *mrp = &p2m->pod.mrp;
@@ -997,31 +1052,8 @@ static void pod_eager_reclaim(struct p2m_domain *p2m)
      * entries have been exhaused.
      */
     do
-    {
-        unsigned int idx = (mrp->idx + i++) % ARRAY_SIZE(mrp->list);
-        unsigned long gfn = mrp->list[idx];
-
-        if ( gfn != gfn_x(INVALID_GFN) )
-        {
-            if ( gfn & POD_LAST_SUPERPAGE )
-            {
-                gfn &= ~POD_LAST_SUPERPAGE;
-
-                if ( p2m_pod_zero_check_superpage(p2m, gfn) == 0 )
-                {
-                    unsigned int x;
-
-                    for ( x = 0; x < SUPERPAGE_PAGES; ++x, ++gfn )
-                        p2m_pod_zero_check(p2m, &gfn, 1);
-                }
-            }
-            else
-                p2m_pod_zero_check(p2m, &gfn, 1);
-
-            mrp->list[idx] = gfn_x(INVALID_GFN);
-        }
-
-    } while ( (p2m->pod.count == 0) && (i < ARRAY_SIZE(mrp->list)) );
+        pod_mrp_reclaim(p2m, (mrp->idx + i++) % ARRAY_SIZE(mrp->list));
+    while ( (p2m->pod.count == 0) && (i < ARRAY_SIZE(mrp->list)) );
 }
 
 static void pod_eager_record(struct p2m_domain *p2m,
@@ -1036,6 +1068,218 @@ static void pod_eager_record(struct p2m_domain *p2m,
     mrp->idx %= ARRAY_SIZE(mrp->list);
 }
 
+/*
+ * Background reclaim
+ *
+ * Left to p2m_pod_demand_populate(), reclaiming happens once the cache has
+ * run dry, with the faulting vCPU stalled and the p2m locked for as long as
+ * the sweep takes to find something, which on large guests can be a while.
+ * When enabled, the cache of guests with outstanding PoD entries is instead
+ * kept topped up to pod_reclaim_watermark pages in the background: first
+ * from the recently populated pages recorded by the fault path (a guest
+ * zeroing its memory at boot faults them in and hands them straight back),
+ * then by sweeping the p2m 2M at a time.  Unlike the emergency sweep, this
+ * doesn't shatter superpages which aren't entirely zero.  A guest whose
+ * last full sweep found nothing is left alone for exponentially longer,
+ * until a sweep finds something again or its memory target changes.
+ */
+static bool __read_mostly opt_pod_reclaim;
+boolean_param("pod_reclaim", opt_pod_reclaim);
+
+static unsigned int __read_mostly opt_pod_reclaim_watermark = 4096;
+integer_param("pod_reclaim_watermark", opt_pod_reclaim_watermark);
+
+#define POD_RECLAIM_PERIOD  MILLISECS(100)
+/* Max gfns swept per domain and run (1GB worth). */
+#define POD_RECLAIM_BUDGET  (1UL << PAGE_ORDER_1G)
+/* Max runs a domain is skipped for, after full passes reclaiming nothing. */
+#define POD_RECLAIM_BACKOFF_MAX 128
+/* Min time between two kicks from the fault path. */
+#define POD_RECLAIM_KICK_DELAY  MILLISECS(10)
+
+static struct timer pod_reclaim_timer;
+static s_time_t pod_reclaim_kicked;
+static void pod_reclaim_work(unsigned long unused);
+static DECLARE_TASKLET(pod_reclaim_tasklet, pod_reclaim_work, 0);
+
+static bool pod_reclaim_needed(const struct p2m_domain *p2m)
+{
+    return p2m->pod.entry_count > p2m->pod.count &&
+           p2m->pod.count < opt_pod_reclaim_watermark;
+}
+
+/*
+ * Called from the fault path, as the cache is drawn from, with the pod lock
+ * held. Populating happens a lot, so don't kick more often than every
+ * POD_RECLAIM_KICK_DELAY, nor for domains reclaim is backing off from.
+ */
+static void pod_reclaim_kick(struct p2m_domain *p2m)
+{
+    s_time_t now;
+
+    if ( !opt_pod_reclaim || p2m->pod.reclaim_skip ||
+         !pod_reclaim_needed(p2m) )
+        return;
+
+    now = NOW();
+    if ( now - read_atomic(&pod_reclaim_kicked) < POD_RECLAIM_KICK_DELAY )
+        return;
+    write_atomic(&pod_reclaim_kicked, now);
+
+    tasklet_schedule(&pod_reclaim_tasklet);
+}
+
+/*
+ * Sweep the 2M range ending at p2m->pod.reclaim_single.  Returns the number
+ * of gfns looked at, or 0 if there's nothing left to do for now.
+ */
+static unsigned long pod_reclaim_chunk(struct p2m_domain *p2m)
+{
+    unsigned long gfns[POD_SWEEP_STRIDE];
+    unsigned long gfn, start, end, done = 0;
+    unsigned int i, j = 0, order;
+    p2m_access_t a;
+    p2m_type_t t;
+
+    p2m_lock(p2m);
+    pod_lock(p2m);
+
+    if ( p2m->domain->is_dying || !pod_reclaim_needed(p2m) )
+        goto out;
+
+    for ( i = 0; i < ARRAY_SIZE(p2m->pod.mrp.list); i++ )
+        pod_mrp_reclaim(p2m, i);
+
+    if ( p2m->pod.reclaim_single == 0 )
+        p2m->pod.reclaim_single = p2m->pod.max_guest;
+    end = p2m->pod.reclaim_single;
+    if ( !end )
+        goto out;
+    start = end & ~(SUPERPAGE_PAGES - 1);
+
+    p2m->get_entry(p2m, start, &t, &a, 0, &order, NULL);
+    if ( order >= PAGE_ORDER_2M )
+    {
+        if ( p2m_is_ram(t) && end - start == SUPERPAGE_PAGES - 1 &&
+             p2m_pod_zero_check_superpage(p2m, start) )
+        {
+            p2m->pod.reclaim_found += SUPERPAGE_PAGES;
+            perfc_add(pod_reclaim_pages, SUPERPAGE_PAGES);
+        }
+    }
+    else
+    {
+        for ( gfn = end; ; gfn-- )
+        {
+            p2m->get_entry(p2m, gfn, &t, &a, 0, NULL, NULL);
+            if ( p2m_is_ram(t) )
+                gfns[j++] = gfn;
+            if ( j == POD_SWEEP_STRIDE || (gfn == start && j) )
+            {
+                unsigned int reclaimed = p2m_pod_zero_check(p2m, gfns, j);
+
+                p2m->pod.reclaim_found += reclaimed;
+                perfc_add(pod_reclaim_pages, reclaimed);
+                j = 0;
+            }
+            if ( gfn == start )
+                break;
+        }
+    }
+
+    /* Having got to the bottom, start again from the top on the next run. */
+    p2m->pod.reclaim_single = start ? start - 1 : 0;
+    done = start ? end - start + 1 : 0;
+
+    /*
+     * If the whole pass found nothing, what's left is most likely all in
+     * use: back off exponentially, rather than sweeping it again and again.
+     */
+    if ( !start )
+    {
+        if ( p2m->pod.reclaim_found )
+            p2m->pod.reclaim_backoff = 0;
+        else
+            p2m->pod.reclaim_backoff =
+                min(p2m->pod.reclaim_backoff * 2 ?: 1,
+                    (unsigned int)POD_RECLAIM_BACKOFF_MAX);
+        p2m->pod.reclaim_skip = p2m->pod.reclaim_backoff;
+        p2m->pod.reclaim_found = 0;
+    }
+
+ out:
+    pod_unlock(p2m);
+    p2m_unlock(p2m);
+
+    return done;
+}
+
+static void pod_reclaim_domain(struct domain *d)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long budget = POD_RECLAIM_BUDGET, done;
+    bool skip;
+
+    pod_lock(p2m);
+    skip = p2m->pod.reclaim_skip;
+    if ( skip )
+        p2m->pod.reclaim_skip--;
+    pod_unlock(p2m);
+    if ( skip )
+        return;
+
+    while ( budget && (done = pod_reclaim_chunk(p2m)) != 0 )
+    {
+        budget -= min(budget, done);
+        process_pending_softirqs();
+    }
+}
+
+static void pod_reclaim_work(unsigned long unused)
+{
+    struct domain *d;
+
+    rcu_read_lock(&domlist_read_lock);
+
+    for_each_domain ( d )
+    {
+        if ( !is_hvm_domain(d) || d->is_dying ||
+             !pod_reclaim_needed(p2m_get_hostp2m(d)) || !get_domain(d) )
+            continue;
+
+        pod_reclaim_domain(d);
+
+        put_domain(d);
+        process_pending_softirqs();
+    }
+
+    rcu_read_unlock(&domlist_read_lock);
+
+    set_timer(&pod_reclaim_timer, NOW() + POD_RECLAIM_PERIOD);
+}
+
+static void pod_reclaim_timer_fn(void *unused)
+{
+    tasklet_schedule(&pod_reclaim_tasklet);
+}
+
+static int __init pod_reclaim_init(void)
+{
+    if ( !opt_pod_reclaim || !hvm_enabled || !opt_pod_reclaim_watermark )
+    {
+        opt_pod_reclaim = false;
+        return 0;
+    }
+
+    init_timer(&pod_reclaim_timer, pod_reclaim_timer_fn, NULL, 0);
+    set_timer(&pod_reclaim_timer, NOW() + POD_RECLAIM_PERIOD);
+    printk(XENLOG_INFO "PoD background reclaim enabled, watermark %u pages\n",
+           opt_pod_reclaim_watermark);
+
+    return 0;
+}
+__initcall(pod_reclaim_init);
+
 int
 p2m_pod_demand_populate(struct p2m_domain *p2m, unsigned long gfn,
                         unsigned int order,
@@ -1117,6 +1361,7 @@ p2m_pod_demand_populate(struct p2m_domain *p2m, unsigned long gfn,
     BUG_ON(p2m->pod.entry_count < 0);
 
     pod_eager_record(p2m, gfn_aligned, order);
+    pod_reclaim_kick(p2m);
 
     if ( tb_init_done )
     {
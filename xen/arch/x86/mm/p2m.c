@@ -27,6 +27,8 @@
 #include <xen/iommu.h>
 #include <xen/vm_event.h>
 #include <xen/event.h>
+#include <xen/softirq.h>
+#include <xen/domain_page.h>
 #include <public/vm_event.h>
 #include <asm/domain.h>
 #include <asm/page.h>
@@ -44,7 +46,14 @@
 
 /* Turn on/off host superpage page table support for hap, default on. */
 bool_t __initdata opt_hap_1gb = 1, __initdata opt_hap_2mb = 1;
-boolean_param("hap_1gb", opt_hap_1gb);
+/* Whether hap_1gb was given, so that nothing else may turn it off. */
+bool_t __initdata opt_hap_1gb_set;
+static void __init parse_hap_1gb(const char *s)
+{
+    opt_hap_1gb = !!parse_bool(s);
+    opt_hap_1gb_set = 1;
+}
+custom_param("hap_1gb", parse_hap_1gb);
 boolean_param("hap_2mb", opt_hap_2mb);
 
 /* Override macros from asm/page.h to make them work with mfn_t */
@@ -419,6 +428,8 @@ mfn_t __get_gfn_type_access(struct p2m_domain *p2m, unsigned long gfn,
                     p2m_type_t *t, p2m_access_t *a, p2m_query_t q,
                     unsigned int *page_order, bool_t locked)
 {
+    struct mem_sharing_precopy pc = { NULL };
+    bool fork_fill;
     mfn_t mfn;
 
     /* Unshare makes no sense withuot populate. */
@@ -433,22 +444,60 @@ mfn_t __get_gfn_type_access(struct p2m_domain *p2m, unsigned long gfn,
         return _mfn(gfn);
     }
 
+    /*
+     * Should this turn out to need unsharing, do the copy now, so that other
+     * vcpus faulting on the p2m lock don't have to wait for it.
+     */
+    if ( (q & P2M_UNSHARE) && locked && p2m_is_hostp2m(p2m) &&
+         p2m->domain->arch.hvm_domain.mem_sharing_enabled &&
+         !p2m_locked_by_me(p2m) )
+        mem_sharing_unshare_prepare(p2m->domain, gfn, &pc);
+
+    /*
+     * A fork's memory is filled in from its parent on first access. That
+     * needs the parent's p2m lock, which mustn't be taken with ours held, so
+     * it can't be done by lookups nested inside a locked p2m: they see the
+     * hole.
+     */
+    fork_fill = (q & P2M_ALLOC) && locked && p2m_is_hostp2m(p2m) &&
+                p2m->domain->arch.hvm_domain.mem_sharing_parent &&
+                !p2m_locked_by_me(p2m);
+
     if ( locked )
         /* Grab the lock here, don't release until put_gfn */
         gfn_lock(p2m, gfn, 0);
 
     mfn = p2m->get_entry(p2m, gfn, t, a, q, page_order, NULL);
 
+    while ( fork_fill && (*t == p2m_invalid || *t == p2m_mmio_dm) )
+    {
+        int rc;
+
+        gfn_unlock(p2m, gfn, 0);
+        rc = mem_sharing_fork_page(p2m->domain, _gfn(gfn), q & P2M_UNSHARE);
+        gfn_lock(p2m, gfn, 0);
+
+        /* Look again: the entry may have changed while unlocked. */
+        mfn = p2m->get_entry(p2m, gfn, t, a, q, page_order, NULL);
+        if ( rc )
+            break;
+    }
+
     if ( (q & P2M_UNSHARE) && p2m_is_shared(*t) )
     {
         ASSERT(p2m_is_hostp2m(p2m));
         /* Try to unshare. If we fail, communicate ENOMEM without
          * sleeping. */
-        if ( mem_sharing_unshare_page(p2m->domain, gfn, 0) < 0 )
+        if ( mem_sharing_unshare_page_precopied(p2m->domain, gfn, &pc) < 0 )
             (void)mem_sharing_notify_enomem(p2m->domain, gfn, 0);
+        else
+            /* The guest is likely to write to the pages around, too. */
+            mem_sharing_unshare_batch_queue(p2m->domain, gfn);
         mfn = p2m->get_entry(p2m, gfn, t, a, q, page_order, NULL);
     }
 
+    mem_sharing_unshare_release(&pc);
+
     if (unlikely((p2m_is_broken(*t))))
     {
         /* Return invalid_mfn to avoid caller's access */
@@ -568,6 +617,145 @@ int p2m_set_entry(struct p2m_domain *p2m, unsigned long gfn, mfn_t mfn,
     return rc;
 }
 
+/*
+ * Replacing the frames backing guest memory with copies, for the background
+ * workers moving it around (see numa_balance.c and p2m-collapse.c).
+ *
+ * Only HAP guests whose memory nobody else may have a hold on are dealt
+ * with, i.e., no passthrough, log-dirty, paging, sharing, altp2m or nested
+ * virtualization. Callers may add their own restrictions.
+ */
+bool p2m_frames_replaceable(const struct domain *d)
+{
+    return is_hvm_domain(d) && hap_enabled(d) && !d->is_dying &&
+           !d->controller_pause_count && d->vcpu != NULL &&
+           !need_iommu(d) && !paging_mode_log_dirty(d) &&
+           !d->arch.hvm_domain.mem_sharing_enabled &&
+           !vm_event_check_ring(&d->vm_event->paging) &&
+           !altp2m_active(d) && !nestedhvm_enabled(d);
+}
+
+/*
+ * Call fn on each domain whose frames can be replaced, with what is left of
+ * budget, until it is used up. fn returns how much of the budget it used.
+ */
+void p2m_for_each_replaceable_domain(
+    unsigned long budget,
+    unsigned long (*fn)(struct domain *d, unsigned long budget))
+{
+    struct domain *d;
+
+    rcu_read_lock(&domlist_read_lock);
+
+    for_each_domain ( d )
+    {
+        if ( !budget )
+            break;
+        if ( !p2m_frames_replaceable(d) || !get_domain(d) )
+            continue;
+
+        budget -= min(budget, fn(d, budget));
+
+        put_domain(d);
+        process_pending_softirqs();
+    }
+
+    rcu_read_unlock(&domlist_read_lock);
+}
+
+/*
+ * Allocate (1 << order) pages to replace frames of d with. This is done
+ * without checking max_pages, or the domain may not be able to get them.
+ * They're accounted to it right away though, as they either replace the
+ * old ones, or go away with free_domheap_pages().
+ */
+struct page_info *p2m_alloc_replacement(struct domain *d, unsigned int order,
+                                        unsigned int memflags)
+{
+    struct page_info *pg;
+
+    pg = alloc_domheap_pages(d, order, memflags | MEMF_no_refcount);
+    if ( !pg )
+        return NULL;
+
+    spin_lock(&d->page_alloc_lock);
+    domain_adjust_tot_pages(d, 1UL << order);
+    spin_unlock(&d->page_alloc_lock);
+
+    return pg;
+}
+
+/*
+ * Replace the (1 << order) frames old[], mapped as p2m_ram_rw at gfn
+ * (aligned) in the host p2m of d, with copies in new_pg, which must come
+ * from p2m_alloc_replacement(). The gfn lock must be held, and the mapping
+ * must have been checked with it held. Frames anyone but the guest has a
+ * reference to are not replaced (-EBUSY). On success the old frames are
+ * scrubbed and freed; on failure, new_pg is still the caller's.
+ */
+int p2m_replace_frames(struct domain *d, unsigned long gfn, unsigned int order,
+                       const mfn_t *old, struct page_info *new_pg,
+                       p2m_access_t a)
+{
+    struct p2m_domain *p2m = p2m_get_hostp2m(d);
+    unsigned long i, nr = 1UL << order;
+    struct page_info *pg;
+    int rc;
+
+    ASSERT(gfn_locked_by_me(p2m, gfn));
+    ASSERT(!(gfn & (nr - 1)));
+
+    for ( i = 0; i < nr; i++ )
+    {
+        pg = mfn_to_page(old[i]);
+        if ( !get_page(pg, d) )
+            break;
+        /* The guest's reference (and ours) must be the only ones. */
+        if ( (pg->count_info & (PGC_count_mask | PGC_allocated)) !=
+             (2 | PGC_allocated) ||
+             (pg->u.inuse.type_info & PGT_count_mask) != 0 )
+        {
+            put_page(pg);
+            break;
+        }
+    }
+    if ( i < nr )
+    {
+        while ( i-- )
+            put_page(mfn_to_page(old[i]));
+        return -EBUSY;
+    }
+
+    for ( i = 0; i < nr; i++ )
+        copy_domain_page(page_to_mfn(&new_pg[i]), old[i]);
+
+    rc = p2m_set_entry(p2m, gfn, page_to_mfn(new_pg), order, p2m_ram_rw, a);
+    if ( rc )
+    {
+        for ( i = 0; i < nr; i++ )
+            put_page(mfn_to_page(old[i]));
+        return rc;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        set_gpfn_from_mfn(mfn_x(page_to_mfn(&new_pg[i])), gfn + i);
+        set_gpfn_from_mfn(mfn_x(old[i]), INVALID_M2P_ENTRY);
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        pg = mfn_to_page(old[i]);
+        /* The guest did not ask for these to go, so clean them up. */
+        scrub_one_page(pg);
+        if ( test_and_clear_bit(_PGC_allocated, &pg->count_info) )
+            put_page(pg);
+        put_page(pg);
+    }
+
+    return 0;
+}
+
 struct page_info *p2m_alloc_ptp(struct p2m_domain *p2m, unsigned long type)
 {
     struct page_info *pg;
@@ -444,6 +444,8 @@ static void dump_numa(unsigned char key)
         for_each_online_node ( i )
             printk("    Node %u: %u\n", i, page_num_node[i]);
 
+        numa_balance_dump_domain(d);
+
         if ( !read_trylock(&d->vnuma_rwlock) )
             continue;
 
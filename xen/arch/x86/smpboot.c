@@ -643,6 +643,7 @@ static void cpu_smpboot_free(unsigned int cpu)
     c[cpu].phys_proc_id = XEN_INVALID_SOCKET_ID;
     c[cpu].cpu_core_id = XEN_INVALID_CORE_ID;
     c[cpu].compute_unit_id = INVALID_CUID;
+    c[cpu].cpu_llc_id = INVALID_LLC_ID;
     cpumask_clear_cpu(cpu, &cpu_sibling_setup_map);
 
     free_cpumask_var(per_cpu(cpu_sibling_mask, cpu));
@@ -17,6 +17,8 @@ CHECK_TYPE(domid);
 
 CHECK_vmemrange;
 
+CHECK_memory_populate_range;
+
 #ifdef CONFIG_HAS_PASSTHROUGH
 struct get_reserved_device_memory {
     struct compat_reserved_device_memory_map map;
@@ -59,6 +61,10 @@ int compat_memory_op(unsigned int cmd, XEN_GUEST_HANDLE_PARAM(void) compat)
     long rc;
     unsigned int start_extent = cmd >> MEMOP_EXTENT_SHIFT;
 
+    /* Same layout for compat callers, see CHECK_memory_populate_range. */
+    if ( op == XENMEM_populate_physmap_range )
+        return do_memory_op(cmd, compat);
+
     do
     {
         unsigned int i, end_extent = 0;
@@ -25,6 +25,7 @@
 #include <xen/guest_access.h>
 #include <xen/keyhandler.h>
 #include <xen/event_fifo.h>
+#include <xen/xmem_cache.h>
 #include <asm/current.h>
 
 #include <public/xen.h>
@@ -59,6 +60,9 @@
  */
 static xen_event_channel_notification_t xen_consumers[NR_XEN_CONSUMERS];
 
+static DEFINE_XMEM_CACHE(evtchn_bucket_cache,
+                         struct evtchn[EVTCHNS_PER_BUCKET]);
+
 /* Default notification action: wake up from wait_on_xen_event_channel(). */
 static void default_xen_notification_fn(struct vcpu *v, unsigned int port)
 {
@@ -124,7 +128,7 @@ static struct evtchn *alloc_evtchn_bucket(struct domain *d, unsigned int port)
     struct evtchn *chn;
     unsigned int i;
 
-    chn = xzalloc_array(struct evtchn, EVTCHNS_PER_BUCKET);
+    chn = xmem_cache_zalloc(&evtchn_bucket_cache);
     if ( !chn )
         return NULL;
 
@@ -134,7 +138,7 @@ static struct evtchn *alloc_evtchn_bucket(struct domain *d, unsigned int port)
         {
             while ( i-- )
                 xsm_free_security_evtchn(&chn[i]);
-            xfree(chn);
+            xmem_cache_free(&evtchn_bucket_cache, chn);
             return NULL;
         }
         chn[i].port = port + i;
@@ -153,7 +157,7 @@ static void free_evtchn_bucket(struct domain *d, struct evtchn *bucket)
     for ( i = 0; i < EVTCHNS_PER_BUCKET; i++ )
         xsm_free_security_evtchn(bucket + i);
 
-    xfree(bucket);
+    xmem_cache_free(&evtchn_bucket_cache, bucket);
 }
 
 static int get_free_port(struct domain *d)
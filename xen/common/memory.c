@@ -271,6 +271,97 @@ out:
     a->nr_done = i;
 }
 
+/* Extent orders tried by populate_physmap_range(): 1GB, 2MB and 4kB. */
+static const unsigned int populate_orders[] = { 18, 9, 0 };
+
+static int populate_physmap_range(struct domain *d,
+                                  struct xen_memory_populate_range *r,
+                                  unsigned int memflags)
+{
+    struct page_info *page;
+    unsigned int i, j, order;
+    bool need_tlbflush = false, first = true;
+    uint32_t tlbflush_timestamp = 0;
+    int rc = 0;
+
+    if ( !paging_mode_translate(d) || is_domain_direct_mapped(d) )
+        return -EOPNOTSUPP;
+
+    if ( r->gpfn + r->nr_pages < r->gpfn )
+        return -EINVAL;
+
+    r->max_order = min(r->max_order, max_order(current->domain));
+
+    /* See populate_physmap(). */
+    if ( unlikely(!d->creation_finished) )
+        memflags |= MEMF_no_tlbflush | MEMF_no_icache_flush;
+
+    while ( r->nr_pages )
+    {
+        if ( !first && hypercall_preempt_check() )
+        {
+            rc = -ERESTART;
+            break;
+        }
+        first = false;
+
+        /* Largest order allowed which the range is aligned to and covers. */
+        for ( i = 0; ; i++ )
+        {
+            order = populate_orders[i];
+            if ( order <= r->max_order &&
+                 !(r->gpfn & ((1UL << order) - 1)) &&
+                 r->nr_pages >= (1UL << order) )
+                break;
+        }
+
+        while ( (page = alloc_domheap_pages(d, order, memflags)) == NULL )
+        {
+            if ( !order )
+            {
+                rc = -ENOMEM;
+                goto out;
+            }
+            /* Fragmented or exhausted: stop trying this order. */
+            order = populate_orders[++i];
+            r->max_order = order;
+        }
+
+        if ( unlikely(memflags & MEMF_no_tlbflush) )
+            for ( j = 0; j < (1U << order); j++ )
+                accumulate_tlbflush(&need_tlbflush, &page[j],
+                                    &tlbflush_timestamp);
+
+        rc = guest_physmap_add_page(d, _gfn(r->gpfn),
+                                    _mfn(page_to_mfn(page)), order);
+        if ( rc )
+        {
+            for ( j = 0; j < (1U << order); j++ )
+                if ( test_and_clear_bit(_PGC_allocated, &page[j].count_info) )
+                    put_page(&page[j]);
+            break;
+        }
+
+        r->gpfn += 1UL << order;
+        r->nr_pages -= 1UL << order;
+        switch ( order )
+        {
+        case 18: r->nr_1g++; break;
+        case 9:  r->nr_2m++; break;
+        default: r->nr_4k++; break;
+        }
+    }
+
+ out:
+    if ( need_tlbflush )
+        filtered_flush_tlb_mask(tlbflush_timestamp);
+
+    if ( memflags & MEMF_no_icache_flush )
+        invalidate_icache();
+
+    return rc;
+}
+
 int guest_remove_page(struct domain *d, unsigned long gmfn)
 {
     struct page_info *page;
@@ -1001,6 +1092,50 @@ long do_memory_op(unsigned long cmd, XEN_GUEST_HANDLE_PARAM(void) arg)
         rc = memory_exchange(guest_handle_cast(arg, xen_memory_exchange_t));
         break;
 
+    case XENMEM_populate_physmap_range:
+    {
+        struct xen_memory_populate_range range;
+
+        if ( unlikely(start_extent) )
+            return -EINVAL;
+
+        if ( copy_from_guest(&range, arg, 1) )
+            return -EFAULT;
+
+        if ( range.pad || range.pad2 ||
+             (range.mem_flags & XENMEMF_populate_on_demand) )
+            return -EINVAL;
+
+        d = rcu_lock_domain_by_any_id(range.domid);
+        if ( d == NULL )
+            return -ESRCH;
+
+        rc = xsm_memory_adjust_reservation(XSM_TARGET, curr_d, d);
+        if ( rc )
+        {
+            rcu_unlock_domain(d);
+            return rc;
+        }
+
+        memset(&reservation, 0, sizeof(reservation));
+        reservation.mem_flags = range.mem_flags;
+        args.domain = d;
+        rc = construct_memop_from_reservation(&reservation, &args);
+        if ( !rc )
+            rc = populate_physmap_range(d, &range, args.memflags);
+
+        rcu_unlock_domain(d);
+
+        if ( __copy_to_guest(arg, &range, 1) )
+            return -EFAULT;
+
+        if ( rc == -ERESTART )
+            return hypercall_create_continuation(
+                __HYPERVISOR_memory_op, "lh", op, arg);
+
+        break;
+    }
+
     case XENMEM_maximum_ram_page:
         if ( unlikely(start_extent) )
             return -EINVAL;
@@ -127,6 +127,7 @@
 #include <xen/spinlock.h>
 #include <xen/mm.h>
 #include <xen/irq.h>
+#include <xen/cpu.h>
 #include <xen/softirq.h>
 #include <xen/domain_page.h>
 #include <xen/keyhandler.h>
@@ -393,6 +394,57 @@ static long midsize_alloc_zone_pages;
 static DEFINE_SPINLOCK(heap_lock);
 static long outstanding_claims; /* total outstanding claims by all domains */
 
+/*
+ * Pages freed without being cleaned (e.g. those of a dying domain) stay on
+ * the heap marked PGC_need_scrub, with dirty buddies kept at the tail of the
+ * free lists. Idle CPUs scrub them in the background (scrub_free_pages()),
+ * and alloc_heap_pages() scrubs any dirty page it hands out on demand.
+ */
+static unsigned long node_need_scrub[MAX_NUMNODES];
+static nodemask_t node_scrubbing;
+
+/* Largest buddy (2MB with 4k pages) the idle scrubber works on at a time. */
+#define SCRUB_CHUNK_ORDER 9
+
+/*
+ * Per-CPU caches ("magazines") of free order-0 pages in front of the buddy
+ * heap. They hold clean pages of the CPU's own node from above the DMA
+ * zone, and are refilled from and drained to the heap PCP_BATCH pages at a
+ * time, so that single page allocations and frees, which make up most of
+ * domain building, ballooning and PoD, only take heap_lock once per batch.
+ * Cached pages are detached free pages not accounted in avail[], but which
+ * avail_heap_pages() reports as available. Claims are checked against the
+ * heap alone: caches are drained before one gets refused, and bypassed while
+ * any are outstanding.
+ */
+static bool_t __read_mostly opt_page_cache = 1;
+boolean_param("percpu_page_cache", opt_page_cache);
+
+#define PCP_BATCH 32
+#define PCP_HIGH  (4 * PCP_BATCH)
+
+struct page_cache {
+    spinlock_t lock;
+    struct page_list_head list;
+    unsigned int count;
+    unsigned int zone_count[NR_ZONES];
+    bool enabled;
+};
+static DEFINE_PER_CPU(struct page_cache, page_cache);
+static unsigned long drain_page_caches(void);
+static unsigned long page_cache_pages(void);
+
+/* Take heap_lock, accounting for how often it was found busy. */
+static void lock_heap(void)
+{
+    perfc_incr(heap_lock_acquired);
+    if ( unlikely(!spin_trylock(&heap_lock)) )
+    {
+        perfc_incr(heap_lock_contended);
+        spin_lock(&heap_lock);
+    }
+}
+
 unsigned long domain_adjust_tot_pages(struct domain *d, long pages)
 {
     long dom_before, dom_after, dom_claimed, sys_before, sys_after;
@@ -430,7 +482,9 @@ int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
 {
     int ret = -ENOMEM;
     unsigned long claim, avail_pages;
+    bool drained = false;
 
+ retry:
     /*
      * take the domain's page_alloc_lock, else all d->tot_page adjustments
      * must always take the global heap_lock rather than only in the much
@@ -483,7 +537,22 @@ int domain_set_outstanding_pages(struct domain *d, unsigned long pages)
      */
     claim = pages - d->tot_pages;
     if ( claim > avail_pages )
+    {
+        /*
+         * Pages in per-CPU caches aren't in total_avail_pages: give them back
+         * to the heap and look again. While the claim is outstanding, they
+         * won't go back into the caches.
+         */
+        if ( !drained && page_cache_pages() )
+        {
+            spin_unlock(&heap_lock);
+            spin_unlock(&d->page_alloc_lock);
+            drain_page_caches();
+            drained = true;
+            goto retry;
+        }
         goto out;
+    }
 
     /* yay, claim fits in available memory, stake the claim, success! */
     d->outstanding_pages = claim;
@@ -678,19 +747,412 @@ static void check_low_mem_virq(void)
     }
 }
 
+/* Put a free buddy on its list: clean ones at the head, dirty at the tail. */
+static void page_list_add_scrub(struct page_info *pg, unsigned int node,
+                                unsigned int zone, unsigned int order,
+                                unsigned int first_dirty)
+{
+    PFN_ORDER(pg) = order;
+    pg->u.free.detached = false;
+    pg->u.free.first_dirty = first_dirty;
+
+    if ( first_dirty != INVALID_DIRTY_IDX )
+        page_list_add_tail(pg, &heap(node, zone, order));
+    else
+        page_list_add(pg, &heap(node, zone, order));
+}
+
+/* Index of the first page needing scrubbing in a buddy, if any. */
+static unsigned int find_first_dirty(const struct page_info *pg,
+                                     unsigned int order)
+{
+    unsigned int i;
+
+    for ( i = 0; i < (1U << order); i++ )
+        if ( test_bit(_PGC_need_scrub, &pg[i].count_info) )
+            return i;
+
+    return INVALID_DIRTY_IDX;
+}
+
+/*
+ * Merge a free buddy, whose head's first_dirty is valid, with its free
+ * neighbours as far as possible and put the result on the free lists.
+ */
+static struct page_info *merge_and_free_buddy(
+    struct page_info *pg, unsigned int node, unsigned int zone,
+    unsigned int order)
+{
+    unsigned long mask;
+
+    ASSERT(spin_is_locked(&heap_lock));
+
+    /* Merge chunks as far as possible. */
+    while ( order < MAX_ORDER )
+    {
+        mask = 1UL << order;
+
+        if ( (page_to_mfn(pg) & mask) )
+        {
+            struct page_info *predecessor = pg - mask;
+
+            /* Merge with predecessor block? */
+            if ( !mfn_valid(_mfn(page_to_mfn(predecessor))) ||
+                 !page_state_is(predecessor, free) ||
+                 (PFN_ORDER(predecessor) != order) ||
+                 predecessor->u.free.detached ||
+                 (phys_to_nid(page_to_maddr(predecessor)) != node) )
+                break;
+            page_list_del(predecessor, &heap(node, zone, order));
+
+            if ( predecessor->u.free.first_dirty == INVALID_DIRTY_IDX &&
+                 pg->u.free.first_dirty != INVALID_DIRTY_IDX )
+                predecessor->u.free.first_dirty =
+                    (1U << order) + pg->u.free.first_dirty;
+            pg = predecessor;
+        }
+        else
+        {
+            struct page_info *successor = pg + mask;
+
+            /* Merge with successor block? */
+            if ( !mfn_valid(_mfn(page_to_mfn(successor))) ||
+                 !page_state_is(successor, free) ||
+                 (PFN_ORDER(successor) != order) ||
+                 successor->u.free.detached ||
+                 (phys_to_nid(page_to_maddr(successor)) != node) )
+                break;
+            page_list_del(successor, &heap(node, zone, order));
+
+            if ( pg->u.free.first_dirty == INVALID_DIRTY_IDX &&
+                 successor->u.free.first_dirty != INVALID_DIRTY_IDX )
+                pg->u.free.first_dirty =
+                    (1U << order) + successor->u.free.first_dirty;
+        }
+
+        order++;
+    }
+
+    page_list_add_scrub(pg, node, zone, order, pg->u.free.first_dirty);
+
+    return pg;
+}
+
+/* Lowest zone whose pages may be cached: DMA memory is left to the heap. */
+static unsigned int page_cache_zone_lo(void)
+{
+    return dma_bitsize ? bits_to_zone(dma_bitsize) + 1 : MEMZONE_XEN + 1;
+}
+
+/* Put a page freed while in a per-CPU cache where offline_page() wants it. */
+static void page_cache_reserve(struct page_info *pg)
+{
+    ASSERT(spin_is_locked(&heap_lock));
+    ASSERT(page_state_is(pg, offlined));
+
+    page_list_add_tail(pg, (pg->count_info & PGC_broken) ?
+                           &page_broken_list : &page_offlined_list);
+}
+
+static void page_cache_add(struct page_cache *pc, struct page_info *pg,
+                           bool hot)
+{
+    if ( hot )
+        page_list_add(pg, &pc->list);
+    else
+        page_list_add_tail(pg, &pc->list);
+    pc->count++;
+    pc->zone_count[page_to_zone(pg)]++;
+}
+
+static void page_cache_del(struct page_cache *pc, struct page_info *pg)
+{
+    page_list_del(pg, &pc->list);
+    pc->count--;
+    pc->zone_count[page_to_zone(pg)]--;
+}
+
+/* Take up to PCP_BATCH clean pages of @node into @pc. */
+static void page_cache_refill(struct page_cache *pc, unsigned int node,
+                              unsigned int zone_lo, unsigned int zone_hi)
+{
+    unsigned int zone = zone_hi, j, n = 0;
+    struct page_info *pg;
+
+    ASSERT(spin_is_locked(&pc->lock));
+
+    lock_heap();
+
+    do {
+        while ( n < PCP_BATCH && avail[node] && avail[node][zone] )
+        {
+            for ( j = 0; j <= MAX_ORDER; j++ )
+                if ( (pg = page_list_first(&heap(node, zone, j))) &&
+                     pg->u.free.first_dirty == INVALID_DIRTY_IDX )
+                    break;
+            if ( j > MAX_ORDER )
+                break;
+
+            page_list_del(pg, &heap(node, zone, j));
+            /* Keep the first page, returning the rest of the buddy. */
+            while ( j-- )
+                page_list_add_scrub(pg + (1U << j), node, zone, j,
+                                    INVALID_DIRTY_IDX);
+
+            pg->u.free.detached = true;
+            page_cache_add(pc, pg, false);
+            avail[node][zone]--;
+            total_avail_pages--;
+            n++;
+        }
+    } while ( n < PCP_BATCH && zone-- > zone_lo );
+
+    if ( n )
+        check_low_mem_virq();
+
+    spin_unlock(&heap_lock);
+
+    perfc_incr(page_cache_refill);
+}
+
+/* Give the @nr coldest pages of @pc back to the heap. */
+static void page_cache_drain(struct page_cache *pc, unsigned int nr)
+{
+    struct page_info *pg;
+
+    ASSERT(spin_is_locked(&pc->lock));
+
+    lock_heap();
+
+    while ( nr-- && (pg = page_list_last(&pc->list)) != NULL )
+    {
+        unsigned int node = phys_to_nid(page_to_maddr(pg));
+        unsigned int zone = page_to_zone(pg);
+
+        page_cache_del(pc, pg);
+
+        if ( !page_state_is(pg, free) )
+        {
+            page_cache_reserve(pg);
+            continue;
+        }
+
+        avail[node][zone]++;
+        total_avail_pages++;
+        pg->u.free.first_dirty = INVALID_DIRTY_IDX;
+        merge_and_free_buddy(pg, node, zone, 0);
+    }
+
+    spin_unlock(&heap_lock);
+
+    perfc_incr(page_cache_drain);
+}
+
+/* Empty all per-CPU caches, returning the number of pages released. */
+static unsigned long drain_page_caches(void)
+{
+    unsigned int cpu;
+    unsigned long nr = 0;
+
+    for_each_online_cpu ( cpu )
+    {
+        struct page_cache *pc = &per_cpu(page_cache, cpu);
+
+        if ( !pc->enabled || !read_atomic(&pc->count) )
+            continue;
+
+        spin_lock(&pc->lock);
+        nr += pc->count;
+        page_cache_drain(pc, pc->count);
+        spin_unlock(&pc->lock);
+    }
+
+    return nr;
+}
+
+/* Number of free pages held by per-CPU caches; racy, for reporting. */
+static unsigned long page_cache_pages(void)
+{
+    unsigned int cpu;
+    unsigned long nr = 0;
+
+    for_each_online_cpu ( cpu )
+        nr += read_atomic(&per_cpu(page_cache, cpu).count);
+
+    return nr;
+}
+
+/* Try to satisfy an order-0 allocation from the local CPU's cache. */
+static struct page_info *alloc_cached_page(
+    unsigned int zone_lo, unsigned int zone_hi, unsigned int node,
+    unsigned int memflags)
+{
+    struct page_cache *pc = &this_cpu(page_cache);
+    struct page_info *pg;
+    unsigned int zone;
+    bool_t need_tlbflush = 0;
+    uint32_t tlbflush_timestamp = 0;
+
+    /* Claims and tmem need every allocation to go through the heap. */
+    if ( !pc->enabled || node != cpu_to_node(smp_processor_id()) ||
+         outstanding_claims || tmem_enabled() )
+        return NULL;
+
+    zone_lo = max(zone_lo, page_cache_zone_lo());
+    if ( zone_lo > zone_hi )
+        return NULL;
+
+    spin_lock(&pc->lock);
+
+    for ( ; ; )
+    {
+        if ( !pc->count )
+            page_cache_refill(pc, node, zone_lo, zone_hi);
+
+        pg = page_list_first(&pc->list);
+        if ( !pg || (zone = page_to_zone(pg)) < zone_lo || zone > zone_hi )
+        {
+            pg = NULL;
+            break;
+        }
+
+        page_cache_del(pc, pg);
+
+        if ( cmpxchg(&pg->count_info, PGC_state_free,
+                     PGC_state_inuse) == PGC_state_free )
+            break;
+
+        /* The page got offlined while in the cache. */
+        lock_heap();
+        page_cache_reserve(pg);
+        spin_unlock(&heap_lock);
+    }
+
+    spin_unlock(&pc->lock);
+
+    if ( !pg )
+    {
+        perfc_incr(page_cache_miss);
+        return NULL;
+    }
+
+    perfc_incr(page_cache_hit);
+
+    if ( !(memflags & MEMF_no_tlbflush) )
+        accumulate_tlbflush(&need_tlbflush, pg, &tlbflush_timestamp);
+
+    /* Initialise fields which have other uses for free pages. */
+    pg->u.inuse.type_info = 0;
+    page_set_owner(pg, NULL);
+
+    flush_page_to_ram(page_to_mfn(pg), !(memflags & MEMF_no_icache_flush));
+
+    if ( need_tlbflush )
+        filtered_flush_tlb_mask(tlbflush_timestamp);
+
+    return pg;
+}
+
+/* Try to put a freed order-0 page into the local CPU's cache. */
+static bool free_cached_page(struct page_info *pg)
+{
+    struct page_cache *pc = &this_cpu(page_cache);
+    unsigned long x, y = pg->count_info;
+
+    if ( !pc->enabled ||
+         phys_to_nid(page_to_maddr(pg)) != cpu_to_node(smp_processor_id()) ||
+         page_to_zone(pg) < page_cache_zone_lo() ||
+         outstanding_claims || tmem_enabled() )
+        return false;
+
+    /* Broken pages and those being offlined are left to the heap. */
+    do {
+        x = y;
+        if ( (x & PGC_state) != PGC_state_inuse || (x & PGC_broken) )
+            return false;
+    } while ( (y = cmpxchg(&pg->count_info, x, PGC_state_free)) != x );
+
+    /* If a page has no owner it will need no safety TLB flush. */
+    pg->u.free.need_tlbflush = (page_get_owner(pg) != NULL);
+    if ( pg->u.free.need_tlbflush )
+        pg->tlbflush_timestamp = tlbflush_current_time();
+    pg->u.free.detached = true;
+    pg->u.free.first_dirty = INVALID_DIRTY_IDX;
+
+    /* This page is not a guest frame any more. */
+    page_set_owner(pg, NULL); /* set_gpfn_from_mfn snoops pg owner */
+    set_gpfn_from_mfn(page_to_mfn(pg), INVALID_M2P_ENTRY);
+
+    spin_lock(&pc->lock);
+    page_cache_add(pc, pg, true);
+    if ( pc->count > PCP_HIGH )
+        page_cache_drain(pc, PCP_BATCH);
+    spin_unlock(&pc->lock);
+
+    return true;
+}
+
+static int page_cache_cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu;
+    struct page_cache *pc = &per_cpu(page_cache, cpu);
+
+    switch ( action )
+    {
+    case CPU_UP_PREPARE:
+        spin_lock_init(&pc->lock);
+        INIT_PAGE_LIST_HEAD(&pc->list);
+        pc->count = 0;
+        memset(pc->zone_count, 0, sizeof(pc->zone_count));
+        pc->enabled = true;
+        break;
+    case CPU_UP_CANCELED:
+    case CPU_DEAD:
+        spin_lock(&pc->lock);
+        pc->enabled = false;
+        page_cache_drain(pc, pc->count);
+        spin_unlock(&pc->lock);
+        break;
+    default:
+        break;
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block page_cache_cpu_nfb = {
+    .notifier_call = page_cache_cpu_callback
+};
+
+static int __init page_cache_init(void)
+{
+    if ( !opt_page_cache )
+        return 0;
+
+    page_cache_cpu_callback(&page_cache_cpu_nfb, CPU_UP_PREPARE,
+                            (void *)(long)smp_processor_id());
+    register_cpu_notifier(&page_cache_cpu_nfb);
+
+    return 0;
+}
+presmp_initcall(page_cache_init);
+
 /* Allocate 2^@order contiguous pages. */
-static struct page_info *alloc_heap_pages(
+static struct page_info *__alloc_heap_pages(
     unsigned int zone_lo, unsigned int zone_hi,
     unsigned int order, unsigned int memflags,
     struct domain *d)
 {
     unsigned int i, j, zone = 0, nodemask_retry = 0;
+    unsigned int first_dirty, dirty_cnt = 0;
     nodeid_t first_node, node = MEMF_get_node(memflags), req_node = node;
     unsigned long request = 1UL << order;
     struct page_info *pg;
     nodemask_t nodemask = (d != NULL ) ? d->node_affinity : node_online_map;
     bool_t need_tlbflush = 0;
     uint32_t tlbflush_timestamp = 0;
+    bool use_unscrubbed = memflags & MEMF_no_scrub;
 
     /* Make sure there are enough bits in memflags for nodeID. */
     BUILD_BUG_ON((_MEMF_bits - _MEMF_node) < (8 * sizeof(nodeid_t)));
@@ -715,7 +1177,14 @@ static struct page_info *alloc_heap_pages(
     if ( unlikely(order > MAX_ORDER) )
         return NULL;
 
-    spin_lock(&heap_lock);
+    if ( !order && (pg = alloc_cached_page(zone_lo, zone_hi, node, memflags)) )
+    {
+        if ( d != NULL )
+            d->last_alloc_node = node;
+        return pg;
+    }
+
+    lock_heap();
 
     /*
      * Claimed memory is considered unavailable unless the request
@@ -751,12 +1220,26 @@ static struct page_info *alloc_heap_pages(
             if ( !avail[node] || (avail[node][zone] < request) )
                 continue;
 
-            /* Find smallest order which can satisfy the request. */
+            /*
+             * Find smallest order which can satisfy the request. Clean
+             * buddies sit at the head of each list, so a dirty head means
+             * there is no clean buddy of that order.
+             */
             for ( j = order; j <= MAX_ORDER; j++ )
-                if ( (pg = page_list_remove_head(&heap(node, zone, j))) )
+                if ( (pg = page_list_first(&heap(node, zone, j))) &&
+                     (use_unscrubbed ||
+                      pg->u.free.first_dirty == INVALID_DIRTY_IDX) )
                     goto found;
         } while ( zone-- > zone_lo ); /* careful: unsigned zone may wrap */
 
+        /* Rather scrub node-local memory than go off-node for clean pages. */
+        if ( !use_unscrubbed )
+        {
+            use_unscrubbed = true;
+            continue;
+        }
+        use_unscrubbed = memflags & MEMF_no_scrub;
+
         if ( (memflags & MEMF_exact_node) && req_node != NUMA_NO_NODE )
             goto not_found;
 
@@ -798,12 +1281,21 @@ static struct page_info *alloc_heap_pages(
     return NULL;
 
  found: 
+    page_list_del(pg, &heap(node, zone, j));
+    first_dirty = pg->u.free.first_dirty;
+
     /* We may have to halve the chunk a number of times. */
     while ( j != order )
     {
-        PFN_ORDER(pg) = --j;
-        page_list_add_tail(pg, &heap(node, zone, j));
+        --j;
+        page_list_add_scrub(pg, node, zone, j,
+                            (1U << j) > first_dirty ?
+                            first_dirty : INVALID_DIRTY_IDX);
         pg += 1 << j;
+
+        if ( first_dirty != INVALID_DIRTY_IDX )
+            first_dirty = (first_dirty >= (1U << j)) ?
+                          first_dirty - (1U << j) : 0;
     }
 
     ASSERT(avail[node][zone] >= request);
@@ -819,8 +1311,14 @@ static struct page_info *alloc_heap_pages(
     for ( i = 0; i < (1 << order); i++ )
     {
         /* Reference count must continuously be zero for free pages. */
-        BUG_ON(pg[i].count_info != PGC_state_free);
-        pg[i].count_info = PGC_state_inuse;
+        BUG_ON((pg[i].count_info & ~PGC_need_scrub) != PGC_state_free);
+        ASSERT(first_dirty != INVALID_DIRTY_IDX ||
+               !(pg[i].count_info & PGC_need_scrub));
+        if ( pg[i].count_info & PGC_need_scrub )
+            dirty_cnt++;
+        /* Keep PGC_need_scrub for the scrubbing below, done unlocked. */
+        pg[i].count_info = PGC_state_inuse |
+                           (pg[i].count_info & PGC_need_scrub);
 
         if ( !(memflags & MEMF_no_tlbflush) )
             accumulate_tlbflush(&need_tlbflush, &pg[i],
@@ -829,6 +1327,20 @@ static struct page_info *alloc_heap_pages(
         /* Initialise fields which have other uses for free pages. */
         pg[i].u.inuse.type_info = 0;
         page_set_owner(&pg[i], NULL);
+    }
+
+    node_need_scrub[node] -= dirty_cnt;
+
+    spin_unlock(&heap_lock);
+
+    for ( i = 0; i < (1 << order); i++ )
+    {
+        if ( dirty_cnt && test_bit(_PGC_need_scrub, &pg[i].count_info) )
+        {
+            if ( !(memflags & MEMF_no_scrub) )
+                scrub_one_page(&pg[i]);
+            clear_bit(_PGC_need_scrub, &pg[i].count_info);
+        }
 
         /* Ensure cache and RAM are consistent for platforms where the
          * guest can control its own visibility of/through the cache.
@@ -836,7 +1348,8 @@ static struct page_info *alloc_heap_pages(
         flush_page_to_ram(page_to_mfn(&pg[i]), !(memflags & MEMF_no_icache_flush));
     }
 
-    spin_unlock(&heap_lock);
+    if ( dirty_cnt && !(memflags & MEMF_no_scrub) )
+        perfc_add(scrub_alloc_pages, dirty_cnt);
 
     if ( need_tlbflush )
         filtered_flush_tlb_mask(tlbflush_timestamp);
@@ -844,6 +1357,21 @@ static struct page_info *alloc_heap_pages(
     return pg;
 }
 
+static struct page_info *alloc_heap_pages(
+    unsigned int zone_lo, unsigned int zone_hi,
+    unsigned int order, unsigned int memflags,
+    struct domain *d)
+{
+    struct page_info *pg = __alloc_heap_pages(zone_lo, zone_hi, order,
+                                              memflags, d);
+
+    /* Out of single pages: some may be sitting in per-CPU caches. */
+    if ( unlikely(!pg) && !order && drain_page_caches() )
+        pg = __alloc_heap_pages(zone_lo, zone_hi, order, memflags, d);
+
+    return pg;
+}
+
 /* Remove any offlined page in the buddy pointed to by head. */
 static int reserve_offlined_page(struct page_info *head)
 {
@@ -851,6 +1379,7 @@ static int reserve_offlined_page(struct page_info *head)
     int zone = page_to_zone(head), i, head_order = PFN_ORDER(head), count = 0;
     struct page_info *cur_head;
     int cur_order;
+    bool need_scrub = head->u.free.first_dirty != INVALID_DIRTY_IDX;
 
     ASSERT(spin_is_locked(&heap_lock));
 
@@ -892,8 +1421,10 @@ static int reserve_offlined_page(struct page_info *head)
             {
             merge:
                 /* We don't consider merging outside the head_order. */
-                page_list_add_tail(cur_head, &heap(node, zone, cur_order));
-                PFN_ORDER(cur_head) = cur_order;
+                page_list_add_scrub(cur_head, node, zone, cur_order,
+                                    need_scrub ?
+                                    find_first_dirty(cur_head, cur_order) :
+                                    INVALID_DIRTY_IDX);
                 cur_head += (1 << cur_order);
                 break;
             }
@@ -909,6 +1440,10 @@ static int reserve_offlined_page(struct page_info *head)
         total_avail_pages--;
         ASSERT(total_avail_pages >= 0);
 
+        /* Offlined pages keep PGC_need_scrub for when they get onlined. */
+        if ( cur_head->count_info & PGC_need_scrub )
+            node_need_scrub[node]--;
+
         page_list_add_tail(cur_head,
                            test_bit(_PGC_broken, &cur_head->count_info) ?
                            &page_broken_list : &page_offlined_list);
@@ -921,16 +1456,19 @@ static int reserve_offlined_page(struct page_info *head)
 
 /* Free 2^@order set of pages. */
 static void free_heap_pages(
-    struct page_info *pg, unsigned int order)
+    struct page_info *pg, unsigned int order, bool need_scrub)
 {
-    unsigned long mask, mfn = page_to_mfn(pg);
+    unsigned long mfn = page_to_mfn(pg);
     unsigned int i, node = phys_to_nid(page_to_maddr(pg)), tainted = 0;
     unsigned int zone = page_to_zone(pg);
 
     ASSERT(order <= MAX_ORDER);
     ASSERT(node >= 0);
 
-    spin_lock(&heap_lock);
+    if ( !order && !need_scrub && free_cached_page(pg) )
+        return;
+
+    lock_heap();
 
     for ( i = 0; i < (1 << order); i++ )
     {
@@ -953,6 +1491,13 @@ static void free_heap_pages(
         if ( page_state_is(&pg[i], offlined) )
             tainted = 1;
 
+        /* Counted even if offlined: reserve_offlined_page() uncounts it. */
+        if ( need_scrub )
+        {
+            pg[i].count_info |= PGC_need_scrub;
+            node_need_scrub[node]++;
+        }
+
         /* If a page has no owner it will need no safety TLB flush. */
         pg[i].u.free.need_tlbflush = (page_get_owner(&pg[i]) != NULL);
         if ( pg[i].u.free.need_tlbflush )
@@ -970,38 +1515,8 @@ static void free_heap_pages(
         midsize_alloc_zone_pages = max(
             midsize_alloc_zone_pages, total_avail_pages / MIDSIZE_ALLOC_FRAC);
 
-    /* Merge chunks as far as possible. */
-    while ( order < MAX_ORDER )
-    {
-        mask = 1UL << order;
-
-        if ( (page_to_mfn(pg) & mask) )
-        {
-            /* Merge with predecessor block? */
-            if ( !mfn_valid(_mfn(page_to_mfn(pg-mask))) ||
-                 !page_state_is(pg-mask, free) ||
-                 (PFN_ORDER(pg-mask) != order) ||
-                 (phys_to_nid(page_to_maddr(pg-mask)) != node) )
-                break;
-            pg -= mask;
-            page_list_del(pg, &heap(node, zone, order));
-        }
-        else
-        {
-            /* Merge with successor block? */
-            if ( !mfn_valid(_mfn(page_to_mfn(pg+mask))) ||
-                 !page_state_is(pg+mask, free) ||
-                 (PFN_ORDER(pg+mask) != order) ||
-                 (phys_to_nid(page_to_maddr(pg+mask)) != node) )
-                break;
-            page_list_del(pg + mask, &heap(node, zone, order));
-        }
-
-        order++;
-    }
-
-    PFN_ORDER(pg) = order;
-    page_list_add_tail(pg, &heap(node, zone, order));
+    pg->u.free.first_dirty = need_scrub ? 0 : INVALID_DIRTY_IDX;
+    pg = merge_and_free_buddy(pg, node, zone, order);
 
     if ( tainted )
         reserve_offlined_page(pg);
@@ -1121,10 +1636,14 @@ int offline_page(unsigned long mfn, int broken, uint32_t *status)
 
     if ( page_state_is(pg, offlined) )
     {
-        reserve_heap_page(pg);
+        int rc = reserve_heap_page(pg);
 
         spin_unlock(&heap_lock);
 
+        /* Not on the free lists: it may be in a per-CPU cache. */
+        if ( rc < 0 )
+            drain_page_caches();
+
         *status = broken ? PG_OFFLINE_OFFLINED | PG_OFFLINE_BROKEN
                          : PG_OFFLINE_OFFLINED;
         return 0;
@@ -1220,13 +1739,13 @@ unsigned int online_page(unsigned long mfn, uint32_t *status)
         }
 
         x = y;
-        nx = (x & ~PGC_state) | PGC_state_inuse;
+        nx = (x & ~(PGC_state | PGC_need_scrub)) | PGC_state_inuse;
     } while ( (y = cmpxchg(&pg->count_info, x, nx)) != x );
 
     spin_unlock(&heap_lock);
 
     if ( (y & PGC_state) == PGC_state_offlined )
-        free_heap_pages(pg, 0);
+        free_heap_pages(pg, 0, y & PGC_need_scrub);
 
     return ret;
 }
@@ -1295,7 +1814,7 @@ static void init_heap_pages(
             nr_pages -= n;
         }
 
-        free_heap_pages(pg+i, 0);
+        free_heap_pages(pg+i, 0, false);
     }
 }
 
@@ -1317,12 +1836,23 @@ static unsigned long avail_heap_pages(
                 free_pages += avail[i][zone];
     }
 
+    /* Pages in per-CPU caches are free too, and from the CPU's node. */
+    for_each_online_cpu ( i )
+    {
+        const struct page_cache *pc = &per_cpu(page_cache, i);
+
+        if ( !pc->enabled || ((node != -1) && (node != cpu_to_node(i))) )
+            continue;
+        for ( zone = zone_lo; zone <= zone_hi; zone++ )
+            free_pages += read_atomic(&pc->zone_count[zone]);
+    }
+
     return free_pages;
 }
 
 unsigned long total_free_pages(void)
 {
-    return total_avail_pages - midsize_alloc_zone_pages;
+    return total_avail_pages + page_cache_pages() - midsize_alloc_zone_pages;
 }
 
 void __init end_boot_allocator(void)
@@ -1566,6 +2096,134 @@ void __init scrub_heap_pages(void)
     setup_low_mem_virq();
 }
 
+/*
+ * Pick a node with dirty free memory that no other CPU is scrubbing,
+ * preferring the local one, and claim it in node_scrubbing.
+ */
+static nodeid_t node_to_scrub(void)
+{
+    nodeid_t node, local = cpu_to_node(smp_processor_id());
+
+    if ( local == NUMA_NO_NODE )
+        local = 0;
+
+    if ( node_need_scrub[local] && !node_test_and_set(local, node_scrubbing) )
+        return local;
+
+    for_each_online_node ( node )
+        if ( node != local && node_need_scrub[node] &&
+             !node_test_and_set(node, node_scrubbing) )
+            return node;
+
+    return NUMA_NO_NODE;
+}
+
+/*
+ * Called from the idle loop: scrub (part of) one dirty buddy. The buddy,
+ * at most 2^SCRUB_CHUNK_ORDER pages, is marked as detached so that
+ * nobody merges with it while heap_lock is dropped, and the work stops as
+ * soon as a softirq is pending. Returns whether dirty pages remain.
+ */
+bool scrub_free_pages(void)
+{
+    unsigned int cpu = smp_processor_id();
+    unsigned int zone, order, i, first_dirty, dirty_cnt = 0;
+    struct page_info *pg, *head;
+    nodeid_t node;
+    bool more;
+
+    /* Softirqs and tasklets take precedence. */
+    if ( !cpu_is_haltable(cpu) )
+        return false;
+
+    node = node_to_scrub();
+    if ( node == NUMA_NO_NODE )
+        return false;
+
+    lock_heap();
+
+    /* Dirty buddies live at the tail of the free lists. */
+    for ( zone = 0; zone < NR_ZONES; zone++ )
+        for ( order = MAX_ORDER + 1; order-- > 0; )
+        {
+            pg = page_list_last(&heap(node, zone, order));
+            if ( pg && pg->u.free.first_dirty != INVALID_DIRTY_IDX )
+                goto found;
+        }
+
+    /* The remaining dirty pages are being handed out by allocators. */
+    spin_unlock(&heap_lock);
+    node_clear(node, node_scrubbing);
+    return false;
+
+ found:
+    page_list_del(pg, &heap(node, zone, order));
+    first_dirty = pg->u.free.first_dirty;
+
+    /* Split off the chunk holding the first possibly dirty page. */
+    while ( order > SCRUB_CHUNK_ORDER )
+    {
+        --order;
+        if ( first_dirty >= (1U << order) )
+        {
+            page_list_add_scrub(pg, node, zone, order, INVALID_DIRTY_IDX);
+            pg += 1U << order;
+            first_dirty -= 1U << order;
+        }
+        else
+            page_list_add_scrub(pg + (1U << order), node, zone, order, 0);
+    }
+
+    PFN_ORDER(pg) = order;
+    pg->u.free.detached = true;
+
+    spin_unlock(&heap_lock);
+
+    for ( i = first_dirty; i < (1U << order); )
+    {
+        /*
+         * Pages offlined (or found broken) meanwhile are left alone, to be
+         * reserved below, still marked and counted as needing scrubbing.
+         */
+        if ( test_bit(_PGC_need_scrub, &pg[i].count_info) &&
+             page_state_is(&pg[i], free) &&
+             !test_bit(_PGC_broken, &pg[i].count_info) )
+        {
+            scrub_one_page(&pg[i]);
+            clear_bit(_PGC_need_scrub, &pg[i].count_info);
+            dirty_cnt++;
+        }
+
+        if ( ++i < (1U << order) && softirq_pending(cpu) )
+            break;
+    }
+
+    lock_heap();
+
+    node_need_scrub[node] -= dirty_cnt;
+    pg->u.free.detached = false;
+    pg->u.free.first_dirty = (i < (1U << order)) ? i : INVALID_DIRTY_IDX;
+    head = merge_and_free_buddy(pg, node, zone, order);
+
+    /* Pages may have been offlined while the buddy was off the lists. */
+    for ( i = 0; i < (1U << order); i++ )
+        if ( page_state_is(&pg[i], offlined) )
+        {
+            reserve_offlined_page(head);
+            break;
+        }
+
+    more = node_need_scrub[node] != 0;
+
+    spin_unlock(&heap_lock);
+
+    node_clear(node, node_scrubbing);
+
+    perfc_add(scrub_idle_pages, dirty_cnt);
+
+    return more;
+}
+
 
 
 /*************************
@@ -1622,7 +2280,7 @@ void free_xenheap_pages(void *v, unsigned int order)
 
     memguard_guard_range(v, 1 << (order + PAGE_SHIFT));
 
-    free_heap_pages(virt_to_page(v), order);
+    free_heap_pages(virt_to_page(v), order, false);
 }
 
 #else
@@ -1676,12 +2334,9 @@ void free_xenheap_pages(void *v, unsigned int order)
     pg = virt_to_page(v);
 
     for ( i = 0; i < (1u << order); i++ )
-    {
-        scrub_one_page(&pg[i]);
         pg[i].count_info &= ~PGC_xen_heap;
-    }
 
-    free_heap_pages(pg, order);
+    free_heap_pages(pg, order, true);
 }
 
 #endif
@@ -1790,7 +2445,7 @@ struct page_info *alloc_domheap_pages(
     if ( d && !(memflags & MEMF_no_owner) &&
          assign_pages(d, pg, order, memflags) )
     {
-        free_heap_pages(pg, order);
+        free_heap_pages(pg, order, memflags & MEMF_no_scrub);
         return NULL;
     }
     
@@ -1858,11 +2513,8 @@ void free_domheap_pages(struct page_info *pg, unsigned int order)
             scrub = 1;
         }
 
-        if ( unlikely(scrub) )
-            for ( i = 0; i < (1 << order); i++ )
-                scrub_one_page(&pg[i]);
-
-        free_heap_pages(pg, order);
+        /* Scrubbing is deferred to idle CPUs or the next allocation. */
+        free_heap_pages(pg, order, scrub);
     }
 
     if ( drop_dom_ref )
@@ -1960,7 +2612,15 @@ static void dump_heap(unsigned char key)
         for ( j = 0; j < NR_ZONES; j++ )
             printk("heap[node=%d][zone=%d] -> %lu pages\n",
                    i, j, avail[i][j]);
+        if ( node_need_scrub[i] )
+            printk("heap[node=%d] -> %lu pages need scrubbing\n",
+                   i, node_need_scrub[i]);
     }
+
+    for_each_online_cpu ( i )
+        if ( per_cpu(page_cache, i).count )
+            printk("page cache[cpu=%d] -> %u pages\n",
+                   i, per_cpu(page_cache, i).count);
 }
 
 static __init int register_heap_trigger(void)
@@ -10,11 +10,17 @@
 #include <xen/sched.h>
 #include <xen/errno.h>
 #include <xen/rangeset.h>
+#include <xen/rbtree.h>
+#include <xen/xmem_cache.h>
 #include <xsm/xsm.h>
 
-/* An inclusive range [s,e] and pointer to next range in ascending order. */
+/*
+ * An inclusive range [s,e], linked to the next range in ascending order and
+ * indexed by s in the set's rb-tree.
+ */
 struct range {
     struct list_head list;
+    struct rb_node node;
     unsigned long s, e;
 };
 
@@ -23,8 +29,13 @@ struct rangeset {
     struct list_head rangeset_list;
     struct domain   *domain;
 
-    /* Ordered list of ranges contained in this set, and protecting lock. */
+    /*
+     * Ordered list of ranges contained in this set, for walking it, and a
+     * tree of the same ranges, for finding one in O(log n).  Both are
+     * protected by lock.
+     */
     struct list_head range_list;
+    struct rb_root   range_tree;
 
     /* Number of ranges that can be allocated */
     long             nr_ranges;
@@ -37,21 +48,29 @@ struct rangeset {
     unsigned int     flags;
 };
 
+static DEFINE_XMEM_CACHE(range_cache, struct range);
+
 /*****************************
- * Private range functions hide the underlying linked-list implemnetation.
+ * Private range functions hide the underlying list/tree implementation.
  */
 
 /* Find highest range lower than or containing s. NULL if no such range. */
 static struct range *find_range(
     struct rangeset *r, unsigned long s)
 {
+    struct rb_node *n = r->range_tree.rb_node;
     struct range *x = NULL, *y;
 
-    list_for_each_entry ( y, &r->range_list, list )
+    while ( n != NULL )
     {
+        y = rb_entry(n, struct range, node);
         if ( y->s > s )
-            break;
-        x = y;
+            n = n->rb_left;
+        else
+        {
+            x = y;
+            n = n->rb_right;
+        }
     }
 
     return x;
@@ -79,17 +98,44 @@ static struct range *next_range(
 static void insert_range(
     struct rangeset *r, struct range *x, struct range *y)
 {
+    struct rb_node **link, *parent = NULL;
+
     list_add(&y->list, (x != NULL) ? &x->list : &r->range_list);
+
+    /*
+     * x is y's in-order predecessor, so y goes in the leftmost slot of x's
+     * right subtree (or of the whole tree if x is NULL): no keys need
+     * comparing.
+     */
+    if ( x == NULL )
+        link = &r->range_tree.rb_node;
+    else if ( x->node.rb_right == NULL )
+    {
+        parent = &x->node;
+        link = &parent->rb_right;
+    }
+    else
+        link = &x->node.rb_right;
+
+    while ( *link != NULL )
+    {
+        parent = *link;
+        link = &parent->rb_left;
+    }
+
+    rb_link_node(&y->node, parent, link);
+    rb_insert_color(&y->node, &r->range_tree);
 }
 
-/* Remove a range from its list and free it. */
+/* Remove a range from its list and tree and free it. */
 static void destroy_range(
     struct rangeset *r, struct range *x)
 {
     r->nr_ranges++;
 
     list_del(&x->list);
-    xfree(x);
+    rb_erase(&x->node, &r->range_tree);
+    xmem_cache_free(&range_cache, x);
 }
 
 /* Allocate a new range */
@@ -101,7 +147,7 @@ static struct range *alloc_range(
     if ( r->nr_ranges == 0 )
         return NULL;
 
-    x = xmalloc(struct range);
+    x = xmem_cache_alloc(&range_cache);
     if ( x )
         --r->nr_ranges;
 
@@ -227,7 +273,8 @@ int rangeset_remove_range(
 
         if ( x->s < s )
         {
-            x->e = s - 1;
+            if ( x->e >= s )
+                x->e = s - 1;
             x = next_range(r, x);
         }
 
@@ -289,7 +336,10 @@ int rangeset_report_ranges(
 
     read_lock(&r->lock);
 
-    for ( x = first_range(r); x && (x->s <= e) && !rc; x = next_range(r, x) )
+    if ( (x = find_range(r, s)) == NULL )
+        x = first_range(r);
+
+    for ( ; x && (x->s <= e) && !rc; x = next_range(r, x) )
         if ( x->e >= s )
             rc = cb(max(x->s, s), min(x->e, e), ctxt);
 
@@ -333,6 +383,7 @@ struct rangeset *rangeset_new(
 
     rwlock_init(&r->lock);
     INIT_LIST_HEAD(&r->range_list);
+    r->range_tree = RB_ROOT;
     r->nr_ranges = -1;
 
     BUG_ON(flags & ~RANGESETF_prettyprint_hex);
@@ -411,6 +462,7 @@ void rangeset_domain_destroy(
 void rangeset_swap(struct rangeset *a, struct rangeset *b)
 {
     LIST_HEAD(tmp);
+    struct rb_root tree;
 
     if ( a < b )
     {
@@ -427,6 +479,10 @@ void rangeset_swap(struct rangeset *a, struct rangeset *b)
     list_splice_init(&b->range_list, &a->range_list);
     list_splice(&tmp, &b->range_list);
 
+    tree = a->range_tree;
+    a->range_tree = b->range_tree;
+    b->range_tree = tree;
+
     write_unlock(&a->lock);
     write_unlock(&b->lock);
 }
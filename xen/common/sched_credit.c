@@ -163,6 +163,26 @@
 static int __read_mostly sched_credit_tslice_ms = CSCHED_DEFAULT_TSLICE_MS;
 integer_param("sched_credit_tslice_ms", sched_credit_tslice_ms);
 
+/*
+ * Lock-free summary of the work that can be stolen, per NUMA node.
+ *
+ * For each node, we track which of its pCPUs have vCPUs waiting in their
+ * runqueue (i.e., work that csched_load_balance() may steal) in two
+ * bitmaps: one for pCPUs with vCPUs of priority UNDER or higher, and one
+ * for pCPUs with any vCPU at all (i.e., of priority OVER or higher).
+ *
+ * The bitmaps, and the per-pCPU steal_pri hint, are updated by each pCPU
+ * while holding its own runqueue lock, but are read without any lock by
+ * the pCPUs that are load balancing. They are just hints, as priorities
+ * of queued vCPUs may change under our feet (e.g., in csched_acct()), but
+ * they let a pCPU avoid taking the lock of peers that surely don't have
+ * anything interesting to steal.
+ */
+struct csched_steal_summary {
+    cpumask_t under;
+    cpumask_t over;
+} __cacheline_aligned;
+
 /*
  * Physical CPU
  */
@@ -173,6 +193,8 @@ struct csched_pcpu {
     unsigned int tick;
     unsigned int idle_bias;
     unsigned int nr_runnable;
+    int16_t steal_pri;     /* Priority of the head of runq (lock-free hint) */
+    struct csched_steal_summary *steal;  /* Summary of the node of the pcpu */
 };
 
 /*
@@ -230,6 +252,7 @@ struct csched_private {
     int credit_balance;
     uint32_t runq_sort;
     uint32_t *balance_bias;
+    struct csched_steal_summary *steal;  /* One per NUMA node */
     unsigned ratelimit_us;
     /* Period of master and tick in milliseconds */
     unsigned tslice_ms, tick_period_us, ticks_per_tslice;
@@ -279,6 +302,45 @@ dec_nr_runnable(unsigned int cpu)
     CSCHED_PCPU(cpu)->nr_runnable--;
 }
 
+/*
+ * Update the lock-free summary of the stealable work of cpu, after its
+ * runqueue has changed. To avoid bouncing the cache lines of the node's
+ * summary, it is only written when the priority of the head of the
+ * runqueue changes class.
+ */
+static inline void
+runq_update_steal(unsigned int cpu)
+{
+    struct csched_pcpu * const spc = CSCHED_PCPU(cpu);
+    int pri = CSCHED_PRI_IDLE;
+
+    ASSERT(spin_is_locked(per_cpu(schedule_data, cpu).schedule_lock));
+
+    if ( !list_empty(&spc->runq) )
+        pri = __runq_elem(spc->runq.next)->pri;
+
+    if ( pri == spc->steal_pri )
+        return;
+
+    write_atomic(&spc->steal_pri, pri);
+
+    if ( pri >= CSCHED_PRI_TS_UNDER )
+    {
+        if ( !cpumask_test_cpu(cpu, &spc->steal->under) )
+            cpumask_set_cpu(cpu, &spc->steal->under);
+    }
+    else if ( cpumask_test_cpu(cpu, &spc->steal->under) )
+        cpumask_clear_cpu(cpu, &spc->steal->under);
+
+    if ( pri >= CSCHED_PRI_TS_OVER )
+    {
+        if ( !cpumask_test_cpu(cpu, &spc->steal->over) )
+            cpumask_set_cpu(cpu, &spc->steal->over);
+    }
+    else if ( cpumask_test_cpu(cpu, &spc->steal->over) )
+        cpumask_clear_cpu(cpu, &spc->steal->over);
+}
+
 static inline void
 __runq_insert(struct csched_vcpu *svc)
 {
@@ -308,6 +370,7 @@ __runq_insert(struct csched_vcpu *svc)
     }
 
     list_add_tail(&svc->runq_elem, iter);
+    runq_update_steal(cpu);
 }
 
 static inline void
@@ -322,6 +385,7 @@ __runq_remove(struct csched_vcpu *svc)
 {
     BUG_ON( !__vcpu_on_runq(svc) );
     list_del_init(&svc->runq_elem);
+    runq_update_steal(svc->vcpu->processor);
 }
 
 static inline void
@@ -591,6 +655,8 @@ csched_deinit_pdata(const struct scheduler *ops, void *pcpu, int cpu)
         if ( !cpumask_empty(cpumask_scratch) )
             prv->balance_bias[node] =  cpumask_first(cpumask_scratch);
     }
+    cpumask_clear_cpu(cpu, &spc->steal->under);
+    cpumask_clear_cpu(cpu, &spc->steal->over);
     kill_timer(&spc->ticker);
     if ( prv->ncpus == 0 )
         kill_timer(&prv->master_ticker);
@@ -640,6 +706,8 @@ init_pdata(struct csched_private *prv, struct csched_pcpu *spc, int cpu)
     INIT_LIST_HEAD(&spc->runq);
     spc->runq_sort_last = prv->runq_sort;
     spc->idle_bias = nr_cpu_ids - 1;
+    spc->steal_pri = CSCHED_PRI_IDLE;
+    spc->steal = &prv->steal[cpu_to_node(cpu)];
 
     /* Start off idling... */
     BUG_ON(!is_idle_vcpu(curr_on_cpu(cpu)));
@@ -1234,6 +1302,36 @@ csched_vcpu_yield(const struct scheduler *ops, struct vcpu *vc)
     set_bit(CSCHED_FLAG_VCPU_YIELD, &svc->flags);
 }
 
+/*
+ * Directed yield: vc is spinning, and target (runnable, but preempted) may
+ * be what it is waiting for. Boost target, as if it had just woken up, so
+ * it goes ahead of the non boosted vcpus. As for wakeups, the boost goes
+ * away as soon as target is found running by the accounting code. Only
+ * UNDER vcpus are boosted: an OVER one has used up its credit, and boosting
+ * it would let a guest get around its fair share (and cap) by spinning.
+ */
+static int
+csched_vcpu_yield_to(const struct scheduler *ops, struct vcpu *vc,
+                     struct vcpu *target)
+{
+    struct csched_vcpu * const svc = CSCHED_VCPU(target);
+
+    if ( !__vcpu_on_runq(svc) || svc->pri != CSCHED_PRI_TS_UNDER ||
+         test_bit(CSCHED_FLAG_VCPU_PARKED, &svc->flags) )
+        return -EBUSY;
+
+    TRACE_2D(TRC_CSCHED_BOOST_START, target->domain->domain_id,
+             target->vcpu_id);
+    SCHED_STAT_CRANK(vcpu_boost);
+
+    runq_remove(svc);
+    svc->pri = CSCHED_PRI_TS_BOOST;
+    runq_insert(svc);
+    __runq_tickle(svc);
+
+    return 0;
+}
+
 static int
 csched_dom_cntl(
     const struct scheduler *ops,
@@ -1426,6 +1524,8 @@ csched_runq_sort(struct csched_private *prv, unsigned int cpu)
         elem = next;
     }
 
+    runq_update_steal(cpu);
+
     pcpu_schedule_unlock_irqrestore(lock, flags, cpu);
 }
 
@@ -1786,9 +1886,17 @@ csched_load_balance(struct csched_private *prv, int cpu,
         peer_node = node;
         do
         {
-            /* Select the pCPUs in this node that have work we can steal. */
-            cpumask_andnot(&workers, online, prv->idlers);
-            cpumask_and(&workers, &workers, &node_to_cpumask(peer_node));
+            /*
+             * Select the pCPUs in this node that have work we can steal.
+             * We use the node's summary for that: if we are idle, any
+             * queued vCPU is better than what we have; if we are about
+             * to run an OVER vCPU, only UNDER (or BOOST) ones are.
+             */
+            cpumask_and(&workers, online,
+                        snext->pri == CSCHED_PRI_IDLE ?
+                        &prv->steal[peer_node].over :
+                        &prv->steal[peer_node].under);
+            cpumask_andnot(&workers, &workers, prv->idlers);
             __cpumask_clear_cpu(cpu, &workers);
 
             first_cpu = cpumask_cycle(prv->balance_bias[peer_node], &workers);
@@ -1825,7 +1933,9 @@ csched_load_balance(struct csched_private *prv, int cpu,
                  *     optimization), it the pCPU would schedule right after we
                  *     have taken the lock, and hence block on it.
                  */
-                if ( CSCHED_PCPU(peer_cpu)->nr_runnable <= 1 )
+                if ( CSCHED_PCPU(peer_cpu)->nr_runnable <= 1 ||
+                     read_atomic(&CSCHED_PCPU(peer_cpu)->steal_pri) <=
+                     snext->pri )
                 {
                     TRACE_2D(TRC_CSCHED_STEAL_CHECK, peer_cpu, /* skipp'n */ 0);
                     goto next_cpu;
@@ -2231,10 +2341,19 @@ csched_init(struct scheduler *ops)
         return -ENOMEM;
     }
 
+    prv->steal = xzalloc_array(struct csched_steal_summary, MAX_NUMNODES);
+    if ( prv->steal == NULL )
+    {
+        xfree(prv->balance_bias);
+        xfree(prv);
+        return -ENOMEM;
+    }
+
     if ( !zalloc_cpumask_var(&prv->cpus) ||
          !zalloc_cpumask_var(&prv->idlers) )
     {
         free_cpumask_var(prv->cpus);
+        xfree(prv->steal);
         xfree(prv->balance_bias);
         xfree(prv);
         return -ENOMEM;
@@ -2281,6 +2400,7 @@ csched_deinit(struct scheduler *ops)
         ops->sched_data = NULL;
         free_cpumask_var(prv->cpus);
         free_cpumask_var(prv->idlers);
+        xfree(prv->steal);
         xfree(prv->balance_bias);
         xfree(prv);
     }
@@ -2324,6 +2444,7 @@ static const struct scheduler sched_credit_def = {
     .sleep          = csched_vcpu_sleep,
     .wake           = csched_vcpu_wake,
     .yield          = csched_vcpu_yield,
+    .yield_to       = csched_vcpu_yield_to,
 
     .adjust         = csched_dom_cntl,
     .adjust_global  = csched_sys_cntl,
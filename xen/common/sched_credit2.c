@@ -25,6 +25,7 @@
 #include <xen/trace.h>
 #include <xen/cpu.h>
 #include <xen/keyhandler.h>
+#include <xen/guest_access.h>
 
 /* Meant only for helping developers during debugging. */
 /* #define d2printk printk */
@@ -57,6 +58,7 @@
 #define TRC_CSCHED2_SCHEDULE         TRC_SCHED_CLASS_EVT(CSCHED2, 21)
 #define TRC_CSCHED2_RATELIMIT        TRC_SCHED_CLASS_EVT(CSCHED2, 22)
 #define TRC_CSCHED2_RUNQ_CAND_CHECK  TRC_SCHED_CLASS_EVT(CSCHED2, 23)
+#define TRC_CSCHED2_ADAPT_TSLICE     TRC_SCHED_CLASS_EVT(CSCHED2, 24)
 
 /*
  * WARNING: This is still in an experimental phase.  Status and work can be found at the
@@ -208,6 +210,32 @@
 static unsigned int __read_mostly opt_migrate_resist = 500;
 integer_param("sched_credit2_migrate_resist", opt_migrate_resist);
 
+/*
+ * Cache hotness: for how long (in microseconds) after having been descheduled
+ * a vcpu is considered to still have a warm cache on the pcpu it ran on.
+ * Both csched2_cpu_pick() and balance_load() charge moving a hot vcpu away
+ * from there, with the charge decaying linearly to zero over this window.
+ * 0 disables the cache hotness model.
+ */
+static unsigned int __read_mostly opt_cache_hot = 1000;
+integer_param("credit2_cache_hot", opt_cache_hot);
+
+/*
+ * Adaptive timeslicing: each runqueue keeps its own maximum timeslice (and
+ * a ratelimit scaled accordingly), which is periodically adjusted looking
+ * at the runqueue load and at how vcpus leave the pcpus. If the runqueue is
+ * overloaded and vcpus mostly wake up (i.e., they are I/O or latency bound),
+ * the slice shrinks, so that waiters get to run sooner. If the runqueue is
+ * not overloaded, or vcpus mostly run until their slice expires (i.e., they
+ * are CPU bound), the slice grows back, to reduce context switch overhead.
+ *
+ * The slice varies between CSCHED2_MIN_TSLICE and CSCHED2_MAX_TIMER.
+ */
+#define CSCHED2_MIN_TSLICE           MILLISECS(1)
+#define CSCHED2_ADAPT_PERIOD         MILLISECS(100)
+static bool __read_mostly opt_adaptive_tslice;
+boolean_param("credit2_adaptive_tslice", opt_adaptive_tslice);
+
 /*
  * Load tracking and load balancing
  *
@@ -305,6 +333,13 @@ integer_param("credit2_balance_over", opt_overload_balance_tolerance);
  *             core of the host. This will happen if the opt_runqueue
  *             parameter is set to 'core';
  *
+ * - per-LLC: meaning that there will be one runqueue per each group of
+ *            cpus sharing the same last level cache. On hosts where one
+ *            socket contains multiple LLC domains (e.g., several core
+ *            complexes per package) this keeps vcpus from being moved
+ *            back and forth between cache domains. This will happen if
+ *            the opt_runqueue parameter is set to 'llc';
+ *
  * - per-socket: meaning that there will be one runqueue per each physical
  *               socket (AKA package, which often, but not always, also
  *               matches a NUMA node) of the host; This will happen if
@@ -319,15 +354,18 @@ integer_param("credit2_balance_over", opt_overload_balance_tolerance);
  *           the opt_runqueue parameter is set to 'all'.
  *
  * Depending on the value of opt_runqueue, therefore, cpus that are part of
- * either the same physical core, the same physical socket, the same NUMA
- * node, or just all of them, will be put together to form runqueues.
+ * either the same physical core, the same last level cache, the same physical
+ * socket, the same NUMA node, or just all of them, will be put together to
+ * form runqueues.
  */
 #define OPT_RUNQUEUE_CORE   0
-#define OPT_RUNQUEUE_SOCKET 1
-#define OPT_RUNQUEUE_NODE   2
-#define OPT_RUNQUEUE_ALL    3
+#define OPT_RUNQUEUE_LLC    1
+#define OPT_RUNQUEUE_SOCKET 2
+#define OPT_RUNQUEUE_NODE   3
+#define OPT_RUNQUEUE_ALL    4
 static const char *const opt_runqueue_str[] = {
     [OPT_RUNQUEUE_CORE] = "core",
+    [OPT_RUNQUEUE_LLC] = "llc",
     [OPT_RUNQUEUE_SOCKET] = "socket",
     [OPT_RUNQUEUE_NODE] = "node",
     [OPT_RUNQUEUE_ALL] = "all"
@@ -372,6 +410,12 @@ struct csched2_runqueue_data {
     s_time_t load_last_update;  /* Last time average was updated */
     s_time_t avgload;           /* Decaying queue load */
     s_time_t b_avgload;         /* Decaying queue load modified by balancing */
+
+    s_time_t tslice;            /* Max timeslice, when adaptive             */
+    unsigned int ratelimit_us;  /* Ratelimit, when adaptive                 */
+    s_time_t adapt_last;        /* Last time tslice was adjusted            */
+    unsigned int nr_wakeups;    /* Wakeups since adapt_last                 */
+    unsigned int nr_expired;    /* Slices run to completion since adapt_last */
 };
 
 /*
@@ -390,6 +434,7 @@ struct csched2_private {
     unsigned int load_precision_shift;
     unsigned int load_window_shift;
     unsigned ratelimit_us; /* each cpupool can have its own ratelimit */
+    bool adaptive;         /* per-runqueue adaptive timeslicing */
 };
 
 /*
@@ -416,6 +461,9 @@ struct csched2_vcpu {
     s_time_t load_last_update;  /* Last time average was updated */
     s_time_t avgload;           /* Decaying queue load */
 
+    s_time_t last_run;          /* When we were last descheduled */
+    s_time_t balance_cost;      /* Migration cost, cached by balance_load() */
+
     struct csched2_runqueue_data *migrate_rqd; /* Pre-determined rqd to which to migrate */
 };
 
@@ -460,6 +508,19 @@ static inline struct csched2_runqueue_data *c2rqd(const struct scheduler *ops,
     return &csched2_priv(ops)->rqd[c2r(ops, cpu)];
 }
 
+/* Effective ratelimit and maximum timeslice of a runqueue. */
+static inline unsigned int rqd_ratelimit_us(const struct csched2_private *prv,
+                                            const struct csched2_runqueue_data *rqd)
+{
+    return prv->adaptive ? rqd->ratelimit_us : prv->ratelimit_us;
+}
+
+static inline s_time_t rqd_max_timer(const struct csched2_private *prv,
+                                     const struct csched2_runqueue_data *rqd)
+{
+    return prv->adaptive ? rqd->tslice : CSCHED2_MAX_TIMER;
+}
+
 /*
  * Hyperthreading (SMT) support.
  *
@@ -619,6 +680,11 @@ static void activate_runqueue(struct csched2_private *prv, int rqi)
     INIT_LIST_HEAD(&rqd->runq);
     spin_lock_init(&rqd->lock);
 
+    rqd->tslice = CSCHED2_MAX_TIMER;
+    rqd->ratelimit_us = prv->ratelimit_us;
+    rqd->adapt_last = NOW();
+    rqd->nr_wakeups = rqd->nr_expired = 0;
+
     __cpumask_set_cpu(rqi, &prv->active_queues);
 }
 
@@ -645,6 +711,12 @@ static inline bool same_socket(unsigned int cpua, unsigned int cpub)
     return cpu_to_socket(cpua) == cpu_to_socket(cpub);
 }
 
+static inline bool same_llc(unsigned int cpua, unsigned int cpub)
+{
+    return same_socket(cpua, cpub) &&
+           cpu_to_llc(cpua) == cpu_to_llc(cpub);
+}
+
 static inline bool same_core(unsigned int cpua, unsigned int cpub)
 {
     return same_socket(cpua, cpub) &&
@@ -685,6 +757,7 @@ cpu_to_runqueue(struct csched2_private *prv, unsigned int cpu)
 
         if ( opt_runqueue == OPT_RUNQUEUE_ALL ||
              (opt_runqueue == OPT_RUNQUEUE_CORE && same_core(peer_cpu, cpu)) ||
+             (opt_runqueue == OPT_RUNQUEUE_LLC && same_llc(peer_cpu, cpu)) ||
              (opt_runqueue == OPT_RUNQUEUE_SOCKET && same_socket(peer_cpu, cpu)) ||
              (opt_runqueue == OPT_RUNQUEUE_NODE && same_node(peer_cpu, cpu)) )
             break;
@@ -1570,7 +1643,8 @@ csched2_vcpu_wake(const struct scheduler *ops, struct vcpu *vc)
     now = NOW();
 
     update_load(ops, svc->rqd, svc, 1, now);
-        
+    svc->rqd->nr_wakeups++;
+
     /* Put the VCPU on the runq */
     runq_insert(ops, svc);
     runq_tickle(ops, svc, now);
@@ -1587,6 +1661,42 @@ csched2_vcpu_yield(const struct scheduler *ops, struct vcpu *v)
     __set_bit(__CSFLAG_vcpu_yield, &svc->flags);
 }
 
+/*
+ * Directed yield: v is spinning, and target (runnable, but preempted) may
+ * be what it is waiting for. If target has less credit than v, they swap
+ * credits, so target moves up in the runqueue (and, since v then yields,
+ * may well run right here). This only works within a runqueue (that's
+ * where credits are comparable) and, as v and target belong to the same
+ * domain, the domain's share is not affected.
+ */
+static int
+csched2_vcpu_yield_to(const struct scheduler *ops, struct vcpu *v,
+                      struct vcpu *target)
+{
+    struct csched2_vcpu * const svc = csched2_vcpu(v);
+    struct csched2_vcpu * const tsvc = csched2_vcpu(target);
+    s_time_t now = NOW();
+    int credit;
+
+    if ( !vcpu_on_runq(tsvc) || tsvc->rqd != svc->rqd )
+        return -EBUSY;
+
+    burn_credits(svc->rqd, svc, now);
+    if ( tsvc->credit >= svc->credit )
+        return -EBUSY;
+
+    credit = tsvc->credit;
+    tsvc->credit = svc->credit;
+    svc->credit = credit;
+    SCHED_STAT_CRANK(yield_to_credit_swap);
+
+    runq_remove(tsvc);
+    runq_insert(ops, tsvc);
+    runq_tickle(ops, tsvc, now);
+
+    return 0;
+}
+
 static void
 csched2_context_saved(const struct scheduler *ops, struct vcpu *vc)
 {
@@ -1622,6 +1732,66 @@ csched2_context_saved(const struct scheduler *ops, struct vcpu *vc)
     vcpu_schedule_unlock_irq(lock, vc);
 }
 
+/*
+ * Cache affinity.
+ *
+ * How much of its cache footprint a vcpu still has on the pcpu it last ran
+ * on is estimated from how long ago it ran there: the estimate is at its
+ * maximum while the vcpu is running, and decays linearly to zero over
+ * opt_cache_hot microseconds after it has been descheduled.
+ *
+ * The result is expressed in the same unit of the load averages (i.e., it
+ * is a fixed point value, with load_precision_shift fractional bits), so it
+ * can be added to them. At most, moving a vcpu away from its cache is
+ * considered as bad as adding half of a fully busy vcpu to the target.
+ */
+static s_time_t cache_warmth(const struct csched2_private *prv,
+                             const struct csched2_vcpu *svc, s_time_t now)
+{
+    s_time_t window = MICROSECS(opt_cache_hot);
+    s_time_t max = 1LL << (prv->load_precision_shift - 1);
+    s_time_t elapsed = 0;
+
+    if ( !opt_cache_hot )
+        return 0;
+
+    if ( !(svc->flags & CSFLAG_scheduled) )
+    {
+        elapsed = now - svc->last_run;
+        if ( svc->last_run == 0 || elapsed >= window )
+            return 0;
+        if ( elapsed < 0 )
+            elapsed = 0;
+    }
+
+    return (max * (window - elapsed)) / window;
+}
+
+/*
+ * Cost of moving svc to rqd, depending on how much of svc's cache it would
+ * lose. Moving to a runqueue containing the pcpu where svc last ran, or one
+ * of its SMT siblings, costs nothing. Moving to a runqueue sharing the last
+ * level cache with it costs half of the cache warmth of svc, while moving
+ * further away costs all of it.
+ */
+static s_time_t migrate_cost(const struct csched2_private *prv,
+                             const struct csched2_vcpu *svc,
+                             const struct csched2_runqueue_data *rqd,
+                             s_time_t now)
+{
+    unsigned int cpu = svc->vcpu->processor;
+    s_time_t warmth;
+
+    if ( cpumask_intersects(per_cpu(cpu_sibling_mask, cpu), &rqd->active) )
+        return 0;
+
+    warmth = cache_warmth(prv, svc, now);
+    if ( warmth && same_llc(cpu, cpumask_first(&rqd->active)) )
+        warmth >>= 1;
+
+    return warmth;
+}
+
 #define MAX_LOAD (STIME_MAX);
 static int
 csched2_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
@@ -1629,6 +1799,7 @@ csched2_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
     struct csched2_private *prv = csched2_priv(ops);
     int i, min_rqi = -1, new_cpu, cpu = vc->processor;
     struct csched2_vcpu *svc = csched2_vcpu(vc);
+    s_time_t now = NOW();
     s_time_t min_avgload = MAX_LOAD;
 
     ASSERT(!cpumask_empty(&prv->active_queues));
@@ -1708,6 +1879,9 @@ csched2_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
          * first time when we see such change, so it is indeed possible
          * that none of the cpus in svc's current runqueue is in our
          * (new) hard affinity!
+         *
+         * Other runqueues are also charged with what moving svc there
+         * would cost, in terms of cache warmth lost.
          */
         if ( rqd == svc->rqd )
         {
@@ -1717,7 +1891,8 @@ csched2_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
         else if ( spin_trylock(&rqd->lock) )
         {
             if ( cpumask_intersects(cpumask_scratch_cpu(cpu), &rqd->active) )
-                rqd_avgload = rqd->b_avgload;
+                rqd_avgload = rqd->b_avgload +
+                              migrate_cost(prv, svc, rqd, now);
 
             spin_unlock(&rqd->lock);
         }
@@ -1740,9 +1915,24 @@ csched2_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
 
     cpumask_and(cpumask_scratch_cpu(cpu), cpumask_scratch_cpu(cpu),
                 &prv->rqd[min_rqi].active);
-    new_cpu = cpumask_cycle(prv->rqd[min_rqi].pick_bias,
-                            cpumask_scratch_cpu(cpu));
-    prv->rqd[min_rqi].pick_bias = new_cpu;
+
+    /*
+     * If svc still has a warm cache where it last ran, and that is in the
+     * chosen runqueue, stay there. Otherwise, spread vcpus among the pcpus
+     * of the runqueue.
+     */
+    if ( cpumask_test_cpu(cpu, cpumask_scratch_cpu(cpu)) &&
+         cache_warmth(prv, svc, now) )
+    {
+        new_cpu = cpu;
+        SCHED_STAT_CRANK(pick_cache_hot);
+    }
+    else
+    {
+        new_cpu = cpumask_cycle(prv->rqd[min_rqi].pick_bias,
+                                cpumask_scratch_cpu(cpu));
+        prv->rqd[min_rqi].pick_bias = new_cpu;
+    }
     BUG_ON(new_cpu >= nr_cpu_ids);
 
  out_up:
@@ -1782,27 +1972,36 @@ static void consider(balance_state_t *st,
                      struct csched2_vcpu *push_svc,
                      struct csched2_vcpu *pull_svc)
 {
-    s_time_t l_load, o_load, delta;
+    s_time_t l_load, o_load, delta, cost;
 
     l_load = st->lrqd->b_avgload;
     o_load = st->orqd->b_avgload;
+    cost = 0;
     if ( push_svc )
     {
         /* What happens to the load on both if we push? */
         l_load -= push_svc->avgload;
         o_load += push_svc->avgload;
+        cost += push_svc->balance_cost;
     }
     if ( pull_svc )
     {
         /* What happens to the load on both if we pull? */
         l_load += pull_svc->avgload;
         o_load -= pull_svc->avgload;
+        cost += pull_svc->balance_cost;
     }
 
     delta = l_load - o_load;
     if ( delta < 0 )
         delta = -delta;
 
+    /*
+     * Moving vcpus around makes them lose (part of) their cache footprint:
+     * only do that if the improvement in balance is worth it.
+     */
+    delta += cost;
+
     if ( delta < st->load_delta )
     {
         st->load_delta = delta;
@@ -2038,12 +2237,18 @@ retry:
         if ( !vcpu_is_migrateable(push_svc, st.orqd) )
             continue;
 
+        push_svc->balance_cost = migrate_cost(prv, push_svc, st.orqd, now);
+
         list_for_each( pull_iter, &st.orqd->svc )
         {
             struct csched2_vcpu * pull_svc = list_entry(pull_iter, struct csched2_vcpu, rqd_elem);
             
             if ( !inner_load_updated )
+            {
                 update_svc_load(ops, pull_svc, 0, now);
+                pull_svc->balance_cost = migrate_cost(prv, pull_svc,
+                                                      st.lrqd, now);
+            }
         
             if ( !vcpu_is_migrateable(pull_svc, st.lrqd) )
                 continue;
@@ -2064,6 +2269,10 @@ retry:
         if ( !vcpu_is_migrateable(pull_svc, st.lrqd) )
             continue;
 
+        /* If there was nothing to push, costs have not been computed yet. */
+        if ( !inner_load_updated )
+            pull_svc->balance_cost = migrate_cost(prv, pull_svc, st.lrqd, now);
+
         /* Consider pull only */
         consider(&st, NULL, pull_svc);
     }
@@ -2205,7 +2414,9 @@ static int csched2_sys_cntl(const struct scheduler *ops,
 {
     xen_sysctl_credit2_schedule_t *params = &sc->u.sched_credit2;
     struct csched2_private *prv = csched2_priv(ops);
+    xen_sysctl_credit2_runq_t runq;
     unsigned long flags;
+    unsigned int i, n = 0;
 
     switch (sc->cmd )
     {
@@ -2221,11 +2432,51 @@ static int csched2_sys_cntl(const struct scheduler *ops,
         else if ( prv->ratelimit_us && !params->ratelimit_us )
             printk(XENLOG_INFO "Disabling context switch rate limiting\n");
         prv->ratelimit_us = params->ratelimit_us;
+
+        /*
+         * Restart adaptation from the configured values, on all runqueues.
+         * The per-runqueue values are updated (and used) with only the
+         * runqueue lock held, so we need that too.
+         */
+        for_each_cpu ( i, &prv->active_queues )
+        {
+            struct csched2_runqueue_data *rqd = prv->rqd + i;
+
+            spin_lock(&rqd->lock);
+            rqd->tslice = CSCHED2_MAX_TIMER;
+            rqd->ratelimit_us = prv->ratelimit_us;
+            rqd->adapt_last = NOW();
+            rqd->nr_wakeups = rqd->nr_expired = 0;
+            spin_unlock(&rqd->lock);
+        }
+        prv->adaptive = !!params->adaptive;
         write_unlock_irqrestore(&prv->lock, flags);
 
     /* FALLTHRU */
     case XEN_SYSCTL_SCHEDOP_getinfo:
+        read_lock_irqsave(&prv->lock, flags);
         params->ratelimit_us = prv->ratelimit_us;
+        params->adaptive = prv->adaptive;
+        for_each_cpu ( i, &prv->active_queues )
+        {
+            if ( !guest_handle_is_null(params->runqs) && n < params->nr_runqs )
+            {
+                runq.id = i;
+                runq.nr_cpus = cpumask_weight(&prv->rqd[i].active);
+                runq.tslice_us = rqd_max_timer(prv, &prv->rqd[i]) /
+                                 MICROSECS(1);
+                runq.ratelimit_us = rqd_ratelimit_us(prv, &prv->rqd[i]);
+
+                /* Don't copy to the guest while holding the lock. */
+                read_unlock_irqrestore(&prv->lock, flags);
+                if ( copy_to_guest_offset(params->runqs, n, &runq, 1) )
+                    return -EFAULT;
+                read_lock_irqsave(&prv->lock, flags);
+            }
+            n++;
+        }
+        params->nr_runqs = n;
+        read_unlock_irqrestore(&prv->lock, flags);
         break;
     }
 
@@ -2359,6 +2610,72 @@ csched2_vcpu_remove(const struct scheduler *ops, struct vcpu *vc)
     svc->sdom->nr_vcpus--;
 }
 
+/*
+ * Adjust the timeslice of a runqueue, see the comment close to the
+ * definition of opt_adaptive_tslice. Must be called with the runqueue
+ * lock held, and does something only once per CSCHED2_ADAPT_PERIOD.
+ */
+static void
+adapt_tslice(const struct csched2_private *prv,
+             struct csched2_runqueue_data *rqd, s_time_t now)
+{
+    s_time_t max_load;
+    bool overloaded;
+
+    if ( now - rqd->adapt_last < CSCHED2_ADAPT_PERIOD )
+        return;
+
+    max_load = (s_time_t)cpumask_weight(&rqd->active) <<
+               prv->load_precision_shift;
+    overloaded = rqd->avgload > max_load;
+
+    if ( overloaded && rqd->nr_wakeups > rqd->nr_expired )
+    {
+        if ( rqd->tslice > CSCHED2_MIN_TSLICE )
+        {
+            rqd->tslice = max(rqd->tslice / 2, CSCHED2_MIN_TSLICE);
+            SCHED_STAT_CRANK(tslice_shrink);
+        }
+    }
+    else if ( !overloaded || rqd->nr_expired > 2 * rqd->nr_wakeups )
+    {
+        if ( rqd->tslice < CSCHED2_MAX_TIMER )
+        {
+            rqd->tslice = min(rqd->tslice * 2, CSCHED2_MAX_TIMER);
+            SCHED_STAT_CRANK(tslice_grow);
+        }
+    }
+
+    /* Scale the ratelimit as well, but never below the minimum allowed. */
+    rqd->ratelimit_us = prv->ratelimit_us;
+    if ( rqd->ratelimit_us )
+        rqd->ratelimit_us = max_t(unsigned int,
+                                  prv->ratelimit_us * rqd->tslice /
+                                  CSCHED2_MAX_TIMER,
+                                  XEN_SYSCTL_SCHED_RATELIMIT_MIN);
+
+    if ( unlikely(tb_init_done) )
+    {
+        struct {
+            unsigned rqi:16, overloaded:16;
+            unsigned tslice_us, ratelimit_us;
+            unsigned wakeups, expired;
+        } d;
+        d.rqi = rqd->id;
+        d.overloaded = overloaded;
+        d.tslice_us = rqd->tslice / MICROSECS(1);
+        d.ratelimit_us = rqd->ratelimit_us;
+        d.wakeups = rqd->nr_wakeups;
+        d.expired = rqd->nr_expired;
+        __trace_var(TRC_CSCHED2_ADAPT_TSLICE, 1,
+                    sizeof(d),
+                    (unsigned char *)&d);
+    }
+
+    rqd->adapt_last = now;
+    rqd->nr_wakeups = rqd->nr_expired = 0;
+}
+
 /* How long should we let this vcpu run for? */
 static s_time_t
 csched2_runtime(const struct scheduler *ops, int cpu,
@@ -2369,6 +2686,8 @@ csched2_runtime(const struct scheduler *ops, int cpu,
     struct csched2_runqueue_data *rqd = c2rqd(ops, cpu);
     struct list_head *runq = &rqd->runq;
     struct csched2_private *prv = csched2_priv(ops);
+    unsigned int ratelimit_us = rqd_ratelimit_us(prv, rqd);
+    s_time_t max_time = rqd_max_timer(prv, rqd);
 
     /*
      * If we're idle, just stay so. Others (or external events)
@@ -2387,12 +2706,12 @@ csched2_runtime(const struct scheduler *ops, int cpu,
 
     /* Calculate mintime */
     min_time = CSCHED2_MIN_TIMER;
-    if ( prv->ratelimit_us )
+    if ( ratelimit_us )
     {
-        s_time_t ratelimit_min = MICROSECS(prv->ratelimit_us);
+        s_time_t ratelimit_min = MICROSECS(ratelimit_us);
         if ( snext->vcpu->is_running )
             ratelimit_min = snext->vcpu->runstate.state_entry_time +
-                            MICROSECS(prv->ratelimit_us) - now;
+                            MICROSECS(ratelimit_us) - now;
         if ( ratelimit_min > min_time )
             min_time = ratelimit_min;
     }
@@ -2435,9 +2754,9 @@ csched2_runtime(const struct scheduler *ops, int cpu,
         time = min_time;
         SCHED_STAT_CRANK(runtime_min_timer);
     }
-    else if (time > CSCHED2_MAX_TIMER)
+    else if (time > max_time)
     {
-        time = CSCHED2_MAX_TIMER;
+        time = max_time;
         SCHED_STAT_CRANK(runtime_max_timer);
     }
 
@@ -2456,6 +2775,7 @@ runq_candidate(struct csched2_runqueue_data *rqd,
     struct list_head *iter;
     struct csched2_vcpu *snext = NULL;
     struct csched2_private *prv = csched2_priv(per_cpu(scheduler, cpu));
+    unsigned int ratelimit_us = rqd_ratelimit_us(prv, rqd);
     bool yield = __test_and_clear_bit(__CSFLAG_vcpu_yield, &scurr->flags);
 
     *skipped = 0;
@@ -2469,10 +2789,10 @@ runq_candidate(struct csched2_runqueue_data *rqd,
      * In fact, it may be the case that scurr is about to spin, and there's
      * no point forcing it to do so until rate limiting expires.
      */
-    if ( !yield && prv->ratelimit_us && !is_idle_vcpu(scurr->vcpu) &&
-         vcpu_runnable(scurr->vcpu) &&
+    if ( !yield && ratelimit_us && !is_idle_vcpu(scurr->vcpu) &&
+         vcpu_runnable(scurr->vcpu) && sched_core_allowed(cpu, scurr->vcpu) &&
          (now - scurr->vcpu->runstate.state_entry_time) <
-          MICROSECS(prv->ratelimit_us) )
+          MICROSECS(ratelimit_us) )
     {
         if ( unlikely(tb_init_done) )
         {
@@ -2490,8 +2810,11 @@ runq_candidate(struct csched2_runqueue_data *rqd,
         return scurr;
     }
 
-    /* Default to current if runnable, idle otherwise */
-    if ( vcpu_runnable(scurr->vcpu) )
+    /*
+     * Default to current if runnable (and, with core scheduling, if still
+     * compatible with what is running on our siblings), idle otherwise.
+     */
+    if ( vcpu_runnable(scurr->vcpu) && sched_core_allowed(cpu, scurr->vcpu) )
         snext = scurr;
     else
         snext = csched2_vcpu(idle_vcpu[cpu]);
@@ -2519,6 +2842,17 @@ runq_candidate(struct csched2_runqueue_data *rqd,
             continue;
         }
 
+        /*
+         * With core scheduling, only consider vcpus of the domain which is
+         * running on our siblings, if any. Let the core know we're waiting.
+         */
+        if ( !sched_core_allowed(cpu, svc->vcpu) )
+        {
+            (*skipped)++;
+            sched_core_defer(cpu, svc->vcpu);
+            continue;
+        }
+
         /*
          * If a vcpu is meant to be picked up by another processor, and such
          * processor has not scheduled yet, leave it in the runqueue for him.
@@ -2667,7 +3001,14 @@ csched2_schedule(
     if ( snext != scurr
          && !is_idle_vcpu(scurr->vcpu)
          && vcpu_runnable(current) )
+    {
         __set_bit(__CSFLAG_delayed_runq_add, &scurr->flags);
+        rqd->nr_expired++;
+    }
+
+    /* Cache warmth of a vcpu starts decaying when it is descheduled. */
+    if ( snext != scurr && !is_idle_vcpu(scurr->vcpu) )
+        scurr->last_run = now;
 
     ret.migrated = 0;
 
@@ -2748,6 +3089,9 @@ csched2_schedule(
         update_load(ops, rqd, NULL, 0, now);
     }
 
+    if ( csched2_priv(ops)->adaptive )
+        adapt_tslice(csched2_priv(ops), rqd, now);
+
     /*
      * Return task to run next...
      */
@@ -2829,7 +3173,9 @@ csched2_dump(const struct scheduler *ops)
                "\tmax_weight         = %u\n"
                "\tpick_bias          = %u\n"
                "\tinstload           = %d\n"
-               "\taveload            = %"PRI_stime" (~%"PRI_stime"%%)\n",
+               "\taveload            = %"PRI_stime" (~%"PRI_stime"%%)\n"
+               "\ttslice             = %"PRI_stime"us\n"
+               "\tratelimit          = %uus\n",
                i,
                cpumask_weight(&prv->rqd[i].active),
                cpustr,
@@ -2837,7 +3183,9 @@ csched2_dump(const struct scheduler *ops)
                prv->rqd[i].pick_bias,
                prv->rqd[i].load,
                prv->rqd[i].avgload,
-               fraction);
+               fraction,
+               rqd_max_timer(prv, &prv->rqd[i]) / MICROSECS(1),
+               rqd_ratelimit_us(prv, &prv->rqd[i]));
 
         cpumask_scnprintf(cpustr, sizeof(cpustr), &prv->rqd[i].idle);
         printk("\tidlers: %s\n", cpustr);
@@ -3119,6 +3467,7 @@ csched2_init(struct scheduler *ops)
     }
     /* initialize ratelimit */
     prv->ratelimit_us = sched_ratelimit_us;
+    prv->adaptive = opt_adaptive_tslice;
 
     prv->load_precision_shift = opt_load_precision_shift;
     prv->load_window_shift = opt_load_window_shift - LOADAVG_GRANULARITY_SHIFT;
@@ -3152,6 +3501,7 @@ static const struct scheduler sched_credit2_def = {
     .sleep          = csched2_vcpu_sleep,
     .wake           = csched2_vcpu_wake,
     .yield          = csched2_vcpu_yield,
+    .yield_to       = csched2_vcpu_yield_to,
 
     .adjust         = csched2_dom_cntl,
     .adjust_global  = csched2_sys_cntl,
@@ -667,6 +667,15 @@ static struct task_slice null_schedule(const struct scheduler *ops,
                   ret.task == NULL ||
                   !vcpu_runnable(ret.task)) )
         ret.task = idle_vcpu[cpu];
+    else if ( unlikely(!sched_core_allowed(cpu, ret.task)) )
+    {
+        /*
+         * With core scheduling, our vcpu must wait for the domain running
+         * on our siblings to leave the core. It stays assigned to us.
+         */
+        sched_core_defer(cpu, ret.task);
+        ret.task = idle_vcpu[cpu];
+    }
 
     NULL_VCPU_CHECK(ret.task);
     return ret;
@@ -62,24 +62,51 @@
  * When a VCPU has no task but with budget left, its budget is preserved.
  *
  * Queue scheme:
- * A global runqueue and a global depletedqueue for each CPU pool.
+ * A runqueue, a depletedqueue and a replenishment queue for each cluster
+ * of PCPUs (see below). By default, there is only one cluster per CPU pool.
  * The runqueue holds all runnable VCPUs with budget, sorted by deadline;
  * The depletedqueue holds all VCPUs without budget, unsorted;
  *
  * Note: cpumask and cpupool is supported.
  */
 
+/*
+ * Clustering:
+ * The PCPUs of a CPU pool are arranged in clusters, and EDF is applied
+ * within each cluster, on the cluster's own queues. How clusters are
+ * formed is decided per CPU pool (XEN_SYSCTL_SCHEDOP_putinfo, while the
+ * pool has no PCPUs yet), starting from the rtds_cluster boot parameter:
+ * - 'all' (default): one cluster with all the PCPUs, i.e., global EDF;
+ * - 'node': one cluster per NUMA node;
+ * - 'socket': one cluster per physical socket;
+ * - 'core': one cluster per physical core;
+ * - 'cpu': one cluster per PCPU, i.e., partitioned EDF.
+ *
+ * VCPUs move between clusters by means of a simple push/pull balancer:
+ * - push: when a VCPU wakes up (or is replenished) and there is no PCPU
+ *   in its cluster that it can preempt, an idle PCPU of another cluster,
+ *   within the VCPU's affinity, is tickled;
+ * - pull: when a PCPU would otherwise go idle, it looks in the RunQ of
+ *   the other clusters (using trylock) and steals the VCPU with the
+ *   earliest deadline among the ones that can run on it.
+ */
+
 /*
  * Locking:
- * A global system lock is used to protect the RunQ and DepletedQ.
- * The global lock is referenced by schedule_data.schedule_lock
- * from all physical cpus.
+ * Each cluster has its own lock, protecting its RunQ, DepletedQ and
+ * replenishment queue. The lock of a cluster is referenced by
+ * schedule_data.schedule_lock of all the physical cpus of the cluster.
  *
  * The lock is already grabbed when calling wake/sleep/schedule/ functions
  * in schedule.c
  *
  * The functions involes RunQ and needs to grab locks are:
  *    vcpu_insert, vcpu_remove, context_saved, runq_insert
+ *
+ * A private scheduler lock protects the list of domains and the
+ * arrangement of the clusters. If both are needed, the private lock must
+ * be taken first. A cluster lock can be taken while holding another
+ * cluster lock only with trylock (see runq_steal()).
  */
 
 
@@ -161,21 +188,67 @@
 #define TRC_RTDS_SCHED_TASKLET    TRC_SCHED_CLASS_EVT(RTDS, 5)
 #define TRC_RTDS_SCHEDULE         TRC_SCHED_CLASS_EVT(RTDS, 6)
 
+#define OPT_CLUSTER_CPU     XEN_SYSCTL_RTDS_CLUSTER_CPU
+#define OPT_CLUSTER_CORE    XEN_SYSCTL_RTDS_CLUSTER_CORE
+#define OPT_CLUSTER_SOCKET  XEN_SYSCTL_RTDS_CLUSTER_SOCKET
+#define OPT_CLUSTER_NODE    XEN_SYSCTL_RTDS_CLUSTER_NODE
+#define OPT_CLUSTER_ALL     XEN_SYSCTL_RTDS_CLUSTER_ALL
+static const char *const opt_cluster_str[] = {
+    [OPT_CLUSTER_CPU] = "cpu",
+    [OPT_CLUSTER_CORE] = "core",
+    [OPT_CLUSTER_SOCKET] = "socket",
+    [OPT_CLUSTER_NODE] = "node",
+    [OPT_CLUSTER_ALL] = "all"
+};
+static int __read_mostly opt_cluster = OPT_CLUSTER_ALL;
+
+static void parse_rtds_cluster(const char *s)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(opt_cluster_str); i++ )
+    {
+        if ( !strcmp(s, opt_cluster_str[i]) )
+        {
+            opt_cluster = i;
+            return;
+        }
+    }
+
+    printk("WARNING, unrecognized value of rtds_cluster option!\n");
+}
+custom_param("rtds_cluster", parse_rtds_cluster);
+
 static void repl_timer_handler(void *data);
 
 /*
- * System-wide private data, include global RunQueue/DepletedQ
- * Global lock is referenced by schedule_data.schedule_lock from all
- * physical cpus. It can be grabbed via vcpu_schedule_lock_irq()
+ * Per-cluster data, including the cluster's RunQueue/DepletedQ
+ * The cluster lock is referenced by schedule_data.schedule_lock from all
+ * the physical cpus of the cluster. It can be grabbed via
+ * vcpu_schedule_lock_irq()
  */
-struct rt_private {
-    spinlock_t lock;            /* the global coarse-grained lock */
-    struct list_head sdom;      /* list of availalbe domains, used for dump */
+struct rt_cluster {
+    int id;                     /* index in rt_private.clusters, or -1 */
+    const struct scheduler *ops;/* up-pointer, for the timer handler */
+    spinlock_t lock;            /* the cluster lock */
+    cpumask_t cpus;             /* cpus belonging to the cluster */
     struct list_head runq;      /* ordered list of runnable vcpus */
     struct list_head depletedq; /* unordered list of depleted vcpus */
     struct list_head replq;     /* ordered list of vcpus that need replenishment */
     cpumask_t tickled;          /* cpus been tickled */
-    struct timer *repl_timer;   /* replenishment timer */
+    struct timer repl_timer;    /* replenishment timer */
+};
+
+/*
+ * System-wide private data
+ */
+struct rt_private {
+    spinlock_t lock;            /* protects sdom and clusters arrangement */
+    struct list_head sdom;      /* list of availalbe domains, used for dump */
+    unsigned int cluster;       /* clusters arrangement (OPT_CLUSTER_*) */
+    int cluster_map[NR_CPUS];   /* cpu to cluster index */
+    cpumask_t active_clusters;  /* clusters with at least one cpu */
+    struct rt_cluster *clusters;
 };
 
 /*
@@ -227,19 +300,20 @@ static inline struct rt_dom *rt_dom(const struct domain *dom)
     return dom->sched_priv;
 }
 
-static inline struct list_head *rt_runq(const struct scheduler *ops)
+/* CPU to cluster struct */
+static inline struct rt_cluster *rt_cluster(const struct scheduler *ops,
+                                            unsigned int cpu)
 {
-    return &rt_priv(ops)->runq;
-}
+    struct rt_private *prv = rt_priv(ops);
 
-static inline struct list_head *rt_depletedq(const struct scheduler *ops)
-{
-    return &rt_priv(ops)->depletedq;
+    return &prv->clusters[prv->cluster_map[cpu]];
 }
 
-static inline struct list_head *rt_replq(const struct scheduler *ops)
+/* The cluster a vcpu is in, which is the one of the cpu it is assigned to */
+static inline struct rt_cluster *vcpu_cluster(const struct scheduler *ops,
+                                              const struct rt_vcpu *svc)
 {
-    return &rt_priv(ops)->replq;
+    return rt_cluster(ops, svc->vcpu->processor);
 }
 
 /*
@@ -318,58 +392,72 @@ rt_dump_vcpu(const struct scheduler *ops, const struct rt_vcpu *svc)
 static void
 rt_dump_pcpu(const struct scheduler *ops, int cpu)
 {
-    struct rt_private *prv = rt_priv(ops);
     struct rt_vcpu *svc;
+    spinlock_t *lock;
     unsigned long flags;
 
-    spin_lock_irqsave(&prv->lock, flags);
-    printk("CPU[%02d]\n", cpu);
+    lock = pcpu_schedule_lock_irqsave(cpu, &flags);
+    printk("CPU[%02d] cluster %d\n", cpu, rt_priv(ops)->cluster_map[cpu]);
     /* current VCPU (nothing to say if that's the idle vcpu). */
     svc = rt_vcpu(curr_on_cpu(cpu));
     if ( svc && !is_idle_vcpu(svc->vcpu) )
     {
         rt_dump_vcpu(ops, svc);
     }
-    spin_unlock_irqrestore(&prv->lock, flags);
+    pcpu_schedule_unlock_irqrestore(lock, flags, cpu);
 }
 
 static void
 rt_dump(const struct scheduler *ops)
 {
-    struct list_head *runq, *depletedq, *replq, *iter;
+    struct list_head *iter;
     struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl;
     struct rt_vcpu *svc;
     struct rt_dom *sdom;
     unsigned long flags;
+    unsigned int i;
 
     spin_lock_irqsave(&prv->lock, flags);
 
+    printk("Clusters arrangement: %s\n", opt_cluster_str[prv->cluster]);
+
     if ( list_empty(&prv->sdom) )
         goto out;
 
-    runq = rt_runq(ops);
-    depletedq = rt_depletedq(ops);
-    replq = rt_replq(ops);
-
-    printk("Global RunQueue info:\n");
-    list_for_each ( iter, runq )
+    for_each_cpu ( i, &prv->active_clusters )
     {
-        svc = q_elem(iter);
-        rt_dump_vcpu(ops, svc);
-    }
+        cl = &prv->clusters[i];
 
-    printk("Global DepletedQueue info:\n");
-    list_for_each ( iter, depletedq )
-    {
-        svc = q_elem(iter);
-        rt_dump_vcpu(ops, svc);
-    }
+        /* We already hold the private lock, and IRQs are disabled. */
+        spin_lock(&cl->lock);
 
-    printk("Global Replenishment Events info:\n");
-    list_for_each ( iter, replq )
-    {
-        svc = replq_elem(iter);
-        rt_dump_vcpu(ops, svc);
+        cpulist_scnprintf(keyhandler_scratch, sizeof(keyhandler_scratch),
+                          &cl->cpus);
+        printk("Cluster %d: cpus=%s\n", cl->id, keyhandler_scratch);
+
+        printk("RunQueue info:\n");
+        list_for_each ( iter, &cl->runq )
+        {
+            svc = q_elem(iter);
+            rt_dump_vcpu(ops, svc);
+        }
+
+        printk("DepletedQueue info:\n");
+        list_for_each ( iter, &cl->depletedq )
+        {
+            svc = q_elem(iter);
+            rt_dump_vcpu(ops, svc);
+        }
+
+        printk("Replenishment Events info:\n");
+        list_for_each ( iter, &cl->replq )
+        {
+            svc = replq_elem(iter);
+            rt_dump_vcpu(ops, svc);
+        }
+
+        spin_unlock(&cl->lock);
     }
 
     printk("Domain info:\n");
@@ -382,8 +470,11 @@ rt_dump(const struct scheduler *ops)
 
         for_each_vcpu ( sdom->dom, v )
         {
+            spinlock_t *lock = vcpu_schedule_lock(v);
+
             svc = rt_vcpu(v);
             rt_dump_vcpu(ops, svc);
+            vcpu_schedule_unlock(lock, v);
         }
     }
 
@@ -496,8 +587,8 @@ q_remove(struct rt_vcpu *svc)
 static inline void
 replq_remove(const struct scheduler *ops, struct rt_vcpu *svc)
 {
-    struct rt_private *prv = rt_priv(ops);
-    struct list_head *replq = rt_replq(ops);
+    struct rt_cluster *cl = vcpu_cluster(ops, svc);
+    struct list_head *replq = &cl->replq;
 
     ASSERT( vcpu_on_replq(svc) );
 
@@ -512,10 +603,10 @@ replq_remove(const struct scheduler *ops, struct rt_vcpu *svc)
         if ( !list_empty(replq) )
         {
             struct rt_vcpu *svc_next = replq_elem(replq->next);
-            set_timer(prv->repl_timer, svc_next->cur_deadline);
+            set_timer(&cl->repl_timer, svc_next->cur_deadline);
         }
         else
-            stop_timer(prv->repl_timer);
+            stop_timer(&cl->repl_timer);
     }
 }
 
@@ -527,25 +618,23 @@ replq_remove(const struct scheduler *ops, struct rt_vcpu *svc)
 static void
 runq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 {
-    struct rt_private *prv = rt_priv(ops);
-    struct list_head *runq = rt_runq(ops);
+    struct rt_cluster *cl = vcpu_cluster(ops, svc);
 
-    ASSERT( spin_is_locked(&prv->lock) );
+    ASSERT( spin_is_locked(&cl->lock) );
     ASSERT( !vcpu_on_q(svc) );
     ASSERT( vcpu_on_replq(svc) );
 
     /* add svc to runq if svc still has budget */
     if ( svc->cur_budget > 0 )
-        deadline_runq_insert(svc, &svc->q_elem, runq);
+        deadline_runq_insert(svc, &svc->q_elem, &cl->runq);
     else
-        list_add(&svc->q_elem, &prv->depletedq);
+        list_add(&svc->q_elem, &cl->depletedq);
 }
 
 static void
 replq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 {
-    struct list_head *replq = rt_replq(ops);
-    struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl = vcpu_cluster(ops, svc);
 
     ASSERT( !vcpu_on_replq(svc) );
 
@@ -553,8 +642,8 @@ replq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
      * The timer may be re-programmed if svc is inserted
      * at the front of the event list.
      */
-    if ( deadline_replq_insert(svc, &svc->replq_elem, replq) )
-        set_timer(prv->repl_timer, svc->cur_deadline);
+    if ( deadline_replq_insert(svc, &svc->replq_elem, &cl->replq) )
+        set_timer(&cl->repl_timer, svc->cur_deadline);
 }
 
 /*
@@ -566,7 +655,7 @@ replq_insert(const struct scheduler *ops, struct rt_vcpu *svc)
 static void
 replq_reinsert(const struct scheduler *ops, struct rt_vcpu *svc)
 {
-    struct list_head *replq = rt_replq(ops);
+    struct list_head *replq = &vcpu_cluster(ops, svc)->replq;
     struct rt_vcpu *rearm_svc = svc;
     bool_t rearm = 0;
 
@@ -591,7 +680,7 @@ replq_reinsert(const struct scheduler *ops, struct rt_vcpu *svc)
         rearm = deadline_replq_insert(svc, &svc->replq_elem, replq);
 
     if ( rearm )
-        set_timer(rt_priv(ops)->repl_timer, rearm_svc->cur_deadline);
+        set_timer(&vcpu_cluster(ops, svc)->repl_timer, rearm_svc->cur_deadline);
 }
 
 /*
@@ -617,6 +706,101 @@ rt_cpu_pick(const struct scheduler *ops, struct vcpu *vc)
     return cpu;
 }
 
+/*
+ * Cluster related code
+ */
+static void
+activate_cluster(struct rt_private *prv, int ci)
+{
+    struct rt_cluster *cl = &prv->clusters[ci];
+
+    BUG_ON(!cpumask_empty(&cl->cpus));
+
+    cl->id = ci;
+    INIT_LIST_HEAD(&cl->runq);
+    INIT_LIST_HEAD(&cl->depletedq);
+    INIT_LIST_HEAD(&cl->replq);
+    cpumask_clear(&cl->tickled);
+
+    __cpumask_set_cpu(ci, &prv->active_clusters);
+}
+
+static void
+deactivate_cluster(struct rt_private *prv, int ci)
+{
+    struct rt_cluster *cl = &prv->clusters[ci];
+
+    BUG_ON(!cpumask_empty(&cl->cpus));
+    ASSERT(list_empty(&cl->runq) && list_empty(&cl->depletedq) &&
+           list_empty(&cl->replq));
+
+    cl->id = -1;
+
+    __cpumask_clear_cpu(ci, &prv->active_clusters);
+}
+
+static inline bool
+same_node(unsigned int cpua, unsigned int cpub)
+{
+    return cpu_to_node(cpua) == cpu_to_node(cpub);
+}
+
+static inline bool
+same_socket(unsigned int cpua, unsigned int cpub)
+{
+    return cpu_to_socket(cpua) == cpu_to_socket(cpub);
+}
+
+static inline bool
+same_core(unsigned int cpua, unsigned int cpub)
+{
+    return same_socket(cpua, cpub) &&
+           cpu_to_core(cpua) == cpu_to_core(cpub);
+}
+
+static unsigned int
+cpu_to_cluster(struct rt_private *prv, unsigned int cpu)
+{
+    struct rt_cluster *cl;
+    unsigned int ci;
+
+    for ( ci = 0; ci < nr_cpu_ids; ci++ )
+    {
+        unsigned int peer_cpu;
+
+        /*
+         * As soon as we come across an uninitialized cluster, use it: we
+         * either are dealing with the first cpu, or none of the active
+         * clusters matches the topology of this one.
+         */
+        if ( prv->clusters[ci].id == -1 )
+            break;
+
+        if ( prv->cluster == OPT_CLUSTER_ALL )
+            break;
+
+        cl = &prv->clusters[ci];
+        BUG_ON(cpumask_empty(&cl->cpus));
+
+        peer_cpu = cpumask_first(&cl->cpus);
+        BUG_ON(cpu_to_socket(cpu) == XEN_INVALID_SOCKET_ID ||
+               cpu_to_socket(peer_cpu) == XEN_INVALID_SOCKET_ID);
+
+        if ( (prv->cluster == OPT_CLUSTER_CORE &&
+              same_core(peer_cpu, cpu)) ||
+             (prv->cluster == OPT_CLUSTER_SOCKET &&
+              same_socket(peer_cpu, cpu)) ||
+             (prv->cluster == OPT_CLUSTER_NODE &&
+              same_node(peer_cpu, cpu)) )
+            break;
+    }
+
+    /* We really expect to be able to assign each cpu to a cluster. */
+    BUG_ON(ci >= nr_cpu_ids);
+
+    return ci;
+}
+
 /*
  * Init/Free related code
  */
@@ -624,26 +808,37 @@ static int
 rt_init(struct scheduler *ops)
 {
     int rc = -ENOMEM;
+    unsigned int i;
     struct rt_private *prv = xzalloc(struct rt_private);
 
     printk("Initializing RTDS scheduler\n"
            "WARNING: This is experimental software in development.\n"
            "Use at your own risk.\n");
+    printk(XENLOG_INFO " clusters arrangement: %s\n",
+           opt_cluster_str[opt_cluster]);
 
     if ( prv == NULL )
         goto err;
 
-    prv->repl_timer = xzalloc(struct timer);
-    if ( prv->repl_timer == NULL )
+    prv->clusters = xzalloc_array(struct rt_cluster, nr_cpu_ids);
+    if ( prv->clusters == NULL )
         goto err;
 
     spin_lock_init(&prv->lock);
     INIT_LIST_HEAD(&prv->sdom);
-    INIT_LIST_HEAD(&prv->runq);
-    INIT_LIST_HEAD(&prv->depletedq);
-    INIT_LIST_HEAD(&prv->replq);
+    prv->cluster = opt_cluster;
 
-    cpumask_clear(&prv->tickled);
+    /*
+     * Cluster locks are initialized once and for all here, as other
+     * clusters may trylock them (see runq_steal()) at any time.
+     */
+    for ( i = 0; i < nr_cpu_ids; i++ )
+    {
+        prv->cluster_map[i] = -1;
+        prv->clusters[i].id = -1;
+        prv->clusters[i].ops = ops;
+        spin_lock_init(&prv->clusters[i].lock);
+    }
 
     ops->sched_data = prv;
     rc = 0;
@@ -651,7 +846,7 @@ rt_init(struct scheduler *ops)
  err:
     if ( rc && prv )
     {
-        xfree(prv->repl_timer);
+        xfree(prv->clusters);
         xfree(prv);
     }
 
@@ -662,43 +857,79 @@ static void
 rt_deinit(struct scheduler *ops)
 {
     struct rt_private *prv = rt_priv(ops);
+    unsigned int i;
 
-    ASSERT(prv->repl_timer->status == TIMER_STATUS_invalid ||
-           prv->repl_timer->status == TIMER_STATUS_killed);
-    xfree(prv->repl_timer);
+    for ( i = 0; i < nr_cpu_ids; i++ )
+        ASSERT(prv->clusters[i].repl_timer.status == TIMER_STATUS_invalid ||
+               prv->clusters[i].repl_timer.status == TIMER_STATUS_killed);
+    xfree(prv->clusters);
 
     ops->sched_data = NULL;
     xfree(prv);
 }
 
 /*
- * Point per_cpu spinlock to the global system lock;
- * All cpu have same global system lock
+ * Assign cpu to its cluster (activating it, if necessary), and make sure
+ * the cluster has its replenishment timer ready.
+ */
+static struct rt_cluster *
+init_pdata(struct rt_private *prv, unsigned int cpu)
+{
+    struct rt_cluster *cl;
+    unsigned int ci;
+
+    ASSERT(spin_is_locked(&prv->lock));
+
+    ci = cpu_to_cluster(prv, cpu);
+    cl = &prv->clusters[ci];
+
+    printk(XENLOG_INFO "RTDS: adding cpu %u to cluster %u\n", cpu, ci);
+    if ( !cpumask_test_cpu(ci, &prv->active_clusters) )
+        activate_cluster(prv, ci);
+
+    /*
+     * If we are the absolute first cpu of the cluster (in which case we'll
+     * see TIMER_STATUS_invalid), or the first one that is added back to a
+     * cluster that had all its cpus removed (in which case we'll see
+     * TIMER_STATUS_killed), it's our job to (re)initialize the timer.
+     */
+    if ( cl->repl_timer.status == TIMER_STATUS_invalid ||
+         cl->repl_timer.status == TIMER_STATUS_killed )
+    {
+        init_timer(&cl->repl_timer, repl_timer_handler, cl, cpu);
+        dprintk(XENLOG_DEBUG, "RTDS: timer of cluster %u initialized on cpu %u\n",
+                ci, cpu);
+    }
+
+    prv->cluster_map[cpu] = ci;
+    __cpumask_set_cpu(cpu, &cl->cpus);
+
+    return cl;
+}
+
+/*
+ * Point per_cpu spinlock to the lock of the cluster of the cpu;
+ * All the cpus of a cluster have the same lock
  */
 static void
 rt_init_pdata(const struct scheduler *ops, void *pdata, int cpu)
 {
     struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl;
     spinlock_t *old_lock;
     unsigned long flags;
 
-    old_lock = pcpu_schedule_lock_irqsave(cpu, &flags);
+    spin_lock_irqsave(&prv->lock, flags);
+    old_lock = pcpu_schedule_lock(cpu);
 
-    /*
-     * TIMER_STATUS_invalid means we are the first cpu that sees the timer
-     * allocated but not initialized, and so it's up to us to initialize it.
-     */
-    if ( prv->repl_timer->status == TIMER_STATUS_invalid )
-    {
-        init_timer(prv->repl_timer, repl_timer_handler, (void*) ops, cpu);
-        dprintk(XENLOG_DEBUG, "RTDS: timer initialized on cpu %u\n", cpu);
-    }
+    cl = init_pdata(prv, cpu);
 
-    /* Move the scheduler lock to our global runqueue lock.  */
-    per_cpu(schedule_data, cpu).schedule_lock = &prv->lock;
+    /* Move the scheduler lock to our cluster lock.  */
+    per_cpu(schedule_data, cpu).schedule_lock = &cl->lock;
 
     /* _Not_ pcpu_schedule_unlock(): per_cpu().schedule_lock changed! */
-    spin_unlock_irqrestore(old_lock, flags);
+    spin_unlock(old_lock);
+    spin_unlock_irqrestore(&prv->lock, flags);
 }
 
 /* Change the scheduler of cpu to us (RTDS). */
@@ -708,6 +939,7 @@ rt_switch_sched(struct scheduler *new_ops, unsigned int cpu,
 {
     struct rt_private *prv = rt_priv(new_ops);
     struct rt_vcpu *svc = vdata;
+    struct rt_cluster *cl;
 
     ASSERT(!pdata && svc && is_idle_vcpu(svc->vcpu));
 
@@ -715,23 +947,15 @@ rt_switch_sched(struct scheduler *new_ops, unsigned int cpu,
      * We are holding the runqueue lock already (it's been taken in
      * schedule_cpu_switch()). It's actually the runqueue lock of
      * another scheduler, but that is how things need to be, for
-     * preventing races.
+     * preventing races. As it belongs to another scheduler, it has no
+     * particular ordering relationship with our private lock.
      */
-    ASSERT(per_cpu(schedule_data, cpu).schedule_lock != &prv->lock);
+    ASSERT(!local_irq_is_enabled());
+    spin_lock(&prv->lock);
 
-    /*
-     * If we are the absolute first cpu being switched toward this
-     * scheduler (in which case we'll see TIMER_STATUS_invalid), or the
-     * first one that is added back to the cpupool that had all its cpus
-     * removed (in which case we'll see TIMER_STATUS_killed), it's our
-     * job to (re)initialize the timer.
-     */
-    if ( prv->repl_timer->status == TIMER_STATUS_invalid ||
-         prv->repl_timer->status == TIMER_STATUS_killed )
-    {
-        init_timer(prv->repl_timer, repl_timer_handler, (void*) new_ops, cpu);
-        dprintk(XENLOG_DEBUG, "RTDS: timer initialized on cpu %u\n", cpu);
-    }
+    cl = init_pdata(prv, cpu);
+
+    ASSERT(per_cpu(schedule_data, cpu).schedule_lock != &cl->lock);
 
     idle_vcpu[cpu]->sched_priv = vdata;
     per_cpu(scheduler, cpu) = new_ops;
@@ -743,7 +967,9 @@ rt_switch_sched(struct scheduler *new_ops, unsigned int cpu,
      * taking it, find all the initializations we've done above in place.
      */
     smp_mb();
-    per_cpu(schedule_data, cpu).schedule_lock = &prv->lock;
+    per_cpu(schedule_data, cpu).schedule_lock = &cl->lock;
+
+    spin_unlock(&prv->lock);
 }
 
 static void
@@ -751,30 +977,47 @@ rt_deinit_pdata(const struct scheduler *ops, void *pcpu, int cpu)
 {
     unsigned long flags;
     struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl;
+    int ci;
 
     spin_lock_irqsave(&prv->lock, flags);
 
-    if ( prv->repl_timer->cpu == cpu )
+    ci = prv->cluster_map[cpu];
+    cl = &prv->clusters[ci];
+
+    /* No need to save IRQs here, they're already disabled */
+    spin_lock(&cl->lock);
+
+    printk(XENLOG_INFO "RTDS: removing cpu %d from cluster %d\n", cpu, ci);
+
+    __cpumask_clear_cpu(cpu, &cl->cpus);
+    __cpumask_clear_cpu(cpu, &cl->tickled);
+
+    if ( cl->repl_timer.cpu == cpu )
     {
-        struct cpupool *c = per_cpu(cpupool, cpu);
-        unsigned int new_cpu = cpumask_cycle(cpu, cpupool_online_cpumask(c));
+        unsigned int new_cpu = cpumask_first(&cl->cpus);
 
         /*
-         * Make sure the timer run on one of the cpus that are still available
-         * to this scheduler. If there aren't any left, it means it's the time
+         * Make sure the timer run on one of the cpus that are still part
+         * of the cluster. If there aren't any left, it means it's the time
          * to just kill it.
          */
         if ( new_cpu >= nr_cpu_ids )
         {
-            kill_timer(prv->repl_timer);
+            kill_timer(&cl->repl_timer);
             dprintk(XENLOG_DEBUG, "RTDS: timer killed on cpu %d\n", cpu);
         }
         else
         {
-            migrate_timer(prv->repl_timer, new_cpu);
+            migrate_timer(&cl->repl_timer, new_cpu);
         }
     }
 
+    if ( cpumask_empty(&cl->cpus) )
+        deactivate_cluster(prv, ci);
+
+    spin_unlock(&cl->lock);
+
     spin_unlock_irqrestore(&prv->lock, flags);
 }
 
@@ -989,9 +1232,9 @@ burn_budget(const struct scheduler *ops, struct rt_vcpu *svc, s_time_t now)
  * lock is grabbed before calling this function
  */
 static struct rt_vcpu *
-runq_pick(const struct scheduler *ops, const cpumask_t *mask)
+runq_pick(struct rt_cluster *cl, const cpumask_t *mask)
 {
-    struct list_head *runq = rt_runq(ops);
+    struct list_head *runq = &cl->runq;
     struct list_head *iter;
     struct rt_vcpu *svc = NULL;
     struct rt_vcpu *iter_svc = NULL;
@@ -1036,6 +1279,68 @@ runq_pick(const struct scheduler *ops, const cpumask_t *mask)
     return svc;
 }
 
+/*
+ * Pull a vcpu that can run on cpu from the RunQ of another cluster.
+ * The other clusters are looked at in turn, starting from the one after
+ * cpu's own, and the earliest deadline vcpu of the first cluster that has
+ * one which can run on cpu is stolen. As we already hold our own cluster
+ * lock, only trylock can be used on the others.
+ * The lock of cpu's cluster is grabbed before calling this function
+ */
+static struct rt_vcpu *
+runq_steal(const struct scheduler *ops, unsigned int cpu)
+{
+    struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl = rt_cluster(ops, cpu);
+    struct rt_vcpu *svc = NULL;
+    unsigned int ci = cl->id;
+
+    ASSERT( spin_is_locked(&cl->lock) );
+
+    while ( (ci = cpumask_cycle(ci, &prv->active_clusters)) != cl->id )
+    {
+        struct rt_cluster *peer = &prv->clusters[ci];
+
+        if ( list_empty(&peer->runq) )
+            continue;
+
+        if ( !spin_trylock(&peer->lock) )
+        {
+            SCHED_STAT_CRANK(rtds_pull_trylock_failed);
+            continue;
+        }
+
+        /* Check again, with the lock held, that the cluster is still there. */
+        if ( peer->id == ci )
+            svc = runq_pick(peer, cpumask_of(cpu));
+
+        if ( svc != NULL )
+        {
+            /*
+             * svc is in peer's queues, and not running, so we can move it to
+             * ours. As we hold both the locks, and the lock of svc is going
+             * to change from peer's to ours when we update its processor,
+             * anyone waiting for peer's lock will see that, and retry.
+             */
+            q_remove(svc);
+            replq_remove(ops, svc);
+            svc->vcpu->processor = cpu;
+            replq_insert(ops, svc);
+            runq_insert(ops, svc);
+        }
+
+        spin_unlock(&peer->lock);
+
+        if ( svc != NULL )
+        {
+            SCHED_STAT_CRANK(rtds_pull);
+            break;
+        }
+    }
+
+    return svc;
+}
+
 /*
  * schedule function for rt scheduler.
  * The lock is already grabbed in schedule.c, no need to lock here
@@ -1044,7 +1349,7 @@ static struct task_slice
 rt_schedule(const struct scheduler *ops, s_time_t now, bool_t tasklet_work_scheduled)
 {
     const int cpu = smp_processor_id();
-    struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl = rt_cluster(ops, cpu);
     struct rt_vcpu *const scurr = rt_vcpu(current);
     struct rt_vcpu *snext = NULL;
     struct task_slice ret = { .migrated = 0 };
@@ -1056,7 +1361,7 @@ rt_schedule(const struct scheduler *ops, s_time_t now, bool_t tasklet_work_sched
         } d;
         d.cpu = cpu;
         d.tasklet = tasklet_work_scheduled;
-        d.tickled = cpumask_test_cpu(cpu, &prv->tickled);
+        d.tickled = cpumask_test_cpu(cpu, &cl->tickled);
         d.idle = is_idle_vcpu(current);
         trace_var(TRC_RTDS_SCHEDULE, 1,
                   sizeof(d),
@@ -1064,7 +1369,7 @@ rt_schedule(const struct scheduler *ops, s_time_t now, bool_t tasklet_work_sched
     }
 
     /* clear ticked bit now that we've been scheduled */
-    cpumask_clear_cpu(cpu, &prv->tickled);
+    cpumask_clear_cpu(cpu, &cl->tickled);
 
     /* burn_budget would return for IDLE VCPU */
     burn_budget(ops, scurr, now);
@@ -1076,7 +1381,19 @@ rt_schedule(const struct scheduler *ops, s_time_t now, bool_t tasklet_work_sched
     }
     else
     {
-        snext = runq_pick(ops, cpumask_of(cpu));
+        snext = runq_pick(cl, cpumask_of(cpu));
+
+        /*
+         * If there is nothing we can run in our cluster, and we can't just
+         * keep running scurr either, try to pull something from the others.
+         */
+        if ( snext == NULL &&
+             cpumask_weight(&rt_priv(ops)->active_clusters) > 1 &&
+             (is_idle_vcpu(current) || !vcpu_runnable(current) ||
+              scurr->cur_budget <= 0) &&
+             (snext = runq_steal(ops, cpu)) != NULL )
+            ret.migrated = 1;
+
         if ( snext == NULL )
             snext = rt_vcpu(idle_vcpu[cpu]);
 
@@ -1159,7 +1476,7 @@ rt_vcpu_sleep(const struct scheduler *ops, struct vcpu *vc)
 static void
 runq_tickle(const struct scheduler *ops, struct rt_vcpu *new)
 {
-    struct rt_private *prv = rt_priv(ops);
+    struct rt_cluster *cl;
     struct rt_vcpu *latest_deadline_vcpu = NULL; /* lowest priority */
     struct rt_vcpu *iter_svc;
     struct vcpu *iter_vc;
@@ -1170,9 +1487,11 @@ runq_tickle(const struct scheduler *ops, struct rt_vcpu *new)
     if ( new == NULL || is_idle_vcpu(new->vcpu) )
         return;
 
+    cl = vcpu_cluster(ops, new);
     online = cpupool_domain_cpumask(new->vcpu->domain);
     cpumask_and(&not_tickled, online, new->vcpu->cpu_hard_affinity);
-    cpumask_andnot(&not_tickled, &not_tickled, &prv->tickled);
+    cpumask_and(&not_tickled, &not_tickled, &cl->cpus);
+    cpumask_andnot(&not_tickled, &not_tickled, &cl->tickled);
 
     /* 1) if new's previous cpu is idle, kick it for cache benefit */
     if ( is_idle_vcpu(curr_on_cpu(new->vcpu->processor)) )
@@ -1208,6 +1527,28 @@ runq_tickle(const struct scheduler *ops, struct rt_vcpu *new)
         goto out;
     }
 
+    /*
+     * 4) no one to preempt in our cluster, push: if there is an idle pcpu
+     *    in another cluster, kick it, and it will pull new from our RunQ.
+     *    We don't hold the locks of the other clusters, so what we see is
+     *    just a hint, but the worst that can happen is a useless tickle.
+     */
+    if ( cpumask_weight(&rt_priv(ops)->active_clusters) > 1 )
+    {
+        cpumask_and(&not_tickled, online, new->vcpu->cpu_hard_affinity);
+        cpumask_andnot(&not_tickled, &not_tickled, &cl->cpus);
+        for_each_cpu(cpu, &not_tickled)
+        {
+            if ( is_idle_vcpu(curr_on_cpu(cpu)) &&
+                 !cpumask_test_cpu(cpu, &rt_cluster(ops, cpu)->tickled) )
+            {
+                SCHED_STAT_CRANK(rtds_push);
+                cpu_to_tickle = cpu;
+                goto out;
+            }
+        }
+    }
+
     /* didn't tickle any cpu */
     SCHED_STAT_CRANK(tickled_no_cpu);
     return;
@@ -1224,7 +1565,7 @@ runq_tickle(const struct scheduler *ops, struct rt_vcpu *new)
                   (unsigned char *)&d);
     }
 
-    cpumask_set_cpu(cpu_to_tickle, &prv->tickled);
+    cpumask_set_cpu(cpu_to_tickle, &rt_cluster(ops, cpu_to_tickle)->tickled);
     cpu_raise_softirq(cpu_to_tickle, SCHEDULE_SOFTIRQ);
     return;
 }
@@ -1338,9 +1679,9 @@ rt_dom_cntl(
     struct domain *d,
     struct xen_domctl_scheduler_op *op)
 {
-    struct rt_private *prv = rt_priv(ops);
     struct rt_vcpu *svc;
     struct vcpu *v;
+    spinlock_t *lock;
     unsigned long flags;
     int rc = 0;
     xen_domctl_schedparam_vcpu_t local_sched;
@@ -1360,14 +1701,14 @@ rt_dom_cntl(
             rc = -EINVAL;
             break;
         }
-        spin_lock_irqsave(&prv->lock, flags);
         for_each_vcpu ( d, v )
         {
+            lock = vcpu_schedule_lock_irqsave(v, &flags);
             svc = rt_vcpu(v);
             svc->period = MICROSECS(op->u.rtds.period); /* transfer to nanosec */
             svc->budget = MICROSECS(op->u.rtds.budget);
+            vcpu_schedule_unlock_irqrestore(lock, flags, v);
         }
-        spin_unlock_irqrestore(&prv->lock, flags);
         break;
     case XEN_DOMCTL_SCHEDOP_getvcpuinfo:
     case XEN_DOMCTL_SCHEDOP_putvcpuinfo:
@@ -1388,11 +1729,12 @@ rt_dom_cntl(
 
             if ( op->cmd == XEN_DOMCTL_SCHEDOP_getvcpuinfo )
             {
-                spin_lock_irqsave(&prv->lock, flags);
-                svc = rt_vcpu(d->vcpu[local_sched.vcpuid]);
+                v = d->vcpu[local_sched.vcpuid];
+                lock = vcpu_schedule_lock_irqsave(v, &flags);
+                svc = rt_vcpu(v);
                 local_sched.u.rtds.budget = svc->budget / MICROSECS(1);
                 local_sched.u.rtds.period = svc->period / MICROSECS(1);
-                spin_unlock_irqrestore(&prv->lock, flags);
+                vcpu_schedule_unlock_irqrestore(lock, flags, v);
 
                 if ( copy_to_guest_offset(op->u.v.vcpus, index,
                                           &local_sched, 1) )
@@ -1412,11 +1754,12 @@ rt_dom_cntl(
                     break;
                 }
 
-                spin_lock_irqsave(&prv->lock, flags);
-                svc = rt_vcpu(d->vcpu[local_sched.vcpuid]);
+                v = d->vcpu[local_sched.vcpuid];
+                lock = vcpu_schedule_lock_irqsave(v, &flags);
+                svc = rt_vcpu(v);
                 svc->period = period;
                 svc->budget = budget;
-                spin_unlock_irqrestore(&prv->lock, flags);
+                vcpu_schedule_unlock_irqrestore(lock, flags, v);
             }
             /* Process a most 64 vCPUs without checking for preemptions. */
             if ( (++index > 63) && hypercall_preempt_check() )
@@ -1431,22 +1774,74 @@ rt_dom_cntl(
     return rc;
 }
 
+/*
+ * set/get the clusters arrangement of the cpupool
+ */
+static int
+rt_sys_cntl(
+    const struct scheduler *ops,
+    struct xen_sysctl_scheduler_op *sc)
+{
+    xen_sysctl_rtds_schedule_t *params = &sc->u.sched_rtds;
+    struct rt_private *prv = rt_priv(ops);
+    unsigned long flags;
+    int rc = 0;
+
+    switch ( sc->cmd )
+    {
+    case XEN_SYSCTL_SCHEDOP_putinfo:
+        if ( params->cluster >= ARRAY_SIZE(opt_cluster_str) )
+            return -EINVAL;
+
+        spin_lock_irqsave(&prv->lock, flags);
+        /*
+         * Clusters are formed as PCPUs are added to the pool, in
+         * init_pdata(), so the arrangement can't change under the feet of
+         * the ones that are already there.
+         */
+        if ( params->cluster != prv->cluster &&
+             !cpumask_empty(&prv->active_clusters) )
+            rc = -EBUSY;
+        else if ( params->cluster != prv->cluster )
+        {
+            printk(XENLOG_INFO "RTDS: clusters arrangement: %s\n",
+                   opt_cluster_str[params->cluster]);
+            prv->cluster = params->cluster;
+        }
+        spin_unlock_irqrestore(&prv->lock, flags);
+
+        if ( rc )
+            break;
+
+    /* FALLTHRU */
+    case XEN_SYSCTL_SCHEDOP_getinfo:
+        params->cluster = prv->cluster;
+        break;
+
+    default:
+        rc = -EINVAL;
+        break;
+    }
+
+    return rc;
+}
+
 /*
  * The replenishment timer handler picks vcpus
- * from the replq and does the actual replenishment.
+ * from the replq of a cluster and does the actual replenishment.
  */
 static void repl_timer_handler(void *data){
     s_time_t now;
-    struct scheduler *ops = data;
-    struct rt_private *prv = rt_priv(ops);
-    struct list_head *replq = rt_replq(ops);
-    struct list_head *runq = rt_runq(ops);
-    struct timer *repl_timer = prv->repl_timer;
+    struct rt_cluster *cl = data;
+    const struct scheduler *ops = cl->ops;
+    struct list_head *replq = &cl->replq;
+    struct list_head *runq = &cl->runq;
+    struct timer *repl_timer = &cl->repl_timer;
     struct list_head *iter, *tmp;
     struct rt_vcpu *svc;
     LIST_HEAD(tmp_replq);
 
-    spin_lock_irq(&prv->lock);
+    spin_lock_irq(&cl->lock);
 
     now = NOW();
 
@@ -1509,7 +1904,7 @@ static void repl_timer_handler(void *data){
     if ( !list_empty(replq) )
         set_timer(repl_timer, replq_elem(replq->next)->cur_deadline);
 
-    spin_unlock_irq(&prv->lock);
+    spin_unlock_irq(&cl->lock);
 }
 
 static const struct scheduler sched_rtds_def = {
@@ -1535,6 +1930,7 @@ static const struct scheduler sched_rtds_def = {
     .remove_vcpu    = rt_vcpu_remove,
 
     .adjust         = rt_dom_cntl,
+    .adjust_global  = rt_sys_cntl,
 
     .pick_cpu       = rt_cpu_pick,
     .do_schedule    = rt_schedule,
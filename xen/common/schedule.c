@@ -33,6 +33,7 @@
 #include <xen/multicall.h>
 #include <xen/cpu.h>
 #include <xen/preempt.h>
+#include <xen/keyhandler.h>
 #include <xen/event.h>
 #include <public/sched.h>
 #include <xsm/xsm.h>
@@ -54,6 +55,25 @@ boolean_param("sched_smt_power_savings", sched_smt_power_savings);
  * */
 int sched_ratelimit_us = SCHED_DEFAULT_RATELIMIT_US;
 integer_param("sched_ratelimit_us", sched_ratelimit_us);
+
+/* Boost a preempted sibling when a vcpu is found spinning (see below). */
+static bool __read_mostly opt_directed_yield = true;
+boolean_param("sched_directed_yield", opt_directed_yield);
+
+/*
+ * Scheduling granularity: 'cpu' (default) schedules each pCPU on its own,
+ * 'core' only lets vcpus of the same domain run at the same time on the
+ * SMT siblings of a core (see struct sched_core in sched-if.h).
+ */
+static bool __read_mostly opt_sched_core;
+static void __init parse_sched_gran(const char *s)
+{
+    if ( !strcmp(s, "core") )
+        opt_sched_core = true;
+    else if ( strcmp(s, "cpu") )
+        printk("WARNING: unrecognized value of sched_gran option!\n");
+}
+custom_param("sched_gran", parse_sched_gran);
 /* Various timer handlers. */
 static void s_timer_fn(void *unused);
 static void vcpu_periodic_timer_fn(void *data);
@@ -67,6 +87,27 @@ DEFINE_PER_CPU(struct scheduler *, scheduler);
 /* Scratch space for cpumasks. */
 DEFINE_PER_CPU(cpumask_t, cpumask_scratch);
 
+/*
+ * Scheduling latency histograms (see XEN_SYSCTL_sched_stats).
+ *
+ * The per-pCPU ones are only ever updated by the pCPU itself, so plain
+ * increments are enough. The per-domain ones are updated by all the pCPUs
+ * running the domain's vcpus, and atomic increments are used for them.
+ * Neither needs any lock.
+ */
+struct sched_hist {
+    unsigned long h[XEN_SYSCTL_SCHED_STATS_NR][XEN_SYSCTL_SCHED_STATS_BUCKETS];
+};
+static DEFINE_PER_CPU(struct sched_hist, sched_hist);
+
+/* Core scheduling state (NULL if core scheduling is disabled). */
+DEFINE_PER_CPU(struct sched_core *, sched_core);
+DEFINE_PER_CPU(bool, sched_core_busy);
+DEFINE_PER_CPU(bool, sched_core_waiting);
+static DEFINE_PER_CPU(struct sched_core *, sched_core_spare);
+/* Domain whose vcpu may have its context loaded on the pCPU, if any. */
+static DEFINE_PER_CPU(const struct domain *, sched_core_guest);
+
 extern const struct scheduler *__start_schedulers_array[], *__end_schedulers_array[];
 #define NUM_SCHEDULERS (__end_schedulers_array - __start_schedulers_array)
 #define schedulers __start_schedulers_array
@@ -149,6 +190,136 @@ static inline void trace_continue_running(struct vcpu *v)
     __trace_var(TRC_SCHED_CONTINUE_RUNNING, 1/*tsc*/, sizeof(d), &d);
 }
 
+static inline void sched_hist_add(const struct domain *d, unsigned int which,
+                                  s_time_t t)
+{
+    unsigned int b = 0;
+
+    if ( t > 0 )
+        b = min_t(unsigned int, fls64(t) - 1,
+                  XEN_SYSCTL_SCHED_STATS_BUCKETS - 1);
+
+    this_cpu(sched_hist).h[which][b]++;
+    if ( d->sched_hist )
+        arch_fetch_and_add(&d->sched_hist->h[which][b], 1);
+}
+
+static void sched_hist_copy(XEN_GUEST_HANDLE_64(uint64) hist,
+                            const struct sched_hist *src, int *rc)
+{
+    unsigned int i, j;
+
+    for ( i = 0; i < XEN_SYSCTL_SCHED_STATS_NR; i++ )
+        for ( j = 0; j < XEN_SYSCTL_SCHED_STATS_BUCKETS; j++ )
+        {
+            uint64_t val = read_atomic(&src->h[i][j]);
+
+            if ( copy_to_guest_offset(hist,
+                                      i * XEN_SYSCTL_SCHED_STATS_BUCKETS + j,
+                                      &val, 1) )
+            {
+                *rc = -EFAULT;
+                return;
+            }
+        }
+}
+
+long sched_stats_op(struct xen_sysctl_sched_stats *op)
+{
+    struct domain *d;
+    unsigned int cpu;
+    int rc = 0;
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_SCHED_STATS_get_pcpu:
+        /*
+         * Offline pCPUs have no per-CPU area. As we are not preventing
+         * hotplug, it must be fine for the numbers to be stale.
+         */
+        if ( op->id >= nr_cpu_ids || !cpu_online(op->id) )
+            return -ENODEV;
+        sched_hist_copy(op->hist, &per_cpu(sched_hist, op->id), &rc);
+        break;
+
+    case XEN_SYSCTL_SCHED_STATS_get_domain:
+        d = rcu_lock_domain_by_id(op->id);
+        if ( d == NULL )
+            return -ESRCH;
+        if ( d->sched_hist )
+            sched_hist_copy(op->hist, d->sched_hist, &rc);
+        else
+            rc = -ENODATA;
+        rcu_unlock_domain(d);
+        break;
+
+    case XEN_SYSCTL_SCHED_STATS_reset:
+        for_each_online_cpu ( cpu )
+            memset(&per_cpu(sched_hist, cpu), 0, sizeof(struct sched_hist));
+        rcu_read_lock(&domlist_read_lock);
+        for_each_domain ( d )
+            if ( d->sched_hist )
+                memset(d->sched_hist, 0, sizeof(*d->sched_hist));
+        rcu_read_unlock(&domlist_read_lock);
+        break;
+
+    default:
+        rc = -EOPNOTSUPP;
+        break;
+    }
+
+    return rc;
+}
+
+static void sched_hist_print(const char *name, const unsigned long *h)
+{
+    unsigned int i;
+    unsigned long n = 0;
+
+    for ( i = 0; i < XEN_SYSCTL_SCHED_STATS_BUCKETS; i++ )
+        n += h[i];
+    if ( !n )
+        return;
+
+    printk("  %-5s %8lu:", name, n);
+    for ( i = 0; i < XEN_SYSCTL_SCHED_STATS_BUCKETS; i++ )
+        if ( h[i] )
+            printk(" 2^%u:%lu", i, h[i]);
+    printk("\n");
+}
+
+static void sched_hist_dump(const struct sched_hist *hist)
+{
+    sched_hist_print("wake", hist->h[XEN_SYSCTL_SCHED_STATS_wake]);
+    sched_hist_print("wait", hist->h[XEN_SYSCTL_SCHED_STATS_wait]);
+    sched_hist_print("slice", hist->h[XEN_SYSCTL_SCHED_STATS_slice]);
+}
+
+static void dump_sched_hist(unsigned char key)
+{
+    struct domain *d;
+    unsigned int cpu;
+
+    printk("'%c' pressed -> dumping scheduling latency histograms\n", key);
+    printk("(bucket 2^i counts samples in [2^i, 2^(i+1)) ns)\n");
+
+    for_each_online_cpu ( cpu )
+    {
+        printk("CPU%u:\n", cpu);
+        sched_hist_dump(&per_cpu(sched_hist, cpu));
+    }
+
+    rcu_read_lock(&domlist_read_lock);
+    for_each_domain ( d )
+    {
+        if ( !d->sched_hist )
+            continue;
+        printk("d%d:\n", d->domain_id);
+        sched_hist_dump(d->sched_hist);
+    }
+    rcu_read_unlock(&domlist_read_lock);
+}
+
 static inline void vcpu_urgent_count_update(struct vcpu *v)
 {
     if ( is_idle_vcpu(v) )
@@ -417,12 +588,27 @@ int sched_init_domain(struct domain *d, int poolid)
 
     ASSERT(d->cpupool == NULL);
 
+    if ( !is_idle_domain(d) )
+    {
+        d->sched_hist = xzalloc(struct sched_hist);
+        if ( d->sched_hist == NULL )
+            return -ENOMEM;
+    }
+
     if ( (ret = cpupool_add_domain(d, poolid)) )
-        return ret;
+        goto fail;
 
     SCHED_STAT_CRANK(dom_init);
     TRACE_1D(TRC_SCHED_DOM_ADD, d->domain_id);
-    return SCHED_OP(dom_scheduler(d), init_domain, d);
+    if ( (ret = SCHED_OP(dom_scheduler(d), init_domain, d)) )
+        goto fail;
+
+    return 0;
+
+ fail:
+    xfree(d->sched_hist);
+    d->sched_hist = NULL;
+    return ret;
 }
 
 void sched_destroy_domain(struct domain *d)
@@ -434,6 +620,9 @@ void sched_destroy_domain(struct domain *d)
     SCHED_OP(dom_scheduler(d), destroy_domain, d);
 
     cpupool_rm_domain(d);
+
+    xfree(d->sched_hist);
+    d->sched_hist = NULL;
 }
 
 void vcpu_sleep_nosync(struct vcpu *v)
@@ -478,7 +667,10 @@ void vcpu_wake(struct vcpu *v)
     if ( likely(vcpu_runnable(v)) )
     {
         if ( v->runstate.state >= RUNSTATE_blocked )
+        {
             vcpu_runstate_change(v, RUNSTATE_runnable, NOW());
+            v->sched_woken = true;
+        }
         SCHED_OP(vcpu_scheduler(v), wake, v);
     }
     else if ( !(v->pause_flags & VPF_blocked) )
@@ -1003,6 +1195,74 @@ long vcpu_yield(void)
     return 0;
 }
 
+/* Ask the scheduler to let t (preempted) run ahead of its turn, for v. */
+static int vcpu_yield_to(struct vcpu *v, struct vcpu *t)
+{
+    const struct scheduler *ops = vcpu_scheduler(v);
+    spinlock_t *lock, *t_lock;
+    unsigned long flags;
+    int rc = -EBUSY;
+
+    /* v is running, so its lock can't change, but t may be migrating. */
+    lock = per_cpu(schedule_data, v->processor).schedule_lock;
+    for ( ; ; )
+    {
+        t_lock = per_cpu(schedule_data, t->processor).schedule_lock;
+        sched_spin_lock_double(lock, t_lock, &flags);
+        if ( t_lock == per_cpu(schedule_data, t->processor).schedule_lock )
+            break;
+        sched_spin_unlock_double(lock, t_lock, flags);
+    }
+
+    if ( t->runstate.state == RUNSTATE_runnable && !t->is_running &&
+         vcpu_runnable(t) && vcpu_scheduler(t) == ops )
+        rc = SCHED_OP(ops, yield_to, v, t);
+
+    sched_spin_unlock_double(lock, t_lock, flags);
+
+    return rc;
+}
+
+/*
+ * Directed yield, to mitigate lock-holder preemption.
+ *
+ * current has been found spinning (e.g., it took a PAUSE-loop exit), most
+ * likely waiting for a lock held by a sibling that has been preempted.
+ * Look for a sibling which is runnable but not running, starting from the
+ * one after the one we boosted last time (so all get a chance, in case
+ * there are many), have the scheduler boost it, and then yield.
+ */
+long vcpu_directed_yield(void)
+{
+    struct vcpu *v = current, *t;
+    struct domain *d = v->domain;
+    unsigned int i, id;
+
+    if ( !opt_directed_yield || !vcpu_scheduler(v)->yield_to )
+        return vcpu_yield();
+
+    id = ACCESS_ONCE(d->last_boosted_vcpu);
+    for ( i = 0; i < d->max_vcpus; i++ )
+    {
+        if ( ++id >= d->max_vcpus )
+            id = 0;
+        t = d->vcpu[id];
+        if ( t == NULL || t == v || t->runstate.state != RUNSTATE_runnable )
+            continue;
+
+        if ( vcpu_yield_to(v, t) == 0 )
+        {
+            d->last_boosted_vcpu = id;
+            SCHED_STAT_CRANK(vcpu_yield_to);
+            TRACE_3D(TRC_SCHED_YIELD_TO, d->domain_id, v->vcpu_id, t->vcpu_id);
+            return vcpu_yield();
+        }
+    }
+
+    SCHED_STAT_CRANK(vcpu_yield_to_none);
+    return vcpu_yield();
+}
+
 static void domain_watchdog_timeout(void *data)
 {
     struct domain *d = data;
@@ -1374,6 +1634,180 @@ static void vcpu_periodic_timer_work(struct vcpu *v)
     set_timer(&v->periodic_timer, periodic_next_event);
 }
 
+/* Only schedulers which honour sched_core_allowed() can do core scheduling. */
+static bool sched_core_supported(const struct scheduler *sched)
+{
+    return sched->sched_id == XEN_SCHEDULER_CREDIT2 ||
+           sched->sched_id == XEN_SCHEDULER_NULL;
+}
+
+/* Make the siblings of cpu that are (or are not) busy reschedule. */
+static void sched_core_kick(unsigned int cpu, bool busy)
+{
+    const struct sched_core *core = per_cpu(sched_core, cpu);
+    unsigned int sibling;
+
+    for_each_cpu ( sibling, per_cpu(cpu_sibling_mask, cpu) )
+        if ( sibling != cpu && per_cpu(sched_core, sibling) == core &&
+             per_cpu(sched_core_busy, sibling) == busy )
+            cpu_raise_softirq(sibling, SCHEDULE_SOFTIRQ);
+}
+
+/*
+ * Called by the schedulers, from within do_schedule, when a runnable vcpu
+ * could not be picked on cpu because a sibling is running another domain.
+ */
+void sched_core_defer(unsigned int cpu, const struct vcpu *v)
+{
+    struct sched_core *core = per_cpu(sched_core, cpu);
+
+    ASSERT(core && spin_is_locked(&core->lock));
+
+    if ( !per_cpu(sched_core_waiting, cpu) )
+    {
+        per_cpu(sched_core_waiting, cpu) = true;
+        core->nr_waiting++;
+    }
+    if ( core->next == NULL )
+        core->next = v->domain;
+
+    SCHED_STAT_CRANK(sched_core_defer);
+}
+
+/*
+ * The core lock only serialises the scheduling decisions: a sibling that has
+ * decided to stop running a vcpu of the owner is still switching away from
+ * it for a while, with its context loaded. Before cpu loads the context of a
+ * vcpu of d, wait until no sibling has one of another domain's loaded, which
+ * makes the context switches themselves a rendezvous.
+ *
+ * This can't deadlock: a sibling can only have decided to run d (and come
+ * here) after the siblings running other domains decided to stop, and they
+ * don't wait for anyone to finish switching away.
+ */
+static void sched_core_enter(unsigned int cpu, const struct domain *d)
+{
+    const struct sched_core *core = per_cpu(sched_core, cpu);
+    const struct domain *other;
+    unsigned int sibling;
+    bool waited = false;
+
+    if ( per_cpu(sched_core_guest, cpu) == d )
+        return;
+
+    for_each_cpu ( sibling, per_cpu(cpu_sibling_mask, cpu) )
+    {
+        if ( sibling == cpu || per_cpu(sched_core, sibling) != core )
+            continue;
+
+        while ( (other = ACCESS_ONCE(per_cpu(sched_core_guest, sibling))) &&
+                other != d )
+        {
+            waited = true;
+            cpu_relax();
+        }
+    }
+
+    if ( waited )
+        SCHED_STAT_CRANK(sched_core_rendezvous);
+
+    per_cpu(sched_core_guest, cpu) = d;
+    smp_mb();
+}
+
+/*
+ * Account for what cpu is going to run, once the scheduler has decided, and
+ * possibly shorten the time slice, if cpu has to wait for the owner of the
+ * core to give it up.
+ */
+static void sched_core_update(struct sched_core *core, unsigned int cpu,
+                              const struct vcpu *next, s_time_t now,
+                              s_time_t *time)
+{
+    bool *busy = &per_cpu(sched_core_busy, cpu);
+
+    if ( !is_idle_vcpu(next) )
+    {
+        ASSERT(core->owner == next->domain || core->nr_busy == *busy);
+
+        if ( core->owner != next->domain )
+        {
+            /*
+             * We are taking the core, the other siblings should come and
+             * see if there is anything they can run now.
+             */
+            core->owner = next->domain;
+            core->owned_since = now;
+            if ( core->next == next->domain )
+                core->next = NULL;
+            core->draining = false;
+            sched_core_kick(cpu, false);
+        }
+        if ( !*busy )
+        {
+            *busy = true;
+            core->nr_busy++;
+        }
+    }
+    else if ( *busy )
+    {
+        *busy = false;
+        if ( --core->nr_busy == 0 )
+        {
+            /* Last one out: the core is free, let the waiters in. */
+            core->owner = NULL;
+            core->next = NULL;
+            core->draining = false;
+            if ( core->nr_waiting )
+                sched_core_kick(cpu, false);
+        }
+    }
+
+    if ( !per_cpu(sched_core_waiting, cpu) || core->owner == NULL ||
+         core->draining )
+        return;
+
+    /*
+     * We are idling because of the owner of the core. If it has had the
+     * core for long enough, ask it to leave. If not, come back when it has.
+     */
+    if ( now - core->owned_since >= SCHED_CORE_SLICE )
+    {
+        core->draining = true;
+        sched_core_kick(cpu, true);
+        SCHED_STAT_CRANK(sched_core_drain);
+    }
+    else if ( *time < 0 || *time > core->owned_since + SCHED_CORE_SLICE - now )
+        *time = core->owned_since + SCHED_CORE_SLICE - now;
+}
+
+static spinlock_t *sched_core_lock(struct sched_core *core, unsigned int cpu)
+{
+    if ( likely(core == NULL) )
+        return pcpu_schedule_lock_irq(cpu);
+
+    spin_lock_irq(&core->lock);
+    if ( per_cpu(sched_core_waiting, cpu) )
+    {
+        per_cpu(sched_core_waiting, cpu) = false;
+        core->nr_waiting--;
+    }
+    return pcpu_schedule_lock(cpu);
+}
+
+static void sched_core_unlock(struct sched_core *core, spinlock_t *lock,
+                              unsigned int cpu)
+{
+    if ( likely(core == NULL) )
+    {
+        pcpu_schedule_unlock_irq(lock, cpu);
+        return;
+    }
+
+    pcpu_schedule_unlock(lock, cpu);
+    spin_unlock_irq(&core->lock);
+}
+
 /* 
  * The main function
  * - deschedule the current domain (scheduler independent).
@@ -1389,6 +1823,7 @@ static void schedule(void)
     struct schedule_data *sd;
     spinlock_t           *lock;
     struct task_slice     next_slice;
+    struct sched_core    *core;
     int cpu = smp_processor_id();
 
     ASSERT_NOT_IN_ATOMIC();
@@ -1415,7 +1850,8 @@ static void schedule(void)
         BUG();
     }
 
-    lock = pcpu_schedule_lock_irq(cpu);
+    core = this_cpu(sched_core);
+    lock = sched_core_lock(core, cpu);
 
     now = NOW();
 
@@ -1429,12 +1865,15 @@ static void schedule(void)
 
     sd->curr = next;
 
+    if ( core )
+        sched_core_update(core, cpu, next, now, &next_slice.time);
+
     if ( next_slice.time >= 0 ) /* -ve means no limit */
         set_timer(&sd->s_timer, now + next_slice.time);
 
     if ( unlikely(prev == next) )
     {
-        pcpu_schedule_unlock_irq(lock, cpu);
+        sched_core_unlock(core, lock, cpu);
         TRACE_4D(TRC_SCHED_SWITCH_INFCONT,
                  next->domain->domain_id, next->vcpu_id,
                  now - prev->runstate.state_entry_time,
@@ -1458,6 +1897,19 @@ static void schedule(void)
              prev->domain->domain_id, prev->vcpu_id,
              next->domain->domain_id, next->vcpu_id);
 
+    if ( !is_idle_vcpu(prev) )
+        sched_hist_add(prev->domain, XEN_SYSCTL_SCHED_STATS_slice,
+                       now - prev->runstate.state_entry_time);
+    if ( !is_idle_vcpu(next) && next->runstate.state == RUNSTATE_runnable )
+    {
+        s_time_t wait = now - next->runstate.state_entry_time;
+
+        sched_hist_add(next->domain, XEN_SYSCTL_SCHED_STATS_wait, wait);
+        if ( next->sched_woken )
+            sched_hist_add(next->domain, XEN_SYSCTL_SCHED_STATS_wake, wait);
+    }
+    next->sched_woken = false;
+
     vcpu_runstate_change(
         prev,
         ((prev->pause_flags & VPF_blocked) ? RUNSTATE_blocked :
@@ -1476,7 +1928,7 @@ static void schedule(void)
     ASSERT(!next->is_running);
     next->is_running = 1;
 
-    pcpu_schedule_unlock_irq(lock, cpu);
+    sched_core_unlock(core, lock, cpu);
 
     SCHED_STAT_CRANK(sched_ctx);
 
@@ -1487,6 +1939,9 @@ static void schedule(void)
 
     vcpu_periodic_timer_work(next);
 
+    if ( core && !is_idle_vcpu(next) )
+        sched_core_enter(cpu, next->domain);
+
     context_switch(prev, next);
 }
 
@@ -1497,6 +1952,11 @@ void context_saved(struct vcpu *prev)
 
     prev->is_running = 0;
 
+    /* Siblings waiting in sched_core_enter() can go on now. */
+    if ( this_cpu(sched_core_guest) == prev->domain &&
+         current->domain != prev->domain )
+        this_cpu(sched_core_guest) = NULL;
+
     /* Check for migration request /after/ clearing running flag. */
     smp_mb();
 
@@ -1536,10 +1996,91 @@ static void poll_timer_fn(void *data)
         vcpu_unblock(v);
 }
 
+/*
+ * Siblings come up one by one, so each pCPU allocates a struct sched_core
+ * in CPU_UP_PREPARE, and then only uses it in CPU_STARTING (when sibling
+ * information is available), if it is the first one of its core.
+ */
+static int sched_core_alloc(unsigned int cpu)
+{
+    struct sched_core *core;
+
+    if ( !opt_sched_core || per_cpu(sched_core_spare, cpu) )
+        return 0;
+
+    core = xzalloc(struct sched_core);
+    if ( core == NULL )
+        return -ENOMEM;
+    spin_lock_init(&core->lock);
+    per_cpu(sched_core_spare, cpu) = core;
+
+    return 0;
+}
+
+static void sched_core_attach(unsigned int cpu)
+{
+    struct sched_core *core = NULL;
+    unsigned int sibling;
+    unsigned long flags;
+
+    if ( !opt_sched_core )
+        return;
+
+    for_each_cpu ( sibling, per_cpu(cpu_sibling_mask, cpu) )
+        if ( sibling != cpu && per_cpu(sched_core, sibling) != NULL )
+        {
+            core = per_cpu(sched_core, sibling);
+            break;
+        }
+
+    if ( core == NULL )
+    {
+        core = per_cpu(sched_core_spare, cpu);
+        per_cpu(sched_core_spare, cpu) = NULL;
+        ASSERT(core && core->nr_cpus == 0);
+    }
+
+    spin_lock_irqsave(&core->lock, flags);
+    core->nr_cpus++;
+    per_cpu(sched_core_busy, cpu) = false;
+    per_cpu(sched_core_waiting, cpu) = false;
+    per_cpu(sched_core, cpu) = core;
+    spin_unlock_irqrestore(&core->lock, flags);
+}
+
+static void sched_core_detach(unsigned int cpu)
+{
+    struct sched_core *core = per_cpu(sched_core, cpu);
+    unsigned long flags;
+    bool last;
+
+    xfree(per_cpu(sched_core_spare, cpu));
+    per_cpu(sched_core_spare, cpu) = NULL;
+
+    if ( core == NULL )
+        return;
+
+    /* An offline pCPU runs its idle vcpu, and is neither busy nor waiting. */
+    spin_lock_irqsave(&core->lock, flags);
+    ASSERT(!per_cpu(sched_core_busy, cpu));
+    if ( per_cpu(sched_core_waiting, cpu) )
+    {
+        per_cpu(sched_core_waiting, cpu) = false;
+        core->nr_waiting--;
+    }
+    per_cpu(sched_core, cpu) = NULL;
+    last = --core->nr_cpus == 0;
+    spin_unlock_irqrestore(&core->lock, flags);
+
+    if ( last )
+        xfree(core);
+}
+
 static int cpu_schedule_up(unsigned int cpu)
 {
     struct schedule_data *sd = &per_cpu(schedule_data, cpu);
     void *sched_priv;
+    int rc;
 
     per_cpu(scheduler, cpu) = &ops;
     spin_lock_init(&sd->_lock);
@@ -1548,6 +2089,10 @@ static int cpu_schedule_up(unsigned int cpu)
     init_timer(&sd->s_timer, s_timer_fn, NULL, cpu);
     atomic_set(&sd->urgent_count, 0);
 
+    rc = sched_core_alloc(cpu);
+    if ( rc )
+        return rc;
+
     /* Boot CPU is dealt with later in schedule_init(). */
     if ( cpu == 0 )
         return 0;
@@ -1604,6 +2149,8 @@ static void cpu_schedule_down(unsigned int cpu)
     sd->sched_priv = NULL;
 
     kill_timer(&sd->s_timer);
+
+    sched_core_detach(cpu);
 }
 
 static int cpu_schedule_callback(
@@ -1649,6 +2196,7 @@ static int cpu_schedule_callback(
     switch ( action )
     {
     case CPU_STARTING:
+        sched_core_attach(cpu);
         SCHED_OP(sched, init_pdata, sd->sched_priv, cpu);
         break;
     case CPU_UP_PREPARE:
@@ -1679,6 +2227,9 @@ void __init scheduler_init(void)
 
     open_softirq(SCHEDULE_SOFTIRQ, schedule);
 
+    register_keyhandler('y', dump_sched_hist,
+                        "dump scheduling latency histograms", 1);
+
     for ( i = 0; i < NUM_SCHEDULERS; i++)
     {
         if ( schedulers[i]->global_init && schedulers[i]->global_init() < 0 )
@@ -1701,8 +2252,23 @@ void __init scheduler_init(void)
         printk("Using '%s' (%s)\n", ops.name, ops.opt_name);
     }
 
+    if ( opt_sched_core && !sched_core_supported(&ops) )
+    {
+        printk("WARNING: %s does not support core scheduling, using cpu"
+               " granularity\n", ops.name);
+        opt_sched_core = false;
+    }
+
     if ( cpu_schedule_up(0) )
         BUG();
+    /* No sibling information yet: the boot CPU is the first of its core. */
+    if ( opt_sched_core )
+    {
+        this_cpu(sched_core) = this_cpu(sched_core_spare);
+        this_cpu(sched_core_spare) = NULL;
+        this_cpu(sched_core)->nr_cpus = 1;
+        printk("Using core scheduling\n");
+    }
     register_cpu_notifier(&cpu_schedule_nfb);
 
     printk("Using scheduler: %s (%s)\n", ops.name, ops.opt_name);
@@ -1769,6 +2335,13 @@ int schedule_cpu_switch(unsigned int cpu, struct cpupool *c)
     if ( old_ops == new_ops )
         goto out;
 
+    if ( opt_sched_core && !sched_core_supported(new_ops) )
+    {
+        printk(XENLOG_WARNING "%s does not support core scheduling\n",
+               new_ops->name);
+        return -EOPNOTSUPP;
+    }
+
     /*
      * To setup the cpu for the new scheduler we need:
      *  - a valid instance of per-CPU scheduler specific data, as it is
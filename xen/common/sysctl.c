@@ -248,6 +248,10 @@ long do_sysctl(XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
         ret = sched_adjust_global(&op->u.scheduler_op);
         break;
 
+    case XEN_SYSCTL_sched_stats:
+        ret = sched_stats_op(&op->u.sched_stats);
+        break;
+
     case XEN_SYSCTL_physinfo:
     {
         xen_sysctl_physinfo_t *pi = &op->u.physinfo;
@@ -39,7 +39,7 @@ struct tmem_statistics tmem_stats = {
 
 struct tmem_object_root {
     struct xen_tmem_oid oid;
-    struct rb_node rb_tree_node; /* Protected by pool->pool_rwlock. */
+    struct rb_node rb_tree_node; /* Protected by its bucket's lock. */
     unsigned long objnode_count; /* Atomicity depends on obj_spinlock. */
     long pgp_count; /* Atomicity depends on obj_spinlock. */
     struct radix_tree_root tree_root; /* Tree of pages within object. */
@@ -72,6 +72,7 @@ struct tmem_page_descriptor {
                     else compressed data (cdata). */
     uint32_t index;
     bool_t eviction_attempted;  /* CHANGE TO lifetimes? (settable). */
+    uint16_t eph_cpu;  /* Whose LRU global_eph_pages is on. */
     union {
         struct page_info *pfp;  /* Page frame pointer. */
         char *cdata; /* Compressed data. */
@@ -105,16 +106,29 @@ PAGE_LIST_HEAD(tmem_page_list);
 unsigned long tmem_page_list_pages = 0;
 
 DEFINE_RWLOCK(tmem_rwlock);
-static DEFINE_SPINLOCK(eph_lists_spinlock); /* Protects global AND clients. */
 static DEFINE_SPINLOCK(pers_lists_spinlock);
 
+/*
+ * Ephemeral pages are kept in LRU order per client, for quota-driven
+ * eviction, and globally.  The global LRU is split per CPU: a page goes on
+ * the list of the CPU which put it (or last got it from a shared pool), so
+ * puts and gets on different CPUs don't contend for one lock.  Global
+ * eviction starts with the local CPU's list, so it is only roughly LRU.
+ * Lock order is client->eph_lock, then a CPU's lock.
+ */
+struct tmem_eph_lru {
+    spinlock_t lock;
+    struct list_head list;
+} __cacheline_aligned;
+
+static struct tmem_eph_lru *eph_lru;
+
 #define ASSERT_SPINLOCK(_l) ASSERT(spin_is_locked(_l))
 #define ASSERT_WRITELOCK(_l) ASSERT(rw_is_write_locked(_l))
 
     atomic_t client_weight_total;
 
 struct tmem_global tmem_global = {
-    .ephemeral_page_list = LIST_HEAD_INIT(tmem_global.ephemeral_page_list),
     .client_list = LIST_HEAD_INIT(tmem_global.client_list),
     .client_weight_total = ATOMIC_INIT(0),
 };
@@ -342,6 +356,67 @@ static void pgp_free(struct tmem_page_descriptor *pgp)
     __pgp_free(pgp, pool);
 }
 
+/* Caller holds client->eph_lock and the lock of pgp's CPU LRU. */
+static void pgp_eph_unlink(struct tmem_page_descriptor *pgp,
+                           struct client *client)
+{
+    ASSERT_SPINLOCK(&client->eph_lock);
+    ASSERT_SPINLOCK(&eph_lru[pgp->eph_cpu].lock);
+    list_del_init(&pgp->us.client_eph_pages);
+    client->eph_count--;
+    ASSERT(client->eph_count >= 0);
+    list_del_init(&pgp->global_eph_pages);
+    atomic_dec(&tmem_global.eph_count);
+    ASSERT(_atomic_read(tmem_global.eph_count) >= 0);
+}
+
+/* Remove pgp from the ephemeral LRUs, if it is on them. */
+static void pgp_eph_del(struct tmem_page_descriptor *pgp,
+                        struct client *client)
+{
+    struct tmem_eph_lru *lru;
+
+    spin_lock(&client->eph_lock);
+    if ( !list_empty(&pgp->us.client_eph_pages) )
+    {
+        lru = &eph_lru[pgp->eph_cpu];
+        spin_lock(&lru->lock);
+        pgp_eph_unlink(pgp, client);
+        spin_unlock(&lru->lock);
+    }
+    spin_unlock(&client->eph_lock);
+}
+
+/* (Re)insert pgp at the most recently used end of the ephemeral LRUs. */
+static void pgp_eph_add(struct tmem_page_descriptor *pgp,
+                        struct client *client)
+{
+    struct tmem_eph_lru *lru;
+
+    spin_lock(&client->eph_lock);
+    if ( !list_empty(&pgp->us.client_eph_pages) )
+    {
+        lru = &eph_lru[pgp->eph_cpu];
+        spin_lock(&lru->lock);
+        pgp_eph_unlink(pgp, client);
+        spin_unlock(&lru->lock);
+    }
+
+    pgp->eph_cpu = smp_processor_id();
+    lru = &eph_lru[pgp->eph_cpu];
+    spin_lock(&lru->lock);
+    list_add_tail(&pgp->global_eph_pages, &lru->list);
+    spin_unlock(&lru->lock);
+    atomic_inc(&tmem_global.eph_count);
+    if ( _atomic_read(tmem_global.eph_count) > tmem_stats.global_eph_count_max )
+        tmem_stats.global_eph_count_max = _atomic_read(tmem_global.eph_count);
+
+    list_add_tail(&pgp->us.client_eph_pages, &client->ephemeral_page_list);
+    if ( ++client->eph_count > client->eph_count_max )
+        client->eph_count_max = client->eph_count;
+    spin_unlock(&client->eph_lock);
+}
+
 /* Remove pgp from global/pool/client lists and free it. */
 static void pgp_delist_free(struct tmem_page_descriptor *pgp)
 {
@@ -356,18 +431,7 @@ static void pgp_delist_free(struct tmem_page_descriptor *pgp)
 
     /* Delist pgp. */
     if ( !is_persistent(pgp->us.obj->pool) )
-    {
-        spin_lock(&eph_lists_spinlock);
-        if ( !list_empty(&pgp->us.client_eph_pages) )
-            client->eph_count--;
-        ASSERT(client->eph_count >= 0);
-        list_del_init(&pgp->us.client_eph_pages);
-        if ( !list_empty(&pgp->global_eph_pages) )
-            tmem_global.eph_count--;
-        ASSERT(tmem_global.eph_count >= 0);
-        list_del_init(&pgp->global_eph_pages);
-        spin_unlock(&eph_lists_spinlock);
-    }
+        pgp_eph_del(pgp, client);
     else
     {
         if ( client->info.flags.u.migrating )
@@ -506,16 +570,23 @@ static unsigned oid_hash(struct xen_tmem_oid *oidp)
                      BITS_PER_LONG) & OBJ_HASH_BUCKETS_MASK);
 }
 
+static struct tmem_obj_bucket *obj_bucket(struct tmem_pool *pool,
+                                          struct xen_tmem_oid *oidp)
+{
+    return &pool->obj_buckets[oid_hash(oidp)];
+}
+
 /* Searches for object==oid in pool, returns locked object if found. */
 static struct tmem_object_root * obj_find(struct tmem_pool *pool,
                                           struct xen_tmem_oid *oidp)
 {
+    struct tmem_obj_bucket *bucket = obj_bucket(pool, oidp);
     struct rb_node *node;
     struct tmem_object_root *obj;
 
 restart_find:
-    read_lock(&pool->pool_rwlock);
-    node = pool->obj_rb_root[oid_hash(oidp)].rb_node;
+    read_lock(&bucket->lock);
+    node = bucket->root.rb_node;
     while ( node )
     {
         obj = container_of(node, struct tmem_object_root, rb_tree_node);
@@ -524,10 +595,10 @@ restart_find:
             case 0: /* Equal. */
                 if ( !spin_trylock(&obj->obj_spinlock) )
                 {
-                    read_unlock(&pool->pool_rwlock);
+                    read_unlock(&bucket->lock);
                     goto restart_find;
                 }
-                read_unlock(&pool->pool_rwlock);
+                read_unlock(&bucket->lock);
                 return obj;
             case -1:
                 node = node->rb_left;
@@ -536,15 +607,18 @@ restart_find:
                 node = node->rb_right;
         }
     }
-    read_unlock(&pool->pool_rwlock);
+    read_unlock(&bucket->lock);
     return NULL;
 }
 
-/* Free an object that has no more pgps in it. */
+/*
+ * Free an object that has no more pgps in it.  The caller holds the
+ * object's bucket lock for write.
+ */
 static void obj_free(struct tmem_object_root *obj)
 {
     struct tmem_pool *pool;
-    struct xen_tmem_oid old_oid;
+    struct tmem_obj_bucket *bucket;
 
     ASSERT_SPINLOCK(&obj->obj_spinlock);
     ASSERT(obj != NULL);
@@ -552,30 +626,40 @@ static void obj_free(struct tmem_object_root *obj)
     pool = obj->pool;
     ASSERT(pool != NULL);
     ASSERT(pool->client != NULL);
-    ASSERT_WRITELOCK(&pool->pool_rwlock);
+    bucket = obj_bucket(pool, &obj->oid);
+    ASSERT_WRITELOCK(&bucket->lock);
     if ( obj->tree_root.rnode != NULL ) /* May be a "stump" with no leaves. */
         radix_tree_destroy(&obj->tree_root, pgp_destroy);
     ASSERT((long)obj->objnode_count == 0);
     ASSERT(obj->tree_root.rnode == NULL);
-    pool->obj_count--;
-    ASSERT(pool->obj_count >= 0);
+    atomic_dec(&pool->obj_count);
+    ASSERT(_atomic_read(pool->obj_count) >= 0);
     obj->pool = NULL;
-    old_oid = obj->oid;
     oid_set_invalid(&obj->oid);
     obj->last_client = TMEM_CLI_ID_NULL;
     atomic_dec_and_assert(global_obj_count);
-    rb_erase(&obj->rb_tree_node, &pool->obj_rb_root[oid_hash(&old_oid)]);
+    rb_erase(&obj->rb_tree_node, &bucket->root);
     spin_unlock(&obj->obj_spinlock);
     tmem_free(obj, pool);
 }
 
+/* As obj_free(), but taking the object's bucket lock itself. */
+static void obj_free_unhash(struct tmem_object_root *obj)
+{
+    rwlock_t *lock = &obj_bucket(obj->pool, &obj->oid)->lock;
+
+    write_lock(lock);
+    obj_free(obj);
+    write_unlock(lock);
+}
+
 static int obj_rb_insert(struct rb_root *root, struct tmem_object_root *obj)
 {
     struct rb_node **new, *parent = NULL;
     struct tmem_object_root *this;
 
     ASSERT(obj->pool);
-    ASSERT_WRITELOCK(&obj->pool->pool_rwlock);
+    ASSERT_WRITELOCK(&obj_bucket(obj->pool, &obj->oid)->lock);
 
     new = &(root->rb_node);
     while ( *new )
@@ -611,9 +695,9 @@ static struct tmem_object_root * obj_alloc(struct tmem_pool *pool,
     ASSERT(pool != NULL);
     if ( (obj = tmem_malloc(sizeof(struct tmem_object_root), pool)) == NULL )
         return NULL;
-    pool->obj_count++;
-    if (pool->obj_count > pool->obj_count_max)
-        pool->obj_count_max = pool->obj_count;
+    atomic_inc(&pool->obj_count);
+    if ( _atomic_read(pool->obj_count) > pool->obj_count_max )
+        pool->obj_count_max = _atomic_read(pool->obj_count);
     atomic_inc_and_max(global_obj_count);
     radix_tree_init(&obj->tree_root);
     radix_tree_set_alloc_callbacks(&obj->tree_root, rtn_alloc, rtn_free, obj);
@@ -629,7 +713,7 @@ static struct tmem_object_root * obj_alloc(struct tmem_pool *pool,
 /* Free an object after destroying any pgps in it. */
 static void obj_destroy(struct tmem_object_root *obj)
 {
-    ASSERT_WRITELOCK(&obj->pool->pool_rwlock);
+    ASSERT_WRITELOCK(&obj_bucket(obj->pool, &obj->oid)->lock);
     radix_tree_destroy(&obj->tree_root, pgp_destroy);
     obj_free(obj);
 }
@@ -641,11 +725,11 @@ static void pool_destroy_objs(struct tmem_pool *pool, domid_t cli_id)
     struct tmem_object_root *obj;
     int i;
 
-    write_lock(&pool->pool_rwlock);
     pool->is_dying = 1;
     for (i = 0; i < OBJ_HASH_BUCKETS; i++)
     {
-        node = rb_first(&pool->obj_rb_root[i]);
+        write_lock(&pool->obj_buckets[i].lock);
+        node = rb_first(&pool->obj_buckets[i].root);
         while ( node != NULL )
         {
             obj = container_of(node, struct tmem_object_root, rb_tree_node);
@@ -656,8 +740,8 @@ static void pool_destroy_objs(struct tmem_pool *pool, domid_t cli_id)
             else
                 spin_unlock(&obj->obj_spinlock);
         }
+        write_unlock(&pool->obj_buckets[i].lock);
     }
-    write_unlock(&pool->pool_rwlock);
 }
 
 
@@ -671,9 +755,11 @@ static struct tmem_pool * pool_alloc(void)
     if ( (pool = xzalloc(struct tmem_pool)) == NULL )
         return NULL;
     for (i = 0; i < OBJ_HASH_BUCKETS; i++)
-        pool->obj_rb_root[i] = RB_ROOT;
+    {
+        rwlock_init(&pool->obj_buckets[i].lock);
+        pool->obj_buckets[i].root = RB_ROOT;
+    }
     INIT_LIST_HEAD(&pool->persistent_page_list);
-    rwlock_init(&pool->pool_rwlock);
     return pool;
 }
 
@@ -730,10 +816,17 @@ static void shared_pool_reassign(struct tmem_pool *pool)
         if (new_client->pools[poolid] == pool)
             break;
     ASSERT(poolid != MAX_POOLS_PER_DOMAIN);
-    new_client->eph_count += _atomic_read(pool->pgp_count);
-    old_client->eph_count -= _atomic_read(pool->pgp_count);
-    list_splice_init(&old_client->ephemeral_page_list,
-                     &new_client->ephemeral_page_list);
+    if ( new_client != old_client )
+    {
+        spin_lock(&old_client->eph_lock);
+        spin_lock(&new_client->eph_lock);
+        new_client->eph_count += _atomic_read(pool->pgp_count);
+        old_client->eph_count -= _atomic_read(pool->pgp_count);
+        list_splice_init(&old_client->ephemeral_page_list,
+                         &new_client->ephemeral_page_list);
+        spin_unlock(&new_client->eph_lock);
+        spin_unlock(&old_client->eph_lock);
+    }
     tmem_client_info("reassigned shared pool from %s=%d to %s=%d pool_id=%d\n",
         tmem_cli_id_str, old_client->cli_id, tmem_cli_id_str, new_client->cli_id, poolid);
     pool->pool_id = poolid;
@@ -850,6 +943,7 @@ struct client *client_create(domid_t cli_id)
         client->shared_auth_uuid[i][0] =
             client->shared_auth_uuid[i][1] = -1L;
     list_add_tail(&client->client_list, &tmem_global.client_list);
+    spin_lock_init(&client->eph_lock);
     INIT_LIST_HEAD(&client->ephemeral_page_list);
     INIT_LIST_HEAD(&client->persistent_invalidated_list);
     tmem_client_info("ok\n");
@@ -892,16 +986,18 @@ static bool_t client_over_quota(struct client *client)
     if ( (total == 0) || (client->info.weight == 0) ||
           (client->eph_count == 0) )
         return 0;
-    return ( ((tmem_global.eph_count*100L) / client->eph_count ) >
+    return ( ((_atomic_read(tmem_global.eph_count)*100L) / client->eph_count ) >
              ((total*100L) / client->info.weight) );
 }
 
 /************ MEMORY REVOCATION ROUTINES *******************************/
 
-static bool_t tmem_try_to_evict_pgp(struct tmem_page_descriptor *pgp, bool_t *hold_pool_rwlock)
+static bool_t tmem_try_to_evict_pgp(struct tmem_page_descriptor *pgp,
+                                    rwlock_t **bucket_lock)
 {
     struct tmem_object_root *obj = pgp->us.obj;
     struct tmem_pool *pool = obj->pool;
+    rwlock_t *lock;
 
     if ( pool->is_dying )
         return 0;
@@ -909,9 +1005,10 @@ static bool_t tmem_try_to_evict_pgp(struct tmem_page_descriptor *pgp, bool_t *ho
     {
         if ( obj->pgp_count > 1 )
             return 1;
-        if ( write_trylock(&pool->pool_rwlock) )
+        lock = &obj_bucket(pool, &obj->oid)->lock;
+        if ( write_trylock(lock) )
         {
-            *hold_pool_rwlock = 1;
+            *bucket_lock = lock;
             return 1;
         }
         spin_unlock(&obj->obj_spinlock);
@@ -925,41 +1022,61 @@ int tmem_evict(void)
     struct tmem_page_descriptor *pgp = NULL, *pgp_del;
     struct tmem_object_root *obj;
     struct tmem_pool *pool;
+    struct tmem_eph_lru *lru;
+    rwlock_t *bucket_lock = NULL;
+    unsigned int i;
     int ret = 0;
-    bool_t hold_pool_rwlock = 0;
 
     tmem_stats.evict_attempts++;
-    spin_lock(&eph_lists_spinlock);
     if ( (client != NULL) && client_over_quota(client) &&
          !list_empty(&client->ephemeral_page_list) )
     {
+        spin_lock(&client->eph_lock);
         list_for_each_entry(pgp, &client->ephemeral_page_list, us.client_eph_pages)
-            if ( tmem_try_to_evict_pgp(pgp, &hold_pool_rwlock) )
+            if ( tmem_try_to_evict_pgp(pgp, &bucket_lock) )
+            {
+                lru = &eph_lru[pgp->eph_cpu];
+                spin_lock(&lru->lock);
+                pgp_eph_unlink(pgp, client);
+                spin_unlock(&lru->lock);
+                spin_unlock(&client->eph_lock);
                 goto found;
+            }
+        spin_unlock(&client->eph_lock);
+        goto out;
     }
-    else if ( !list_empty(&tmem_global.ephemeral_page_list) )
+
+    /* Start with the local CPU's LRU, then try the others in turn. */
+    for ( i = 0; i < nr_cpu_ids; i++ )
     {
-        list_for_each_entry(pgp, &tmem_global.ephemeral_page_list, global_eph_pages)
-            if ( tmem_try_to_evict_pgp(pgp, &hold_pool_rwlock) )
+        lru = &eph_lru[(smp_processor_id() + i) % nr_cpu_ids];
+        if ( list_empty(&lru->list) )
+            continue;
+        spin_lock(&lru->lock);
+        list_for_each_entry(pgp, &lru->list, global_eph_pages)
+        {
+            client = pgp->us.obj->pool->client;
+            /* Lock order is client then CPU, so we can only try. */
+            if ( !spin_trylock(&client->eph_lock) )
+            {
+                tmem_stats.eph_lru_busy++;
+                continue;
+            }
+            if ( tmem_try_to_evict_pgp(pgp, &bucket_lock) )
             {
-                client = pgp->us.obj->pool->client;
+                pgp_eph_unlink(pgp, client);
+                spin_unlock(&client->eph_lock);
+                spin_unlock(&lru->lock);
                 goto found;
             }
+            spin_unlock(&client->eph_lock);
+        }
+        spin_unlock(&lru->lock);
     }
-     /* Global_ephemeral_page_list is empty, so we bail out. */
-    spin_unlock(&eph_lists_spinlock);
+    /* Nothing evictable on any LRU, so we bail out. */
     goto out;
 
 found:
-    /* Delist. */
-    list_del_init(&pgp->us.client_eph_pages);
-    client->eph_count--;
-    list_del_init(&pgp->global_eph_pages);
-    tmem_global.eph_count--;
-    ASSERT(tmem_global.eph_count >= 0);
-    ASSERT(client->eph_count >= 0);
-    spin_unlock(&eph_lists_spinlock);
-
     ASSERT(pgp != NULL);
     obj = pgp->us.obj;
     ASSERT(obj != NULL);
@@ -974,13 +1091,13 @@ found:
     pgp_free(pgp);
     if ( obj->pgp_count == 0 )
     {
-        ASSERT_WRITELOCK(&pool->pool_rwlock);
+        ASSERT(bucket_lock != NULL);
         obj_free(obj);
     }
     else
         spin_unlock(&obj->obj_spinlock);
-    if ( hold_pool_rwlock )
-        write_unlock(&pool->pool_rwlock);
+    if ( bucket_lock )
+        write_unlock(bucket_lock);
     tmem_stats.evicted_pgs++;
     ret = 1;
 out:
@@ -1014,6 +1131,17 @@ static inline bool_t tmem_ensure_avail_pages(void)
 
 /************ TMEM CORE OPERATIONS ************************************/
 
+/* Not atomic: like the other tmem_stats, these are only approximate. */
+static void cyc_count(struct tmem_cyc_counter *c, uint64_t cycles)
+{
+    if ( !c->count || cycles < c->min_cycles )
+        c->min_cycles = cycles;
+    if ( cycles > c->max_cycles )
+        c->max_cycles = cycles;
+    c->sum_cycles += cycles;
+    c->count++;
+}
+
 static int do_tmem_put_compress(struct tmem_page_descriptor *pgp, xen_pfn_t cmfn,
                                          tmem_cli_va_param_t clibuf)
 {
@@ -1121,13 +1249,9 @@ cleanup:
     ASSERT(pgpfound == pgp);
     pgp_delist_free(pgpfound);
     if ( obj->pgp_count == 0 )
-    {
-        write_lock(&pool->pool_rwlock);
-        obj_free(obj);
-        write_unlock(&pool->pool_rwlock);
-    } else {
+        obj_free_unhash(obj);
+    else
         spin_unlock(&obj->obj_spinlock);
-    }
     pool->dup_puts_flushed++;
     return ret;
 }
@@ -1138,6 +1262,7 @@ static int do_tmem_put(struct tmem_pool *pool,
 {
     struct tmem_object_root *obj = NULL;
     struct tmem_page_descriptor *pgp = NULL;
+    struct tmem_obj_bucket *bucket;
     struct client *client;
     int ret, newobj = 0;
 
@@ -1170,21 +1295,24 @@ refind:
         if ( (obj = obj_alloc(pool, oidp)) == NULL )
             return -ENOMEM;
 
-        write_lock(&pool->pool_rwlock);
+        bucket = obj_bucket(pool, oidp);
+        write_lock(&bucket->lock);
         /*
-         * Parallel callers may already allocated obj and inserted to obj_rb_root
-         * before us.
+         * Parallel callers may already allocated obj and inserted to the
+         * bucket before us.
          */
-        if ( !obj_rb_insert(&pool->obj_rb_root[oid_hash(oidp)], obj) )
+        if ( !obj_rb_insert(&bucket->root, obj) )
         {
+            atomic_dec(&pool->obj_count);
+            atomic_dec_and_assert(global_obj_count);
             tmem_free(obj, pool);
-            write_unlock(&pool->pool_rwlock);
+            write_unlock(&bucket->lock);
             goto refind;
         }
 
         spin_lock(&obj->obj_spinlock);
         newobj = 1;
-        write_unlock(&pool->pool_rwlock);
+        write_unlock(&bucket->lock);
     }
 
     /* When arrive here, we have a spinlocked obj for use. */
@@ -1232,17 +1360,7 @@ copy_uncompressed:
 
 insert_page:
     if ( !is_persistent(pool) )
-    {
-        spin_lock(&eph_lists_spinlock);
-        list_add_tail(&pgp->global_eph_pages, &tmem_global.ephemeral_page_list);
-        if (++tmem_global.eph_count > tmem_stats.global_eph_count_max)
-            tmem_stats.global_eph_count_max = tmem_global.eph_count;
-        list_add_tail(&pgp->us.client_eph_pages,
-            &client->ephemeral_page_list);
-        if (++client->eph_count > client->eph_count_max)
-            client->eph_count_max = client->eph_count;
-        spin_unlock(&eph_lists_spinlock);
-    }
+        pgp_eph_add(pgp, client);
     else
     { /* is_persistent. */
         spin_lock(&pers_lists_spinlock);
@@ -1275,15 +1393,9 @@ free_pgp:
     pgp_free(pgp);
 unlock_obj:
     if ( newobj )
-    {
-        write_lock(&pool->pool_rwlock);
-        obj_free(obj);
-        write_unlock(&pool->pool_rwlock);
-    }
+        obj_free_unhash(obj);
     else
-    {
         spin_unlock(&obj->obj_spinlock);
-    }
     pool->no_mem_puts++;
     return ret;
 }
@@ -1332,18 +1444,11 @@ static int do_tmem_get(struct tmem_pool *pool,
             pgp_delist_free(pgp);
             if ( obj->pgp_count == 0 )
             {
-                write_lock(&pool->pool_rwlock);
-                obj_free(obj);
+                obj_free_unhash(obj);
                 obj = NULL;
-                write_unlock(&pool->pool_rwlock);
             }
         } else {
-            spin_lock(&eph_lists_spinlock);
-            list_del(&pgp->global_eph_pages);
-            list_add_tail(&pgp->global_eph_pages,&tmem_global.ephemeral_page_list);
-            list_del(&pgp->us.client_eph_pages);
-            list_add_tail(&pgp->us.client_eph_pages,&client->ephemeral_page_list);
-            spin_unlock(&eph_lists_spinlock);
+            pgp_eph_add(pgp, client);
             obj->last_client = current->domain->domain_id;
         }
     }
@@ -1382,13 +1487,9 @@ static int do_tmem_flush_page(struct tmem_pool *pool,
     }
     pgp_delist_free(pgp);
     if ( obj->pgp_count == 0 )
-    {
-        write_lock(&pool->pool_rwlock);
-        obj_free(obj);
-        write_unlock(&pool->pool_rwlock);
-    } else {
+        obj_free_unhash(obj);
+    else
         spin_unlock(&obj->obj_spinlock);
-    }
     pool->flushs_found++;
 
 out:
@@ -1402,15 +1503,17 @@ static int do_tmem_flush_object(struct tmem_pool *pool,
                                 struct xen_tmem_oid *oidp)
 {
     struct tmem_object_root *obj;
+    rwlock_t *lock;
 
     pool->flush_objs++;
     obj = obj_find(pool,oidp);
     if ( obj == NULL )
         goto out;
-    write_lock(&pool->pool_rwlock);
+    lock = &obj_bucket(pool, oidp)->lock;
+    write_lock(lock);
     obj_destroy(obj);
     pool->flush_objs_found++;
-    write_unlock(&pool->pool_rwlock);
+    write_unlock(lock);
 
 out:
     if ( pool->client->info.flags.u.frozen )
@@ -1882,6 +1985,7 @@ long do_tmem_op(tmem_cli_op_t uops)
     bool_t succ_get = 0, succ_put = 0;
     bool_t non_succ_get = 0, non_succ_put = 0;
     bool_t flush = 0, flush_obj = 0;
+    uint64_t start;
 
     if ( !tmem_initialized )
         return -ENODEV;
@@ -1953,6 +2057,7 @@ long do_tmem_op(tmem_cli_op_t uops)
             read_lock(&tmem_rwlock);
 
             oidp = &op.u.gen.oid;
+            start = get_cycles();
             switch ( op.cmd )
             {
             case TMEM_NEW_POOL:
@@ -1988,6 +2093,19 @@ long do_tmem_op(tmem_cli_op_t uops)
                 break;
             }
             read_unlock(&tmem_rwlock);
+            start = get_cycles() - start;
+            if ( succ_get )
+                cyc_count(&tmem_stats.succ_get, start);
+            else if ( succ_put )
+                cyc_count(&tmem_stats.succ_put, start);
+            else if ( non_succ_get )
+                cyc_count(&tmem_stats.non_succ_get, start);
+            else if ( non_succ_put )
+                cyc_count(&tmem_stats.non_succ_put, start);
+            else if ( flush )
+                cyc_count(&tmem_stats.flush, start);
+            else if ( flush_obj )
+                cyc_count(&tmem_stats.flush_obj, start);
             if ( rc < 0 )
                 tmem_stats.errored_tmem_ops++;
             return rc;
@@ -2073,12 +2191,26 @@ unsigned long tmem_freeable_pages(void)
 /* Called at hypervisor startup. */
 static int __init init_tmem(void)
 {
+    unsigned int cpu;
+
     if ( !tmem_enabled() )
         return 0;
 
     if ( !tmem_mempool_init() )
         return 0;
 
+    eph_lru = xzalloc_array(struct tmem_eph_lru, nr_cpu_ids);
+    if ( !eph_lru )
+    {
+        printk("tmem: initialization FAILED\n");
+        return 0;
+    }
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+    {
+        spin_lock_init(&eph_lru[cpu].lock);
+        INIT_LIST_HEAD(&eph_lru[cpu].list);
+    }
+
     if ( tmem_init() )
     {
         printk("tmem: initialized comp=%d\n", tmem_compression_enabled());
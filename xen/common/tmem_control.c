@@ -130,11 +130,11 @@ static int tmemc_list_client(struct client *c, tmem_cli_va_param_t buf,
                       use_long ? ',' : '\n');
         if (use_long)
             n += scnprintf(info+n,BSIZE-n,
-             "Pc:%d,Pm:%d,Oc:%ld,Om:%ld,Nc:%lu,Nm:%lu,"
+             "Pc:%d,Pm:%d,Oc:%d,Om:%d,Nc:%lu,Nm:%lu,"
              "ps:%lu,pt:%lu,pd:%lu,pr:%lu,px:%lu,gs:%lu,gt:%lu,"
              "fs:%lu,ft:%lu,os:%lu,ot:%lu\n",
              _atomic_read(p->pgp_count), p->pgp_count_max,
-             p->obj_count, p->obj_count_max,
+             _atomic_read(p->obj_count), p->obj_count_max,
              p->objnode_count, p->objnode_count_max,
              p->good_puts, p->puts,p->dup_puts_flushed, p->dup_puts_replaced,
              p->no_mem_puts,
@@ -169,11 +169,11 @@ static int tmemc_list_shared(tmem_cli_va_param_t buf, int off, uint32_t len,
         n += scnprintf(info+n,BSIZE-n,"%c", use_long ? ',' : '\n');
         if (use_long)
             n += scnprintf(info+n,BSIZE-n,
-             "Pc:%d,Pm:%d,Oc:%ld,Om:%ld,Nc:%lu,Nm:%lu,"
+             "Pc:%d,Pm:%d,Oc:%d,Om:%d,Nc:%lu,Nm:%lu,"
              "ps:%lu,pt:%lu,pd:%lu,pr:%lu,px:%lu,gs:%lu,gt:%lu,"
              "fs:%lu,ft:%lu,os:%lu,ot:%lu\n",
              _atomic_read(p->pgp_count), p->pgp_count_max,
-             p->obj_count, p->obj_count_max,
+             _atomic_read(p->obj_count), p->obj_count_max,
              p->objnode_count, p->objnode_count_max,
              p->good_puts, p->puts,p->dup_puts_flushed, p->dup_puts_replaced,
              p->no_mem_puts,
@@ -187,6 +187,14 @@ static int tmemc_list_shared(tmem_cli_va_param_t buf, int off, uint32_t len,
     return sum;
 }
 
+static int cyc_counter_str(char *buf, int size, const char *prefix,
+                           const struct tmem_cyc_counter *c)
+{
+    return scnprintf(buf,size,"%sn:%lu,%st:%"PRIu64",%sx:%"PRIu64",%sm:%"PRIu64",",
+                     prefix, c->count, prefix, c->sum_cycles,
+                     prefix, c->max_cycles, prefix, c->min_cycles);
+}
+
 static int tmemc_list_global_perf(tmem_cli_va_param_t buf, int off,
                                   uint32_t len, bool_t use_long)
 {
@@ -194,6 +202,13 @@ static int tmemc_list_global_perf(tmem_cli_va_param_t buf, int off,
     int n = 0, sum = 0;
 
     n = scnprintf(info+n,BSIZE-n,"T=");
+    n += cyc_counter_str(info+n,BSIZE-n,"G",&tmem_stats.succ_get);
+    n += cyc_counter_str(info+n,BSIZE-n,"P",&tmem_stats.succ_put);
+    n += cyc_counter_str(info+n,BSIZE-n,"g",&tmem_stats.non_succ_get);
+    n += cyc_counter_str(info+n,BSIZE-n,"p",&tmem_stats.non_succ_put);
+    n += cyc_counter_str(info+n,BSIZE-n,"F",&tmem_stats.flush);
+    n += cyc_counter_str(info+n,BSIZE-n,"O",&tmem_stats.flush_obj);
+    n += scnprintf(info+n,BSIZE-n,"Lb:%lu,",tmem_stats.eph_lru_busy);
     n--; /* Overwrite trailing comma. */
     n += scnprintf(info+n,BSIZE-n,"\n");
     if ( sum + n >= len )
@@ -220,9 +235,9 @@ static int tmemc_list_global(tmem_cli_va_param_t buf, int off, uint32_t len,
       tmem_stats.total_flush_pool, use_long ? ',' : '\n');
     if (use_long)
         n += scnprintf(info+n,BSIZE-n,
-          "Ec:%ld,Em:%ld,Oc:%d,Om:%d,Nc:%d,Nm:%d,Pc:%d,Pm:%d,"
+          "Ec:%d,Em:%ld,Oc:%d,Om:%d,Nc:%d,Nm:%d,Pc:%d,Pm:%d,"
           "Fc:%d,Fm:%d,Sc:%d,Sm:%d,Ep:%lu,Gd:%lu,Zt:%lu,Gz:%lu\n",
-          tmem_global.eph_count, tmem_stats.global_eph_count_max,
+          _atomic_read(tmem_global.eph_count), tmem_stats.global_eph_count_max,
           _atomic_read(tmem_stats.global_obj_count), tmem_stats.global_obj_count_max,
           _atomic_read(tmem_stats.global_rtree_node_count), tmem_stats.global_rtree_node_count_max,
           _atomic_read(tmem_stats.global_pgp_count), tmem_stats.global_pgp_count_max,
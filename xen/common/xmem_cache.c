@@ -0,0 +1,382 @@
+/******************************************************************************
+ * xmem_cache.c
+ *
+ * Caches of fixed-size objects.
+ *
+ * Each CPU keeps a small stack ("magazine") of free objects per cache, which
+ * is only ever touched by that CPU, so the common alloc/free paths take no
+ * lock at all.  Magazines are refilled from, and overflow into, slabs kept
+ * per NUMA node under a per-node lock, and the slab pages themselves come
+ * from the node of the allocating CPU.
+ */
+
+#include <xen/cpu.h>
+#include <xen/init.h>
+#include <xen/irq.h>
+#include <xen/lib.h>
+#include <xen/mm.h>
+#include <xen/perfc.h>
+#include <xen/sched.h>
+#include <xen/xmem_cache.h>
+
+/* Objects moved between a magazine and the slabs at once. */
+#define XMEM_CACHE_BATCH  (XMEM_CACHE_MAG / 2)
+
+/* Header at the start of each slab page. */
+struct xmem_slab {
+    struct list_head list;
+    void *free;
+    unsigned int inuse;
+    nodeid_t node;
+};
+
+static DEFINE_SPINLOCK(xmem_caches_lock);
+static LIST_HEAD(xmem_caches);
+
+static nodeid_t local_node(void)
+{
+    nodeid_t node = cpu_to_node(smp_processor_id());
+
+    return node < MAX_NUMNODES ? node : 0;
+}
+
+static int xmem_cache_setup(struct xmem_cache *cache)
+{
+    struct xmem_cache_cpu *cpu;
+    unsigned int i, size, offset;
+    int rc = 0;
+
+    spin_lock(&xmem_caches_lock);
+
+    if ( cache->cpu )
+        goto out;
+
+    cpu = xzalloc_array(struct xmem_cache_cpu, nr_cpu_ids);
+    if ( !cpu )
+    {
+        rc = -ENOMEM;
+        goto out;
+    }
+
+    /* Free objects in slabs hold a pointer to the next one. */
+    cache->align = max_t(unsigned int, cache->align, sizeof(void *));
+    size = ROUNDUP(cache->size, cache->align);
+    offset = ROUNDUP(sizeof(struct xmem_slab), cache->align);
+    if ( size <= (PAGE_SIZE - offset) / 8 )
+    {
+        cache->size = size;
+        cache->offset = offset;
+        cache->per_slab = (PAGE_SIZE - offset) / size;
+    }
+    else
+        cache->order = get_order_from_bytes(max(cache->size, cache->align));
+
+    for ( i = 0; i < MAX_NUMNODES; i++ )
+    {
+        spin_lock_init(&cache->node[i].lock);
+        INIT_LIST_HEAD(&cache->node[i].partial);
+    }
+
+    list_add(&cache->list, &xmem_caches);
+
+    /* Layout must be visible before other CPUs see the cache as set up. */
+    smp_wmb();
+    cache->cpu = cpu;
+
+ out:
+    spin_unlock(&xmem_caches_lock);
+
+    return rc;
+}
+
+static struct xmem_slab *obj_to_slab(void *obj)
+{
+    return (struct xmem_slab *)((unsigned long)obj & PAGE_MASK);
+}
+
+static struct xmem_slab *new_slab(struct xmem_cache *cache, nodeid_t node)
+{
+    struct xmem_slab *slab;
+    unsigned int i;
+    char *obj;
+
+    slab = alloc_xenheap_pages(0, MEMF_node(node));
+    if ( !slab )
+        return NULL;
+
+    slab->free = NULL;
+    slab->inuse = 0;
+    slab->node = node;
+
+    obj = (char *)slab + cache->offset + (cache->per_slab - 1) * cache->size;
+    for ( i = 0; i < cache->per_slab; i++, obj -= cache->size )
+    {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+    }
+
+    return slab;
+}
+
+/* Move up to XMEM_CACHE_BATCH objects from the slabs into @mag. */
+static void refill_magazine(struct xmem_cache *cache,
+                            struct xmem_cache_cpu *mag)
+{
+    nodeid_t node = local_node();
+    struct xmem_cache_node *n = &cache->node[node];
+    struct xmem_slab *slab;
+
+    if ( cache->order )
+    {
+        void *obj = alloc_xenheap_pages(cache->order, MEMF_node(node));
+
+        if ( obj )
+            mag->objs[mag->count++] = obj;
+        return;
+    }
+
+    spin_lock(&n->lock);
+
+    while ( mag->count < XMEM_CACHE_BATCH )
+    {
+        if ( list_empty(&n->partial) )
+        {
+            spin_unlock(&n->lock);
+            slab = new_slab(cache, node);
+            spin_lock(&n->lock);
+            if ( !slab )
+                break;
+            list_add(&slab->list, &n->partial);
+            n->nr_slabs++;
+            n->nr_empty++;
+        }
+
+        slab = list_first_entry(&n->partial, struct xmem_slab, list);
+        if ( !slab->inuse )
+            n->nr_empty--;
+
+        while ( slab->free && mag->count < XMEM_CACHE_BATCH )
+        {
+            mag->objs[mag->count++] = slab->free;
+            slab->free = *(void **)slab->free;
+            slab->inuse++;
+        }
+
+        if ( !slab->free )
+            list_del(&slab->list);
+    }
+
+    spin_unlock(&n->lock);
+}
+
+/* Return @nr objects to the slabs they came from. */
+static void flush_objs(struct xmem_cache *cache, void **objs, unsigned int nr)
+{
+    struct xmem_cache_node *n = NULL;
+    unsigned int i;
+
+    if ( cache->order )
+    {
+        for ( i = 0; i < nr; i++ )
+            free_xenheap_pages(objs[i], cache->order);
+        return;
+    }
+
+    for ( i = 0; i < nr; i++ )
+    {
+        struct xmem_slab *slab = obj_to_slab(objs[i]);
+        struct xmem_cache_node *sn = &cache->node[slab->node];
+
+        if ( sn != n )
+        {
+            if ( n )
+                spin_unlock(&n->lock);
+            n = sn;
+            spin_lock(&n->lock);
+        }
+
+        if ( !slab->free )
+            list_add(&slab->list, &n->partial);
+        *(void **)objs[i] = slab->free;
+        slab->free = objs[i];
+
+        if ( --slab->inuse )
+            continue;
+
+        /* Keep one empty slab per node around; free the rest. */
+        if ( n->nr_empty )
+        {
+            list_del(&slab->list);
+            n->nr_slabs--;
+            spin_unlock(&n->lock);
+            free_xenheap_page(slab);
+            spin_lock(&n->lock);
+        }
+        else
+            n->nr_empty++;
+    }
+
+    if ( n )
+        spin_unlock(&n->lock);
+}
+
+void *xmem_cache_alloc(struct xmem_cache *cache)
+{
+    struct xmem_cache_cpu *mag;
+
+    ASSERT(!in_irq());
+
+    if ( unlikely(!ACCESS_ONCE(cache->cpu)) && xmem_cache_setup(cache) )
+        return NULL;
+    smp_rmb();
+
+    mag = &cache->cpu[smp_processor_id()];
+    if ( likely(mag->count) )
+    {
+        perfc_incr(xmem_cache_hit);
+        return mag->objs[--mag->count];
+    }
+
+    perfc_incr(xmem_cache_miss);
+    refill_magazine(cache, mag);
+
+    return mag->count ? mag->objs[--mag->count] : NULL;
+}
+
+void *xmem_cache_zalloc(struct xmem_cache *cache)
+{
+    void *obj = xmem_cache_alloc(cache);
+
+    return obj ? memset(obj, 0, cache->size) : NULL;
+}
+
+void xmem_cache_free(struct xmem_cache *cache, void *obj)
+{
+    struct xmem_cache_cpu *mag;
+
+    if ( !obj )
+        return;
+
+    ASSERT(!in_irq());
+    ASSERT(cache->cpu);
+
+    mag = &cache->cpu[smp_processor_id()];
+    if ( unlikely(mag->count == XMEM_CACHE_MAG) )
+    {
+        /* Hand back the coldest half, keeping recently freed objects. */
+        perfc_incr(xmem_cache_flush);
+        flush_objs(cache, mag->objs, XMEM_CACHE_BATCH);
+        memmove(mag->objs, mag->objs + XMEM_CACHE_BATCH,
+                (XMEM_CACHE_MAG - XMEM_CACHE_BATCH) * sizeof(*mag->objs));
+        mag->count -= XMEM_CACHE_BATCH;
+    }
+
+    mag->objs[mag->count++] = obj;
+}
+
+struct xmem_cache *xmem_cache_create(
+    const char *name, unsigned long size, unsigned long align)
+{
+    struct xmem_cache *cache;
+
+    ASSERT(!(align & (align - 1)));
+    if ( !size || size > UINT_MAX || align > PAGE_SIZE )
+        return NULL;
+
+    cache = xzalloc(struct xmem_cache);
+    if ( !cache )
+        return NULL;
+
+    cache->name = name;
+    cache->size = size;
+    cache->align = align;
+
+    if ( xmem_cache_setup(cache) )
+    {
+        xfree(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void xmem_cache_destroy(struct xmem_cache *cache)
+{
+    unsigned int cpu, node;
+
+    if ( !cache )
+        return;
+
+    spin_lock(&xmem_caches_lock);
+    list_del(&cache->list);
+    spin_unlock(&xmem_caches_lock);
+
+    for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+        flush_objs(cache, cache->cpu[cpu].objs, cache->cpu[cpu].count);
+
+    for ( node = 0; node < MAX_NUMNODES; node++ )
+    {
+        struct xmem_cache_node *n = &cache->node[node];
+        struct xmem_slab *slab, *tmp;
+
+        list_for_each_entry_safe ( slab, tmp, &n->partial, list )
+        {
+            if ( slab->inuse )
+                continue;
+            list_del(&slab->list);
+            n->nr_slabs--;
+            free_xenheap_page(slab);
+        }
+
+        if ( n->nr_slabs )
+            printk(XENLOG_WARNING
+                   "xmem_cache %s: %u slabs still in use on node %u\n",
+                   cache->name, n->nr_slabs, node);
+    }
+
+    xfree(cache->cpu);
+    xfree(cache);
+}
+
+static int cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu;
+    struct xmem_cache *cache;
+
+    if ( action != CPU_DEAD )
+        return NOTIFY_DONE;
+
+    /* The dead CPU's magazines can't be touched by anyone else. */
+    spin_lock(&xmem_caches_lock);
+    list_for_each_entry ( cache, &xmem_caches, list )
+    {
+        flush_objs(cache, cache->cpu[cpu].objs, cache->cpu[cpu].count);
+        cache->cpu[cpu].count = 0;
+    }
+    spin_unlock(&xmem_caches_lock);
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block cpu_nfb = {
+    .notifier_call = cpu_callback
+};
+
+static int __init xmem_cache_init(void)
+{
+    register_cpu_notifier(&cpu_nfb);
+
+    return 0;
+}
+presmp_initcall(xmem_cache_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
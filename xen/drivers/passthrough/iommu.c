@@ -69,6 +69,7 @@ bool_t __read_mostly iommu_intremap = 1;
  */
 bool_t __read_mostly iommu_intpost;
 bool_t __read_mostly iommu_hap_pt_share = 1;
+bool_t __initdata iommu_hap_pt_share_forced;
 bool_t __read_mostly iommu_debug;
 bool_t __read_mostly amd_iommu_perdev_intremap = 1;
 
@@ -123,7 +124,7 @@ static void __init parse_iommu_param(char *s)
         else if ( !strcmp(s, "dom0-strict") )
             iommu_dom0_strict = val;
         else if ( !strcmp(s, "sharept") )
-            iommu_hap_pt_share = val;
+            iommu_hap_pt_share = iommu_hap_pt_share_forced = val;
 
         s = ss + 1;
     } while ( ss );
@@ -33,6 +33,8 @@ void print_vtd_entries(struct iommu *iommu, int bus, int devfn, u64 gmfn);
 keyhandler_fn_t vtd_dump_iommu_info;
 
 int enable_qinval(struct iommu *iommu);
+int __must_check qinval_iotlb_range(struct iommu *iommu, u16 did,
+                                    unsigned long gfn, unsigned long nr);
 void disable_qinval(struct iommu *iommu);
 int enable_intremap(struct iommu *iommu, int eim);
 void disable_intremap(struct iommu *iommu);
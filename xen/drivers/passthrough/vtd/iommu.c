@@ -461,6 +461,7 @@ static int __must_check flush_iotlb_reg(void *_iommu, u16 did, u64 addr,
         dmar_writeq(iommu->reg, tlb_offset, size_order | addr);
     }
     dmar_writeq(iommu->reg, tlb_offset + 8, val);
+    iommu_count_iotlb_flush(iommu, type);
 
     /* Make sure hardware complete it */
     IOMMU_WAIT_OP(iommu, (tlb_offset + 8), dmar_readq,
@@ -584,6 +585,49 @@ static int __must_check iommu_flush_all(void)
     return rc;
 }
 
+/*
+ * IOTLB flushes owed by this CPU for mapping changes made while
+ * iommu_dont_flush_iotlb was set, to be carried out by the caller's
+ * iommu_iotlb_flush().  Only replaced or removed entries which were present
+ * need invalidating, and only within [@start, @end]: populating empty
+ * entries just needs the write buffer flushing (or, in caching mode, a
+ * non-present entry flush).
+ */
+struct vtd_deferred_flush {
+    struct domain *d;
+    unsigned long start, end;
+    bool_t present;
+};
+static DEFINE_PER_CPU(struct vtd_deferred_flush, vtd_deferred_flush);
+
+static void vtd_defer_flush(struct domain *d, unsigned long gfn,
+                            bool_t present)
+{
+    struct vtd_deferred_flush *df = &this_cpu(vtd_deferred_flush);
+
+    if ( df->d != d )
+    {
+        /*
+         * Changes recorded for another domain are left for its own flush,
+         * which finding nothing recorded will cover its whole range.  The
+         * same goes for us if we already had a record clobbered that way.
+         */
+        bool_t clobbered = !!df->d;
+
+        df->d = d;
+        df->present = clobbered;
+        df->start = clobbered ? 0 : ~0UL;
+        df->end = clobbered ? ~0UL : 0;
+    }
+
+    if ( !present )
+        return;
+
+    df->present = 1;
+    df->start = min(df->start, gfn);
+    df->end = max(df->end, gfn);
+}
+
 static int __must_check iommu_flush_iotlb(struct domain *d,
                                           unsigned long gfn,
                                           bool_t dma_old_pte_present,
@@ -612,15 +656,28 @@ static int __must_check iommu_flush_iotlb(struct domain *d,
         if ( iommu_domid == -1 )
             continue;
 
-        if ( page_count != 1 || gfn == gfn_x(INVALID_GFN) )
-            rc = iommu_flush_iotlb_dsi(iommu, iommu_domid,
-                                       0, flush_dev_iotlb);
-        else
+        if ( page_count == 1 && gfn != gfn_x(INVALID_GFN) )
             rc = iommu_flush_iotlb_psi(iommu, iommu_domid,
                                        (paddr_t)gfn << PAGE_SHIFT_4K,
                                        PAGE_ORDER_4K,
                                        !dma_old_pte_present,
                                        flush_dev_iotlb);
+        else if ( !dma_old_pte_present )
+            rc = iommu_flush_iotlb_dsi(iommu, iommu_domid,
+                                       1, flush_dev_iotlb);
+        else
+        {
+            rc = -EOPNOTSUPP;
+            if ( page_count && gfn != gfn_x(INVALID_GFN) && !flush_dev_iotlb )
+            {
+                vtd_ops_preamble_quirk(iommu);
+                rc = qinval_iotlb_range(iommu, iommu_domid, gfn, page_count);
+                vtd_ops_postamble_quirk(iommu);
+            }
+            if ( rc == -EOPNOTSUPP )
+                rc = iommu_flush_iotlb_dsi(iommu, iommu_domid,
+                                           0, flush_dev_iotlb);
+        }
 
         if ( rc > 0 )
         {
@@ -636,12 +693,34 @@ static int __must_check iommu_flush_iotlb_pages(struct domain *d,
                                                 unsigned long gfn,
                                                 unsigned int page_count)
 {
+    struct vtd_deferred_flush *df = &this_cpu(vtd_deferred_flush);
+
+    if ( df->d == d )
+    {
+        df->d = NULL;
+        if ( !df->present )
+        {
+            perfc_incr(vtd_deferred_flush_elided);
+            return iommu_flush_iotlb(d, gfn, 0, page_count);
+        }
+
+        /* Only the recorded entries can be stale. */
+        if ( df->end - df->start < UINT_MAX )
+        {
+            gfn = df->start;
+            page_count = df->end - df->start + 1;
+        }
+    }
+
     return iommu_flush_iotlb(d, gfn, 1, page_count);
 }
 
 static int __must_check iommu_flush_iotlb_all(struct domain *d)
 {
-    return iommu_flush_iotlb(d, gfn_x(INVALID_GFN), 0, 0);
+    if ( this_cpu(vtd_deferred_flush).d == d )
+        this_cpu(vtd_deferred_flush).d = NULL;
+
+    return iommu_flush_iotlb(d, gfn_x(INVALID_GFN), 1, 0);
 }
 
 /* clear one page's page table */
@@ -676,7 +755,9 @@ static int __must_check dma_pte_clear_one(struct domain *domain, u64 addr)
     iommu_flush_cache_entry(pte, sizeof(struct dma_pte));
 
     if ( !this_cpu(iommu_dont_flush_iotlb) )
-        rc = iommu_flush_iotlb_pages(domain, addr >> PAGE_SHIFT_4K, 1);
+        rc = iommu_flush_iotlb(domain, addr >> PAGE_SHIFT_4K, 1, 1);
+    else
+        vtd_defer_flush(domain, addr >> PAGE_SHIFT_4K, 1);
 
     unmap_vtd_domain_page(page);
 
@@ -1802,6 +1883,8 @@ static int __must_check intel_iommu_map_page(struct domain *d,
 
     if ( !this_cpu(iommu_dont_flush_iotlb) )
         rc = iommu_flush_iotlb(d, gfn, dma_pte_present(old), 1);
+    else
+        vtd_defer_flush(d, gfn, dma_pte_present(old));
 
     return rc;
 }
@@ -1863,17 +1946,35 @@ int iommu_pte_flush(struct domain *d, u64 gfn, u64 *pte,
     return rc;
 }
 
-static int __init vtd_ept_page_compatible(struct iommu *iommu)
+/* Set if some IOMMU can't walk 1GB EPT entries. */
+static bool __initdata vtd_ept_no_1gb;
+
+/*
+ * Shared tables only work if VT-d can walk every superpage EPT may create.
+ * Sizes only VT-d supports are harmless.  A missing size normally means not
+ * sharing, which only costs guests with passthrough devices.  If the admin
+ * asked for sharing (and not for 1GB HAP pages) a missing 1GB size is
+ * dealt with by not creating 1GB EPT entries, for all guests, instead.
+ */
+static bool __init vtd_ept_page_compatible(struct iommu *iommu)
 {
     u64 ept_cap, vtd_cap = iommu->cap;
 
     /* EPT is not initialised yet, so we must check the capability in
      * the MSR explicitly rather than use cpu_has_vmx_ept_*() */
-    if ( rdmsr_safe(MSR_IA32_VMX_EPT_VPID_CAP, ept_cap) != 0 ) 
-        return 0;
+    if ( rdmsr_safe(MSR_IA32_VMX_EPT_VPID_CAP, ept_cap) != 0 )
+        return false;
+
+    if ( ept_has_2mb(ept_cap) && opt_hap_2mb && !cap_sps_2mb(vtd_cap) )
+        return false;
 
-    return (ept_has_2mb(ept_cap) && opt_hap_2mb) == cap_sps_2mb(vtd_cap) &&
-           (ept_has_1gb(ept_cap) && opt_hap_1gb) == cap_sps_1gb(vtd_cap);
+    if ( ept_has_1gb(ept_cap) && opt_hap_1gb && !cap_sps_1gb(vtd_cap) )
+    {
+        vtd_ept_no_1gb = true;
+        return iommu_hap_pt_share_forced && !opt_hap_1gb_set;
+    }
+
+    return true;
 }
 
 /*
@@ -2270,7 +2371,7 @@ int __init intel_vtd_setup(void)
         if ( !cap_intr_post(iommu->cap) || !cpu_has_cx16 )
             iommu_intpost = 0;
 
-        if ( !vtd_ept_page_compatible(iommu) )
+        if ( iommu_hap_pt_share && !vtd_ept_page_compatible(iommu) )
             iommu_hap_pt_share = 0;
 
         ret = iommu_set_interrupt(drhd);
@@ -2307,6 +2408,16 @@ int __init intel_vtd_setup(void)
     if ( ret )
         goto error;
 
+    /* HAP is set up later, and will see this. */
+    if ( vtd_ept_no_1gb && iommu_hap_pt_share )
+    {
+        printk("Intel VT-d: no 1GB superpages, disabling 1GB HAP pages for "
+               "shared EPT tables.\n");
+        opt_hap_1gb = 0;
+    }
+    else if ( vtd_ept_no_1gb )
+        printk("Intel VT-d: no 1GB superpages, not sharing EPT tables.\n");
+
     register_keyhandler('V', vtd_dump_iommu_info, "dump iommu info", 1);
 
     return 0;
@@ -545,8 +545,33 @@ struct iommu {
     struct list_head ats_devices;
     unsigned long *domid_bitmap;  /* domain id bitmap */
     u16 *domid_map;               /* domain id mapping array */
+
+    /* IOTLB invalidations issued, protected by register_lock. */
+    struct {
+        unsigned long global, dsi, psi;
+        unsigned long wait;       /* wait descriptors completed */
+        s_time_t wait_time;       /* time spent polling for them */
+    } flush_stats;
 };
 
+static inline void iommu_count_iotlb_flush(struct iommu *iommu, u64 type)
+{
+    ASSERT(spin_is_locked(&iommu->register_lock));
+
+    switch ( type )
+    {
+    case DMA_TLB_GLOBAL_FLUSH:
+        iommu->flush_stats.global++;
+        break;
+    case DMA_TLB_DSI_FLUSH:
+        iommu->flush_stats.dsi++;
+        break;
+    case DMA_TLB_PSI_FLUSH:
+        iommu->flush_stats.psi++;
+        break;
+    }
+}
+
 static inline struct qi_ctrl *iommu_qi_ctrl(struct iommu *iommu)
 {
     return iommu ? &iommu->intel->qi_ctrl : NULL;
@@ -106,10 +106,9 @@ static int __must_check queue_invalidate_context_sync(struct iommu *iommu,
     return invalidate_sync(iommu);
 }
 
-static int __must_check queue_invalidate_iotlb_sync(struct iommu *iommu,
-                                                    u8 granu, u8 dr, u8 dw,
-                                                    u16 did, u8 am, u8 ih,
-                                                    u64 addr)
+static void queue_invalidate_iotlb(struct iommu *iommu,
+                                   u8 granu, u8 dr, u8 dw,
+                                   u16 did, u8 am, u8 ih, u64 addr)
 {
     unsigned long flags;
     unsigned int index;
@@ -138,7 +137,16 @@ static int __must_check queue_invalidate_iotlb_sync(struct iommu *iommu,
 
     unmap_vtd_domain_page(qinval_entries);
     qinval_update_qtail(iommu, index);
+    iommu_count_iotlb_flush(iommu, (u64)granu << DMA_TLB_FLUSH_GRANU_OFFSET);
     spin_unlock_irqrestore(&iommu->register_lock, flags);
+}
+
+static int __must_check queue_invalidate_iotlb_sync(struct iommu *iommu,
+                                                    u8 granu, u8 dr, u8 dw,
+                                                    u16 did, u8 am, u8 ih,
+                                                    u64 addr)
+{
+    queue_invalidate_iotlb(iommu, granu, dr, dw, did, am, ih, addr);
 
     return invalidate_sync(iommu);
 }
@@ -176,10 +184,10 @@ static int __must_check queue_invalidate_wait(struct iommu *iommu,
     /* Now we don't support interrupt method */
     if ( sw )
     {
-        s_time_t timeout;
+        s_time_t start = NOW(), timeout;
 
         /* In case all wait descriptor writes to same addr with same data */
-        timeout = NOW() + MILLISECS(flush_dev_iotlb ?
+        timeout = start + MILLISECS(flush_dev_iotlb ?
                                     iommu_dev_iotlb_timeout : VTD_QI_TIMEOUT);
 
         while ( poll_slot != QINVAL_STAT_DONE )
@@ -193,6 +201,12 @@ static int __must_check queue_invalidate_wait(struct iommu *iommu,
             }
             cpu_relax();
         }
+
+        spin_lock_irqsave(&iommu->register_lock, flags);
+        iommu->flush_stats.wait++;
+        iommu->flush_stats.wait_time += NOW() - start;
+        spin_unlock_irqrestore(&iommu->register_lock, flags);
+
         return 0;
     }
 
@@ -394,6 +408,70 @@ static int __must_check flush_iotlb_qi(void *_iommu, u16 did, u64 addr,
     return ret;
 }
 
+/*
+ * Invalidate the IOTLB entries of domain @did for [@gfn, @gfn + @nr) using
+ * page selective descriptors, each covering the largest naturally aligned
+ * block the unit allows, queued back to back and completed by a single wait
+ * descriptor.  Ranges needing more than VTD_QI_RANGE_MAX descriptors get a
+ * domain selective flush instead.  Device IOTLBs are not covered.
+ */
+#define VTD_QI_RANGE_MAX 32
+
+/*
+ * Order of the block the page selective descriptor for @gfn covers, out of
+ * @left pages still to be invalidated.
+ */
+static unsigned int qinval_range_order(unsigned long gfn, unsigned long left,
+                                       unsigned int max_order)
+{
+    unsigned int order = min_t(unsigned int, gfn ? ffsl(gfn) - 1 : max_order,
+                               flsl(left) - 1);
+
+    return min(order, max_order);
+}
+
+int qinval_iotlb_range(struct iommu *iommu, u16 did,
+                       unsigned long gfn, unsigned long nr)
+{
+    unsigned int max_order = cap_max_amask_val(iommu->cap), order, n;
+    unsigned long g, left;
+    u8 dr = cap_read_drain(iommu->cap), dw = cap_write_drain(iommu->cap);
+    bool psi = cap_pgsel_inv(iommu->cap);
+
+    if ( iommu_get_flush(iommu)->iotlb != flush_iotlb_qi )
+        return -EOPNOTSUPP;
+
+    ASSERT(nr);
+
+    /* Count the descriptors needed, giving up as soon as it's too many. */
+    for ( n = 0, g = gfn, left = nr; psi && left; n++, g += 1UL << order,
+                                                 left -= 1UL << order )
+    {
+        if ( n == VTD_QI_RANGE_MAX )
+        {
+            psi = false;
+            break;
+        }
+        order = qinval_range_order(g, left, max_order);
+    }
+
+    if ( !psi )
+        return queue_invalidate_iotlb_sync(
+            iommu, DMA_TLB_DSI_FLUSH >> DMA_TLB_FLUSH_GRANU_OFFSET,
+            dr, dw, did, 0, 0, 0);
+
+    for ( g = gfn, left = nr; left; g += 1UL << order, left -= 1UL << order )
+    {
+        order = qinval_range_order(g, left, max_order);
+        queue_invalidate_iotlb(iommu,
+                               DMA_TLB_PSI_FLUSH >> DMA_TLB_FLUSH_GRANU_OFFSET,
+                               dr, dw, did, order, 0,
+                               (paddr_t)g << PAGE_SHIFT_4K);
+    }
+
+    return invalidate_sync(iommu);
+}
+
 int enable_qinval(struct iommu *iommu)
 {
     struct acpi_drhd_unit *drhd;
@@ -201,6 +201,12 @@ void vtd_dump_iommu_info(unsigned char key)
         printk("  Interrupt Posting: %ssupported.\n",
                cap_intr_post(iommu->cap) ? "" : "not ");
 
+        printk("  IOTLB invalidations: %lu global, %lu domain, %lu page\n",
+               iommu->flush_stats.global, iommu->flush_stats.dsi,
+               iommu->flush_stats.psi);
+        printk("  Invalidation waits: %lu, %"PRI_stime"us total\n",
+               iommu->flush_stats.wait, iommu->flush_stats.wait_time / 1000);
+
         if ( status & DMA_GSTS_IRES )
         {
             /* Dump interrupt remapping table. */
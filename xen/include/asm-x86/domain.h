@@ -390,6 +390,9 @@ struct arch_domain
     /* COS assigned to the domain for each socket */
     unsigned int *psr_cos_ids;
 
+    /* NUMA balancing state, see arch/x86/mm/numa_balance.c */
+    struct numa_balance *numa_balance;
+
     /* Shared page for notifying that explicit PIRQ EOI is required. */
     unsigned long *pirq_eoi_map;
     unsigned long pirq_eoi_map_mfn;
@@ -48,7 +48,7 @@ struct hvm_ioreq_vcpu {
     bool_t           pending;
 };
 
-#define NR_IO_RANGE_TYPES (XEN_DMOP_IO_RANGE_PCI + 1)
+#define NR_IO_RANGE_TYPES (XEN_DMOP_IO_RANGE_POSTED_MEMORY + 1)
 #define MAX_NR_IO_RANGES  256
 
 struct hvm_ioreq_server {
@@ -71,6 +71,7 @@ struct hvm_ioreq_server {
     struct rangeset        *range[NR_IO_RANGE_TYPES];
     bool_t                 enabled;
     bool_t                 bufioreq_atomic;
+    bool_t                 bufioreq_extended;
 };
 
 /*
@@ -122,6 +123,9 @@ struct hvm_domain {
 
     struct hvm_io_handler *io_handler;
     unsigned int          io_handler_count;
+    /* Indexes of the plain port I/O handlers in io_handler, by port. */
+    uint8_t               portio_sorted[NR_IO_HANDLERS];
+    unsigned int          portio_sorted_count;
 
     /* Lock protects access to irq, vpic and vioapic. */
     spinlock_t             irq_lock;
@@ -168,6 +172,14 @@ struct hvm_domain {
 
     bool_t                 hap_enabled;
     bool_t                 mem_sharing_enabled;
+    /* Where the deduplication scanner resumes, see mem_sharing.c. */
+    unsigned long          mem_sharing_scan_gfn;
+    /* Domain this one was forked from, kept paused while this one lives. */
+    struct domain         *mem_sharing_parent;
+    /* Unshare statistics, updated under the p2m lock. */
+    unsigned long          mem_sharing_unshares;
+    uint64_t               mem_sharing_unshare_ns;
+    uint64_t               mem_sharing_unshare_max_ns;
     bool_t                 qemu_mapcache_invalidate;
     bool_t                 is_s3_suspended;
 
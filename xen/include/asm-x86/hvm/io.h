@@ -74,6 +74,7 @@ struct hvm_io_handler {
     };
     const struct hvm_io_ops *ops;
     uint8_t type;
+    unsigned long hits; /* Statistics only: not updated atomically. */
 };
 
 typedef int (*hvm_io_read_t)(const struct hvm_io_handler *,
@@ -81,7 +81,9 @@ enum hvm_copy_result hvm_copy_from_guest_phys(
  * Returns:
  *  HVMCOPY_okay: Copy was entirely successful.
  *  HVMCOPY_bad_gfn_to_mfn: Some guest physical address did not map to
- *                          ordinary machine memory.
+ *                          ordinary machine memory.  For linear copies the
+ *                          pagefault_info_t structure, if provided, gets
+ *                          the linear address and the gfn it translated to.
  *  HVMCOPY_bad_gva_to_gfn: Some guest virtual address did not have a valid
  *                          mapping to a guest physical address.  The
  *                          pagefault_info_t structure will be filled in if
@@ -90,6 +92,7 @@ enum hvm_copy_result hvm_copy_from_guest_phys(
 typedef struct pagefault_info
 {
     unsigned long linear;
+    unsigned long gfn;
     int ec;
 } pagefault_info_t;
 
@@ -53,20 +53,32 @@ struct hvm_mmio_cache {
     uint8_t buffer[32];
 };
 
+/*
+ * HVM emulation:
+ *  Linear page @gla maps to MMIO physical frame @gpfn.
+ *  The latter is known to be an MMIO frame (not RAM).
+ *  This translation is only valid for accesses as per @access.
+ */
+struct hvm_mmio_xlat {
+    struct npfec        access;
+    unsigned long       gla;
+    unsigned long       gpfn;
+};
+
 struct hvm_vcpu_io {
     /* I/O request in flight to device model. */
     enum hvm_io_completion io_completion;
     ioreq_t                io_req;
 
     /*
-     * HVM emulation:
-     *  Linear address @mmio_gla maps to MMIO physical frame @mmio_gpfn.
-     *  The latter is known to be an MMIO frame (not RAM).
-     *  This translation is only valid for accesses as per @mmio_access.
+     * Translations seen by the fault that led to emulation, or found while
+     * emulating, kept until the instruction completes (i.e. across retries
+     * and device model round trips).  They can't outlive it: with HAP the
+     * guest's CR3 writes and INVLPGs don't trap, so stale entries would go
+     * unnoticed.
      */
-    struct npfec        mmio_access;
-    unsigned long       mmio_gla;
-    unsigned long       mmio_gpfn;
+    struct hvm_mmio_xlat mmio_xlat[4];
+    unsigned int        mmio_xlat_next;
 
     /*
      * We may need to handle up to 3 distinct memory accesses per
@@ -89,6 +101,9 @@ struct hvm_vcpu_io {
     unsigned long msix_snoop_gpa;
 
     const struct g2m_ioport *g2m_ioport;
+
+    /* Index of the I/O handler last hit, per IOREQ_TYPE_{PIO,COPY}. */
+    unsigned int io_handler_hint[2];
 };
 
 static inline bool_t hvm_vcpu_io_need_completion(const struct hvm_vcpu_io *vio)
@@ -97,6 +112,12 @@ static inline bool_t hvm_vcpu_io_need_completion(const struct hvm_vcpu_io *vio)
            !vio->io_req.data_is_ptr;
 }
 
+static inline void hvm_vcpu_io_flush_xlat(struct hvm_vcpu_io *vio)
+{
+    memset(vio->mmio_xlat, 0, sizeof(vio->mmio_xlat));
+    vio->mmio_xlat_next = 0;
+}
+
 struct nestedvcpu {
     bool_t nv_guestmode; /* vcpu in guestmode? */
     void *nv_vvmcx; /* l1 guest virtual VMCB/VMCS */
@@ -57,20 +57,56 @@ struct page_sharing_info
 unsigned int mem_sharing_get_nr_saved_mfns(void);
 unsigned int mem_sharing_get_nr_shared_mfns(void);
 
+/*
+ * Private copy of a shared frame, made before taking the p2m lock so that
+ * the lock isn't held across the copy. See mem_sharing_unshare_prepare().
+ */
+struct mem_sharing_precopy {
+    struct page_info *page;     /* The copy, if still unused. */
+    struct page_info *src;      /* The shared frame it was made from. */
+    s_time_t start;             /* When unsharing started. */
+};
+
+void mem_sharing_unshare_prepare(struct domain *d, unsigned long gfn,
+                                 struct mem_sharing_precopy *pc);
+void mem_sharing_unshare_release(struct mem_sharing_precopy *pc);
+
 #define MEM_SHARING_DESTROY_GFN       (1<<1)
 /* Only fails with -ENOMEM. Enforce it with a BUG_ON wrapper. */
 int __mem_sharing_unshare_page(struct domain *d,
                              unsigned long gfn, 
-                             uint16_t flags);
+                             uint16_t flags,
+                             struct mem_sharing_precopy *pc);
 static inline int mem_sharing_unshare_page(struct domain *d,
                                            unsigned long gfn,
                                            uint16_t flags)
 {
-    int rc = __mem_sharing_unshare_page(d, gfn, flags);
+    int rc = __mem_sharing_unshare_page(d, gfn, flags, NULL);
     BUG_ON( rc && (rc != -ENOMEM) );
     return rc;
 }
 
+/* Same, using (if still valid) a copy made by mem_sharing_unshare_prepare. */
+static inline int mem_sharing_unshare_page_precopied(
+    struct domain *d, unsigned long gfn, struct mem_sharing_precopy *pc)
+{
+    int rc = __mem_sharing_unshare_page(d, gfn, 0, pc);
+    BUG_ON( rc && (rc != -ENOMEM) );
+    return rc;
+}
+
+/*
+ * Unsharing the neighbours of a gfn the guest just wrote to (best effort) is
+ * queued with the p2m locked, and done by the fault handler once unlocked.
+ */
+void mem_sharing_unshare_batch_queue(struct domain *d, unsigned long gfn);
+void mem_sharing_unshare_batch(struct domain *d);
+
+void mem_sharing_dump_domain(const struct domain *d);
+
+/* Fill a hole in a fork's physmap from its parent. */
+int mem_sharing_fork_page(struct domain *d, gfn_t gfn, bool unsharing);
+
 /* If called by a foreign domain, possible errors are
  *   -EBUSY -> ring full
  *   -ENOSYS -> no ring to begin with
@@ -78,6 +78,10 @@ static inline __attribute__((pure)) nodeid_t phys_to_nid(paddr_t addr)
 extern int valid_numa_range(u64 start, u64 end, nodeid_t node);
 
 void srat_parse_regions(u64 addr);
+
+struct domain;
+void numa_balance_domain_destroy(struct domain *d);
+void numa_balance_dump_domain(const struct domain *d);
 extern u8 __node_distance(nodeid_t a, nodeid_t b);
 unsigned int arch_get_dma_bitsize(void);
 
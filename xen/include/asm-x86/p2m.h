@@ -32,7 +32,7 @@
 #include <asm/mem_sharing.h>
 #include <asm/page.h>    /* for pagetable_t */
 
-extern bool_t opt_hap_1gb, opt_hap_2mb;
+extern bool_t opt_hap_1gb, opt_hap_2mb, opt_hap_1gb_set;
 
 /*
  * The upper levels of the p2m pagetable always contain full rights; all 
@@ -317,6 +317,9 @@ struct p2m_domain {
         long             count,        /* # of pages in cache lists         */
                          entry_count;  /* # of pages in p2m marked pod      */
         unsigned long    reclaim_single; /* Last gpfn of a scan */
+        unsigned long    reclaim_found; /* Reclaimed in this background pass */
+        unsigned int     reclaim_backoff, /* Runs skipped after a vain pass */
+                         reclaim_skip;    /* Runs still to be skipped       */
         unsigned long    max_guest;    /* gpfn of max guest demand-populate */
 
         /*
@@ -354,6 +357,9 @@ struct p2m_domain {
          unsigned int flags;
          unsigned long entry_count;
      } ioreq;
+
+    /* Where the superpage reassembly scan resumes, see p2m-collapse.c. */
+    unsigned long collapse_next_gfn;
 };
 
 /* get host p2m table */
@@ -701,6 +707,17 @@ int p2m_set_entry(struct p2m_domain *p2m, unsigned long gfn, mfn_t mfn,
 /* Set up function pointers for PT implementation: only for use by p2m code */
 extern void p2m_pt_init(struct p2m_domain *p2m);
 
+/* Replacing guest frames with copies, for NUMA balancing and p2m collapse */
+bool p2m_frames_replaceable(const struct domain *d);
+void p2m_for_each_replaceable_domain(
+    unsigned long budget,
+    unsigned long (*fn)(struct domain *d, unsigned long budget));
+struct page_info *p2m_alloc_replacement(struct domain *d, unsigned int order,
+                                        unsigned int memflags);
+int p2m_replace_frames(struct domain *d, unsigned long gfn, unsigned int order,
+                       const mfn_t *old, struct page_info *new_pg,
+                       p2m_access_t a);
+
 void *map_domain_gfn(struct p2m_domain *p2m, gfn_t gfn, mfn_t *mfn,
                      p2m_type_t *p2mt, p2m_query_t q, uint32_t *pfec);
 
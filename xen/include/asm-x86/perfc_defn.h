@@ -137,9 +137,43 @@ PERFCOUNTER(mshv_wrmsr_apic_assist,     "MS Hv wrmsr APIC assist")
 PERFCOUNTER(mshv_wrmsr_apic_msr,        "MS Hv wrmsr APIC msr")
 PERFCOUNTER(mshv_wrmsr_tsc_msr,         "MS Hv wrmsr TSC msr")
 
+PERFCOUNTER(hvm_io_hint,   "HVM I/O: handler was last hit")
+PERFCOUNTER(hvm_io_sorted, "HVM I/O: handler from port search")
+PERFCOUNTER(hvm_io_poll,   "HVM I/O: handler from polling")
+PERFCOUNTER(hvm_mmio_xlat_hit,  "HVM MMIO: translation cached")
+PERFCOUNTER(hvm_mmio_xlat_copy, "HVM MMIO: translation from failed copy")
+PERFCOUNTER(hvm_mmio_xlat_walk, "HVM MMIO: translation walked")
+PERFCOUNTER(ioreq_posted,      "ioreq: writes posted")
+PERFCOUNTER(ioreq_posted_full, "ioreq: posted writes sent synchronously")
+PERFCOUNTER(bufioreq_notify_coalesced, "ioreq: buffered notifications saved")
+
 PERFCOUNTER(realmode_emulations, "realmode instructions emulated")
 PERFCOUNTER(realmode_exits,      "vmexits from realmode")
 
 PERFCOUNTER(pauseloop_exits, "vmexits from Pause-Loop Detection")
 
+PERFCOUNTER(numa_balance_migrated, "numa_balance: pages migrated")
+PERFCOUNTER(numa_balance_busy,     "numa_balance: pages busy")
+
+PERFCOUNTER(p2m_collapse_promoted_2m, "p2m_collapse: 2M promoted in place")
+PERFCOUNTER(p2m_collapse_promoted_1g, "p2m_collapse: 1G promoted in place")
+PERFCOUNTER(p2m_collapse_copied_2m,   "p2m_collapse: 2M copied")
+PERFCOUNTER(p2m_collapse_busy,        "p2m_collapse: 2M busy")
+
+PERFCOUNTER(mem_sharing_scan_pages,    "mem_sharing scan: pages hashed")
+PERFCOUNTER(mem_sharing_scan_merged,   "mem_sharing scan: pages shared")
+PERFCOUNTER(mem_sharing_scan_mismatch, "mem_sharing scan: hash hits not shared")
+PERFCOUNTER(mem_sharing_unshare_precopied, "mem_sharing: unshares copied unlocked")
+PERFCOUNTER(mem_sharing_unshare_batched,   "mem_sharing: neighbours unshared")
+
+PERFCOUNTER(vtd_deferred_flush_elided, "VT-d: deferred IOTLB flushes elided")
+
+PERFCOUNTER(pod_reclaim_pages,         "PoD: pages reclaimed in background")
+PERFCOUNTER(pod_emergency_sweep,       "PoD: sweeps from the fault path")
+
+PERFCOUNTER(mem_sharing_fork,              "mem_sharing: domains forked")
+PERFCOUNTER(mem_sharing_fork_shared,       "mem_sharing: fork pages shared")
+PERFCOUNTER(mem_sharing_fork_copied,       "mem_sharing: fork pages copied")
+PERFCOUNTER(mem_sharing_fork_reset_pages,  "mem_sharing: fork pages reset")
+
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
@@ -138,6 +138,7 @@ struct cpuinfo_x86 {
     __u32 phys_proc_id;    /* package ID of each logical CPU */
     __u32 cpu_core_id;     /* core ID of each logical CPU*/
     __u32 compute_unit_id; /* AMD compute unit ID of each logical CPU */
+    __u32 cpu_llc_id;      /* ID of the last level cache shared by this CPU */
     unsigned short x86_clflush_size;
 } __cacheline_aligned;
 
@@ -177,6 +178,7 @@ extern void detect_ht(struct cpuinfo_x86 *c);
 
 #define cpu_to_core(_cpu)   (cpu_data[_cpu].cpu_core_id)
 #define cpu_to_socket(_cpu) (cpu_data[_cpu].phys_proc_id)
+#define cpu_to_llc(_cpu)    (cpu_data[_cpu].cpu_llc_id)
 
 unsigned int apicid_to_socket(unsigned int);
 
@@ -120,6 +120,16 @@ struct xen_dm_op_get_ioreq_server_info {
  * values which should be encoded using the DMOP_PCI_SBDF helper macro
  * below.
  *
+ * Port and memory ranges may additionally be registered as "posted" with
+ * the XEN_DMOP_IO_RANGE_POSTED_* types.  Single writes (not REP or string
+ * accesses) which the server would be sent, and which fall entirely within
+ * a posted range, are queued on its buffered ioreq ring and the vCPU
+ * carries on without waiting for them to be emulated.  Reads, and writes
+ * that find the ring full, are sent synchronously as usual.  Posted ranges
+ * are only used by servers created with HVM_IOREQSRV_BUFIOREQ_EXTENDED (or,
+ * for ports, any buffered ring) and are suitable for doorbell and similar
+ * registers whose writes have no side effects the guest waits on.
+ *
  * NOTE: unless an emulation request falls entirely within a range mapped
  * by a secondary emulator, it will not be passed to that emulator.
  */
@@ -135,6 +145,8 @@ struct xen_dm_op_ioreq_server_range {
 # define XEN_DMOP_IO_RANGE_PORT   0 /* I/O port range */
 # define XEN_DMOP_IO_RANGE_MEMORY 1 /* MMIO range */
 # define XEN_DMOP_IO_RANGE_PCI    2 /* PCI segment/bus/dev/func range */
+# define XEN_DMOP_IO_RANGE_POSTED_PORT   3 /* Posted-write I/O port range */
+# define XEN_DMOP_IO_RANGE_POSTED_MEMORY 4 /* Posted-write MMIO range */
     /* IN - inclusive start and end of range */
     uint64_aligned_t start, end;
 };
@@ -170,6 +170,12 @@ DEFINE_XEN_GUEST_HANDLE(xen_hvm_get_mem_type_t);
  * the pointer pair gets read atomically:
  */
 #define HVM_IOREQSRV_BUFIOREQ_ATOMIC 2
+/*
+ * As HVM_IOREQSRV_BUFIOREQ_ATOMIC, but the ring uses the buffered_iopage_ext
+ * layout from ioreq.h, which can hold any single write and is what posted
+ * write ranges are queued on:
+ */
+#define HVM_IOREQSRV_BUFIOREQ_EXTENDED 3
 
 #endif /* defined(__XEN__) || defined(__XEN_TOOLS__) */
 
@@ -98,6 +98,42 @@ struct buffered_iopage {
 }; /* NB. Size of this structure must be no greater than one page. */
 typedef struct buffered_iopage buffered_iopage_t;
 
+/*
+ * Buffered ioreq ring layout used with HVM_IOREQSRV_BUFIOREQ_EXTENDED.
+ * Entries carry a full address and 64 bits of data, so any single port
+ * or MMIO write (in particular those to posted ranges, see dm_op.h) can
+ * be queued.  The pointers are handled as for HVM_IOREQSRV_BUFIOREQ_ATOMIC.
+ *
+ * Xen only raises the event channel when it queues an entry on an empty
+ * ring, so one notification may cover many entries.  After advancing
+ * read_pointer the device model must therefore re-read write_pointer (with
+ * a full barrier in between) and keep consuming until the ring is empty
+ * before waiting for the next notification.  It must also drain the ring
+ * before handling any synchronous ioreq, which keeps posted writes ordered
+ * ahead of later accesses by the same vCPU.
+ */
+struct buf_ioreq_ext {
+    uint64_t addr;   /* physical address or port    */
+    uint64_t data;   /* data                        */
+    uint8_t  type;   /* I/O type                    */
+    uint8_t  size;   /* 1, 2, 4 or 8                */
+    uint8_t  dir;    /* 1=read, 0=write             */
+    uint8_t  pad[5];
+};
+typedef struct buf_ioreq_ext buf_ioreq_ext_t;
+
+#define IOREQ_BUFFER_EXT_SLOT_NUM 170 /* 24 bytes each, plus 2 4-byte indexes */
+struct buffered_iopage_ext {
+#ifdef __XEN__
+    union bufioreq_pointers ptrs;
+#else
+    uint32_t read_pointer;
+    uint32_t write_pointer;
+#endif
+    buf_ioreq_ext_t buf_ioreq[IOREQ_BUFFER_EXT_SLOT_NUM];
+}; /* NB. Size of this structure must be no greater than one page. */
+typedef struct buffered_iopage_ext buffered_iopage_ext_t;
+
 /*
  * ACPI Control/Event register locations. Location is controlled by a 
  * version number in HVM_PARAM_ACPI_IOPORTS_LOCATION.
@@ -480,6 +480,8 @@ DEFINE_XEN_GUEST_HANDLE(xen_mem_access_op_t);
 #define XENMEM_sharing_op_add_physmap       6
 #define XENMEM_sharing_op_audit             7
 #define XENMEM_sharing_op_range_share       8
+#define XENMEM_sharing_op_fork              9
+#define XENMEM_sharing_op_fork_reset        10
 
 #define XENMEM_SHARING_OP_S_HANDLE_INVALID  (-10)
 #define XENMEM_SHARING_OP_C_HANDLE_INVALID  (-9)
@@ -523,6 +525,17 @@ struct xen_mem_sharing_op {
             domid_t client_domain;           /* IN: the client domain id */
             uint16_t _pad[3];                /* Must be set to 0 */
         } range;
+        /*
+         * OP_FORK makes `domain', which must have been created with the same
+         * configuration as the parent, have no memory and be paused, a
+         * copy-on-write clone of the parent.  The parent stays paused until
+         * the fork is destroyed.  OP_FORK_RESET discards everything the fork
+         * has written to since and reloads its vCPU state from the parent.
+         */
+        struct mem_sharing_op_fork {         /* OP_FORK */
+            domid_t parent_domain;           /* IN: parent's domain id */
+            uint16_t _pad[3];                /* Must be set to 0 */
+        } fork;
         struct mem_sharing_op_debug {     /* OP_DEBUG_xxx */
             union {
                 uint64_aligned_t gfn;      /* IN: gfn to debug          */
@@ -597,6 +610,37 @@ struct xen_reserved_device_memory_map {
 typedef struct xen_reserved_device_memory_map xen_reserved_device_memory_map_t;
 DEFINE_XEN_GUEST_HANDLE(xen_reserved_device_memory_map_t);
 
+/*
+ * Populate the contiguous guest frame range [gpfn, gpfn + nr_pages) of an
+ * auto-translated domain, letting Xen use the largest pages (1GB, 2MB or
+ * 4kB) that the alignment of the range, max_order and the availability of
+ * contiguous memory allow, and map them as superpages in the guest's p2m.
+ *
+ * Returns 0 once the whole range has been populated.  On any return, gpfn
+ * and nr_pages describe what is left to do, max_order may have been
+ * lowered after an allocation of that order failed, and the nr_* counters
+ * were incremented for each extent populated.  -ENOMEM is returned when
+ * not even a 4kB page could be allocated.
+ */
+#define XENMEM_populate_physmap_range       28
+struct xen_memory_populate_range {
+    /* IN */
+    domid_t domid;
+    uint16_t pad;
+    uint32_t mem_flags;         /* XENMEMF_*, except populate_on_demand. */
+    /* IN/OUT */
+    uint32_t max_order;         /* Largest extent order to use. */
+    uint32_t pad2;
+    uint64_aligned_t gpfn;      /* First guest frame left to populate. */
+    uint64_aligned_t nr_pages;  /* Number of frames left to populate. */
+    /* OUT (incremented) */
+    uint64_aligned_t nr_4k;     /* Number of 4kB pages populated. */
+    uint64_aligned_t nr_2m;     /* Number of 2MB pages populated. */
+    uint64_aligned_t nr_1g;     /* Number of 1GB pages populated. */
+};
+typedef struct xen_memory_populate_range xen_memory_populate_range_t;
+DEFINE_XEN_GUEST_HANDLE(xen_memory_populate_range_t);
+
 #endif /* defined(__XEN__) || defined(__XEN_TOOLS__) */
 
 /*
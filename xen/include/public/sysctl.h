@@ -36,7 +36,7 @@
 #include "physdev.h"
 #include "tmem.h"
 
-#define XEN_SYSCTL_INTERFACE_VERSION 0x0000000F
+#define XEN_SYSCTL_INTERFACE_VERSION 0x00000010
 
 /*
  * Read console content from Xen buffer ring.
@@ -640,12 +640,48 @@ struct xen_sysctl_credit_schedule {
 typedef struct xen_sysctl_credit_schedule xen_sysctl_credit_schedule_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_credit_schedule_t);
 
+struct xen_sysctl_credit2_runq {
+    uint32_t id;           /* Runqueue id */
+    uint32_t nr_cpus;      /* Number of pcpus in the runqueue */
+    uint32_t tslice_us;    /* Current maximum timeslice */
+    uint32_t ratelimit_us; /* Current effective ratelimit */
+};
+typedef struct xen_sysctl_credit2_runq xen_sysctl_credit2_runq_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_credit2_runq_t);
+
 struct xen_sysctl_credit2_schedule {
     unsigned ratelimit_us;
+    /* IN/OUT: per-runqueue adaptive timeslicing enabled (putinfo/getinfo) */
+    uint32_t adaptive;
+    /*
+     * IN: size of the runqs array (getinfo only);
+     * OUT: number of active runqueues.
+     * If runqs is a NULL handle, only nr_runqs is returned. Up to nr_runqs
+     * elements of runqs are filled.
+     */
+    uint32_t nr_runqs;
+    uint32_t pad;
+    XEN_GUEST_HANDLE_64(xen_sysctl_credit2_runq_t) runqs;
 };
 typedef struct xen_sysctl_credit2_schedule xen_sysctl_credit2_schedule_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_credit2_schedule_t);
 
+struct xen_sysctl_rtds_schedule {
+    /*
+     * IN/OUT: how the pCPUs of the cpupool are grouped in clusters.
+     * It can only be changed while the cpupool has no pCPUs.
+     */
+#define XEN_SYSCTL_RTDS_CLUSTER_CPU    0
+#define XEN_SYSCTL_RTDS_CLUSTER_CORE   1
+#define XEN_SYSCTL_RTDS_CLUSTER_SOCKET 2
+#define XEN_SYSCTL_RTDS_CLUSTER_NODE   3
+#define XEN_SYSCTL_RTDS_CLUSTER_ALL    4
+    uint32_t cluster;
+    uint32_t pad;
+};
+typedef struct xen_sysctl_rtds_schedule xen_sysctl_rtds_schedule_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_rtds_schedule_t);
+
 /* XEN_SYSCTL_scheduler_op */
 /* Set or get info? */
 #define XEN_SYSCTL_SCHEDOP_putinfo 0
@@ -660,6 +696,7 @@ struct xen_sysctl_scheduler_op {
         } sched_arinc653;
         struct xen_sysctl_credit_schedule sched_credit;
         struct xen_sysctl_credit2_schedule sched_credit2;
+        struct xen_sysctl_rtds_schedule sched_rtds;
     } u;
 };
 typedef struct xen_sysctl_scheduler_op xen_sysctl_scheduler_op_t;
@@ -1095,6 +1132,42 @@ struct xen_sysctl_livepatch_op {
 typedef struct xen_sysctl_livepatch_op xen_sysctl_livepatch_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_livepatch_op_t);
 
+/*
+ * XEN_SYSCTL_sched_stats
+ *
+ * Scheduling latency histograms, kept by the generic scheduling code, for
+ * each pCPU and for each domain:
+ *  -  wake: time from a vCPU being woken up until it runs;
+ *  -  wait: time spent by a vCPU in the runnable state, before running
+ *           (this includes, but is not limited to, the wake samples);
+ *  - slice: time a vCPU runs for, before being descheduled.
+ *
+ * Each histogram has XEN_SYSCTL_SCHED_STATS_BUCKETS buckets, with bucket
+ * i counting the samples in [2^i, 2^(i+1)) nanoseconds (the first bucket
+ * also counts zero length samples, the last one all samples longer than
+ * that). Counters are updated without locking, so a snapshot is not
+ * guaranteed to be consistent across buckets.
+ */
+#define XEN_SYSCTL_SCHED_STATS_wake       0
+#define XEN_SYSCTL_SCHED_STATS_wait       1
+#define XEN_SYSCTL_SCHED_STATS_slice      2
+#define XEN_SYSCTL_SCHED_STATS_NR         3
+#define XEN_SYSCTL_SCHED_STATS_BUCKETS    32
+struct xen_sysctl_sched_stats {
+#define XEN_SYSCTL_SCHED_STATS_get_pcpu   0
+#define XEN_SYSCTL_SCHED_STATS_get_domain 1
+#define XEN_SYSCTL_SCHED_STATS_reset      2
+    uint32_t cmd;         /* IN: XEN_SYSCTL_SCHED_STATS_{get_*,reset} */
+    uint32_t id;          /* IN: pCPU or domain ID (get_* only) */
+    /*
+     * OUT: XEN_SYSCTL_SCHED_STATS_NR histograms, one after the other, in
+     * the order above (get_* only).
+     */
+    XEN_GUEST_HANDLE_64(uint64) hist;
+};
+typedef struct xen_sysctl_sched_stats xen_sysctl_sched_stats_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_sched_stats_t);
+
 struct xen_sysctl {
     uint32_t cmd;
 #define XEN_SYSCTL_readconsole                    1
@@ -1123,6 +1196,7 @@ struct xen_sysctl {
 #define XEN_SYSCTL_get_cpu_levelling_caps        25
 #define XEN_SYSCTL_get_cpu_featureset            26
 #define XEN_SYSCTL_livepatch_op                  27
+#define XEN_SYSCTL_sched_stats                   28
     uint32_t interface_version; /* XEN_SYSCTL_INTERFACE_VERSION */
     union {
         struct xen_sysctl_readconsole       readconsole;
@@ -1151,6 +1225,7 @@ struct xen_sysctl {
         struct xen_sysctl_cpu_levelling_caps cpu_levelling_caps;
         struct xen_sysctl_cpu_featureset    cpu_featureset;
         struct xen_sysctl_livepatch_op      livepatch;
+        struct xen_sysctl_sched_stats       sched_stats;
         uint8_t                             pad[128];
     } u;
 };
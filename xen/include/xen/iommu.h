@@ -31,7 +31,7 @@ extern bool_t iommu_enable, iommu_enabled;
 extern bool_t force_iommu, iommu_verbose;
 extern bool_t iommu_workaround_bios_bug, iommu_igfx, iommu_passthrough;
 extern bool_t iommu_snoop, iommu_qinval, iommu_intremap, iommu_intpost;
-extern bool_t iommu_hap_pt_share;
+extern bool_t iommu_hap_pt_share, iommu_hap_pt_share_forced;
 extern bool_t iommu_debug;
 extern bool_t amd_iommu_perdev_intremap;
 
@@ -24,6 +24,8 @@ PERFCOUNTER(vcpu_insert,            "sched: vcpu_insert")
 PERFCOUNTER(vcpu_remove,            "sched: vcpu_remove")
 PERFCOUNTER(vcpu_sleep,             "sched: vcpu_sleep")
 PERFCOUNTER(vcpu_yield,             "sched: vcpu_yield")
+PERFCOUNTER(vcpu_yield_to,          "sched: vcpu_yield_to")
+PERFCOUNTER(vcpu_yield_to_none,     "sched: vcpu_yield_to_none")
 PERFCOUNTER(vcpu_wake_running,      "sched: vcpu_wake_running")
 PERFCOUNTER(vcpu_wake_onrunq,       "sched: vcpu_wake_onrunq")
 PERFCOUNTER(vcpu_wake_runnable,     "sched: vcpu_wake_runnable")
@@ -32,6 +34,9 @@ PERFCOUNTER(tickled_no_cpu,         "sched: tickled_no_cpu")
 PERFCOUNTER(tickled_idle_cpu,       "sched: tickled_idle_cpu")
 PERFCOUNTER(tickled_busy_cpu,       "sched: tickled_busy_cpu")
 PERFCOUNTER(vcpu_check,             "sched: vcpu_check")
+PERFCOUNTER(sched_core_defer,       "sched: core_defer")
+PERFCOUNTER(sched_core_drain,       "sched: core_drain")
+PERFCOUNTER(sched_core_rendezvous,  "sched: core_rendezvous")
 
 /* credit specific counters */
 PERFCOUNTER(delay_ms,               "csched: delay")
@@ -72,7 +77,30 @@ PERFCOUNTER(credit_reset,           "csched2: credit_reset")
 PERFCOUNTER(deferred_to_tickled_cpu,"csched2: deferred_to_tickled_cpu")
 PERFCOUNTER(tickled_cpu_overwritten,"csched2: tickled_cpu_overwritten")
 PERFCOUNTER(tickled_cpu_overridden, "csched2: tickled_cpu_overridden")
+PERFCOUNTER(pick_cache_hot,         "csched2: pick_cache_hot")
+PERFCOUNTER(tslice_grow,            "csched2: tslice_grow")
+PERFCOUNTER(tslice_shrink,          "csched2: tslice_shrink")
+PERFCOUNTER(yield_to_credit_swap,   "csched2: yield_to_credit_swap")
+
+/* rtds specific counters */
+PERFCOUNTER(rtds_push,              "rtds: push")
+PERFCOUNTER(rtds_pull,              "rtds: pull")
+PERFCOUNTER(rtds_pull_trylock_failed, "rtds: pull_trylock_failed")
 
 PERFCOUNTER(need_flush_tlb_flush,   "PG_need_flush tlb flushes")
 
+PERFCOUNTER(scrub_idle_pages,       "pages scrubbed while idle")
+PERFCOUNTER(scrub_alloc_pages,      "pages scrubbed on allocation")
+
+PERFCOUNTER(heap_lock_acquired,     "heap_lock: acquired")
+PERFCOUNTER(heap_lock_contended,    "heap_lock: contended")
+PERFCOUNTER(page_cache_hit,         "page cache: hit")
+PERFCOUNTER(page_cache_miss,        "page cache: miss")
+PERFCOUNTER(page_cache_refill,      "page cache: refill")
+PERFCOUNTER(page_cache_drain,       "page cache: drain")
+
+PERFCOUNTER(xmem_cache_hit,         "xmem cache: hit")
+PERFCOUNTER(xmem_cache_miss,        "xmem cache: miss")
+PERFCOUNTER(xmem_cache_flush,       "xmem cache: flush")
+
 /*#endif*/ /* __XEN_PERFC_DEFN_H__ */
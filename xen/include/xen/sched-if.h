@@ -47,6 +47,69 @@ DECLARE_PER_CPU(struct schedule_data, schedule_data);
 DECLARE_PER_CPU(struct scheduler *, scheduler);
 DECLARE_PER_CPU(struct cpupool *, cpupool);
 
+/*
+ * Core scheduling (sched_gran=core).
+ *
+ * All the SMT siblings of a core share one struct sched_core. At any given
+ * time, the core is "owned" by at most one domain, and only vcpus of that
+ * domain (or the idle vcpus) may run on the siblings. Ownership is taken by
+ * the first sibling that schedules a guest vcpu while no other sibling is
+ * running one, and is dropped when all the siblings have gone idle.
+ *
+ * Schedulers supporting core scheduling must, in their do_schedule hook,
+ * only pick vcpus for which sched_core_allowed() is true, and call
+ * sched_core_defer() for the runnable vcpus they had to skip because of
+ * that. Siblings kept idle while a vcpu of another domain waits make the
+ * owner give the core up, after at most SCHED_CORE_SLICE.
+ *
+ * The core lock nests outside of the scheduler locks of all the siblings,
+ * and is held (by schedule()) across do_schedule. Ownership follows those
+ * decisions; the context switches that carry them out are synchronised on
+ * their own, by sched_core_enter(), so that a sibling never enters a vcpu
+ * of the owner while another still has a vcpu of a former owner loaded.
+ * Xen itself (interrupts, and what it does on behalf of the owner's vcpus)
+ * still runs next to the guest code on the siblings.
+ */
+struct sched_core {
+    spinlock_t          lock;
+    const struct domain *owner;   /* Domain owning the core, or NULL       */
+    const struct domain *next;    /* Domain of the first vcpu that waited  */
+    s_time_t            owned_since;
+    unsigned int        nr_cpus;  /* Online siblings using this struct     */
+    unsigned int        nr_busy;  /* Siblings running a vcpu of owner      */
+    unsigned int        nr_waiting; /* Siblings idling because of owner    */
+    bool                draining; /* Owner is being asked to give core up  */
+};
+
+#define SCHED_CORE_SLICE   MILLISECS(10)
+
+DECLARE_PER_CPU(struct sched_core *, sched_core);
+DECLARE_PER_CPU(bool, sched_core_busy);
+DECLARE_PER_CPU(bool, sched_core_waiting);
+
+/*
+ * Can v run on cpu, as far as the domain running on cpu's siblings is
+ * concerned? Always true if core scheduling is disabled.
+ */
+static inline bool sched_core_allowed(unsigned int cpu, const struct vcpu *v)
+{
+    struct sched_core *core = per_cpu(sched_core, cpu);
+
+    if ( likely(core == NULL) || is_idle_vcpu(v) )
+        return true;
+
+    ASSERT(spin_is_locked(&core->lock));
+
+    /* If some other sibling is running a vcpu, we must match its domain. */
+    if ( core->nr_busy > per_cpu(sched_core_busy, cpu) )
+        return core->owner == v->domain && !core->draining;
+
+    /* If draining, make sure the domain that has been waiting gets in. */
+    return !core->draining || core->next == NULL || core->next == v->domain;
+}
+
+void sched_core_defer(unsigned int cpu, const struct vcpu *v);
+
 /*
  * Scratch space, for avoiding having too many cpumask_t on the stack.
  * Within each scheduler, when using the scratch mask of one pCPU:
@@ -162,6 +225,8 @@ struct scheduler {
     void         (*sleep)          (const struct scheduler *, struct vcpu *);
     void         (*wake)           (const struct scheduler *, struct vcpu *);
     void         (*yield)          (const struct scheduler *, struct vcpu *);
+    int          (*yield_to)       (const struct scheduler *, struct vcpu *,
+                                    struct vcpu *);
     void         (*context_saved)  (const struct scheduler *, struct vcpu *);
 
     struct task_slice (*do_schedule) (const struct scheduler *, s_time_t,
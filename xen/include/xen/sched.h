@@ -185,6 +185,8 @@ struct vcpu
     bool             is_running;
     /* VCPU should wake fast (do not deep sleep the CPU). */
     bool             is_urgent;
+    /* Woken up, and not run since (for the scheduling latency stats)? */
+    bool             sched_woken;
 
 #ifdef VCPU_TRAP_LAST
 #define VCPU_TRAP_NONE    0
@@ -335,6 +337,8 @@ struct domain
     /* Scheduling. */
     void            *sched_priv;    /* scheduler-specific data */
     struct cpupool  *cpupool;
+    struct sched_hist *sched_hist;  /* scheduling latency histograms */
+    unsigned int     last_boosted_vcpu; /* last target of directed yield */
 
     struct domain   *next_in_list;
     struct domain   *next_in_hashbucket;
@@ -648,11 +652,13 @@ void sched_destroy_domain(struct domain *d);
 int sched_move_domain(struct domain *d, struct cpupool *c);
 long sched_adjust(struct domain *, struct xen_domctl_scheduler_op *);
 long sched_adjust_global(struct xen_sysctl_scheduler_op *);
+long sched_stats_op(struct xen_sysctl_sched_stats *);
 int  sched_id(void);
 void sched_tick_suspend(void);
 void sched_tick_resume(void);
 void vcpu_wake(struct vcpu *v);
 long vcpu_yield(void);
+long vcpu_directed_yield(void);
 void vcpu_sleep_nosync(struct vcpu *v);
 void vcpu_sleep_sync(struct vcpu *v);
 
@@ -219,6 +219,11 @@ int tmem_copy_to_client(xen_pfn_t, struct page_info *, tmem_cli_va_param_t);
 #define tmem_client_info(fmt, args...) printk(XENLOG_G_INFO fmt, ##args)
 
 /* Global statistics (none need to be locked). */
+struct tmem_cyc_counter {
+    unsigned long count;
+    uint64_t sum_cycles, max_cycles, min_cycles;
+};
+
 struct tmem_statistics {
     unsigned long total_tmem_ops;
     unsigned long errored_tmem_ops;
@@ -242,6 +247,11 @@ struct tmem_statistics {
     unsigned long failed_copies;
     unsigned long pcd_tot_tze_size;
     unsigned long pcd_tot_csize;
+    /* Cycles spent per operation, for throughput ("T=" list line). */
+    struct tmem_cyc_counter succ_get, succ_put, non_succ_get, non_succ_put;
+    struct tmem_cyc_counter flush, flush_obj;
+    /* Global evictions which skipped a page as its client's LRU was busy. */
+    unsigned long eph_lru_busy;
     /* Global counters (should use long_atomic_t access). */
     atomic_t global_obj_count;
     atomic_t global_pgp_count;
@@ -263,11 +273,10 @@ struct tmem_statistics {
 
 #define MAX_GLOBAL_SHARED_POOLS  16
 struct tmem_global {
-    struct list_head ephemeral_page_list;  /* All pages in ephemeral pools. */
     struct list_head client_list;
     struct tmem_pool *shared_pools[MAX_GLOBAL_SHARED_POOLS];
     bool_t shared_auth;
-    long eph_count;  /* Atomicity depends on eph_lists_spinlock. */
+    atomic_t eph_count;  /* Pages on all per-CPU ephemeral LRUs. */
     atomic_t client_weight_total;
 };
 
@@ -281,6 +290,7 @@ struct client {
     struct tmem_pool *pools[MAX_POOLS_PER_DOMAIN];
     struct domain *domain;
     struct xmem_pool *persistent_pool;
+    spinlock_t eph_lock; /* Protects ephemeral_page_list and eph_count. */
     struct list_head ephemeral_page_list;
     long eph_count, eph_count_max;
     domid_t cli_id;
@@ -303,6 +313,15 @@ struct client {
 #define OBJ_HASH_BUCKETS 256 /* Must be power of two. */
 #define OBJ_HASH_BUCKETS_MASK (OBJ_HASH_BUCKETS-1)
 
+/*
+ * Objects are hashed by oid into buckets, each an rb-tree with its own lock,
+ * so that operations on unrelated objects in a pool don't serialise.
+ */
+struct tmem_obj_bucket {
+    rwlock_t lock;
+    struct rb_root root; /* Protected by lock. */
+};
+
 #define is_persistent(_p)  (_p->persistent)
 #define is_shared(_p)      (_p->shared)
 
@@ -313,8 +332,7 @@ struct tmem_pool {
     struct client *client;
     uint64_t uuid[2]; /* 0 for private, non-zero for shared. */
     uint32_t pool_id;
-    rwlock_t pool_rwlock;
-    struct rb_root obj_rb_root[OBJ_HASH_BUCKETS]; /* Protected by pool_rwlock. */
+    struct tmem_obj_bucket obj_buckets[OBJ_HASH_BUCKETS];
     struct list_head share_list; /* Valid if shared. */
     int shared_count; /* Valid if shared. */
     /* For save/restore/migration. */
@@ -323,8 +341,8 @@ struct tmem_pool {
     /* Statistics collection. */
     atomic_t pgp_count;
     int pgp_count_max;
-    long obj_count;  /* Atomicity depends on pool_rwlock held for write. */
-    long obj_count_max;
+    atomic_t obj_count;
+    int obj_count_max;
     unsigned long objnode_count, objnode_count_max;
     uint64_t sum_life_cycles;
     uint64_t sum_evicted_cycles;
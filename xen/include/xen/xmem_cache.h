@@ -0,0 +1,77 @@
+/******************************************************************************
+ * xmem_cache.h
+ *
+ * Caches of fixed-size objects with per-CPU free lists, for objects which
+ * are allocated and freed often enough for the xmalloc() pool lock to show.
+ */
+
+#ifndef __XEN_XMEM_CACHE_H__
+#define __XEN_XMEM_CACHE_H__
+
+#include <xen/cache.h>
+#include <xen/list.h>
+#include <xen/numa.h>
+#include <xen/spinlock.h>
+#include <xen/types.h>
+
+/* Objects held by each CPU before half of them go back to the slabs. */
+#define XMEM_CACHE_MAG    32
+
+struct xmem_cache_cpu {
+    unsigned int count;
+    void *objs[XMEM_CACHE_MAG];
+} __cacheline_aligned;
+
+struct xmem_cache_node {
+    spinlock_t lock;
+    /* Slabs with at least one free object. */
+    struct list_head partial;
+    unsigned int nr_slabs;
+    unsigned int nr_empty;
+};
+
+struct xmem_cache {
+    const char *name;
+    unsigned int size;
+    unsigned int align;
+
+    /*
+     * Objects no bigger than an eighth of a page are carved out of
+     * single-page slabs taken from the local node.  Larger objects are
+     * allocated directly from the xenheap as 2^order pages each.
+     */
+    unsigned int order;
+    unsigned int offset;
+    unsigned int per_slab;
+
+    /* Set up on first use; NULL until then. */
+    struct xmem_cache_cpu *cpu;
+    struct list_head list;
+    struct xmem_cache_node node[MAX_NUMNODES];
+};
+
+/*
+ * Statically define a cache for objects of type @_type.  It is set up on
+ * first allocation, so it can be used as soon as xmalloc() works.
+ */
+#define DEFINE_XMEM_CACHE(_name, _type)                     \
+    struct xmem_cache _name = {                             \
+        .name  = #_name,                                    \
+        .size  = sizeof(_type),                             \
+        .align = __alignof__(_type),                        \
+    }
+
+/*
+ * Create/destroy a cache dynamically.  All objects must have been freed
+ * before the cache is destroyed.
+ */
+struct xmem_cache *xmem_cache_create(
+    const char *name, unsigned long size, unsigned long align);
+void xmem_cache_destroy(struct xmem_cache *cache);
+
+/* Allocate/free an object.  Not to be used in IRQ context. */
+void *xmem_cache_alloc(struct xmem_cache *cache);
+void *xmem_cache_zalloc(struct xmem_cache *cache);
+void xmem_cache_free(struct xmem_cache *cache, void *obj);
+
+#endif /* __XEN_XMEM_CACHE_H__ */